@@ -384,6 +384,7 @@ bool AirportItlwm::start(IOService *provider)
         return false;
     }
     _fWorkloop->addEventSource(_fCommandGate);
+    initTimeout(_fWorkloop);
     const IONetworkMedium *primaryMedium;
     if (!createMediumTables(&primaryMedium) ||
         !setCurrentMedium(primaryMedium) || !setSelectedMedium(primaryMedium)) {
@@ -398,6 +399,10 @@ bool AirportItlwm::start(IOService *provider)
         fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_NOVHT;
     if (PE_parse_boot_argn("-noht40", &boot_value, sizeof(boot_value)))
         fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_NOHT40;
+    if (PE_parse_boot_argn("-nointrmod", &boot_value, sizeof(boot_value)))
+        fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_NOINTRMOD;
+    if (PE_parse_boot_argn("-mrr", &boot_value, sizeof(boot_value)))
+        fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_MRR;
     
     if (!fHalService->attach(pciNub)) {
         XYLog("attach fail\n");
@@ -535,7 +540,7 @@ setLinkStatus(UInt32 status, const IONetworkMedium * activeMedium, UInt64 speed,
 #ifdef __PRIVATE_SPI__
             fNetIf->startOutputThread();
 #endif
-            ifq_set_oactive(&ifq->if_snd);
+            fLinkTxActive = true;
             getCommandGate()->runAction(setLinkStateGated, (void *)kIO80211NetworkLinkUp, (void *)0);
             fNetIf->setLinkQualityMetric(100);
         } else if (!(status & kIONetworkLinkNoNetworkChange)) {
@@ -545,7 +550,7 @@ setLinkStatus(UInt32 status, const IONetworkMedium * activeMedium, UInt64 speed,
 #endif
             ifq->if_snd->lockFlush();
             mq_purge(&fHalService->get80211Controller()->ic_mgtq);
-            ifq_clr_oactive(&ifq->if_snd);
+            fLinkTxActive = false;
             getCommandGate()->runAction(setLinkStateGated, (void *)kIO80211NetworkLinkDown, (void *)fHalService->get80211Controller()->ic_deauth_reason);
         }
     }
@@ -570,6 +575,7 @@ void AirportItlwm::releaseAll()
         fHalService = NULL;
     }
     if (_fWorkloop) {
+        releaseTimeout();
         if (_fCommandGate) {
 //            _fCommandGate->disable();
             _fWorkloop->removeEventSource(_fCommandGate);
@@ -683,12 +689,12 @@ IOReturn AirportItlwm::outputStart(IONetworkInterface *interface, IOOptionBits o
 {
     struct _ifnet *ifp = &fHalService->get80211Controller()->ic_ac.ac_if;
     mbuf_t m = NULL;
-    if (!ifq_is_oactive(&ifp->if_snd)) {
+    if (!fLinkTxActive || ifq_is_oactive(&ifp->if_snd)) {
         return kIOReturnNoResources;
     }
     while (kIOReturnSuccess == interface->dequeueOutputPackets(1, &m)) {
         outputPacket(m, NULL);
-        if (!ifq_is_oactive(&ifp->if_snd)) {
+        if (!fLinkTxActive || ifq_is_oactive(&ifp->if_snd)) {
             return kIOReturnNoResources;
         }
     }
@@ -737,6 +743,14 @@ UInt32 AirportItlwm::getFeatures() const
     return fHalService->getDriverInfo()->supportedFeatures();
 }
 
+IOReturn AirportItlwm::getChecksumSupport(UInt32 *checksumMask, UInt32 checksumFamily, bool isOutput)
+{
+    if (checksumFamily != kChecksumFamilyTCPIP)
+        return kIOReturnUnsupported;
+    *checksumMask = fHalService->getDriverInfo()->supportedChecksums(isOutput);
+    return kIOReturnSuccess;
+}
+
 IOReturn AirportItlwm::setPromiscuousMode(IOEnetPromiscuousMode mode)
 {
     return kIOReturnSuccess;
@@ -231,6 +231,7 @@ public:
     virtual IOReturn getPacketFilters(const OSSymbol *group, UInt32 *filters) const override;
     virtual IOReturn selectMedium(const IONetworkMedium *medium) override;
     virtual UInt32 getFeatures() const override;
+    virtual IOReturn getChecksumSupport(UInt32 *checksumMask, UInt32 checksumFamily, bool isOutput) override;
     
 public:
     IOInterruptEventSource* fInterrupt;
@@ -249,10 +250,12 @@ public:
     UInt8 pmPCICapPtr;
     bool magicPacketEnabled;
     bool magicPacketSupported;
+    bool fLinkTxActive;     /* link is up, output thread may run */
     
     //IO80211
     uint8_t power_state;
     struct ieee80211_node *fNextNodeToSend;
+    struct apple80211_scan_result fScanResult;  /* last result handed out */
     bool fScanResultWrapping;
     IOTimerEventSource *scanSource;
     
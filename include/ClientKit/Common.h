@@ -119,6 +119,62 @@ struct ioctl_tx_power {
     unsigned int version;
 };
 
+/*
+ * One BSS in ioctl_scan_results.buf. Records are 4-byte aligned; 'len'
+ * is the offset of the next record and ie_len bytes of IEs follow the
+ * fixed part. IEs beyond what fits in an otherwise empty buf are cut.
+ */
+struct ioctl_scan_record {
+    uint16_t len;
+    uint16_t ie_len;
+    uint8_t bssid[ETHER_ADDR_LEN];
+    uint8_t ssid_len;
+    uint8_t reserved;
+    unsigned char ssid[NWID_LEN];
+    uint32_t channel;
+    int16_t rssi;
+    int16_t noise;
+    uint32_t age;   //ms since the last beacon or probe response
+    uint16_t capinfo;
+    uint16_t reserved2;
+    uint8_t ie[];
+};
+
+#define SCAN_RESULTS_BUF_LEN 4064
+
+/*
+ * Get: as many scan records as fit, starting at the user client's
+ * cursor, which then moves past them. Set: move the cursor to the
+ * first BSSID not below 'cursor' (all zeroes rewinds).
+ * 'generation' changes whenever a BSS is added or removed, so a walk
+ * which spans it may have missed entries and should be restarted.
+ */
+struct ioctl_scan_results {
+    unsigned int version;
+    uint32_t generation;
+    uint8_t cursor[ETHER_ADDR_LEN]; //BSSID of the next record
+    uint16_t more;  //1 if records remain after these, else the cursor rewinds
+    uint32_t count; //records in buf
+    uint32_t len;   //bytes used in buf
+    uint8_t buf[SCAN_RESULTS_BUF_LEN];
+};
+
+#define RX_POLL_HIST 8
+
+/*
+ * Get only: RX polling counters since the interface came up. Counts
+ * rounds, rounds that ran out of budget with entries left, and ring
+ * entries processed. round_hist[] counts rounds by entries processed,
+ * in the buckets 0, 1, 2-3, 4-7, ... and 64 or more.
+ */
+struct ioctl_rx_poll {
+    unsigned int version;
+    uint64_t rounds;
+    uint64_t exhausted;
+    uint64_t entries;
+    uint64_t round_hist[RX_POLL_HIST];
+};
+
 /*
  * 802.11 ciphers.
  */
@@ -29,6 +29,8 @@ enum IOCTL_IDS {
     IOCTL_80211_SCAN_RESULT,
     IOCTL_80211_TX_POWER_LEVEL,
     IOCTL_80211_NW_BSSID,
+    IOCTL_80211_SCAN_RESULTS,
+    IOCTL_80211_RX_POLL,
     
     IOCTL_ID_MAX
 };
@@ -15,6 +15,8 @@
 #ifndef ItlDriverInfo_h
 #define ItlDriverInfo_h
 
+struct ioctl_rx_poll;
+
 class ItlDriverInfo {
     
 public:
@@ -31,9 +33,13 @@ public:
     
     virtual UInt32 supportedFeatures() = 0;
 
+    virtual UInt32 supportedChecksums(bool isOutput) = 0;
+
     virtual const char *getFirmwareCountryCode() = 0;
 
     virtual uint32_t getTxQueueSize() = 0;
+
+    virtual bool getRxPollStats(struct ioctl_rx_poll *st) = 0;
 };
 
 #endif /* ItlDriverInfo_h */
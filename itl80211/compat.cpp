@@ -299,3 +299,151 @@ int bus_dmamap_load(bus_dmamap_t map, mbuf_t mb) {
 	else
 		return 0;
 }
+
+static void
+rxpool_free(struct rxpool *pool)
+{
+	if (pool->rp_mem) {
+		pool->rp_mem->complete();
+		pool->rp_mem->release();
+	}
+	if (pool->rp_bufs)
+		IOFree(pool->rp_bufs, sizeof(*pool->rp_bufs) * pool->rp_nbufs);
+	if (pool->rp_lock)
+		IOSimpleLockFree(pool->rp_lock);
+	IOFree(pool, sizeof(*pool));
+}
+
+static void
+rxpool_release(struct rxpool *pool)
+{
+	if (OSDecrementAtomic(&pool->rp_refs) == 1)
+		rxpool_free(pool);
+}
+
+static void
+rxpool_extfree(caddr_t addr, u_int size, caddr_t arg)
+{
+	struct rxpool_buf *buf = (struct rxpool_buf *)arg;
+	struct rxpool *pool = buf->rb_pool;
+
+	if (OSDecrementAtomic(&buf->rb_refs) != 1)
+		return;
+	IOSimpleLockLock(pool->rp_lock);
+	SLIST_INSERT_HEAD(&pool->rp_free, buf, rb_next);
+	IOSimpleLockUnlock(pool->rp_lock);
+	rxpool_release(pool);
+}
+
+struct rxpool *
+rxpool_create(size_t bufsize, int nbufs)
+{
+	struct rxpool *pool;
+	IOByteCount len;
+	int i;
+
+	/* Every buffer has to sit inside one physical page. */
+	if (bufsize == 0 || bufsize > PAGE_SIZE || (PAGE_SIZE % bufsize) != 0)
+		return NULL;
+	pool = (struct rxpool *)IOMalloc(sizeof(*pool));
+	if (pool == NULL)
+		return NULL;
+	bzero(pool, sizeof(*pool));
+	pool->rp_bufsize = bufsize;
+	pool->rp_nbufs = nbufs;
+	pool->rp_refs = 1;
+	SLIST_INIT(&pool->rp_free);
+	pool->rp_lock = IOSimpleLockAlloc();
+	pool->rp_bufs = (struct rxpool_buf *)IOMalloc(sizeof(*pool->rp_bufs) * nbufs);
+	pool->rp_mem = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task,
+	    kIODirectionInOut, bufsize * nbufs, 0x00000000fffff000ull);
+	if (pool->rp_lock == NULL || pool->rp_bufs == NULL || pool->rp_mem == NULL)
+		goto fail;
+	if (pool->rp_mem->prepare() != kIOReturnSuccess) {
+		pool->rp_mem->release();
+		pool->rp_mem = NULL;
+		goto fail;
+	}
+	for (i = 0; i < nbufs; i++) {
+		struct rxpool_buf *buf = &pool->rp_bufs[i];
+
+		buf->rb_pool = pool;
+		buf->rb_vaddr = (uint8_t *)pool->rp_mem->getBytesNoCopy() + i * bufsize;
+		buf->rb_paddr = pool->rp_mem->getPhysicalSegment(i * bufsize, &len, kIOMemoryMapperNone);
+		if (buf->rb_paddr == 0 || len < bufsize)
+			goto fail;
+		SLIST_INSERT_HEAD(&pool->rp_free, buf, rb_next);
+	}
+	return pool;
+
+fail:
+	rxpool_free(pool);
+	return NULL;
+}
+
+void
+rxpool_destroy(struct rxpool *pool)
+{
+	if (pool == NULL)
+		return;
+	rxpool_release(pool);
+}
+
+mbuf_t
+rxpool_get(struct rxpool *pool, IOPhysicalSegment *seg, struct rxpool_buf **bufp)
+{
+	struct rxpool_buf *buf;
+	mbuf_t m = NULL;
+
+	if (pool == NULL)
+		return NULL;
+	IOSimpleLockLock(pool->rp_lock);
+	buf = SLIST_FIRST(&pool->rp_free);
+	if (buf != NULL)
+		SLIST_REMOVE_HEAD(&pool->rp_free, rb_next);
+	IOSimpleLockUnlock(pool->rp_lock);
+	if (buf == NULL) {
+		pool->rp_stats.miss++;
+		return NULL;
+	}
+
+	OSIncrementAtomic(&pool->rp_refs);
+	buf->rb_refs = 1;
+	if (mbuf_attachcluster(MBUF_DONTWAIT, MBUF_TYPE_DATA, &m,
+	    (caddr_t)buf->rb_vaddr, rxpool_extfree, pool->rp_bufsize,
+	    (caddr_t)buf) != 0) {
+		IOSimpleLockLock(pool->rp_lock);
+		SLIST_INSERT_HEAD(&pool->rp_free, buf, rb_next);
+		IOSimpleLockUnlock(pool->rp_lock);
+		rxpool_release(pool);
+		pool->rp_stats.miss++;
+		return NULL;
+	}
+	mbuf_setlen(m, pool->rp_bufsize);
+	mbuf_pkthdr_setlen(m, pool->rp_bufsize);
+	seg->location = buf->rb_paddr;
+	seg->length = (UInt32)pool->rp_bufsize;
+	if (bufp != NULL)
+		*bufp = buf;
+	pool->rp_stats.hit++;
+	return m;
+}
+
+mbuf_t
+rxpool_slice(struct rxpool_buf *buf, size_t off, size_t len)
+{
+	mbuf_t m = NULL;
+
+	if (buf == NULL || len == 0 || off + len > buf->rb_pool->rp_bufsize)
+		return NULL;
+	OSIncrementAtomic(&buf->rb_refs);
+	if (mbuf_attachcluster(MBUF_DONTWAIT, MBUF_TYPE_DATA, &m,
+	    (caddr_t)buf->rb_vaddr + off, rxpool_extfree, len,
+	    (caddr_t)buf) != 0) {
+		OSDecrementAtomic(&buf->rb_refs);
+		return NULL;
+	}
+	mbuf_setlen(m, len);
+	mbuf_pkthdr_setlen(m, len);
+	return m;
+}
@@ -290,4 +290,48 @@ void		bus_dmamap_destroy(bus_dma_tag_t tag, bus_dmamap_t dmam);
 int		bus_dmamap_load(bus_dmamap_t map, mbuf_t m);
 #define bus_dmamap_load_mbuf bus_dmamap_load
 
+/*
+ * Recycling RX buffer pool. Buffers are carved out of one wired slab with
+ * their physical address cached, handed to the stack as external mbuf
+ * clusters and put back on the free list by the cluster free callback,
+ * so refilling an RX descriptor skips both the cluster allocator and the
+ * physical segment lookup. A pool outlives its ring until every lent
+ * buffer has come back.
+ *
+ * A buffer holding several MPDUs can be cut into slices: every slice is
+ * its own pkthdr mbuf whose cluster is exactly one packet of the shared
+ * buffer, so no data is copied and a slice can never write into its
+ * neighbours. The buffer goes back to the pool when the last slice and
+ * the original mbuf are freed.
+ */
+struct rxpool_buf {
+	SLIST_ENTRY(rxpool_buf)	rb_next;
+	struct rxpool		*rb_pool;
+	void			*rb_vaddr;
+	IOPhysicalAddress	rb_paddr;
+	volatile SInt32		rb_refs;
+};
+
+struct rxpool_stats {
+	uint64_t		hit;	/* refill served from the pool */
+	uint64_t		miss;	/* pool empty, fell back to allocatePacket */
+	uint64_t		starved;	/* fallback allocation failed too */
+};
+
+struct rxpool {
+	IOBufferMemoryDescriptor	*rp_mem;
+	struct rxpool_buf	*rp_bufs;
+	IOSimpleLock		*rp_lock;
+	SLIST_HEAD(, rxpool_buf) rp_free;
+	size_t			rp_bufsize;
+	int			rp_nbufs;
+	volatile SInt32		rp_refs;	/* lent buffers, +1 while owned */
+	struct rxpool_stats	rp_stats;
+};
+
+struct rxpool	*rxpool_create(size_t bufsize, int nbufs);
+void		rxpool_destroy(struct rxpool *pool);
+mbuf_t		rxpool_get(struct rxpool *pool, IOPhysicalSegment *seg, struct rxpool_buf **bufp);
+mbuf_t		rxpool_slice(struct rxpool_buf *buf, size_t off, size_t len);
+
 #endif
@@ -0,0 +1,524 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Block engine for the software CCM and GCM ciphers.
+ *
+ * Blocks are handed to AES in independent pairs wherever the mode
+ * allows it: the bitsliced implementation in aes.c encrypts two blocks
+ * per pass for the price of one, and AES-NI overlaps the rounds of
+ * both.  On x86_64 CPUs with AES-NI and PCLMULQDQ the accelerated path
+ * is picked at key setup time, after checking it against a FIPS-197
+ * known answer.
+ *
+ * The accelerated path lives in XMM registers, which kernel code may not
+ * touch without saving the interrupted thread's FPU state first, so it
+ * is only built where CRYPTO_SIMD is defined: the host tools, never the
+ * kext, which always runs the bitsliced code.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+
+#include <crypto/aes.h>
+#include <crypto/aes_blk.h>
+#include <crypto/gmac.h>
+
+#if defined(__x86_64__) && defined(CRYPTO_SIMD)
+#define AES_BLK_NI
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+#define AESNI_TARGET	__attribute__((target("aes,pclmul,ssse3")))
+#endif
+
+static int aes_blk_accel = -1;	/* -1: not probed yet */
+
+#ifdef AES_BLK_NI
+
+#define AESNI_KEY128(rk, i, rcon) do {					\
+	__m128i _t = _mm_aeskeygenassist_si128(rk[(i) - 1], (rcon));	\
+	rk[i] = aesni_key_mix(rk[(i) - 1], _mm_shuffle_epi32(_t, 0xff));\
+} while (0)
+
+AESNI_TARGET static inline __m128i
+aesni_key_mix(__m128i k, __m128i t)
+{
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	return _mm_xor_si128(k, t);
+}
+
+AESNI_TARGET static int
+aesni_setkey(uint8_t *out, const uint8_t *key, int len)
+{
+	__m128i rk[AES_MAXROUNDS + 1];
+	__m128i t;
+	int i, nr;
+
+	switch (len) {
+	case 16:
+		nr = 10;
+		rk[0] = _mm_loadu_si128((const __m128i *)key);
+		AESNI_KEY128(rk, 1, 0x01);
+		AESNI_KEY128(rk, 2, 0x02);
+		AESNI_KEY128(rk, 3, 0x04);
+		AESNI_KEY128(rk, 4, 0x08);
+		AESNI_KEY128(rk, 5, 0x10);
+		AESNI_KEY128(rk, 6, 0x20);
+		AESNI_KEY128(rk, 7, 0x40);
+		AESNI_KEY128(rk, 8, 0x80);
+		AESNI_KEY128(rk, 9, 0x1b);
+		AESNI_KEY128(rk, 10, 0x36);
+		break;
+	case 32:
+		nr = 14;
+		rk[0] = _mm_loadu_si128((const __m128i *)key);
+		rk[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+#define AESNI_KEY256(i, rcon) do {					\
+	t = _mm_aeskeygenassist_si128(rk[(i) - 1], (rcon));		\
+	rk[i] = aesni_key_mix(rk[(i) - 2], _mm_shuffle_epi32(t, 0xff));	\
+	if ((i) < 14) {							\
+		t = _mm_aeskeygenassist_si128(rk[i], 0);		\
+		rk[(i) + 1] = aesni_key_mix(rk[(i) - 1],		\
+		    _mm_shuffle_epi32(t, 0xaa));			\
+	}								\
+} while (0)
+		AESNI_KEY256(2, 0x01);
+		AESNI_KEY256(4, 0x02);
+		AESNI_KEY256(6, 0x04);
+		AESNI_KEY256(8, 0x08);
+		AESNI_KEY256(10, 0x10);
+		AESNI_KEY256(12, 0x20);
+		AESNI_KEY256(14, 0x40);
+#undef AESNI_KEY256
+		break;
+	default:
+		return 0;
+	}
+	for (i = 0; i <= nr; i++)
+		_mm_store_si128((__m128i *)(out + i * AES_BLK_LEN), rk[i]);
+	bzero(rk, sizeof(rk));
+	return nr;
+}
+
+AESNI_TARGET static void
+aesni_encrypt(const uint8_t *rk, unsigned nr, const uint8_t *src,
+    uint8_t *dst)
+{
+	const __m128i *k = (const __m128i *)rk;
+	__m128i x;
+	unsigned i;
+
+	x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)src), k[0]);
+	for (i = 1; i < nr; i++)
+		x = _mm_aesenc_si128(x, k[i]);
+	x = _mm_aesenclast_si128(x, k[nr]);
+	_mm_storeu_si128((__m128i *)dst, x);
+}
+
+AESNI_TARGET static void
+aesni_encrypt2(const uint8_t *rk, unsigned nr, const uint8_t *s0,
+    uint8_t *d0, const uint8_t *s1, uint8_t *d1)
+{
+	const __m128i *k = (const __m128i *)rk;
+	__m128i x0, x1;
+	unsigned i;
+
+	x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)s0), k[0]);
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)s1), k[0]);
+	for (i = 1; i < nr; i++) {
+		x0 = _mm_aesenc_si128(x0, k[i]);
+		x1 = _mm_aesenc_si128(x1, k[i]);
+	}
+	x0 = _mm_aesenclast_si128(x0, k[nr]);
+	x1 = _mm_aesenclast_si128(x1, k[nr]);
+	_mm_storeu_si128((__m128i *)d0, x0);
+	_mm_storeu_si128((__m128i *)d1, x1);
+}
+
+/*
+ * X = X * H in GF(2^128) with PCLMULQDQ, on byte-reflected operands
+ * (Intel carry-less multiplication white paper, algorithm 5).
+ */
+AESNI_TARGET static void
+aesni_gfmul(uint8_t *xp, const uint8_t *hp)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+	    8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i a, b, t3, t4, t5, t6, t7, t8, t9;
+
+	a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)xp), bswap);
+	b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)hp), bswap);
+
+	t3 = _mm_clmulepi64_si128(a, b, 0x00);
+	t4 = _mm_clmulepi64_si128(a, b, 0x10);
+	t5 = _mm_clmulepi64_si128(a, b, 0x01);
+	t6 = _mm_clmulepi64_si128(a, b, 0x11);
+
+	t4 = _mm_xor_si128(t4, t5);
+	t5 = _mm_slli_si128(t4, 8);
+	t4 = _mm_srli_si128(t4, 8);
+	t3 = _mm_xor_si128(t3, t5);
+	t6 = _mm_xor_si128(t6, t4);
+
+	/* shift the 256-bit product left by one bit */
+	t7 = _mm_srli_epi32(t3, 31);
+	t8 = _mm_srli_epi32(t6, 31);
+	t3 = _mm_slli_epi32(t3, 1);
+	t6 = _mm_slli_epi32(t6, 1);
+	t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	t3 = _mm_or_si128(t3, t7);
+	t6 = _mm_or_si128(t6, t8);
+	t6 = _mm_or_si128(t6, t9);
+
+	/* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+	t7 = _mm_slli_epi32(t3, 31);
+	t8 = _mm_slli_epi32(t3, 30);
+	t9 = _mm_slli_epi32(t3, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	t3 = _mm_xor_si128(t3, t7);
+
+	t4 = _mm_srli_epi32(t3, 1);
+	t5 = _mm_srli_epi32(t3, 2);
+	t9 = _mm_srli_epi32(t3, 7);
+	t4 = _mm_xor_si128(t4, t5);
+	t4 = _mm_xor_si128(t4, t9);
+	t4 = _mm_xor_si128(t4, t8);
+	t3 = _mm_xor_si128(t3, t4);
+	t6 = _mm_xor_si128(t6, t3);
+
+	_mm_storeu_si128((__m128i *)xp, _mm_shuffle_epi8(t6, bswap));
+}
+
+static int
+aesni_probe(void)
+{
+	static const uint8_t key[16] = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+		0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+	};
+	static const uint8_t pt[16] = {
+		0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+		0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+	};
+	static const uint8_t ct[16] = {	/* FIPS-197 C.1 */
+		0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+		0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+	};
+	uint8_t rk[11 * AES_BLK_LEN] __attribute__((aligned(16)));
+	uint8_t out[16];
+	uint32_t eax = 1, ebx, ecx = 0, edx;
+
+	__asm__ __volatile__("cpuid"
+	    : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	/* AES-NI, PCLMULQDQ and SSSE3 */
+	if ((ecx & (1 << 25)) == 0 || (ecx & (1 << 1)) == 0 ||
+	    (ecx & (1 << 9)) == 0)
+		return 0;
+
+	if (aesni_setkey(rk, key, sizeof(key)) != 10)
+		return 0;
+	aesni_encrypt(rk, 10, pt, out);
+	return memcmp(out, ct, sizeof(ct)) == 0;
+}
+
+#endif /* AES_BLK_NI */
+
+int
+AES_Blk_Accel(void)
+{
+	if (aes_blk_accel < 0) {
+#ifdef AES_BLK_NI
+		aes_blk_accel = aesni_probe();
+#else
+		aes_blk_accel = 0;
+#endif
+	}
+	return aes_blk_accel;
+}
+
+int
+AES_Blk_Setkey(AES_BLK_CTX *ctx, const uint8_t *key, int len)
+{
+	static const uint8_t zero[AES_BLK_LEN] = { 0 };
+
+	if (AES_Setkey(&ctx->sw, key, len) != 0)
+		return -1;
+	ctx->nr = ctx->sw.num_rounds;
+	ctx->accel = 0;
+#ifdef AES_BLK_NI
+	if (AES_Blk_Accel() && aesni_setkey(ctx->rk, key, len) != 0)
+		ctx->accel = 1;
+#endif
+	AES_Blk_Encrypt(ctx, zero, ctx->h);
+	return 0;
+}
+
+void
+AES_Blk_Encrypt(AES_BLK_CTX *ctx, const uint8_t *src, uint8_t *dst)
+{
+#ifdef AES_BLK_NI
+	if (ctx->accel) {
+		aesni_encrypt(ctx->rk, ctx->nr, src, dst);
+		return;
+	}
+#endif
+	AES_Encrypt(&ctx->sw, src, dst);
+}
+
+/*
+ * Encrypt two independent blocks.  Sources and destinations may alias
+ * each other pairwise.
+ */
+void
+AES_Blk_Encrypt2(AES_BLK_CTX *ctx, const uint8_t *s0, uint8_t *d0,
+    const uint8_t *s1, uint8_t *d1)
+{
+	uint8_t buf[2 * AES_BLK_LEN];
+
+#ifdef AES_BLK_NI
+	if (ctx->accel) {
+		aesni_encrypt2(ctx->rk, ctx->nr, s0, d0, s1, d1);
+		return;
+	}
+#endif
+	memcpy(buf, s0, AES_BLK_LEN);
+	memcpy(buf + AES_BLK_LEN, s1, AES_BLK_LEN);
+	AES_Encrypt_ECB(&ctx->sw, buf, buf, 2);
+	memcpy(d0, buf, AES_BLK_LEN);
+	memcpy(d1, buf + AES_BLK_LEN, AES_BLK_LEN);
+}
+
+static inline void
+aes_blk_xor(uint8_t *dst, const uint8_t *src)
+{
+	uint64_t d[2], s[2];
+
+	memcpy(d, dst, AES_BLK_LEN);
+	memcpy(s, src, AES_BLK_LEN);
+	d[0] ^= s[0];
+	d[1] ^= s[1];
+	memcpy(dst, d, AES_BLK_LEN);
+}
+
+/* X = X * H */
+static inline void
+aes_blk_gfmul(AES_BLK_CTX *ctx, uint8_t *x)
+{
+#ifdef AES_BLK_NI
+	if (ctx->accel) {
+		aesni_gfmul(x, ctx->h);
+		return;
+	}
+#endif
+	ghash_gfmul((uint32_t *)x, (uint32_t *)ctx->h, (uint32_t *)x);
+}
+
+/*
+ * CCM: encrypt (enc != 0) or decrypt len bytes of buf in place and fold
+ * the plaintext into the CBC-MAC.  The MAC of block i and the key
+ * stream of block i + 1 are computed in one AES_Blk_Encrypt2() call.
+ */
+void
+AES_CCM_Update(AES_BLK_CTX *ctx, struct aes_ccm_stream *st, uint8_t *buf,
+    size_t len, int enc)
+{
+	while (len > 0) {
+		if (st->j == 0 && len >= AES_BLK_LEN) {
+			/* whole block */
+			if (enc) {
+				aes_blk_xor(st->b, buf);
+				aes_blk_xor(buf, st->s);
+			} else {
+				aes_blk_xor(buf, st->s);
+				aes_blk_xor(st->b, buf);
+			}
+			buf += AES_BLK_LEN;
+			len -= AES_BLK_LEN;
+		} else {
+			if (enc) {
+				st->b[st->j] ^= *buf;
+				*buf ^= st->s[st->j];
+			} else {
+				*buf ^= st->s[st->j];
+				st->b[st->j] ^= *buf;
+			}
+			buf++;
+			len--;
+			if (++st->j < AES_BLK_LEN)
+				continue;
+			st->j = 0;
+		}
+		/* MAC this block, key stream for the next one */
+		st->ctr++;
+		st->a[14] = st->ctr >> 8;
+		st->a[15] = st->ctr & 0xff;
+		AES_Blk_Encrypt2(ctx, st->b, st->b, st->a, st->s);
+	}
+}
+
+void
+AES_CCM_Final(AES_BLK_CTX *ctx, struct aes_ccm_stream *st)
+{
+	if (st->j != 0)	/* partial block, encrypt MIC */
+		AES_Blk_Encrypt(ctx, st->b, st->b);
+}
+
+static inline void
+aes_gcm_inc32(uint8_t *y)
+{
+	uint32_t c;
+
+	c = (uint32_t)y[12] << 24 | (uint32_t)y[13] << 16 |
+	    (uint32_t)y[14] << 8 | y[15];
+	c++;
+	y[12] = c >> 24;
+	y[13] = c >> 16;
+	y[14] = c >> 8;
+	y[15] = c;
+}
+
+/*
+ * GCM with a 96-bit IV: J0 = IV || 1, hash the additional data and
+ * prepare the first counter block.
+ */
+void
+AES_GCM_Init(AES_BLK_CTX *ctx, struct aes_gcm_stream *st,
+    const uint8_t *iv, const uint8_t *aad, size_t aadlen)
+{
+	size_t n;
+
+	memset(st, 0, sizeof(*st));
+	memcpy(st->y, iv, 12);
+	st->y[15] = 1;
+	AES_Blk_Encrypt(ctx, st->y, st->ej0);
+	aes_gcm_inc32(st->y);
+
+	st->aadlen = aadlen;
+	while (aadlen > 0) {
+		n = MIN(aadlen, AES_BLK_LEN);
+		memset(st->g, 0, AES_BLK_LEN);
+		memcpy(st->g, aad, n);
+		aes_blk_xor(st->x, st->g);
+		aes_blk_gfmul(ctx, st->x);
+		aad += n;
+		aadlen -= n;
+	}
+}
+
+/*
+ * GCM: encrypt (enc != 0) or decrypt len bytes of buf in place and fold
+ * the ciphertext into GHASH.  Whole blocks take their key streams two
+ * at a time.
+ */
+void
+AES_GCM_Update(AES_BLK_CTX *ctx, struct aes_gcm_stream *st, uint8_t *buf,
+    size_t len, int enc)
+{
+	uint8_t y1[AES_BLK_LEN], s1[AES_BLK_LEN];
+
+	st->len += len;
+	while (len > 0) {
+		if (st->j == 0 && len >= 2 * AES_BLK_LEN) {
+			memcpy(y1, st->y, AES_BLK_LEN);
+			aes_gcm_inc32(y1);
+			AES_Blk_Encrypt2(ctx, st->y, st->s, y1, s1);
+			if (!enc) {
+				aes_blk_xor(st->x, buf);
+				aes_blk_gfmul(ctx, st->x);
+				aes_blk_xor(st->x, buf + AES_BLK_LEN);
+				aes_blk_gfmul(ctx, st->x);
+			}
+			aes_blk_xor(buf, st->s);
+			aes_blk_xor(buf + AES_BLK_LEN, s1);
+			if (enc) {
+				aes_blk_xor(st->x, buf);
+				aes_blk_gfmul(ctx, st->x);
+				aes_blk_xor(st->x, buf + AES_BLK_LEN);
+				aes_blk_gfmul(ctx, st->x);
+			}
+			memcpy(st->y, y1, AES_BLK_LEN);
+			aes_gcm_inc32(st->y);
+			buf += 2 * AES_BLK_LEN;
+			len -= 2 * AES_BLK_LEN;
+			continue;
+		}
+		if (st->j == 0 && len >= AES_BLK_LEN) {
+			AES_Blk_Encrypt(ctx, st->y, st->s);
+			if (!enc) {
+				aes_blk_xor(st->x, buf);
+				aes_blk_gfmul(ctx, st->x);
+			}
+			aes_blk_xor(buf, st->s);
+			if (enc) {
+				aes_blk_xor(st->x, buf);
+				aes_blk_gfmul(ctx, st->x);
+			}
+			aes_gcm_inc32(st->y);
+			buf += AES_BLK_LEN;
+			len -= AES_BLK_LEN;
+			continue;
+		}
+		if (st->j == 0)
+			AES_Blk_Encrypt(ctx, st->y, st->s);
+		if (enc) {
+			*buf ^= st->s[st->j];
+			st->g[st->j] = *buf;
+		} else {
+			st->g[st->j] = *buf;
+			*buf ^= st->s[st->j];
+		}
+		buf++;
+		len--;
+		if (++st->j < AES_BLK_LEN)
+			continue;
+		aes_blk_xor(st->x, st->g);
+		aes_blk_gfmul(ctx, st->x);
+		aes_gcm_inc32(st->y);
+		st->j = 0;
+	}
+}
+
+void
+AES_GCM_Final(AES_BLK_CTX *ctx, struct aes_gcm_stream *st,
+    uint8_t tag[AES_BLK_LEN])
+{
+	uint64_t bits;
+	int i;
+
+	if (st->j != 0) {
+		memset(st->g + st->j, 0, AES_BLK_LEN - st->j);
+		aes_blk_xor(st->x, st->g);
+		aes_blk_gfmul(ctx, st->x);
+	}
+	bits = st->aadlen * 8;
+	for (i = 0; i < 8; i++)
+		st->g[i] = bits >> (56 - 8 * i);
+	bits = st->len * 8;
+	for (i = 0; i < 8; i++)
+		st->g[8 + i] = bits >> (56 - 8 * i);
+	aes_blk_xor(st->x, st->g);
+	aes_blk_gfmul(ctx, st->x);
+
+	memcpy(tag, st->x, AES_BLK_LEN);
+	aes_blk_xor(tag, st->ej0);
+}
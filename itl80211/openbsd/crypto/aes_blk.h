@@ -0,0 +1,83 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _AES_BLK_H_
+#define _AES_BLK_H_
+
+#include <crypto/aes.h>
+
+#define AES_BLK_LEN	16
+
+/*
+ * AES key usable by either the constant-time software implementation
+ * or, when built with CRYPTO_SIMD and the CPU supports it, AES-NI.
+ * The choice is made once per key in AES_Blk_Setkey().
+ */
+typedef struct aes_blk_ctx {
+	AES_CTX		sw;
+	uint8_t		rk[(AES_MAXROUNDS + 1) * AES_BLK_LEN]
+			    __attribute__((aligned(16)));
+	uint8_t		h[AES_BLK_LEN];		/* GHASH subkey (GCM only) */
+	unsigned	nr;
+	int		accel;
+} AES_BLK_CTX;
+
+/*
+ * Incremental CCM state over a payload split across buffers.  b is the
+ * running CBC-MAC, a the counter block and s the key stream for the
+ * block currently being filled; j bytes of that block are consumed.
+ */
+struct aes_ccm_stream {
+	uint8_t		b[AES_BLK_LEN];
+	uint8_t		a[AES_BLK_LEN];
+	uint8_t		s[AES_BLK_LEN];
+	uint16_t	ctr;
+	u_int		j;
+};
+
+/*
+ * Incremental GCM state.  x is the GHASH accumulator, g collects
+ * ciphertext until a full block can be hashed, y is the counter block
+ * of the block being filled and s its key stream (valid once j > 0).
+ * ej0 holds E(K, J0) for the tag.
+ */
+struct aes_gcm_stream {
+	uint8_t		x[AES_BLK_LEN];
+	uint8_t		g[AES_BLK_LEN];
+	uint8_t		y[AES_BLK_LEN];
+	uint8_t		s[AES_BLK_LEN];
+	uint8_t		ej0[AES_BLK_LEN];
+	u_int		j;
+	uint64_t	aadlen;
+	uint64_t	len;
+};
+
+int	AES_Blk_Setkey(AES_BLK_CTX *, const uint8_t *, int);
+void	AES_Blk_Encrypt(AES_BLK_CTX *, const uint8_t *, uint8_t *);
+void	AES_Blk_Encrypt2(AES_BLK_CTX *, const uint8_t *, uint8_t *,
+	    const uint8_t *, uint8_t *);
+int	AES_Blk_Accel(void);
+
+void	AES_CCM_Update(AES_BLK_CTX *, struct aes_ccm_stream *, uint8_t *,
+	    size_t, int);
+void	AES_CCM_Final(AES_BLK_CTX *, struct aes_ccm_stream *);
+
+void	AES_GCM_Init(AES_BLK_CTX *, struct aes_gcm_stream *,
+	    const uint8_t *, const uint8_t *, size_t);
+void	AES_GCM_Update(AES_BLK_CTX *, struct aes_gcm_stream *, uint8_t *,
+	    size_t, int);
+void	AES_GCM_Final(AES_BLK_CTX *, struct aes_gcm_stream *,
+	    uint8_t [AES_BLK_LEN]);
+
+#endif /* _AES_BLK_H_ */
@@ -38,6 +38,7 @@ typedef struct _AES_GMAC_CTX {
 
 //__BEGIN_DECLS
 extern void (*ghash_update)(GHASH_CTX *, uint8_t *, size_t);
+void	ghash_gfmul(uint32_t *, uint32_t *, uint32_t *);
 
 void	AES_GMAC_Init(void *);
 void	AES_GMAC_Setkey(void *, const uint8_t *, uint16_t);
@@ -43,21 +43,319 @@ int hmac_sha1(const u8 *key, size_t key_len, const u8 *data, size_t data_len,
     return hmac_sha1_vector(key, key_len, 1, &data, &data_len, mac);
 }
 
+/*
+ * After U1 every PRF input is a single 20-byte digest, so once the
+ * ipad and opad states are known each HMAC costs exactly two SHA-1
+ * compressions.  The inner and outer blocks are kept as host-order
+ * words with the padding already in place and handed straight to the
+ * compression function.  Where CRYPTO_SIMD is defined, on x86_64 CPUs
+ * with the SHA extensions the whole iteration loop runs on SHA-NI.  That
+ * path keeps its state in XMM registers, which kernel code may not touch
+ * without saving the interrupted thread's FPU state, so only the host
+ * tools build it; the kext always runs the portable loop.
+ */
+#define PBKDF2_W0(i)	(w[i])
+#define PBKDF2_W(i)	(x[(i) & 15] = rol(x[((i) + 13) & 15] ^		\
+    x[((i) + 8) & 15] ^ x[((i) + 2) & 15] ^ x[(i) & 15], 1))
+#define rol(v, b)	(((v) << (b)) | ((v) >> (32 - (b))))
+#define P0(v,w_,x_,y,z,i) z+=((w_&(x_^y))^y)+(x[i]=PBKDF2_W0(i))+0x5A827999+rol(v,5);w_=rol(w_,30);
+#define P1(v,w_,x_,y,z,i) z+=((w_&(x_^y))^y)+PBKDF2_W(i)+0x5A827999+rol(v,5);w_=rol(w_,30);
+#define P2(v,w_,x_,y,z,i) z+=(w_^x_^y)+PBKDF2_W(i)+0x6ED9EBA1+rol(v,5);w_=rol(w_,30);
+#define P3(v,w_,x_,y,z,i) z+=(((w_|x_)&y)|(w_&x_))+PBKDF2_W(i)+0x8F1BBCDC+rol(v,5);w_=rol(w_,30);
+#define P4(v,w_,x_,y,z,i) z+=(w_^x_^y)+PBKDF2_W(i)+0xCA62C1D6+rol(v,5);w_=rol(w_,30);
+
+static void
+sha1_compress_words(u_int32_t state[5], const u_int32_t w[16])
+{
+	u_int32_t a, b, c, d, e, x[16];
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+
+	P0(a,b,c,d,e, 0); P0(e,a,b,c,d, 1); P0(d,e,a,b,c, 2); P0(c,d,e,a,b, 3);
+	P0(b,c,d,e,a, 4); P0(a,b,c,d,e, 5); P0(e,a,b,c,d, 6); P0(d,e,a,b,c, 7);
+	P0(c,d,e,a,b, 8); P0(b,c,d,e,a, 9); P0(a,b,c,d,e,10); P0(e,a,b,c,d,11);
+	P0(d,e,a,b,c,12); P0(c,d,e,a,b,13); P0(b,c,d,e,a,14); P0(a,b,c,d,e,15);
+	P1(e,a,b,c,d,16); P1(d,e,a,b,c,17); P1(c,d,e,a,b,18); P1(b,c,d,e,a,19);
+	P2(a,b,c,d,e,20); P2(e,a,b,c,d,21); P2(d,e,a,b,c,22); P2(c,d,e,a,b,23);
+	P2(b,c,d,e,a,24); P2(a,b,c,d,e,25); P2(e,a,b,c,d,26); P2(d,e,a,b,c,27);
+	P2(c,d,e,a,b,28); P2(b,c,d,e,a,29); P2(a,b,c,d,e,30); P2(e,a,b,c,d,31);
+	P2(d,e,a,b,c,32); P2(c,d,e,a,b,33); P2(b,c,d,e,a,34); P2(a,b,c,d,e,35);
+	P2(e,a,b,c,d,36); P2(d,e,a,b,c,37); P2(c,d,e,a,b,38); P2(b,c,d,e,a,39);
+	P3(a,b,c,d,e,40); P3(e,a,b,c,d,41); P3(d,e,a,b,c,42); P3(c,d,e,a,b,43);
+	P3(b,c,d,e,a,44); P3(a,b,c,d,e,45); P3(e,a,b,c,d,46); P3(d,e,a,b,c,47);
+	P3(c,d,e,a,b,48); P3(b,c,d,e,a,49); P3(a,b,c,d,e,50); P3(e,a,b,c,d,51);
+	P3(d,e,a,b,c,52); P3(c,d,e,a,b,53); P3(b,c,d,e,a,54); P3(a,b,c,d,e,55);
+	P3(e,a,b,c,d,56); P3(d,e,a,b,c,57); P3(c,d,e,a,b,58); P3(b,c,d,e,a,59);
+	P4(a,b,c,d,e,60); P4(e,a,b,c,d,61); P4(d,e,a,b,c,62); P4(c,d,e,a,b,63);
+	P4(b,c,d,e,a,64); P4(a,b,c,d,e,65); P4(e,a,b,c,d,66); P4(d,e,a,b,c,67);
+	P4(c,d,e,a,b,68); P4(b,c,d,e,a,69); P4(a,b,c,d,e,70); P4(e,a,b,c,d,71);
+	P4(d,e,a,b,c,72); P4(c,d,e,a,b,73); P4(b,c,d,e,a,74); P4(a,b,c,d,e,75);
+	P4(e,a,b,c,d,76); P4(d,e,a,b,c,77); P4(c,d,e,a,b,78); P4(b,c,d,e,a,79);
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+/* U2 ... Uc; ib holds U1 on entry, acc collects the xor of all U */
+static void
+pbkdf2_sha1_iter(const u_int32_t istate[5], const u_int32_t ostate[5],
+    u_int32_t ib[16], u_int32_t ob[16], u_int32_t acc[5], int iterations)
+{
+	int i, j;
+
+	for (i = 1; i < iterations; i++) {
+		memcpy(ob, istate, 5 * sizeof(u_int32_t));
+		sha1_compress_words(ob, ib);
+		memcpy(ib, ostate, 5 * sizeof(u_int32_t));
+		sha1_compress_words(ib, ob);
+		for (j = 0; j < 5; j++)
+			acc[j] ^= ib[j];
+	}
+}
+
+#if defined(__x86_64__) && defined(CRYPTO_SIMD)
+#define PBKDF2_SHA_NI
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <immintrin.h>
+
+#define SHANI_TARGET	__attribute__((target("sha,sse4.1")))
+
+/* four rounds with function f, then schedule the message words ahead */
+#define SHANI_4R(e_in, e_out, m0, m1, m2, m3, f) do {			\
+	e_in = _mm_sha1nexte_epu32(e_in, m0);				\
+	e_out = abcd;							\
+	m1 = _mm_sha1msg2_epu32(m1, m0);				\
+	abcd = _mm_sha1rnds4_epu32(abcd, e_in, f);			\
+	m3 = _mm_sha1msg1_epu32(m3, m0);				\
+	m2 = _mm_xor_si128(m2, m0);					\
+} while (0)
+
+SHANI_TARGET static inline void
+sha1ni_compress(__m128i *abcdp, __m128i *e0p, const u_int32_t w[16])
+{
+	__m128i abcd, e0, e1, m0, m1, m2, m3, abcd_save, e0_save;
+
+	abcd = abcd_save = *abcdp;
+	e0_save = *e0p;
+
+	/* message words are host-order, only their order must be reversed */
+	m0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&w[0]), 0x1b);
+	m1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&w[4]), 0x1b);
+	m2 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&w[8]), 0x1b);
+	m3 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&w[12]), 0x1b);
+
+	/* rounds 0-15 */
+	e0 = _mm_add_epi32(e0_save, m0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+	e1 = _mm_sha1nexte_epu32(e1, m1);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	m0 = _mm_sha1msg1_epu32(m0, m1);
+
+	e0 = _mm_sha1nexte_epu32(e0, m2);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	m1 = _mm_sha1msg1_epu32(m1, m2);
+	m0 = _mm_xor_si128(m0, m2);
+
+	e1 = _mm_sha1nexte_epu32(e1, m3);
+	e0 = abcd;
+	m0 = _mm_sha1msg2_epu32(m0, m3);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	m2 = _mm_sha1msg1_epu32(m2, m3);
+	m1 = _mm_xor_si128(m1, m3);
+
+	/* rounds 16-67 */
+	SHANI_4R(e0, e1, m0, m1, m2, m3, 0);
+	SHANI_4R(e1, e0, m1, m2, m3, m0, 1);
+	SHANI_4R(e0, e1, m2, m3, m0, m1, 1);
+	SHANI_4R(e1, e0, m3, m0, m1, m2, 1);
+	SHANI_4R(e0, e1, m0, m1, m2, m3, 1);
+	SHANI_4R(e1, e0, m1, m2, m3, m0, 1);
+	SHANI_4R(e0, e1, m2, m3, m0, m1, 2);
+	SHANI_4R(e1, e0, m3, m0, m1, m2, 2);
+	SHANI_4R(e0, e1, m0, m1, m2, m3, 2);
+	SHANI_4R(e1, e0, m1, m2, m3, m0, 2);
+	SHANI_4R(e0, e1, m2, m3, m0, m1, 2);
+	SHANI_4R(e1, e0, m3, m0, m1, m2, 3);
+	SHANI_4R(e0, e1, m0, m1, m2, m3, 3);
+
+	/* rounds 68-79 */
+	e1 = _mm_sha1nexte_epu32(e1, m1);
+	e0 = abcd;
+	m2 = _mm_sha1msg2_epu32(m2, m1);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+	m3 = _mm_xor_si128(m3, m1);
+
+	e0 = _mm_sha1nexte_epu32(e0, m2);
+	e1 = abcd;
+	m3 = _mm_sha1msg2_epu32(m3, m2);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+	e1 = _mm_sha1nexte_epu32(e1, m3);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+	*e0p = _mm_sha1nexte_epu32(e0, e0_save);
+	*abcdp = _mm_add_epi32(abcd, abcd_save);
+}
+
+SHANI_TARGET static inline void
+sha1ni_load(const u_int32_t state[5], __m128i *abcd, __m128i *e)
+{
+	*abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state),
+	    0x1b);
+	*e = _mm_set_epi32(state[4], 0, 0, 0);
+}
+
+SHANI_TARGET static inline void
+sha1ni_store(__m128i abcd, __m128i e, u_int32_t state[5])
+{
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+	state[4] = _mm_extract_epi32(e, 3);
+}
+
+SHANI_TARGET static void
+pbkdf2_sha1ni_iter(const u_int32_t istate[5], const u_int32_t ostate[5],
+    u_int32_t ib[16], u_int32_t ob[16], u_int32_t acc[5], int iterations)
+{
+	__m128i iabcd, ie, oabcd, oe, abcd, e, xabcd, xe;
+	int i;
+
+	sha1ni_load(istate, &iabcd, &ie);
+	sha1ni_load(ostate, &oabcd, &oe);
+	sha1ni_load(acc, &xabcd, &xe);
+	for (i = 1; i < iterations; i++) {
+		abcd = iabcd;
+		e = ie;
+		sha1ni_compress(&abcd, &e, ib);
+		sha1ni_store(abcd, e, ob);
+		abcd = oabcd;
+		e = oe;
+		sha1ni_compress(&abcd, &e, ob);
+		sha1ni_store(abcd, e, ib);
+		xabcd = _mm_xor_si128(xabcd, abcd);
+		xe = _mm_xor_si128(xe, e);
+	}
+	sha1ni_store(xabcd, xe, acc);
+}
+
+/* CPUID check plus a known answer against the portable compression */
+static int
+sha1ni_probe(void)
+{
+	u_int32_t eax, ebx, ecx, edx;
+	u_int32_t w[16], s0[5], s1[5];
+	__m128i abcd, e;
+	int i;
+
+	eax = 1;
+	ecx = 0;
+	__asm__ __volatile__("cpuid"
+	    : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	if ((ecx & (1 << 19)) == 0)	/* SSE4.1 */
+		return 0;
+	eax = 0;
+	__asm__ __volatile__("cpuid"
+	    : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	if (eax < 7)
+		return 0;
+	eax = 7;
+	ecx = 0;
+	__asm__ __volatile__("cpuid"
+	    : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	if ((ebx & (1 << 29)) == 0)	/* SHA */
+		return 0;
+
+	for (i = 0; i < 16; i++)
+		w[i] = 0x9e3779b9U * (i + 1);
+	for (i = 0; i < 5; i++)
+		s0[i] = s1[i] = 0x7f4a7c15U * (i + 1);
+	sha1_compress_words(s0, w);
+	sha1ni_load(s1, &abcd, &e);
+	sha1ni_compress(&abcd, &e, w);
+	sha1ni_store(abcd, e, s1);
+	return memcmp(s0, s1, sizeof(s0)) == 0;
+}
+#endif /* __x86_64__ && CRYPTO_SIMD */
+
+static int pbkdf2_sha1_accel = -1;	/* -1: not probed yet */
+
+/* the SHA-1 state after compressing one block of key xor pad */
+static void
+pbkdf2_sha1_pad(const u8 *key, size_t key_len, u8 pad, u_int32_t state[5])
+{
+	u_int32_t w[16];
+	u8 block[SHA1_BLOCK_LENGTH];
+	size_t i;
+
+	memset(block, pad, sizeof(block));
+	for (i = 0; i < key_len; i++)
+		block[i] ^= key[i];
+	for (i = 0; i < 16; i++)
+		w[i] = (u_int32_t)block[4 * i] << 24 |
+		    (u_int32_t)block[4 * i + 1] << 16 |
+		    (u_int32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+	state[0] = 0x67452301;
+	state[1] = 0xEFCDAB89;
+	state[2] = 0x98BADCFE;
+	state[3] = 0x10325476;
+	state[4] = 0xC3D2E1F0;
+	sha1_compress_words(state, w);
+	bzero(block, sizeof(block));
+	bzero(w, sizeof(w));
+}
+
+/* HMAC over data from precomputed ipad/opad states */
+static void
+pbkdf2_sha1_prf(const u_int32_t istate[5], const u_int32_t ostate[5],
+    const u8 *data1, size_t len1, const u8 *data2, size_t len2,
+    u8 mac[SHA1_MAC_LEN])
+{
+	SHA1_CTX ctx;
+
+	memcpy(ctx.state, istate, sizeof(ctx.state));
+	ctx.count = SHA1_BLOCK_LENGTH * 8;
+	SHA1Update(&ctx, data1, (unsigned int)len1);
+	SHA1Update(&ctx, data2, (unsigned int)len2);
+	SHA1Final(mac, &ctx);
+
+	memcpy(ctx.state, ostate, sizeof(ctx.state));
+	ctx.count = SHA1_BLOCK_LENGTH * 8;
+	SHA1Update(&ctx, mac, SHA1_MAC_LEN);
+	SHA1Final(mac, &ctx);
+}
+
 static int pbkdf2_sha1_f(const char *passphrase, const u8 *ssid,
 			 size_t ssid_len, int iterations, unsigned int count,
 			 u8 *digest)
 {
-	unsigned char tmp[SHA1_MAC_LEN], tmp2[SHA1_MAC_LEN];
-	int i, j;
-	unsigned char count_buf[4];
-	const u8 *addr[2];
-	size_t len[2];
-	size_t passphrase_len = strlen(passphrase);
+	u_int32_t istate[5], ostate[5], ib[16], ob[16], acc[5];
+	unsigned char count_buf[4], tk[SHA1_MAC_LEN];
+	const u8 *key = (const u8 *)passphrase;
+	size_t key_len = strlen(passphrase);
+	SHA1_CTX ctx;
+	int i;
 
-	addr[0] = ssid;
-	len[0] = ssid_len;
-	addr[1] = count_buf;
-	len[1] = 4;
+	if (key_len > SHA1_BLOCK_LENGTH) {
+		SHA1Init(&ctx);
+		SHA1Update(&ctx, key, (unsigned int)key_len);
+		SHA1Final(tk, &ctx);
+		key = tk;
+		key_len = SHA1_MAC_LEN;
+	}
+	pbkdf2_sha1_pad(key, key_len, 0x36, istate);
+	pbkdf2_sha1_pad(key, key_len, 0x5c, ostate);
 
 	/* F(P, S, c, i) = U1 xor U2 xor ... Uc
 	 * U1 = PRF(P, S || i)
@@ -69,20 +367,45 @@ static int pbkdf2_sha1_f(const char *passphrase, const u8 *ssid,
 	count_buf[1] = (count >> 16) & 0xff;
 	count_buf[2] = (count >> 8) & 0xff;
 	count_buf[3] = count & 0xff;
-	if (hmac_sha1_vector((u8 *) passphrase, passphrase_len, 2, addr, len,
-			     tmp))
-		return -1;
-	memcpy(digest, tmp, SHA1_MAC_LEN);
+	pbkdf2_sha1_prf(istate, ostate, ssid, ssid_len, count_buf, 4, digest);
 
-	for (i = 1; i < iterations; i++) {
-		if (hmac_sha1((u8 *) passphrase, passphrase_len, tmp,
-			      SHA1_MAC_LEN, tmp2))
-			return -1;
-		memcpy(tmp, tmp2, SHA1_MAC_LEN);
-		for (j = 0; j < SHA1_MAC_LEN; j++)
-			digest[j] ^= tmp2[j];
+	/* one 20-byte message after the key block: 84 bytes in all */
+	memset(ib, 0, sizeof(ib));
+	for (i = 0; i < 5; i++)
+		ib[i] = acc[i] = (u_int32_t)digest[4 * i] << 24 |
+		    (u_int32_t)digest[4 * i + 1] << 16 |
+		    (u_int32_t)digest[4 * i + 2] << 8 | digest[4 * i + 3];
+	ib[5] = 0x80000000;
+	ib[15] = (SHA1_BLOCK_LENGTH + SHA1_MAC_LEN) * 8;
+	memcpy(ob, ib, sizeof(ob));
+
+	if (pbkdf2_sha1_accel < 0) {
+#ifdef PBKDF2_SHA_NI
+		pbkdf2_sha1_accel = sha1ni_probe();
+#else
+		pbkdf2_sha1_accel = 0;
+#endif
+	}
+#ifdef PBKDF2_SHA_NI
+	if (pbkdf2_sha1_accel)
+		pbkdf2_sha1ni_iter(istate, ostate, ib, ob, acc, iterations);
+	else
+#endif
+		pbkdf2_sha1_iter(istate, ostate, ib, ob, acc, iterations);
+
+	for (i = 0; i < 5; i++) {
+		digest[4 * i] = acc[i] >> 24;
+		digest[4 * i + 1] = acc[i] >> 16;
+		digest[4 * i + 2] = acc[i] >> 8;
+		digest[4 * i + 3] = acc[i];
 	}
 
+	bzero(istate, sizeof(istate));
+	bzero(ostate, sizeof(ostate));
+	bzero(ib, sizeof(ib));
+	bzero(ob, sizeof(ob));
+	bzero(acc, sizeof(acc));
+	bzero(tk, sizeof(tk));
 	return 0;
 }
 
@@ -21,108 +21,310 @@
 */
 
 #include <sys/CTimeout.hpp>
+#include <kern/clock.h>
 
-void CTimeout::timeoutOccurred(OSObject* owner, IOTimerEventSource* timer)
+static struct {
+    IOLock *lock;
+    IOWorkLoop *wl;
+    IOTimerEventSource *es;
+    uint64_t clk;                   /* last tick the wheel was advanced to */
+    uint64_t armed;                 /* tick the event source fires at, or 0 */
+    uint32_t count;                 /* timeouts filed in slots */
+    uint64_t bitmap[TIMEOUT_WHEEL_LEVELS];
+    struct ctimeout_list slots[TIMEOUT_WHEEL_LEVELS][TIMEOUT_WHEEL_SIZE];
+    struct ctimeout_list run;       /* expired, callback not yet called */
+} wheel;
+
+static uint64_t
+wheel_now()
 {
-//    IOLog("itlwm %s\n", __FUNCTION__);
-    if (owner == NULL) {
-        IOLog("itlwm tm owner == NULL!!!\n");
-    }
-    CTimeout *tm = OSDynamicCast(CTimeout, owner);
-    if (tm == NULL) {
-        IOLog("itlwm tm == NULL!!!\n");
-        return;
+    uint64_t abstime, ns;
+
+    clock_get_uptime(&abstime);
+    absolutetime_to_nanoseconds(abstime, &ns);
+    return ns / 1000;
+}
+
+/* Start tick of the window covered by the given level/index. */
+#define WHEEL_SHIFT(l)      ((l) * TIMEOUT_WHEEL_BITS)
+
+static uint64_t
+wheel_file(CTimeout *to)
+{
+    uint64_t expires = to->to_time, idx, cur;
+    int l;
+
+    if (expires <= wheel.clk)
+        expires = wheel.clk + 1;
+    for (l = 0; l < TIMEOUT_WHEEL_LEVELS - 1; l++) {
+        if ((expires >> WHEEL_SHIFT(l)) - (wheel.clk >> WHEEL_SHIFT(l)) < TIMEOUT_WHEEL_SIZE)
+            break;
     }
-    //callback
-    tm->isPending = false;
-    tm->to_func(tm->to_arg);
+    idx = expires >> WHEEL_SHIFT(l);
+    cur = wheel.clk >> WHEEL_SHIFT(l);
+    if (idx - cur >= TIMEOUT_WHEEL_SIZE)
+        idx = cur + TIMEOUT_WHEEL_SIZE - 1;
+
+    to->to_level = l;
+    to->to_slot = idx & TIMEOUT_WHEEL_MASK;
+    to->to_state = TO_S_PENDING;
+    TAILQ_INSERT_TAIL(&wheel.slots[l][to->to_slot], to, to_list);
+    wheel.bitmap[l] |= 1ULL << to->to_slot;
+    wheel.count++;
+    return idx << WHEEL_SHIFT(l);
 }
 
-IOReturn CTimeout::timeout_add_msec(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
+static void
+wheel_unfile(CTimeout *to)
 {
-    IOWorkLoop *wl = (IOWorkLoop*)arg1;
-    int msecs = *(int*)arg2;
-    CTimeout **ccto = (CTimeout **)arg0;
-    
-    if (ccto == NULL || *ccto == NULL) {
-        return kIOReturnError;
+    struct ctimeout_list *head;
+
+    if (to->to_state == TO_S_PENDING) {
+        head = &wheel.slots[to->to_level][to->to_slot];
+        TAILQ_REMOVE(head, to, to_list);
+        if (TAILQ_EMPTY(head))
+            wheel.bitmap[to->to_level] &= ~(1ULL << to->to_slot);
+        wheel.count--;
+    } else if (to->to_state == TO_S_FIRING)
+        TAILQ_REMOVE(&wheel.run, to, to_list);
+    to->to_state = TO_S_IDLE;
+}
+
+/*
+ * Earliest tick at which some slot needs attention. For level 0 this is
+ * the exact expiry, for higher levels the start of the slot window, where
+ * its timeouts are cascaded down.
+ */
+static uint64_t
+wheel_next()
+{
+    uint64_t next = 0, bits, cur, start;
+    unsigned int rot;
+    int l;
+
+    for (l = 0; l < TIMEOUT_WHEEL_LEVELS; l++) {
+        if ((bits = wheel.bitmap[l]) == 0)
+            continue;
+        cur = wheel.clk >> WHEEL_SHIFT(l);
+        rot = (cur + 1) & TIMEOUT_WHEEL_MASK;
+        if (rot)
+            bits = (bits >> rot) | (bits << (64 - rot));
+        start = (cur + 1 + __builtin_ctzll(bits)) << WHEEL_SHIFT(l);
+        if (next == 0 || start < next)
+            next = start;
     }
-    CTimeout *cto = *ccto;
-    if (cto->tm == NULL) {
-        cto->tm = IOTimerEventSource::timerEventSource(cto, &CTimeout::timeoutOccurred);
-        if (cto->tm == NULL) {
-            return kIOReturnError;
+    return next;
+}
+
+static void
+wheel_advance(uint64_t now)
+{
+    struct ctimeout_list due;
+    CTimeout *to;
+    uint64_t c0, c1, k, n;
+    unsigned int slot;
+    int l;
+
+    if (now <= wheel.clk)
+        return;
+    TAILQ_INIT(&due);
+    for (l = 0; l < TIMEOUT_WHEEL_LEVELS; l++) {
+        c0 = wheel.clk >> WHEEL_SHIFT(l);
+        c1 = now >> WHEEL_SHIFT(l);
+        if (c0 == c1)
+            break;
+        n = c1 - c0;
+        if (n > TIMEOUT_WHEEL_SIZE)
+            n = TIMEOUT_WHEEL_SIZE;
+        for (k = 1; k <= n && wheel.bitmap[l]; k++) {
+            slot = (c0 + k) & TIMEOUT_WHEEL_MASK;
+            if (!(wheel.bitmap[l] & (1ULL << slot)))
+                continue;
+            TAILQ_FOREACH(to, &wheel.slots[l][slot], to_list)
+                wheel.count--;
+            TAILQ_CONCAT(&due, &wheel.slots[l][slot], to_list);
+            wheel.bitmap[l] &= ~(1ULL << slot);
         }
-        cto->tm->enable();
-        wl->addEventSource(cto->tm);
     }
-    cto->tm->setTimeoutMS(msecs);
-    cto->isPending = true;
-    return kIOReturnSuccess;
+    wheel.clk = now;
+    while ((to = TAILQ_FIRST(&due)) != NULL) {
+        TAILQ_REMOVE(&due, to, to_list);
+        if (to->to_time <= now) {
+            to->to_state = TO_S_FIRING;
+            TAILQ_INSERT_TAIL(&wheel.run, to, to_list);
+        } else
+            wheel_file(to);
+    }
 }
 
-IOReturn CTimeout::timeout_del(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
+static void
+wheel_program(uint64_t next)
 {
-    CTimeout **ccto = (CTimeout **)arg0;
-    if (ccto == NULL || *ccto == NULL) {
-        return kIOReturnSuccess;
+    uint64_t now, delta;
+
+    wheel.armed = next;
+    if (next == 0)
+        return;
+    now = wheel_now();
+    delta = next > now ? next - now : 1;
+    if (delta > UINT32_MAX)
+        delta = UINT32_MAX;
+    wheel.es->setTimeoutUS((UInt32)delta);
+}
+
+bool CTimeout::wheelInit(IOWorkLoop *wl)
+{
+    int l, i;
+
+    if (wheel.es != NULL)
+        return true;
+    if (wheel.lock == NULL && (wheel.lock = IOLockAlloc()) == NULL)
+        return false;
+    for (l = 0; l < TIMEOUT_WHEEL_LEVELS; l++) {
+        wheel.bitmap[l] = 0;
+        for (i = 0; i < TIMEOUT_WHEEL_SIZE; i++)
+            TAILQ_INIT(&wheel.slots[l][i]);
     }
-    CTimeout *cto = *ccto;
-    if (cto->tm == NULL || !cto->isPending) {
-        return kIOReturnSuccess;
+    TAILQ_INIT(&wheel.run);
+    wheel.count = 0;
+    wheel.armed = 0;
+    wheel.clk = wheel_now();
+    wheel.es = IOTimerEventSource::timerEventSource(wl, &CTimeout::wheelOccurred);
+    if (wheel.es == NULL)
+        return false;
+    if (wl->addEventSource(wheel.es) != kIOReturnSuccess) {
+        wheel.es->release();
+        wheel.es = NULL;
+        return false;
     }
-    cto->tm->cancelTimeout();
-    cto->isPending = false;
-    return kIOReturnSuccess;
+    wheel.es->enable();
+    wheel.wl = wl;
+    return true;
 }
 
-IOReturn CTimeout::timeout_free(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
+void CTimeout::wheelRelease()
 {
-    CTimeout **cto = (CTimeout **)arg0;
-    IOWorkLoop *wl = (IOWorkLoop*)arg1;
-    if (cto == NULL || *cto == NULL) {
-        return kIOReturnSuccess;
-    }
-    CTimeout *tm = *cto;
-    if (tm->tm != NULL) {
-        wl->removeEventSource(tm->tm);
-        tm->tm->release();
-        tm->tm = NULL;
+    CTimeout *to;
+    int l, i;
+
+    if (wheel.es == NULL)
+        return;
+    IOLockLock(wheel.lock);
+    wheel.es->cancelTimeout();
+    for (l = 0; l < TIMEOUT_WHEEL_LEVELS; l++) {
+        for (i = 0; i < TIMEOUT_WHEEL_SIZE; i++) {
+            while ((to = TAILQ_FIRST(&wheel.slots[l][i])) != NULL)
+                wheel_unfile(to);
+        }
     }
-    tm->release();
-    *cto = NULL;
-    return kIOReturnSuccess;
+    while ((to = TAILQ_FIRST(&wheel.run)) != NULL)
+        wheel_unfile(to);
+    wheel.armed = 0;
+    IOLockUnlock(wheel.lock);
+    wheel.wl->removeEventSource(wheel.es);
+    wheel.es->release();
+    wheel.es = NULL;
+    wheel.wl = NULL;
 }
 
-typedef void (*callback)(void *);
+void CTimeout::wheelOccurred(OSObject* owner, IOTimerEventSource* timer)
+{
+    CTimeout *to;
+    void (*fn)(void *);
+    void *arg;
+
+    IOLockLock(wheel.lock);
+    wheel.armed = 0;
+    wheel_advance(wheel_now());
+    while ((to = TAILQ_FIRST(&wheel.run)) != NULL) {
+        TAILQ_REMOVE(&wheel.run, to, to_list);
+        to->to_state = TO_S_IDLE;
+        fn = to->to_func;
+        arg = to->to_arg;
+        IOLockUnlock(wheel.lock);
+        //callback
+        fn(arg);
+        IOLockLock(wheel.lock);
+    }
+    wheel_program(wheel_next());
+    IOLockUnlock(wheel.lock);
+}
 
-IOReturn CTimeout::timeout_set(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
+CTimeout *CTimeout::timeout_set(CTimeout **cto, void (*fn)(void *), void *arg)
 {
     CTimeout *tm;
-    CTimeout **cto = (CTimeout **)arg0;
-    if (cto == NULL) {
-        return kIOReturnError;
-    }
+
+    if (cto == NULL)
+        return NULL;
     if ((*cto) == NULL) {
-        *cto = new CTimeout;
-    }
+        tm = new CTimeout;
+        if (tm == NULL)
+            return NULL;
+        tm->to_state = TO_S_IDLE;
+        *cto = tm;
+    } else
+        timeout_del(cto);
     tm = *cto;
-    tm->isPending = false;
-    tm->to_func = (callback)arg1;
-    tm->to_arg = arg2;
-    return kIOReturnSuccess;
+    tm->to_func = fn;
+    tm->to_arg = arg;
+    return tm;
 }
 
-IOReturn CTimeout::timeout_pending(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
+int CTimeout::timeout_add_usec(CTimeout **cto, uint64_t usecs)
+{
+    CTimeout *to;
+    uint64_t start;
+
+    if (cto == NULL || *cto == NULL || wheel.es == NULL)
+        return 0;
+    to = *cto;
+    IOLockLock(wheel.lock);
+    wheel_unfile(to);
+    /* nothing filed, so the wheel can jump straight to the present */
+    if (wheel.count == 0 && TAILQ_EMPTY(&wheel.run))
+        wheel.clk = wheel_now();
+    to->to_time = wheel_now() + usecs;
+    start = wheel_file(to);
+    if (wheel.armed == 0 || start < wheel.armed)
+        wheel_program(start);
+    IOLockUnlock(wheel.lock);
+    return 1;
+}
+
+int CTimeout::timeout_del(CTimeout **cto)
+{
+    CTimeout *to;
+    int ret;
+
+    if (cto == NULL || *cto == NULL || wheel.lock == NULL)
+        return 0;
+    to = *cto;
+    IOLockLock(wheel.lock);
+    ret = to->to_state != TO_S_IDLE;
+    wheel_unfile(to);
+    IOLockUnlock(wheel.lock);
+    return ret;
+}
+
+int CTimeout::timeout_pending(CTimeout **cto)
+{
+    if (cto == NULL || *cto == NULL)
+        return 0;
+    return (*cto)->to_state != TO_S_IDLE;
+}
+
+/*
+ * Freeing goes through the command gate so it can never race with the
+ * callback of the same timeout running on the workloop.
+ */
+IOReturn CTimeout::timeout_free(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
 {
     CTimeout **cto = (CTimeout **)arg0;
-    CTimeout *tm;
-    if (cto == NULL) {
-        return kIOReturnError;
-    }
-    tm = *cto;
-    if (tm != NULL && tm->isPending) {
+    if (cto == NULL || *cto == NULL) {
         return kIOReturnSuccess;
     }
-    return kIOReturnError;
+    timeout_del(cto);
+    (*cto)->release();
+    *cto = NULL;
+    return kIOReturnSuccess;
 }
@@ -233,6 +233,7 @@ ieee80211_ifattach(struct _ifnet *ifp)
     memcpy(LLADDR(ifp->if_sadl), ic->ic_myaddr, ETHER_ADDR_LEN);
     
     ifp->if_output = ieee80211_output;
+    ifiq_init(ifp);
     
 #if NBPFILTER > 0
     bpfattach(&ic->ic_rawbpf, ifp, DLT_IEEE802_11,
@@ -272,6 +273,7 @@ ieee80211_ifdetach(struct _ifnet *ifp)
     
     timeout_del(&ic->ic_bgscan_timeout);
     timeout_free(&ic->ic_bgscan_timeout);
+    ifiq_destroy(ifp);
     ieee80211_proto_detach(ifp);
     ieee80211_crypto_detach(ifp);
     ieee80211_node_detach(ifp);
@@ -2151,7 +2151,6 @@ struct ieee80211_wme_info {
     uint8_t        wme_info;    /* QoS info */
 } __packed;
 
-#ifdef AIRPORT
 static inline uint64_t airport_up_time()
 {
     struct timeval tv;
@@ -2161,7 +2160,6 @@ static inline uint64_t airport_up_time()
     tv_usec = (uint32_t)(tv.tv_usec * 0x10624DD3);
     return (tv_usec >> 0x3F) + (tv_usec >> 0x26) + tv.tv_sec * 1000;
 }
-#endif
 
 #endif /* _NET80211_IEEE80211_H_ */
 
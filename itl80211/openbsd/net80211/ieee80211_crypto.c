@@ -65,13 +65,19 @@ void    ieee80211_kdf(const u_int8_t *, size_t, const u_int8_t *, size_t,
         const u_int8_t *, size_t, u_int8_t *, size_t);
 void    ieee80211_derive_pmkid(enum ieee80211_akm, const u_int8_t *,
         const u_int8_t *, const u_int8_t *, u_int8_t *);
+void    ieee80211_pmksa_free(struct ieee80211com *, struct ieee80211_pmk *);
 
 void
 ieee80211_crypto_attach(struct _ifnet *ifp)
 {
     struct ieee80211com *ic = (struct ieee80211com *)ifp;
 
+    int i;
+
     TAILQ_INIT(&ic->ic_pmksa);
+    for (i = 0; i < IEEE80211_PMKSA_HASHSZ; i++)
+        LIST_INIT(&ic->ic_pmksa_hash[i]);
+    ic->ic_npmksa = 0;
     if (ic->ic_caps & IEEE80211_C_RSN) {
         ic->ic_rsnprotos = IEEE80211_PROTO_RSN;
         ic->ic_rsnakms = IEEE80211_AKM_PSK;
@@ -95,11 +101,8 @@ ieee80211_crypto_detach(struct _ifnet *ifp)
 	struct ieee80211_pmk *pmk;
 
 	/* purge the PMKSA cache */
-	while ((pmk = TAILQ_FIRST(&ic->ic_pmksa)) != NULL) {
-		TAILQ_REMOVE(&ic->ic_pmksa, pmk, pmk_next);
-		explicit_bzero(pmk, sizeof(*pmk));
-		IOFree(pmk, sizeof(*pmk));
-	}
+	while ((pmk = TAILQ_FIRST(&ic->ic_pmksa)) != NULL)
+		ieee80211_pmksa_free(ic, pmk);
 
 	/* clear all group keys from memory */
 	ieee80211_crypto_clear_groupkeys(ic);
@@ -143,6 +146,10 @@ ieee80211_cipher_keylen(enum ieee80211_cipher cipher)
 		return 13;
 	case IEEE80211_CIPHER_BIP:
 		return 16;
+	case IEEE80211_CIPHER_GCMP:
+		return 16;
+	case IEEE80211_CIPHER_GCMP_256:
+		return 32;
 	default:	/* unknown cipher */
 		return 0;
 	}
@@ -165,6 +172,10 @@ ieee80211_set_key(struct ieee80211com *ic, struct ieee80211_node *ni,
     case IEEE80211_CIPHER_CCMP:
         error = ieee80211_ccmp_set_key(ic, k);
         break;
+    case IEEE80211_CIPHER_GCMP:
+    case IEEE80211_CIPHER_GCMP_256:
+        error = ieee80211_gcmp_set_key(ic, k);
+        break;
     case IEEE80211_CIPHER_BIP:
         error = ieee80211_bip_set_key(ic, k);
         break;
@@ -196,6 +207,10 @@ ieee80211_delete_key(struct ieee80211com *ic, struct ieee80211_node *ni,
     case IEEE80211_CIPHER_CCMP:
         ieee80211_ccmp_delete_key(ic, k);
         break;
+    case IEEE80211_CIPHER_GCMP:
+    case IEEE80211_CIPHER_GCMP_256:
+        ieee80211_gcmp_delete_key(ic, k);
+        break;
     case IEEE80211_CIPHER_BIP:
         ieee80211_bip_delete_key(ic, k);
         break;
@@ -280,8 +295,6 @@ ieee80211_encrypt(struct ieee80211com *ic, mbuf_t m0,
         return NULL;
     }
     
-    XYLog("%s kid=%d cipher=%d\n", __FUNCTION__, k->k_id, k->k_cipher);
-
 	switch (k->k_cipher) {
 	case IEEE80211_CIPHER_WEP40:
 	case IEEE80211_CIPHER_WEP104:
@@ -293,6 +306,10 @@ ieee80211_encrypt(struct ieee80211com *ic, mbuf_t m0,
 	case IEEE80211_CIPHER_CCMP:
 		m0 = ieee80211_ccmp_encrypt(ic, m0, k);
 		break;
+	case IEEE80211_CIPHER_GCMP:
+	case IEEE80211_CIPHER_GCMP_256:
+		m0 = ieee80211_gcmp_encrypt(ic, m0, k);
+		break;
 	case IEEE80211_CIPHER_BIP:
 		m0 = ieee80211_bip_encap(ic, m0, k);
 		break;
@@ -327,6 +344,10 @@ ieee80211_decrypt(struct ieee80211com *ic, mbuf_t m0,
     case IEEE80211_CIPHER_CCMP:
         m0 = ieee80211_ccmp_decrypt(ic, m0, k);
         break;
+    case IEEE80211_CIPHER_GCMP:
+    case IEEE80211_CIPHER_GCMP_256:
+        m0 = ieee80211_gcmp_decrypt(ic, m0, k);
+        break;
     case IEEE80211_CIPHER_BIP:
         m0 = ieee80211_bip_decap(ic, m0, k);
         break;
@@ -637,6 +658,49 @@ ieee80211_eapol_key_decrypt(struct ieee80211_eapol_key *key,
     return 1;    /* unknown Key Descriptor Version */
 }
 
+static inline u_int
+ieee80211_pmksa_hash(const u_int8_t *macaddr)
+{
+	/* the low octets of a BSSID vary the most within an ESS */
+	return (macaddr[5] ^ macaddr[4] ^ (macaddr[3] << 1)) &
+	    (IEEE80211_PMKSA_HASHSZ - 1);
+}
+
+void
+ieee80211_pmksa_free(struct ieee80211com *ic, struct ieee80211_pmk *pmk)
+{
+	TAILQ_REMOVE(&ic->ic_pmksa, pmk, pmk_next);
+	LIST_REMOVE(pmk, pmk_hash);
+	ic->ic_npmksa--;
+	explicit_bzero(pmk, sizeof(*pmk));
+	IOFree(pmk, sizeof(*pmk));
+}
+
+/*
+ * Drop the entry if its lifetime has run out.  Returns 1 if it was freed.
+ */
+static int
+ieee80211_pmksa_expire(struct ieee80211com *ic, struct ieee80211_pmk *pmk,
+    u_int64_t now)
+{
+	if (pmk->pmk_expire == 0 || now < pmk->pmk_expire)
+		return 0;
+	ieee80211_pmksa_free(ic, pmk);
+	return 1;
+}
+
+/*
+ * Mark an entry as most recently used.
+ */
+static void
+ieee80211_pmksa_touch(struct ieee80211com *ic, struct ieee80211_pmk *pmk)
+{
+	if (TAILQ_NEXT(pmk, pmk_next) == NULL)
+		return;
+	TAILQ_REMOVE(&ic->ic_pmksa, pmk, pmk_next);
+	TAILQ_INSERT_TAIL(&ic->ic_pmksa, pmk, pmk_next);
+}
+
 /*
  * Add a PMK entry to the PMKSA cache.
  */
@@ -645,23 +709,35 @@ ieee80211_pmksa_add(struct ieee80211com *ic, enum ieee80211_akm akm,
     const u_int8_t *macaddr, const u_int8_t *key, u_int32_t lifetime)
 {
 	struct ieee80211_pmk *pmk;
+	struct ieee80211_node *ni;
+	u_int h = ieee80211_pmksa_hash(macaddr);
 
 	/* check if an entry already exists for this (STA,AKMP) */
-	TAILQ_FOREACH(pmk, &ic->ic_pmksa, pmk_next) {
+	LIST_FOREACH(pmk, &ic->ic_pmksa_hash[h], pmk_hash) {
 		if (pmk->pmk_akm == akm &&
 		    IEEE80211_ADDR_EQ(pmk->pmk_macaddr, macaddr))
 			break;
 	}
 	if (pmk == NULL) {
+		/* recycle the least recently used entry if the cache is full */
+		if (ic->ic_npmksa >= IEEE80211_PMKSA_MAX)
+			ieee80211_pmksa_free(ic, TAILQ_FIRST(&ic->ic_pmksa));
 		/* allocate a new PMKSA entry */
 		if ((pmk = (struct ieee80211_pmk *)_MallocZero(sizeof(*pmk))) == NULL)
 			return NULL;
 		pmk->pmk_akm = akm;
 		IEEE80211_ADDR_COPY(pmk->pmk_macaddr, macaddr);
 		TAILQ_INSERT_TAIL(&ic->ic_pmksa, pmk, pmk_next);
-	}
+		LIST_INSERT_HEAD(&ic->ic_pmksa_hash[h], pmk, pmk_hash);
+		ic->ic_npmksa++;
+	} else
+		ieee80211_pmksa_touch(ic, pmk);
 	memcpy(pmk->pmk_key, key, IEEE80211_PMK_LEN);
-	pmk->pmk_lifetime = lifetime;	/* XXX not used yet */
+	pmk->pmk_lifetime = lifetime;
+	if (lifetime != IEEE80211_PMK_INFINITE)
+		pmk->pmk_expire = nsecuptime() + lifetime * 1000000000ULL;
+	else
+		pmk->pmk_expire = 0;
 #ifndef IEEE80211_STA_ONLY
 	if (ic->ic_opmode == IEEE80211_M_HOSTAP) {
 		ieee80211_derive_pmkid(pmk->pmk_akm, pmk->pmk_key,
@@ -671,6 +747,14 @@ ieee80211_pmksa_add(struct ieee80211com *ic, enum ieee80211_akm akm,
 	{
 		ieee80211_derive_pmkid(pmk->pmk_akm, pmk->pmk_key,
 		    macaddr, ic->ic_myaddr, pmk->pmk_pmkid);
+		/* remember the ESS so that its other APs can reuse the PMK */
+		ni = ic->ic_bss;
+		if (ni == NULL || !IEEE80211_ADDR_EQ(ni->ni_macaddr, macaddr))
+			ni = ieee80211_find_node(ic, macaddr);
+		if (ni != NULL && ni->ni_esslen <= IEEE80211_NWID_LEN) {
+			pmk->pmk_esslen = ni->ni_esslen;
+			memcpy(pmk->pmk_essid, ni->ni_essid, ni->ni_esslen);
+		}
 	}
 	return pmk;
 }
@@ -682,14 +766,72 @@ struct ieee80211_pmk *
 ieee80211_pmksa_find(struct ieee80211com *ic, struct ieee80211_node *ni,
     const u_int8_t *pmkid)
 {
-	struct ieee80211_pmk *pmk;
+	struct ieee80211_pmk *pmk, *next;
+	u_int64_t now = nsecuptime();
+
+	LIST_FOREACH_SAFE(pmk, &ic->ic_pmksa_hash[
+	    ieee80211_pmksa_hash(ni->ni_macaddr)], pmk_hash, next) {
+		if (pmk->pmk_akm != ni->ni_rsnakms ||
+		    !IEEE80211_ADDR_EQ(pmk->pmk_macaddr, ni->ni_macaddr))
+			continue;
+		if (ieee80211_pmksa_expire(ic, pmk, now))
+			continue;
+		if (pmkid == NULL ||
+		    memcmp(pmk->pmk_pmkid, pmkid, IEEE80211_PMKID_LEN) == 0)
+			break;
+	}
+	if (pmk != NULL)
+		ieee80211_pmksa_touch(ic, pmk);
+	return pmk;
+}
 
-	TAILQ_FOREACH(pmk, &ic->ic_pmksa, pmk_next) {
-        if (pmk->pmk_akm == ni->ni_rsnakms &&
-            IEEE80211_ADDR_EQ(pmk->pmk_macaddr, ni->ni_macaddr) &&
-            (pmkid == NULL ||
-             memcmp(pmk->pmk_pmkid, pmkid, IEEE80211_PMKID_LEN) == 0))
-            break;
-    }
+/*
+ * Look for the most recently used PMK cached for another AP of the
+ * node's ESS.  This lets a STA roaming within an ESS whose APs share
+ * the PMK (opportunistic key caching) skip the 802.1X exchange.
+ */
+struct ieee80211_pmk *
+ieee80211_pmksa_find_ess(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+	struct ieee80211_pmk *pmk, *next, *best = NULL;
+	u_int64_t now = nsecuptime();
+
+	if (ni->ni_esslen == 0)
+		return NULL;
+	TAILQ_FOREACH_SAFE(pmk, &ic->ic_pmksa, pmk_next, next) {
+		if (ieee80211_pmksa_expire(ic, pmk, now))
+			continue;
+		if (pmk->pmk_akm == ni->ni_rsnakms &&
+		    pmk->pmk_esslen == ni->ni_esslen &&
+		    memcmp(pmk->pmk_essid, ni->ni_essid, ni->ni_esslen) == 0)
+			best = pmk;
+	}
+	return best;
+}
+
+/*
+ * Cache a PMK for the node's AP taken from the most recently used one of
+ * its ESS (opportunistic key caching).  The copy gets its own PMKID and
+ * expires with the entry it was taken from, which adding the copy may
+ * recycle.
+ */
+struct ieee80211_pmk *
+ieee80211_pmksa_okc(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+	struct ieee80211_pmk *pmk;
+	u_int8_t key[IEEE80211_PMK_LEN];
+	u_int64_t expire;
+	u_int32_t lifetime;
+
+	if ((pmk = ieee80211_pmksa_find_ess(ic, ni)) == NULL)
+		return NULL;
+	memcpy(key, pmk->pmk_key, sizeof(key));
+	expire = pmk->pmk_expire;
+	lifetime = pmk->pmk_lifetime;
+	pmk = ieee80211_pmksa_add(ic, (enum ieee80211_akm)ni->ni_rsnakms,
+	    ni->ni_macaddr, key, lifetime);
+	if (pmk != NULL)
+		pmk->pmk_expire = expire;
+	explicit_bzero(key, sizeof(key));
 	return pmk;
 }
@@ -48,7 +48,9 @@ enum ieee80211_cipher {
 	IEEE80211_CIPHER_TKIP		= 0x00000004,
 	IEEE80211_CIPHER_CCMP		= 0x00000008,
 	IEEE80211_CIPHER_WEP104		= 0x00000010,
-	IEEE80211_CIPHER_BIP		= 0x00000020	/* 11w */
+	IEEE80211_CIPHER_BIP		= 0x00000020,	/* 11w */
+	IEEE80211_CIPHER_GCMP		= 0x00000040,
+	IEEE80211_CIPHER_GCMP_256	= 0x00000080
 };
 
 /*
@@ -118,20 +120,29 @@ struct ieee80211_key {
 #define IEEE80211_KEYBUF_SIZE	16
 
 /*
- * Entry in the PMKSA cache.
+ * Entry in the PMKSA cache.  Entries are hashed on the peer address and
+ * kept on ic_pmksa in least recently used order; the oldest one is
+ * recycled once IEEE80211_PMKSA_MAX entries are cached.
  */
 struct ieee80211_pmk {
 	enum ieee80211_akm	pmk_akm;
 	u_int32_t		pmk_lifetime;
 #define IEEE80211_PMK_INFINITE	0
+	u_int64_t		pmk_expire;	/* nsecuptime(), 0 if infinite */
 
 	u_int8_t		pmk_pmkid[IEEE80211_PMKID_LEN];
 	u_int8_t		pmk_macaddr[IEEE80211_ADDR_LEN];
 	u_int8_t		pmk_key[IEEE80211_PMK_LEN];
+	u_int8_t		pmk_esslen;
+	u_int8_t		pmk_essid[IEEE80211_NWID_LEN];
 
 	TAILQ_ENTRY(ieee80211_pmk) pmk_next;
+	LIST_ENTRY(ieee80211_pmk) pmk_hash;
 };
 
+#define IEEE80211_PMKSA_MAX	64
+#define IEEE80211_PMKSA_HASHSZ	32	/* must be a power of 2 */
+
 /* forward references */
 struct	ieee80211com;
 struct	ieee80211_node;
@@ -169,6 +180,10 @@ struct	ieee80211_pmk *ieee80211_pmksa_add(struct ieee80211com *,
 	    enum ieee80211_akm, const u_int8_t *, const u_int8_t *, u_int32_t);
 struct	ieee80211_pmk *ieee80211_pmksa_find(struct ieee80211com *,
 	    struct ieee80211_node *, const u_int8_t *);
+struct	ieee80211_pmk *ieee80211_pmksa_find_ess(struct ieee80211com *,
+	    struct ieee80211_node *);
+struct	ieee80211_pmk *ieee80211_pmksa_okc(struct ieee80211com *,
+	    struct ieee80211_node *);
 void	ieee80211_derive_ptk(enum ieee80211_akm, const u_int8_t *,
 	    const u_int8_t *, const u_int8_t *, const u_int8_t *,
 	    const u_int8_t *, struct ieee80211_ptk *);
@@ -207,6 +222,18 @@ int    ieee80211_ccmp_get_pn(uint64_t *, uint64_t **, mbuf_t,
                              struct ieee80211_key *);
 mbuf_t ieee80211_ccmp_decrypt(struct ieee80211com *, mbuf_t,
 	    struct ieee80211_key *);
+int	ieee80211_ccmp_aad(const struct ieee80211_frame *, u_int8_t *,
+	    u_int8_t *);
+int	ieee80211_crypto_writable(mbuf_t);
+mbuf_t	ieee80211_crypto_prepare(mbuf_t, int);
+
+int	ieee80211_gcmp_set_key(struct ieee80211com *, struct ieee80211_key *);
+void	ieee80211_gcmp_delete_key(struct ieee80211com *,
+	    struct ieee80211_key *);
+mbuf_t ieee80211_gcmp_encrypt(struct ieee80211com *, mbuf_t,
+	    struct ieee80211_key *);
+mbuf_t ieee80211_gcmp_decrypt(struct ieee80211com *, mbuf_t,
+	    struct ieee80211_key *);
 
 int	ieee80211_bip_set_key(struct ieee80211com *, struct ieee80211_key *);
 void	ieee80211_bip_delete_key(struct ieee80211com *,
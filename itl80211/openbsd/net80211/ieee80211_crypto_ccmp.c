@@ -53,10 +53,11 @@
 #include <net80211/ieee80211_crypto.h>
 
 #include <crypto/aes.h>
+#include <crypto/aes_blk.h>
 
 /* CCMP software crypto context */
 struct ieee80211_ccmp_ctx {
-	AES_CTX		aesctx;
+	AES_BLK_CTX	aesctx;
 };
 
 /*
@@ -71,7 +72,10 @@ ieee80211_ccmp_set_key(struct ieee80211com *ic, struct ieee80211_key *k)
 	ctx = (struct ieee80211_ccmp_ctx *)_MallocZero(sizeof(*ctx));
 	if (ctx == NULL)
 		return ENOMEM;
-	AES_Setkey(&ctx->aesctx, k->k_key, 16);
+	if (AES_Blk_Setkey(&ctx->aesctx, k->k_key, 16) != 0) {
+		IOFree(ctx, sizeof(*ctx));
+		return EINVAL;
+	}
 	k->k_priv = ctx;
 	return 0;
 }
@@ -86,54 +90,106 @@ ieee80211_ccmp_delete_key(struct ieee80211com *ic, struct ieee80211_key *k)
 	k->k_priv = NULL;
 }
 
-/*-
- * Counter with CBC-MAC (CCM) - see RFC3610.
- * CCMP uses the following CCM parameters: M = 8, L = 2
+/*
+ * Return non-zero if the data of every mbuf in the chain may be
+ * modified in place, i.e. no cluster is shared with another mbuf
+ * (e.g. a socket buffer kept for retransmission).
  */
-static void
-ieee80211_ccmp_phase1(AES_CTX *ctx, const struct ieee80211_frame *wh,
-    u_int64_t pn, int lm, u_int8_t b[16], u_int8_t a[16], u_int8_t s0[16])
+int
+ieee80211_crypto_writable(mbuf_t m)
 {
-	u_int8_t auth[32], nonce[13];
-	u_int8_t *aad;
-	u_int8_t tid = 0;
-	int la, i;
+	for (; m != NULL; m = mbuf_next(m)) {
+		if ((mbuf_flags(m) & MBUF_EXT) && mbuf_mclhasreference(m))
+			return 0;
+	}
+	return 1;
+}
 
-	/* construct AAD (additional authenticated data) */
-	aad = &auth[2];	/* skip l(a), will be filled later */
-	*aad = wh->i_fc[0];
+/*
+ * Make sure the chain can be modified in place and its first len bytes
+ * are contiguous.  Shared chains are copied first.  The chain is freed
+ * on failure.
+ */
+mbuf_t
+ieee80211_crypto_prepare(mbuf_t m0, int len)
+{
+	mbuf_t n0;
+
+	if (!ieee80211_crypto_writable(m0)) {
+		if (mbuf_dup(m0, MBUF_DONTWAIT, &n0) != 0) {
+			mbuf_freem(m0);
+			return NULL;
+		}
+		mbuf_freem(m0);
+		m0 = n0;
+	}
+	if (mbuf_len(m0) < len && mbuf_pullup(&m0, len) != 0)
+		return NULL;
+	return m0;
+}
+
+/*
+ * Construct the CCMP/GCMP additional authenticated data for a frame
+ * header.  Returns the AAD length; the frame's TID is stored in *tidp.
+ */
+int
+ieee80211_ccmp_aad(const struct ieee80211_frame *wh, u_int8_t *aad,
+    u_int8_t *tidp)
+{
+	u_int8_t *p = aad;
+
+	*tidp = 0;
+	*p = wh->i_fc[0];
 	/* 11w: conditionally mask subtype field */
 	if ((wh->i_fc[0] & IEEE80211_FC0_TYPE_MASK) ==
 	    IEEE80211_FC0_TYPE_DATA)
-		*aad &= ~IEEE80211_FC0_SUBTYPE_MASK |
+		*p &= ~IEEE80211_FC0_SUBTYPE_MASK |
 		   IEEE80211_FC0_SUBTYPE_QOS;
-	aad++;
+	p++;
 	/* protected bit is already set in wh */
-	*aad = wh->i_fc[1];
-	*aad &= ~(IEEE80211_FC1_RETRY | IEEE80211_FC1_PWR_MGT |
+	*p = wh->i_fc[1];
+	*p &= ~(IEEE80211_FC1_RETRY | IEEE80211_FC1_PWR_MGT |
 	    IEEE80211_FC1_MORE_DATA);
 	/* 11n: conditionally mask order bit */
 	if (ieee80211_has_qos(wh))
-		*aad &= ~IEEE80211_FC1_ORDER;
-	aad++;
-	IEEE80211_ADDR_COPY(aad, wh->i_addr1); aad += IEEE80211_ADDR_LEN;
-	IEEE80211_ADDR_COPY(aad, wh->i_addr2); aad += IEEE80211_ADDR_LEN;
-	IEEE80211_ADDR_COPY(aad, wh->i_addr3); aad += IEEE80211_ADDR_LEN;
-	*aad++ = wh->i_seq[0] & ~0xf0;
-	*aad++ = 0;
+		*p &= ~IEEE80211_FC1_ORDER;
+	p++;
+	IEEE80211_ADDR_COPY(p, wh->i_addr1); p += IEEE80211_ADDR_LEN;
+	IEEE80211_ADDR_COPY(p, wh->i_addr2); p += IEEE80211_ADDR_LEN;
+	IEEE80211_ADDR_COPY(p, wh->i_addr3); p += IEEE80211_ADDR_LEN;
+	*p++ = wh->i_seq[0] & ~0xf0;
+	*p++ = 0;
 	if (ieee80211_has_addr4(wh)) {
-		IEEE80211_ADDR_COPY(aad,
+		IEEE80211_ADDR_COPY(p,
 		    ((const struct ieee80211_frame_addr4 *)wh)->i_addr4);
-		aad += IEEE80211_ADDR_LEN;
+		p += IEEE80211_ADDR_LEN;
 	}
 	if (ieee80211_has_qos(wh)) {
 		/* 
 		 * XXX 802.11-2012 11.4.3.3.3 g says the A-MSDU present bit
 		 * must be set here if both STAs are SPP A-MSDU capable.
 		 */
-		*aad++ = tid = ieee80211_get_qos(wh) & IEEE80211_QOS_TID;
-		*aad++ = 0;
+		*p++ = *tidp = ieee80211_get_qos(wh) & IEEE80211_QOS_TID;
+		*p++ = 0;
 	}
+	return p - aad;
+}
+
+/*-
+ * Counter with CBC-MAC (CCM) - see RFC3610.
+ * CCMP uses the following CCM parameters: M = 8, L = 2
+ */
+static void
+ieee80211_ccmp_phase1(AES_BLK_CTX *ctx, const struct ieee80211_frame *wh,
+    u_int64_t pn, int lm, struct aes_ccm_stream *st, u_int8_t s0[16])
+{
+	u_int8_t auth[32], nonce[13];
+	u_int8_t *b = st->b, *a = st->a;
+	u_int8_t tid;
+	int la;
+
+	/* construct AAD (additional authenticated data) */
+	la = ieee80211_ccmp_aad(wh, &auth[2], &tid);	/* skip l(a) */
 
 	/* construct CCM nonce */
 	nonce[ 0] = tid;
@@ -149,30 +205,128 @@ ieee80211_ccmp_phase1(AES_CTX *ctx, const struct ieee80211_frame *wh,
 	nonce[12] = pn;		/* PN0 */
 
 	/* add 2 authentication blocks (including l(a) and padded AAD) */
-	la = aad - &auth[2];		/* fill l(a) */
-	auth[0] = la >> 8;
+	auth[0] = la >> 8;	/* fill l(a) */
 	auth[1] = la & 0xff;
-	memset(aad, 0, 30 - la);	/* pad AAD with zeros */
+	memset(&auth[2 + la], 0, 30 - la);	/* pad AAD with zeros */
 
 	/* construct first block B_0 */
 	b[ 0] = 89;	/* Flags = 64*Adata + 8*((M-2)/2) + (L-1) */
 	memcpy(&b[1], nonce, 13);
 	b[14] = lm >> 8;
 	b[15] = lm & 0xff;
-	AES_Encrypt(ctx, b, b);
-
-	for (i = 0; i < 16; i++)
-		b[i] ^= auth[i];
-	AES_Encrypt(ctx, b, b);
-	for (i = 0; i < 16; i++)
-		b[i] ^= auth[16 + i];
-	AES_Encrypt(ctx, b, b);
+	AES_Blk_Encrypt(ctx, b, b);
 
-	/* construct S_0 */
+	/* construct A_0 */
 	a[ 0] = 1;	/* Flags = L' = (L-1) */
 	memcpy(&a[1], nonce, 13);
 	a[14] = a[15] = 0;
-	AES_Encrypt(ctx, a, s0);
+
+	/* MAC the AAD; S_0 is computed alongside the last AAD block */
+	for (la = 0; la < 16; la++)
+		b[la] ^= auth[la];
+	AES_Blk_Encrypt(ctx, b, b);
+	for (la = 0; la < 16; la++)
+		b[la] ^= auth[16 + la];
+	AES_Blk_Encrypt2(ctx, b, b, a, s0);
+
+	/* construct S_1 */
+	st->ctr = 1;
+	a[14] = 0;
+	a[15] = 1;
+	AES_Blk_Encrypt(ctx, a, st->s);
+	st->j = 0;
+}
+
+/*
+ * Run the CCM stream over left bytes of the chain starting at offset
+ * off, in place.
+ */
+static void
+ieee80211_ccmp_crypt(AES_BLK_CTX *ctx, struct aes_ccm_stream *st,
+    mbuf_t m, int off, int left, int enc)
+{
+	int len;
+
+	while (m != NULL && left > 0) {
+		if (off >= mbuf_len(m)) {
+			off -= mbuf_len(m);
+			m = mbuf_next(m);
+			continue;
+		}
+		len = min(mbuf_len(m) - off, left);
+		AES_CCM_Update(ctx, st, mtod(m, u_int8_t *) + off, len, enc);
+		left -= len;
+		off = 0;
+		m = mbuf_next(m);
+	}
+}
+
+static void
+ieee80211_ccmp_set_iv(u_int8_t *ivp, struct ieee80211_key *k)
+{
+	ivp[0] = k->k_tsc;		/* PN0 */
+	ivp[1] = k->k_tsc >> 8;		/* PN1 */
+	ivp[2] = 0;			/* Rsvd */
+	ivp[3] = k->k_id << 6 | IEEE80211_WEP_EXTIV;	/* KeyID | ExtIV */
+	ivp[4] = k->k_tsc >> 16;	/* PN2 */
+	ivp[5] = k->k_tsc >> 24;	/* PN3 */
+	ivp[6] = k->k_tsc >> 32;	/* PN4 */
+	ivp[7] = k->k_tsc >> 40;	/* PN5 */
+}
+
+/*
+ * Encrypt in place: the 802.11 header is slid into the first mbuf's
+ * headroom to make room for the CCMP header, the body is encrypted
+ * where it lies and the MIC goes into the last mbuf's tailroom.
+ */
+static mbuf_t
+ieee80211_ccmp_encrypt_inplace(struct ieee80211com *ic, mbuf_t m0,
+    struct ieee80211_key *k, int hdrlen)
+{
+	struct ieee80211_ccmp_ctx *ctx = (struct ieee80211_ccmp_ctx *)k->k_priv;
+	struct aes_ccm_stream st;
+	u_int8_t s0[16];
+	u_int8_t *data, *mic;
+	mbuf_t m, n;
+	int i, left;
+
+	left = mbuf_pkthdr_len(m0) - hdrlen;
+	data = mtod(m0, u_int8_t *) - IEEE80211_CCMP_HDRLEN;
+	mbuf_setdata(m0, data, mbuf_len(m0) + IEEE80211_CCMP_HDRLEN);
+	mbuf_pkthdr_setlen(m0, mbuf_pkthdr_len(m0) + IEEE80211_CCMP_HDRLEN);
+	memmove(data, data + IEEE80211_CCMP_HDRLEN, hdrlen);
+
+	k->k_tsc++;	/* increment the 48-bit PN */
+	ieee80211_ccmp_set_iv(data + hdrlen, k);
+
+	ieee80211_ccmp_phase1(&ctx->aesctx,
+	    (const struct ieee80211_frame *)data, k->k_tsc, left, &st, s0);
+	ieee80211_ccmp_crypt(&ctx->aesctx, &st, m0,
+	    hdrlen + IEEE80211_CCMP_HDRLEN, left, 1);
+	AES_CCM_Final(&ctx->aesctx, &st);
+
+	/* reserve trailing space for MIC */
+	for (m = m0; mbuf_next(m) != NULL; m = mbuf_next(m))
+		;
+	if (mbuf_trailingspace(m) < IEEE80211_CCMP_MICLEN) {
+		n = NULL;
+		mbuf_get(MBUF_DONTWAIT, mbuf_type(m), &n);
+		if (n == NULL) {
+			ic->ic_stats.is_tx_nombuf++;
+			mbuf_freem(m0);
+			return NULL;
+		}
+		mbuf_setlen(n, 0);
+		mbuf_setnext(m, n);
+		m = n;
+	}
+	/* finalize MIC, U := T XOR first-M-bytes( S_0 ) */
+	mic = mtod(m, u_int8_t *) + mbuf_len(m);
+	for (i = 0; i < IEEE80211_CCMP_MICLEN; i++)
+		mic[i] = st.b[i] ^ s0[i];
+	mbuf_setlen(m, mbuf_len(m) + IEEE80211_CCMP_MICLEN);
+	mbuf_pkthdr_setlen(m0, mbuf_pkthdr_len(m0) + IEEE80211_CCMP_MICLEN);
+	return m0;
 }
 
 mbuf_t
@@ -183,15 +337,21 @@ ieee80211_ccmp_encrypt(struct ieee80211com *ic, mbuf_t m0,
 	const struct ieee80211_frame *wh;
 	const u_int8_t *src;
 	u_int8_t *ivp, *mic, *dst;
-	u_int8_t a[16], b[16], s0[16], s[16];
+	u_int8_t s0[16];
+	struct aes_ccm_stream st;
 	mbuf_t n0, m, n;
 	int hdrlen, left, moff, noff, len;
-	u_int16_t ctr;
-	int i, j;
-    mbuf_t temp;
-    unsigned int max_chunks = 1;
+	int i;
+	mbuf_t temp;
+
+	wh = mtod(m0, struct ieee80211_frame *);
+	hdrlen = ieee80211_get_hdrlen(wh);
+	if (mbuf_len(m0) >= hdrlen &&
+	    mbuf_leadingspace(m0) >= IEEE80211_CCMP_HDRLEN &&
+	    ieee80211_crypto_writable(m0))
+		return ieee80211_ccmp_encrypt_inplace(ic, m0, k, hdrlen);
 
-    mbuf_get(MBUF_DONTWAIT, mbuf_type(m0), &n0);
+	mbuf_get(MBUF_DONTWAIT, mbuf_type(m0), &n0);
 	if (n0 == NULL)
 		goto nospace;
 	if (m_dup_pkthdr(n0, m0, MBUF_DONTWAIT))
@@ -207,35 +367,19 @@ ieee80211_ccmp_encrypt(struct ieee80211com *ic, mbuf_t m0,
         mbuf_setlen(n0, mbuf_pkthdr_len(n0));
 
 	/* copy 802.11 header */
-	wh = mtod(m0, struct ieee80211_frame *);
-	hdrlen = ieee80211_get_hdrlen(wh);
 	memcpy(mtod(n0, caddr_t), wh, hdrlen);
 
 	k->k_tsc++;	/* increment the 48-bit PN */
 
 	/* construct CCMP header */
 	ivp = mtod(n0, u_int8_t *) + hdrlen;
-	ivp[0] = k->k_tsc;		/* PN0 */
-	ivp[1] = k->k_tsc >> 8;		/* PN1 */
-	ivp[2] = 0;			/* Rsvd */
-	ivp[3] = k->k_id << 6 | IEEE80211_WEP_EXTIV;	/* KeyID | ExtIV */
-	ivp[4] = k->k_tsc >> 16;	/* PN2 */
-	ivp[5] = k->k_tsc >> 24;	/* PN3 */
-	ivp[6] = k->k_tsc >> 32;	/* PN4 */
-	ivp[7] = k->k_tsc >> 40;	/* PN5 */
+	ieee80211_ccmp_set_iv(ivp, k);
 
-	/* construct initial B, A and S_0 blocks */
+	/* construct initial B, A, S_0 and S_1 blocks */
 	ieee80211_ccmp_phase1(&ctx->aesctx, wh, k->k_tsc,
-	    mbuf_pkthdr_len(m0) - hdrlen, b, a, s0);
-
-	/* construct S_1 */
-	ctr = 1;
-	a[14] = ctr >> 8;
-	a[15] = ctr & 0xff;
-	AES_Encrypt(&ctx->aesctx, a, s);
+	    mbuf_pkthdr_len(m0) - hdrlen, &st, s0);
 
 	/* encrypt frame body and compute MIC */
-	j = 0;
 	m = m0;
 	n = n0;
 	moff = hdrlen;
@@ -269,29 +413,14 @@ ieee80211_ccmp_encrypt(struct ieee80211com *ic, mbuf_t m0,
 
 		src = mtod(m, u_int8_t *) + moff;
 		dst = mtod(n, u_int8_t *) + noff;
-		for (i = 0; i < len; i++) {
-			/* update MIC with clear text */
-			b[j] ^= src[i];
-			/* encrypt message */
-			dst[i] = src[i] ^ s[j];
-			if (++j < 16)
-				continue;
-			/* we have a full block, encrypt MIC */
-			AES_Encrypt(&ctx->aesctx, b, b);
-			/* construct a new S_ctr block */
-			ctr++;
-			a[14] = ctr >> 8;
-			a[15] = ctr & 0xff;
-			AES_Encrypt(&ctx->aesctx, a, s);
-			j = 0;
-		}
+		memcpy(dst, src, len);
+		AES_CCM_Update(&ctx->aesctx, &st, dst, len, 1);
 
 		moff += len;
 		noff += len;
 		left -= len;
 	}
-	if (j != 0)	/* partial block, encrypt MIC */
-		AES_Encrypt(&ctx->aesctx, b, b);
+	AES_CCM_Final(&ctx->aesctx, &st);
 
 	/* reserve trailing space for MIC */
 	if (mbuf_trailingspace(n) < IEEE80211_CCMP_MICLEN) {
@@ -306,7 +435,7 @@ ieee80211_ccmp_encrypt(struct ieee80211com *ic, mbuf_t m0,
 	/* finalize MIC, U := T XOR first-M-bytes( S_0 ) */
 	mic = mtod(n, u_int8_t *) + mbuf_len(n);
 	for (i = 0; i < IEEE80211_CCMP_MICLEN; i++)
-		mic[i] = b[i] ^ s0[i];
+		mic[i] = st.b[i] ^ s0[i];
     mbuf_setlen(n, mbuf_len(n) + IEEE80211_CCMP_MICLEN);
     mbuf_pkthdr_setlen(n0, mbuf_pkthdr_len(n0) + IEEE80211_CCMP_MICLEN);
 
@@ -358,23 +487,63 @@ ieee80211_ccmp_get_pn(uint64_t *pn, uint64_t **prsc, mbuf_t m,
    return 0;
 }
 
+/*
+ * Decrypt in place, then drop the CCMP header by sliding the 802.11
+ * header over it and trim the MIC.
+ */
+static mbuf_t
+ieee80211_ccmp_decrypt_inplace(struct ieee80211com *ic, mbuf_t m0,
+    struct ieee80211_key *k, int hdrlen, u_int64_t pn, u_int64_t *prsc)
+{
+	struct ieee80211_ccmp_ctx *ctx = (struct ieee80211_ccmp_ctx *)k->k_priv;
+	struct ieee80211_frame *wh;
+	struct aes_ccm_stream st;
+	u_int8_t mic0[IEEE80211_CCMP_MICLEN];
+	u_int8_t s0[16];
+	u_int8_t *data;
+	int i, left;
+
+	wh = mtod(m0, struct ieee80211_frame *);
+	left = mbuf_pkthdr_len(m0) - hdrlen - IEEE80211_CCMP_HDRLEN -
+	    IEEE80211_CCMP_MICLEN;
+
+	ieee80211_ccmp_phase1(&ctx->aesctx, wh, pn, left, &st, s0);
+	ieee80211_ccmp_crypt(&ctx->aesctx, &st, m0,
+	    hdrlen + IEEE80211_CCMP_HDRLEN, left, 0);
+	AES_CCM_Final(&ctx->aesctx, &st);
+
+	/* finalize MIC, U := T XOR first-M-bytes( S_0 ) */
+	for (i = 0; i < IEEE80211_CCMP_MICLEN; i++)
+		st.b[i] ^= s0[i];
+
+	/* check that it matches the MIC in received frame */
+	mbuf_copydata(m0, hdrlen + IEEE80211_CCMP_HDRLEN + left,
+	    IEEE80211_CCMP_MICLEN, mic0);
+	if (timingsafe_bcmp(mic0, st.b, IEEE80211_CCMP_MICLEN) != 0) {
+		ic->ic_stats.is_ccmp_dec_errs++;
+		mbuf_freem(m0);
+		return NULL;
+	}
+
+	/* update last seen packet number (MIC is validated) */
+	*prsc = pn;
+
+	/* clear protected bit and strip CCMP header and MIC */
+	wh->i_fc[1] &= ~IEEE80211_FC1_PROTECTED;
+	data = mtod(m0, u_int8_t *);
+	memmove(data + IEEE80211_CCMP_HDRLEN, data, hdrlen);
+	mbuf_adj(m0, IEEE80211_CCMP_HDRLEN);
+	mbuf_adj(m0, -IEEE80211_CCMP_MICLEN);
+	return m0;
+}
+
 mbuf_t
 ieee80211_ccmp_decrypt(struct ieee80211com *ic, mbuf_t m0,
     struct ieee80211_key *k)
 {
-	struct ieee80211_ccmp_ctx *ctx = (struct ieee80211_ccmp_ctx *)k->k_priv;
 	struct ieee80211_frame *wh;
 	u_int64_t pn, *prsc;
-    const u_int8_t *src;
-	u_int8_t *dst;
-	u_int8_t mic0[IEEE80211_CCMP_MICLEN];
-	u_int8_t a[16], b[16], s0[16], s[16];
-	mbuf_t n0, m, n;
-	int hdrlen, left, moff, noff, len;
-	u_int16_t ctr;
-	int i, j;
-    mbuf_t temp;
-    unsigned int max_chunks = 1;
+	int hdrlen;
 
 	wh = mtod(m0, struct ieee80211_frame *);
     hdrlen = ieee80211_get_hdrlen(wh);
@@ -383,7 +552,18 @@ ieee80211_ccmp_decrypt(struct ieee80211com *ic, mbuf_t m0,
         mbuf_freem(m0);
         return NULL;
     }
-    
+
+	/*
+	 * Group-addressed frames and frames the hardware did not decrypt
+	 * all end up here; decrypt them where they lie.  Only a shared or
+	 * fragmented header forces a copy.
+	 */
+	if ((m0 = ieee80211_crypto_prepare(m0,
+	    hdrlen + IEEE80211_CCMP_HDRLEN)) == NULL) {
+		ic->ic_stats.is_rx_nombuf++;
+		return NULL;
+	}
+
     /*
      * Get the frame's Packet Number (PN) and a pointer to our last-seen
      * Receive Sequence Counter (RSC) which we can use to detect replays.
@@ -400,117 +580,5 @@ ieee80211_ccmp_decrypt(struct ieee80211com *ic, mbuf_t m0,
 		return NULL;
 	}
 
-    mbuf_get(MBUF_DONTWAIT, mbuf_type(m0), &n0);
-	if (n0 == NULL)
-		goto nospace;
-	if (m_dup_pkthdr(n0, m0, MBUF_DONTWAIT))
-		goto nospace;
-    
-    mbuf_pkthdr_setlen(n0, mbuf_pkthdr_len(n0) - (IEEE80211_CCMP_HDRLEN + IEEE80211_CCMP_MICLEN));
-    mbuf_setlen(n0, mbuf_get_mhlen());
-	if (mbuf_pkthdr_len(n0) >= mbuf_get_minclsize()) {
-        mbuf_mclget(MBUF_DONTWAIT, mbuf_type(n0), &n0);
-		if (mbuf_flags(n0) & MBUF_EXT)
-            mbuf_setlen(n0, MCLBYTES);
-	}
-	if (mbuf_len(n0) > mbuf_pkthdr_len(n0))
-        mbuf_setlen(n0, mbuf_pkthdr_len(n0));
-
-	/* construct initial B, A and S_0 blocks */
-	ieee80211_ccmp_phase1(&ctx->aesctx, wh, pn,
-	    mbuf_pkthdr_len(n0) - hdrlen, b, a, s0);
-
-	/* copy 802.11 header and clear protected bit */
-	memcpy(mtod(n0, caddr_t), wh, hdrlen);
-	wh = mtod(n0, struct ieee80211_frame *);
-	wh->i_fc[1] &= ~IEEE80211_FC1_PROTECTED;
-
-	/* construct S_1 */
-	ctr = 1;
-	a[14] = ctr >> 8;
-	a[15] = ctr & 0xff;
-	AES_Encrypt(&ctx->aesctx, a, s);
-
-	/* decrypt frame body and compute MIC */
-	j = 0;
-	m = m0;
-	n = n0;
-	moff = hdrlen + IEEE80211_CCMP_HDRLEN;
-	noff = hdrlen;
-	left = mbuf_pkthdr_len(n0) - noff;
-	while (left > 0) {
-		if (moff == mbuf_len(m)) {
-			/* nothing left to copy from m */
-			m = mbuf_next(m);
-			moff = 0;
-		}
-		if (noff == mbuf_len(n)) {
-			/* n is full and there's more data to copy */
-            temp = NULL;
-            mbuf_get(MBUF_DONTWAIT, mbuf_type(n), &temp);
-			if (temp == NULL)
-				goto nospace;
-            mbuf_setnext(n, temp);
-			n = mbuf_next(n);
-            mbuf_setlen(n, mbuf_get_mlen());
-			if (left >= mbuf_get_minclsize()) {
-                mbuf_mclget(MBUF_DONTWAIT, mbuf_type(n), &n);
-				if (mbuf_flags(n) & MBUF_EXT)
-                    mbuf_setlen(n, MCLBYTES);
-			}
-			if (mbuf_len(n) > left)
-                mbuf_setlen(n, left);
-			noff = 0;
-		}
-		len = min(mbuf_len(m) - moff, mbuf_len(n) - noff);
-
-		src = mtod(m, u_int8_t *) + moff;
-		dst = mtod(n, u_int8_t *) + noff;
-		for (i = 0; i < len; i++) {
-			/* decrypt message */
-			dst[i] = src[i] ^ s[j];
-			/* update MIC with clear text */
-			b[j] ^= dst[i];
-			if (++j < 16)
-				continue;
-			/* we have a full block, encrypt MIC */
-			AES_Encrypt(&ctx->aesctx, b, b);
-			/* construct a new S_ctr block */
-			ctr++;
-			a[14] = ctr >> 8;
-			a[15] = ctr & 0xff;
-			AES_Encrypt(&ctx->aesctx, a, s);
-			j = 0;
-		}
-
-		moff += len;
-		noff += len;
-		left -= len;
-	}
-	if (j != 0)	/* partial block, encrypt MIC */
-		AES_Encrypt(&ctx->aesctx, b, b);
-
-	/* finalize MIC, U := T XOR first-M-bytes( S_0 ) */
-	for (i = 0; i < IEEE80211_CCMP_MICLEN; i++)
-		b[i] ^= s0[i];
-
-	/* check that it matches the MIC in received frame */
-	mbuf_copydata(m, moff, IEEE80211_CCMP_MICLEN, mic0);
-	if (timingsafe_bcmp(mic0, b, IEEE80211_CCMP_MICLEN) != 0) {
-		ic->ic_stats.is_ccmp_dec_errs++;
-		mbuf_freem(m0);
-		mbuf_freem(n0);
-		return NULL;
-	}
-
-	/* update last seen packet number (MIC is validated) */
-	*prsc = pn;
-
-	mbuf_freem(m0);
-	return n0;
- nospace:
-	ic->ic_stats.is_rx_nombuf++;
-	mbuf_freem(m0);
-	mbuf_freem(n0);
-	return NULL;
+	return ieee80211_ccmp_decrypt_inplace(ic, m0, k, hdrlen, pn, prsc);
 }
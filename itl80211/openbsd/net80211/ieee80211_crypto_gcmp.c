@@ -0,0 +1,252 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This code implements the Galois/Counter Mode Protocol (GCMP) defined
+ * in IEEE Std 802.11-2016 section 12.5.5.  The GCMP header has the same
+ * layout as the CCMP header, the AAD is built the same way and the
+ * nonce is A2 || PN.  The MIC is 16 bytes for both key sizes.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/mbuf.h>
+#include <sys/malloc.h>
+#include <sys/kernel.h>
+#include <sys/socket.h>
+#include <sys/endian.h>
+
+#include <net/if.h>
+#include <net/if_dl.h>
+#include <net/if_media.h>
+
+#include <netinet/in.h>
+#include <netinet/if_ether.h>
+
+#include <net80211/ieee80211_var.h>
+#include <net80211/ieee80211_crypto.h>
+
+#include <crypto/aes.h>
+#include <crypto/aes_blk.h>
+
+/* GCMP software crypto context */
+struct ieee80211_gcmp_ctx {
+	AES_BLK_CTX	aesctx;
+};
+
+int
+ieee80211_gcmp_set_key(struct ieee80211com *ic, struct ieee80211_key *k)
+{
+	struct ieee80211_gcmp_ctx *ctx;
+
+	ctx = (struct ieee80211_gcmp_ctx *)_MallocZero(sizeof(*ctx));
+	if (ctx == NULL)
+		return ENOMEM;
+	if (AES_Blk_Setkey(&ctx->aesctx, k->k_key,
+	    ieee80211_cipher_keylen(k->k_cipher)) != 0) {
+		IOFree(ctx, sizeof(*ctx));
+		return EINVAL;
+	}
+	k->k_priv = ctx;
+	return 0;
+}
+
+void
+ieee80211_gcmp_delete_key(struct ieee80211com *ic, struct ieee80211_key *k)
+{
+	if (k->k_priv != NULL) {
+		explicit_bzero(k->k_priv, sizeof(struct ieee80211_gcmp_ctx));
+		IOFree(k->k_priv, sizeof(struct ieee80211_gcmp_ctx));
+	}
+	k->k_priv = NULL;
+}
+
+static void
+ieee80211_gcmp_phase1(AES_BLK_CTX *ctx, const struct ieee80211_frame *wh,
+    u_int64_t pn, struct aes_gcm_stream *st)
+{
+	u_int8_t aad[30], nonce[12];
+	u_int8_t tid;
+	int la;
+
+	la = ieee80211_ccmp_aad(wh, aad, &tid);
+
+	IEEE80211_ADDR_COPY(&nonce[0], wh->i_addr2);
+	nonce[ 6] = pn >> 40;	/* PN5 */
+	nonce[ 7] = pn >> 32;	/* PN4 */
+	nonce[ 8] = pn >> 24;	/* PN3 */
+	nonce[ 9] = pn >> 16;	/* PN2 */
+	nonce[10] = pn >> 8;	/* PN1 */
+	nonce[11] = pn;		/* PN0 */
+
+	AES_GCM_Init(ctx, st, nonce, aad, la);
+}
+
+/*
+ * Run the GCM stream over left bytes of the chain starting at offset
+ * off, in place.
+ */
+static void
+ieee80211_gcmp_crypt(AES_BLK_CTX *ctx, struct aes_gcm_stream *st,
+    mbuf_t m, int off, int left, int enc)
+{
+	int len;
+
+	while (m != NULL && left > 0) {
+		if (off >= mbuf_len(m)) {
+			off -= mbuf_len(m);
+			m = mbuf_next(m);
+			continue;
+		}
+		len = min(mbuf_len(m) - off, left);
+		AES_GCM_Update(ctx, st, mtod(m, u_int8_t *) + off, len, enc);
+		left -= len;
+		off = 0;
+		m = mbuf_next(m);
+	}
+}
+
+mbuf_t
+ieee80211_gcmp_encrypt(struct ieee80211com *ic, mbuf_t m0,
+    struct ieee80211_key *k)
+{
+	struct ieee80211_gcmp_ctx *ctx = (struct ieee80211_gcmp_ctx *)k->k_priv;
+	struct aes_gcm_stream st;
+	u_int8_t *data, *ivp;
+	mbuf_t m, n;
+	int hdrlen, left;
+
+	hdrlen = ieee80211_get_hdrlen(mtod(m0, struct ieee80211_frame *));
+	left = mbuf_pkthdr_len(m0) - hdrlen;
+
+	/* make room for the GCMP header in front of the 802.11 header */
+	if ((m0 = ieee80211_crypto_prepare(m0, hdrlen)) == NULL)
+		goto nospace;
+	if (mbuf_prepend(&m0, IEEE80211_GCMP_HDRLEN, MBUF_DONTWAIT) != 0)
+		goto nospace;
+	if (mbuf_len(m0) < hdrlen + IEEE80211_GCMP_HDRLEN &&
+	    mbuf_pullup(&m0, hdrlen + IEEE80211_GCMP_HDRLEN) != 0)
+		goto nospace;
+	data = mtod(m0, u_int8_t *);
+	memmove(data, data + IEEE80211_GCMP_HDRLEN, hdrlen);
+
+	k->k_tsc++;	/* increment the 48-bit PN */
+
+	/* construct GCMP header */
+	ivp = data + hdrlen;
+	ivp[0] = k->k_tsc;		/* PN0 */
+	ivp[1] = k->k_tsc >> 8;		/* PN1 */
+	ivp[2] = 0;			/* Rsvd */
+	ivp[3] = k->k_id << 6 | IEEE80211_WEP_EXTIV;	/* KeyID | ExtIV */
+	ivp[4] = k->k_tsc >> 16;	/* PN2 */
+	ivp[5] = k->k_tsc >> 24;	/* PN3 */
+	ivp[6] = k->k_tsc >> 32;	/* PN4 */
+	ivp[7] = k->k_tsc >> 40;	/* PN5 */
+
+	ieee80211_gcmp_phase1(&ctx->aesctx,
+	    (const struct ieee80211_frame *)data, k->k_tsc, &st);
+	ieee80211_gcmp_crypt(&ctx->aesctx, &st, m0,
+	    hdrlen + IEEE80211_GCMP_HDRLEN, left, 1);
+
+	/* reserve trailing space for MIC */
+	for (m = m0; mbuf_next(m) != NULL; m = mbuf_next(m))
+		;
+	if (mbuf_trailingspace(m) < IEEE80211_GCMP_MICLEN) {
+		n = NULL;
+		mbuf_get(MBUF_DONTWAIT, mbuf_type(m), &n);
+		if (n == NULL)
+			goto nospace;
+		mbuf_setlen(n, 0);
+		mbuf_setnext(m, n);
+		m = n;
+	}
+	AES_GCM_Final(&ctx->aesctx, &st, mtod(m, u_int8_t *) + mbuf_len(m));
+	mbuf_setlen(m, mbuf_len(m) + IEEE80211_GCMP_MICLEN);
+	mbuf_pkthdr_setlen(m0, mbuf_pkthdr_len(m0) + IEEE80211_GCMP_MICLEN);
+	return m0;
+ nospace:
+	ic->ic_stats.is_tx_nombuf++;
+	if (m0 != NULL)
+		mbuf_freem(m0);
+	return NULL;
+}
+
+mbuf_t
+ieee80211_gcmp_decrypt(struct ieee80211com *ic, mbuf_t m0,
+    struct ieee80211_key *k)
+{
+	struct ieee80211_gcmp_ctx *ctx = (struct ieee80211_gcmp_ctx *)k->k_priv;
+	struct ieee80211_frame *wh;
+	struct aes_gcm_stream st;
+	u_int8_t mic0[IEEE80211_GCMP_MICLEN], mic[IEEE80211_GCMP_MICLEN];
+	u_int64_t pn, *prsc;
+	u_int8_t *data;
+	int hdrlen, left;
+
+	wh = mtod(m0, struct ieee80211_frame *);
+	hdrlen = ieee80211_get_hdrlen(wh);
+	if (mbuf_pkthdr_len(m0) < hdrlen + IEEE80211_GCMP_HDRLEN +
+	    IEEE80211_GCMP_MICLEN) {
+		mbuf_freem(m0);
+		return NULL;
+	}
+
+	/* the header and GCMP header must be contiguous and writable */
+	if ((m0 = ieee80211_crypto_prepare(m0,
+	    hdrlen + IEEE80211_GCMP_HDRLEN)) == NULL) {
+		ic->ic_stats.is_rx_nombuf++;
+		return NULL;
+	}
+	wh = mtod(m0, struct ieee80211_frame *);
+
+	/* the GCMP header has the same layout as the CCMP header */
+	if (ieee80211_ccmp_get_pn(&pn, &prsc, m0, k) != 0) {
+		mbuf_freem(m0);
+		return NULL;
+	}
+	if (pn <= *prsc) {
+		/* replayed frame, discard */
+		ic->ic_stats.is_ccmp_replays++;
+		mbuf_freem(m0);
+		return NULL;
+	}
+
+	left = mbuf_pkthdr_len(m0) - hdrlen - IEEE80211_GCMP_HDRLEN -
+	    IEEE80211_GCMP_MICLEN;
+
+	ieee80211_gcmp_phase1(&ctx->aesctx, wh, pn, &st);
+	ieee80211_gcmp_crypt(&ctx->aesctx, &st, m0,
+	    hdrlen + IEEE80211_GCMP_HDRLEN, left, 0);
+	AES_GCM_Final(&ctx->aesctx, &st, mic);
+
+	/* check that it matches the MIC in received frame */
+	mbuf_copydata(m0, hdrlen + IEEE80211_GCMP_HDRLEN + left,
+	    IEEE80211_GCMP_MICLEN, mic0);
+	if (timingsafe_bcmp(mic0, mic, IEEE80211_GCMP_MICLEN) != 0) {
+		ic->ic_stats.is_ccmp_dec_errs++;
+		mbuf_freem(m0);
+		return NULL;
+	}
+
+	/* update last seen packet number (MIC is validated) */
+	*prsc = pn;
+
+	/* clear protected bit and strip GCMP header and MIC */
+	wh->i_fc[1] &= ~IEEE80211_FC1_PROTECTED;
+	data = mtod(m0, u_int8_t *);
+	memmove(data + IEEE80211_GCMP_HDRLEN, data, hdrlen);
+	mbuf_adj(m0, IEEE80211_GCMP_HDRLEN);
+	mbuf_adj(m0, -IEEE80211_GCMP_MICLEN);
+	return m0;
+}
@@ -819,6 +819,84 @@ ieee80211_defrag_timeout(void *arg)
     splx(s);
 }
 
+#define BA_SLOT_ISSET(ba, i)	((ba)->ba_bitmap[(i) >> 6] & (1ULL << ((i) & 63)))
+#define BA_SLOT_SET(ba, i)	((ba)->ba_bitmap[(i) >> 6] |= (1ULL << ((i) & 63)))
+#define BA_SLOT_CLR(ba, i)	((ba)->ba_bitmap[(i) >> 6] &= ~(1ULL << ((i) & 63)))
+
+/*
+ * Return the number of consecutive reordering buffer slots, starting at
+ * the head of the window and at most max, which are all occupied (set)
+ * or all empty (!set).  Works a bitmap word at a time.
+ */
+static int
+ieee80211_ba_run(const struct ieee80211_rx_ba *ba, int set, int max)
+{
+    int pos = ba->ba_head, n = 0, bit, k;
+    uint64_t w;
+
+    while (n < max) {
+        w = ba->ba_bitmap[pos >> 6];
+        if (!set)
+            w = ~w;
+        bit = pos & 63;
+        w = ~(w >> bit);    /* lowest set bit ends the run */
+        k = (w == 0) ? 64 : __builtin_ctzll(w);
+        n += k;
+        if (bit + k < 64)
+            break;
+        pos = (pos + k) & (ba->ba_bufsz - 1);
+    }
+    return MIN(n, max);
+}
+
+/* Pass the frame at the head of the window up, if any, and slide by one. */
+static inline void
+ieee80211_ba_pop(struct ieee80211com *ic, struct ieee80211_node *ni,
+                 struct ieee80211_rx_ba *ba, struct mbuf_list *ml)
+{
+    struct ieee80211_ba_buf *buf = &ba->ba_buf[ba->ba_head];
+
+    if (BA_SLOT_ISSET(ba, ba->ba_head)) {
+        ieee80211_inputm(&ic->ic_if, buf->m, ni, &buf->rxi, ml);
+        buf->m = NULL;
+        BA_SLOT_CLR(ba, ba->ba_head);
+        ba->ba_gapwait--;
+    }
+    ba->ba_head = (ba->ba_head + 1) & (ba->ba_bufsz - 1);
+    ba->ba_winstart = (ba->ba_winstart + 1) & 0xfff;
+}
+
+/* Slide the window over n empty slots. */
+static inline void
+ieee80211_ba_skip(struct ieee80211_rx_ba *ba, int n)
+{
+    ba->ba_head = (ba->ba_head + n) & (ba->ba_bufsz - 1);
+    ba->ba_winstart = (ba->ba_winstart + n) & 0xfff;
+}
+
+/*
+ * Slide the window by count slots, passing up the frames found there.
+ * Returns the number of empty slots, i.e. frames lost.
+ */
+static int
+ieee80211_ba_advance(struct ieee80211com *ic, struct ieee80211_node *ni,
+                     struct ieee80211_rx_ba *ba, int count, struct mbuf_list *ml)
+{
+    int n, lost = 0;
+
+    while (count > 0) {
+        n = ieee80211_ba_run(ba, 0, count);
+        ieee80211_ba_skip(ba, n);
+        lost += n;
+        count -= n;
+        n = ieee80211_ba_run(ba, 1, count);
+        count -= n;
+        while (n-- > 0)
+            ieee80211_ba_pop(ic, ni, ba, ml);
+    }
+    return lost;
+}
+
 /*
  * Process a received data MPDU related to a specific HT-immediate Block Ack
  * agreement (see 9.10.7.6).
@@ -837,9 +915,9 @@ ieee80211_input_ba(struct ieee80211com *ic, mbuf_t m,
     wh = mtod(m, struct ieee80211_frame *);
     sn = letoh16(*(u_int16_t *)wh->i_seq) >> IEEE80211_SEQ_SEQ_SHIFT;
     
-    /* reset Block Ack inactivity timer */
+    /* push back the Block Ack inactivity deadline */
     if (ba->ba_timeout_val != 0)
-        timeout_add_usec(&ba->ba_to, ba->ba_timeout_val);
+        ba->ba_lastact = nsecuptime();
     
     if (SEQ_LT(sn, ba->ba_winstart)) {	/* SN < WinStartB */
         ic->ic_stats.is_ht_rx_frame_below_ba_winstart++;
@@ -889,21 +967,22 @@ ieee80211_input_ba(struct ieee80211com *ic, mbuf_t m,
     ba->ba_winmiss = 0;
     ba->ba_missedsn = 0;
     idx = (sn - ba->ba_winstart) & 0xfff;
-    idx = (ba->ba_head + idx) % IEEE80211_BA_MAX_WINSZ;
+    idx = (ba->ba_head + idx) & (ba->ba_bufsz - 1);
     /* store the received MPDU in the buffer */
-    if (ba->ba_buf[idx].m != NULL) {
+    if (BA_SLOT_ISSET(ba, idx)) {
         ifp->netStat->inputErrors++;
         ic->ic_stats.is_ht_rx_ba_no_buf++;
         mbuf_freem(m);
         return;
     }
     ba->ba_buf[idx].m = m;
+    BA_SLOT_SET(ba, idx);
     /* store Rx meta-data too */
     rxi->rxi_flags |= IEEE80211_RXI_AMPDU_DONE;
     ba->ba_buf[idx].rxi = *rxi;
     ba->ba_gapwait++;
 
-    if (ba->ba_buf[ba->ba_head].m == NULL && ba->ba_gapwait == 1)
+    if (!BA_SLOT_ISSET(ba, ba->ba_head) && ba->ba_gapwait == 1)
         timeout_add_msec(&ba->ba_gap_to, IEEE80211_BA_GAP_TIMEOUT);
     
     ieee80211_input_ba_flush(ic, ni, ba, ml);
@@ -917,32 +996,18 @@ void
 ieee80211_input_ba_seq(struct ieee80211com *ic, struct ieee80211_node *ni,
                        uint8_t tid, uint16_t max_seq, struct mbuf_list *ml)
 {
-    struct _ifnet *ifp = &ic->ic_if;
     struct ieee80211_rx_ba *ba = &ni->ni_rx_ba[tid];
-    struct ieee80211_frame *wh;
-    uint16_t seq;
-    int i = 0;
-    
-    while (i++ < ba->ba_winsize) {
-        /* gaps may exist */
-        if (ba->ba_buf[ba->ba_head].m != NULL) {
-            wh = mtod(ba->ba_buf[ba->ba_head].m,
-                      struct ieee80211_frame *);
-            _KASSERT(ieee80211_has_seq(wh));
-            seq = letoh16(*(u_int16_t *)wh->i_seq) >>
-            IEEE80211_SEQ_SEQ_SHIFT;
-            if (!SEQ_LT(seq, max_seq))
-                break;
-            ieee80211_inputm(ifp, ba->ba_buf[ba->ba_head].m,
-                             ni, &ba->ba_buf[ba->ba_head].rxi, ml);
-            ba->ba_buf[ba->ba_head].m = NULL;
-            ba->ba_gapwait--;
-        } else
-            ic->ic_stats.is_ht_rx_ba_frame_lost++;
-        ba->ba_head = (ba->ba_head + 1) % IEEE80211_BA_MAX_WINSZ;
-        /* move window forward */
-        ba->ba_winstart = (ba->ba_winstart + 1) & 0xfff;
-    }
+    int count, lost;
+
+    /* slot i of the window holds sequence number WinStartB + i */
+    count = (max_seq - ba->ba_winstart) & 0xfff;
+    if (count > ba->ba_winsize)
+        count = ba->ba_winsize;
+    lost = ieee80211_ba_advance(ic, ni, ba, count, ml);
+    /* gaps may exist beyond max_seq, skip up to the next stored frame */
+    count = ieee80211_ba_run(ba, 0, ba->ba_winsize - count);
+    ieee80211_ba_skip(ba, count);
+    ic->ic_stats.is_ht_rx_ba_frame_lost += lost + count;
     ba->ba_winend = (ba->ba_winstart + ba->ba_winsize - 1) & 0xfff;
 }
 
@@ -952,23 +1017,16 @@ ieee80211_input_ba_flush(struct ieee80211com *ic, struct ieee80211_node *ni,
                          struct ieee80211_rx_ba *ba, struct mbuf_list *ml)
 
 {
-    struct _ifnet *ifp = &ic->ic_if;
+    int n;
     
     /* Do not re-arm the gap timeout if we made no progress. */
-    if (ba->ba_buf[ba->ba_head].m == NULL)
+    n = ieee80211_ba_run(ba, 1, ba->ba_winsize);
+    if (n == 0)
         return;
     
     /* pass reordered MPDUs up to the next MAC process */
-    while (ba->ba_buf[ba->ba_head].m != NULL) {
-        ieee80211_inputm(ifp, ba->ba_buf[ba->ba_head].m, ni,
-                         &ba->ba_buf[ba->ba_head].rxi, ml);
-        ba->ba_buf[ba->ba_head].m = NULL;
-        ba->ba_gapwait--;
-        
-        ba->ba_head = (ba->ba_head + 1) % IEEE80211_BA_MAX_WINSZ;
-        /* move window forward */
-        ba->ba_winstart = (ba->ba_winstart + 1) & 0xfff;
-    }
+    while (n-- > 0)
+        ieee80211_ba_pop(ic, ni, ba, ml);
     ba->ba_winend = (ba->ba_winstart + ba->ba_winsize - 1) & 0xfff;
     
     if (timeout_pending(&ba->ba_gap_to))
@@ -986,14 +1044,11 @@ ieee80211_input_ba_flush(struct ieee80211com *ic, struct ieee80211_node *ni,
 int
 ieee80211_input_ba_gap_skip(struct ieee80211_rx_ba *ba)
 {
-    int skipped = 0;
+    int skipped;
 
-    while (skipped < ba->ba_winsize && ba->ba_buf[ba->ba_head].m == NULL) {
-        /* move window forward */
-        ba->ba_head = (ba->ba_head + 1) % IEEE80211_BA_MAX_WINSZ;
-        ba->ba_winstart = (ba->ba_winstart + 1) & 0xfff;
-        skipped++;
-    }
+    /* move window forward */
+    skipped = ieee80211_ba_run(ba, 0, ba->ba_winsize);
+    ieee80211_ba_skip(ba, skipped);
     if (skipped > 0)
         ba->ba_winend = (ba->ba_winstart + ba->ba_winsize - 1) & 0xfff;
 
@@ -1032,7 +1087,6 @@ void
 ieee80211_ba_move_window(struct ieee80211com *ic, struct ieee80211_node *ni,
                          u_int8_t tid, u_int16_t ssn, struct mbuf_list *ml)
 {
-    struct _ifnet *ifp = &ic->ic_if;
     struct ieee80211_rx_ba *ba = &ni->ni_rx_ba[tid];
     int count;
     
@@ -1041,17 +1095,9 @@ ieee80211_ba_move_window(struct ieee80211com *ic, struct ieee80211_node *ni,
     count = (ssn - ba->ba_winstart) & 0xfff;
     if (count > ba->ba_winsize)    /* no overlap */
         count = ba->ba_winsize;
-    while (count-- > 0) {
-        /* gaps may exist */
-        if (ba->ba_buf[ba->ba_head].m != NULL) {
-            ieee80211_inputm(ifp, ba->ba_buf[ba->ba_head].m, ni,
-                             &ba->ba_buf[ba->ba_head].rxi, ml);
-            ba->ba_buf[ba->ba_head].m = NULL;
-            ba->ba_gapwait--;
-        } else
-            ic->ic_stats.is_ht_rx_ba_frame_lost++;
-        ba->ba_head = (ba->ba_head + 1) % IEEE80211_BA_MAX_WINSZ;
-    }
+    /* gaps may exist */
+    ic->ic_stats.is_ht_rx_ba_frame_lost +=
+        ieee80211_ba_advance(ic, ni, ba, count, ml);
     /* move window forward */
     ba->ba_winstart = ssn;
     ba->ba_winend = (ba->ba_winstart + ba->ba_winsize - 1) & 0xfff;
@@ -1244,6 +1290,12 @@ ieee80211_amsdu_decap_validate(struct ieee80211com *ic, mbuf_t m,
 
 /*
  * Decapsulate an Aggregate MSDU (see 7.2.2.2).
+ *
+ * Subframes are carved off the A-MSDU in place: mbuf_split() on a
+ * cluster only takes another reference to it, so every subframe still
+ * points into the original receive buffer.  mbuf_pullup() is only called
+ * when a subframe header straddles two mbufs since XNU always moves the
+ * head of a cluster mbuf into a freshly allocated one.
  */
 void
 ieee80211_amsdu_decap(struct ieee80211com *ic, mbuf_t m,
@@ -1252,7 +1304,7 @@ ieee80211_amsdu_decap(struct ieee80211com *ic, mbuf_t m,
     mbuf_t n;
     struct ether_header *eh;
     struct llc *llc;
-    int len, pad, mcast;
+    int len, pad, mcast, rest;
     struct ieee80211_frame *wh;
     struct mbuf_list subframes = MBUF_LIST_INITIALIZER();
     
@@ -1262,10 +1314,11 @@ ieee80211_amsdu_decap(struct ieee80211com *ic, mbuf_t m,
     /* strip 802.11 header */
     mbuf_adj(m, hdrlen);
     
-    while (mbuf_pkthdr_len(m) >= ETHER_HDR_LEN + LLC_SNAPFRAMELEN) {
+    while (m != NULL &&
+           mbuf_pkthdr_len(m) >= ETHER_HDR_LEN + LLC_SNAPFRAMELEN) {
         /* process an A-MSDU subframe */
-        mbuf_pullup(&m, ETHER_HDR_LEN + LLC_SNAPFRAMELEN);
-        if (m == NULL)
+        if (mbuf_len(m) < ETHER_HDR_LEN + LLC_SNAPFRAMELEN &&
+            mbuf_pullup(&m, ETHER_HDR_LEN + LLC_SNAPFRAMELEN) != 0)
             break;
         eh = mtod(m, struct ether_header *);
         /* examine 802.3 header */
@@ -1286,11 +1339,13 @@ ieee80211_amsdu_decap(struct ieee80211com *ic, mbuf_t m,
             llc->llc_snap.org_code[0] == 0 &&
             llc->llc_snap.org_code[1] == 0 &&
             llc->llc_snap.org_code[2] == 0) {
-            /* convert to Ethernet II header */
-            eh->ether_type = llc->llc_snap.ether_type;
-            /* strip LLC+SNAP headers */
+            /*
+             * Convert to Ethernet II header: the SNAP ethertype
+             * already sits where the new header ends, so only the
+             * addresses have to move over the LLC+SNAP header.
+             */
             memmove((u_int8_t *)eh + LLC_SNAPFRAMELEN, eh,
-                    ETHER_HDR_LEN);
+                    2 * ETHER_ADDR_LEN);
             mbuf_adj(m, LLC_SNAPFRAMELEN);
             len -= LLC_SNAPFRAMELEN;
         }
@@ -1304,9 +1359,7 @@ ieee80211_amsdu_decap(struct ieee80211com *ic, mbuf_t m,
             return;
         }
         
-        /* "detach" our A-MSDU subframe from the others */
-        mbuf_split(m, len, MBUF_DONTWAIT, &n);
-        if (n == NULL) {
+        if (ieee80211_amsdu_decap_validate(ic, m, ni)) {
             /* stop processing A-MSDU subframes */
             ic->ic_stats.is_rx_decap++;
             ml_purge(&subframes);
@@ -1314,7 +1367,19 @@ ieee80211_amsdu_decap(struct ieee80211com *ic, mbuf_t m,
             return;
         }
         
-        if (ieee80211_amsdu_decap_validate(ic, m, ni)) {
+        rest = mbuf_pkthdr_len(m) - len;
+        if (rest < ETHER_HDR_LEN + LLC_SNAPFRAMELEN) {
+            /* last subframe, drop padding and keep the mbuf */
+            if (rest > 0)
+                mbuf_adj(m, -rest);
+            ml_enqueue(&subframes, m);
+            m = NULL;
+            break;
+        }
+        
+        /* "detach" our A-MSDU subframe from the others */
+        mbuf_split(m, len, MBUF_DONTWAIT, &n);
+        if (n == NULL) {
             /* stop processing A-MSDU subframes */
             ic->ic_stats.is_rx_decap++;
             ml_purge(&subframes);
@@ -1333,7 +1398,8 @@ ieee80211_amsdu_decap(struct ieee80211com *ic, mbuf_t m,
     while ((n = ml_dequeue(&subframes)) != NULL)
         ieee80211_enqueue_data(ic, n, ni, mcast, ml);
     
-    mbuf_freem(m);
+    if (m != NULL)
+        mbuf_freem(m);
 }
 
 /*
@@ -2218,9 +2284,7 @@ ieee80211_recv_probe_resp(struct ieee80211com *ic, mbuf_t m,
     
     ni->ni_dtimcount = dtim_count;
     ni->ni_dtimperiod = dtim_period;
-#ifdef AIRPORT
     ni->ni_age_ts = airport_up_time();
-#endif
     
     /*
      * When operating in station mode, check for state updates
@@ -3282,7 +3346,7 @@ ieee80211_recv_addba_req(struct ieee80211com *ic, mbuf_t m,
     const struct ieee80211_frame *wh;
     const u_int8_t *frm;
     struct ieee80211_rx_ba *ba;
-    u_int16_t params, ssn, bufsz, timeout;
+    u_int16_t params, ssn, bufsz, timeout, maxwin;
     u_int8_t token, tid;
     int err = 0;
     
@@ -3320,9 +3384,9 @@ ieee80211_recv_addba_req(struct ieee80211com *ic, mbuf_t m,
     /* check if we already have a Block Ack agreement for this RA/TID */
     if (ba->ba_state == IEEE80211_BA_AGREED) {
         /* XXX should we update the timeout value? */
-        /* reset Block Ack inactivity timer */
+        /* push back the Block Ack inactivity deadline */
         if (ba->ba_timeout_val != 0)
-            timeout_add_usec(&ba->ba_to, ba->ba_timeout_val);
+            ba->ba_lastact = nsecuptime();
         
         /* check if it's a Protected Block Ack agreement */
         if (!(ni->ni_flags & IEEE80211_NODE_MFP) ||
@@ -3363,9 +3427,16 @@ ieee80211_recv_addba_req(struct ieee80211com *ic, mbuf_t m,
     timeout_set(&ba->ba_to, ieee80211_rx_ba_timeout, ba);
     timeout_set(&ba->ba_gap_to, ieee80211_input_ba_gap_timeout, ba);
     ba->ba_gapwait = 0;
+    /*
+     * HE peers may use up to 256 frames if the driver can buffer that
+     * many.  EHT windows would need the ADDBA extension element.
+     */
+    maxwin = IEEE80211_BA_MAX_WINSZ;
+    if ((ni->ni_flags & IEEE80211_NODE_HE) && ic->ic_rx_ba_maxwin > maxwin)
+        maxwin = MIN(ic->ic_rx_ba_maxwin, IEEE80211_HE_BA_MAX_WINSZ);
     ba->ba_winsize = bufsz;
-    if (ba->ba_winsize == 0 || ba->ba_winsize > IEEE80211_BA_MAX_WINSZ)
-        ba->ba_winsize = IEEE80211_BA_MAX_WINSZ;
+    if (ba->ba_winsize == 0 || ba->ba_winsize > maxwin)
+        ba->ba_winsize = maxwin;
     ba->ba_params = (params & IEEE80211_ADDBA_BA_POLICY);
     ba->ba_params |= ((ba->ba_winsize << IEEE80211_ADDBA_BUFSZ_SHIFT) |
                       (tid << IEEE80211_ADDBA_TID_SHIFT));
@@ -3375,12 +3446,9 @@ ieee80211_recv_addba_req(struct ieee80211com *ic, mbuf_t m,
     ba->ba_winstart = ssn;
     ba->ba_winend = (ba->ba_winstart + ba->ba_winsize - 1) & 0xfff;
     /* allocate and setup our reordering buffer */
-    ba->ba_buf = (struct ieee80211_ba_buf*)_MallocZero(IEEE80211_BA_MAX_WINSZ * sizeof(struct ieee80211_ba_buf));
-    if (ba->ba_buf == NULL)
+    if (ieee80211_rx_ba_buf_alloc(ba) != 0)
         goto refuse;
     
-    ba->ba_head = 0;
-    
     /* notify drivers of this new Block Ack agreement */
     if (ic->ic_ampdu_rx_start != NULL)
         err = ic->ic_ampdu_rx_start(ic, ni, tid);
@@ -3410,8 +3478,10 @@ ieee80211_addba_req_accept(struct ieee80211com *ic, struct ieee80211_node *ni,
     ba->ba_state = IEEE80211_BA_AGREED;
     ic->ic_stats.is_ht_rx_ba_agreements++;
     /* start Block Ack inactivity timer */
-    if (ba->ba_timeout_val != 0)
+    if (ba->ba_timeout_val != 0) {
+        ba->ba_lastact = nsecuptime();
         timeout_add_usec(&ba->ba_to, ba->ba_timeout_val);
+    }
     
     /* MLME-ADDBA.response */
     IEEE80211_SEND_ACTION(ic, ni, IEEE80211_CATEG_BA,
@@ -3425,9 +3495,7 @@ ieee80211_addba_req_refuse(struct ieee80211com *ic, struct ieee80211_node *ni,
 {
     struct ieee80211_rx_ba *ba = &ni->ni_rx_ba[tid];
     
-    IOFree(ba->ba_buf,
-           IEEE80211_BA_MAX_WINSZ * sizeof(*ba->ba_buf));
-    ba->ba_buf = NULL;
+    ieee80211_rx_ba_buf_free(ba);
     ba->ba_state = IEEE80211_BA_INIT;
     
     /* MLME-ADDBA.response */
@@ -3507,6 +3575,10 @@ ieee80211_recv_addba_resp(struct ieee80211com *ic, mbuf_t m,
         return;
     }
     
+    /* the recipient decides whether A-MSDUs may be aggregated */
+    if (!(params & IEEE80211_ADDBA_AMSDU))
+        ba->ba_params &= ~IEEE80211_ADDBA_AMSDU;
+    
     /* notify drivers of this new Block Ack agreement */
     if (ic->ic_ampdu_tx_start != NULL)
         err = ic->ic_ampdu_tx_start(ic, ni, tid);
@@ -3538,8 +3610,10 @@ ieee80211_addba_resp_accept(struct ieee80211com *ic,
     ni->ni_addba_req_intval[tid] = 1;
     
     /* start Block Ack inactivity timeout */
-    if (ba->ba_timeout_val != 0)
+    if (ba->ba_timeout_val != 0) {
+        ba->ba_lastact = nsecuptime();
         timeout_add_usec(&ba->ba_to, ba->ba_timeout_val);
+    }
 }
 
 void
@@ -3567,7 +3641,6 @@ ieee80211_recv_delba(struct ieee80211com *ic, mbuf_t m,
     const u_int8_t *frm;
     u_int16_t params, reason;
     u_int8_t tid;
-    int i;
     
     if (mbuf_len(m) < sizeof(*wh) + 6) {
         DPRINTF(("frame too short\n"));
@@ -3601,15 +3674,8 @@ ieee80211_recv_delba(struct ieee80211com *ic, mbuf_t m,
         timeout_del(&ba->ba_gap_to);
         ba->ba_gapwait = 0;
         
-        if (ba->ba_buf != NULL) {
-            /* free all MSDUs stored in reordering buffer */
-            for (i = 0; i < IEEE80211_BA_MAX_WINSZ; i++)
-                mbuf_freem(ba->ba_buf[i].m);
-            /* free reordering buffer */
-            IOFree(ba->ba_buf,
-                   IEEE80211_BA_MAX_WINSZ * sizeof(*ba->ba_buf));
-            ba->ba_buf = NULL;
-        }
+        /* free all MSDUs stored in reordering buffer */
+        ieee80211_rx_ba_buf_free(ba);
     } else {
         /* MLME-DELBA.indication(Recipient) */
         struct ieee80211_tx_ba *ba = &ni->ni_tx_ba[tid];
@@ -3937,9 +4003,9 @@ ieee80211_bar_tid(struct ieee80211com *ic, struct ieee80211_node *ni,
             ic->ic_stats.is_pbac_errs++;
         return;    /* PBAC, do not move window */
     }
-    /* reset Block Ack inactivity timer */
+    /* push back the Block Ack inactivity deadline */
     if (ba->ba_timeout_val != 0)
-        timeout_add_usec(&ba->ba_to, ba->ba_timeout_val);
+        ba->ba_lastact = nsecuptime();
     
     if (SEQ_LT(ba->ba_winstart, ssn)) {
         struct mbuf_list ml = MBUF_LIST_INITIALIZER();
@@ -0,0 +1,520 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/socket.h>
+#include <sys/_arc4random.h>
+
+#include <net/if.h>
+#include <net/if_media.h>
+
+#include <netinet/in.h>
+#include <netinet/if_ether.h>
+
+#include <net80211/ieee80211_var.h>
+#include <net80211/ieee80211_mrr.h>
+
+/* Success probabilities are fixed point with 16 fractional bits. */
+#define MRR_PROB_SHIFT		16
+#define MRR_PROB(pct)		((uint32_t)(pct) * (1 << MRR_PROB_SHIFT) / 100)
+
+/* Weight of a new measurement in the probability EWMA, in percent. */
+#define MRR_EWMA_WEIGHT		25
+
+/* Statistics are folded into the EWMA at this interval. */
+#define MRR_UPDATE_INTERVAL	20000000ULL	/* 20 msec */
+
+/* Tx reports between samples of rates outside the retry chain. */
+#define MRR_SAMPLE_INTERVAL	32
+
+/* Slow rates are sampled at least once in this many update intervals. */
+#define MRR_SAMPLE_STALE	20
+
+/* Attempts per retry chain stage. */
+#define MRR_TRIES_TP		2
+#define MRR_TRIES_PROB		2
+#define MRR_TRIES_SAMPLE	1
+
+static uint32_t
+mrr_rate_kbps(const struct ieee80211_mrr_node *mn, int rate)
+{
+	const struct ieee80211_mrr_group *g = ieee80211_mrr_group(mn, rate);
+
+	return g->rates[rate % IEEE80211_MRR_GROUP_NRATES] * 500;
+}
+
+static int
+mrr_valid(const struct ieee80211_mrr_node *mn, int rate)
+{
+	return rate >= 0 && (mn->valid_rates & (1ULL << rate)) != 0;
+}
+
+/* The most robust rate: lowest MCS of the first group. */
+static int
+mrr_lowest_rate(const struct ieee80211_mrr_node *mn)
+{
+	int rate;
+
+	for (rate = 0; rate < IEEE80211_MRR_MAX_RATES; rate++)
+		if (mrr_valid(mn, rate))
+			break;
+	return rate;
+}
+
+static int
+mrr_node_nss(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+	int i, nss = 0;
+
+	if (ni->ni_flags & (IEEE80211_NODE_VHT | IEEE80211_NODE_HE)) {
+		/* The peer's VHT/HE MCS map is not tracked per stream. */
+		for (i = 0; i < 4; i++)
+			if (ic->ic_sup_mcs[i] != 0)
+				nss++;
+	} else {
+		for (i = 0; i < 4; i++)
+			if (ic->ic_sup_mcs[i] != 0 && ni->ni_rxmcs[i] != 0)
+				nss++;
+	}
+	if (ic->ic_tx_mcs_set & IEEE80211_TX_RX_MCS_NOT_EQUAL)
+		nss = MIN(nss,
+		    1 + ((ic->ic_tx_mcs_set & IEEE80211_TX_SPATIAL_STREAMS) >> 2));
+	return MIN(nss, IEEE80211_MRR_MAX_GROUPS / 2);
+}
+
+static int
+mrr_node_sgi(struct ieee80211_node *ni)
+{
+	if (ni->ni_flags & IEEE80211_NODE_HE)
+		return 0;
+	switch (ni->ni_chw) {
+	case IEEE80211_CHAN_WIDTH_80P80:
+	case IEEE80211_CHAN_WIDTH_160:
+		return ieee80211_node_supports_vht_sgi160(ni);
+	case IEEE80211_CHAN_WIDTH_80:
+		return ieee80211_node_supports_vht_sgi80(ni);
+	case IEEE80211_CHAN_WIDTH_40:
+		return ieee80211_node_supports_ht_sgi40(ni);
+	default:
+		return ieee80211_node_supports_ht_sgi20(ni);
+	}
+}
+
+/* Index of the node's channel width in the VHT and HE rateset tables. */
+static int
+mrr_width_index(struct ieee80211_node *ni)
+{
+	switch (ni->ni_chw) {
+	case IEEE80211_CHAN_WIDTH_40:
+		return 1;
+	case IEEE80211_CHAN_WIDTH_80:
+		return 2;
+	case IEEE80211_CHAN_WIDTH_80P80:
+	case IEEE80211_CHAN_WIDTH_160:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+static void
+mrr_add_group(struct ieee80211_mrr_node *mn, int nss, int sgi, int min_mcs,
+    int nrates, const uint32_t *rates)
+{
+	struct ieee80211_mrr_group *g = &mn->groups[mn->ngroups++];
+
+	g->nss = nss;
+	g->sgi = sgi;
+	g->min_mcs = min_mcs;
+	g->nrates = MIN(nrates, IEEE80211_MRR_GROUP_NRATES);
+	memcpy(g->rates, rates, g->nrates * sizeof(g->rates[0]));
+}
+
+static void
+mrr_build_groups(struct ieee80211_mrr_node *mn, struct ieee80211com *ic,
+    struct ieee80211_node *ni)
+{
+	int nss, sgi, maxsgi, w = mrr_width_index(ni);
+
+	maxsgi = mrr_node_sgi(ni) ? 1 : 0;
+	for (nss = 1; nss <= mrr_node_nss(ic, ni); nss++) {
+		for (sgi = 0; sgi <= maxsgi; sgi++) {
+			if (ni->ni_flags & IEEE80211_NODE_HE) {
+				const struct ieee80211_he_rateset *rs =
+				    &ieee80211_std_ratesets_11ax[w * 2 + nss - 1];
+				mrr_add_group(mn, nss, 0, 0, rs->nrates,
+				    rs->rates);
+				break;
+			} else if (ni->ni_flags & IEEE80211_NODE_VHT) {
+				const struct ieee80211_vht_rateset *rs =
+				    &ieee80211_std_ratesets_11ac[w * 4 +
+				    (nss - 1) * 2 + sgi];
+				mrr_add_group(mn, nss, sgi, 0, rs->nrates,
+				    rs->rates);
+			} else {
+				const struct ieee80211_ht_rateset *rs =
+				    &ieee80211_std_ratesets_11n[
+				    (ni->ni_chw == IEEE80211_CHAN_WIDTH_40 ?
+				    IEEE80211_HT_RATESET_CBW40_SISO : 0) +
+				    (nss - 1) * 2 + sgi];
+				mrr_add_group(mn, nss, sgi, rs->min_mcs,
+				    rs->nrates, rs->rates);
+			}
+		}
+	}
+}
+
+void
+ieee80211_mrr_node_init(struct ieee80211com *ic,
+    struct ieee80211_mrr_node *mn, struct ieee80211_node *ni)
+{
+	const struct ieee80211_mrr_group *g;
+	int i, j, rate, n = 0;
+	uint8_t tmp;
+
+	memset(mn, 0, sizeof(*mn));
+	mn->sample_rate = -1;
+
+	if ((ic->ic_userflags & IEEE80211_F_MRR) == 0 ||
+	    (ni->ni_flags & (IEEE80211_NODE_HT | IEEE80211_NODE_VHT |
+	    IEEE80211_NODE_HE)) == 0)
+		return;
+
+	mrr_build_groups(mn, ic, ni);
+	for (i = 0; i < mn->ngroups; i++) {
+		g = &mn->groups[i];
+		for (j = 0; j < g->nrates; j++) {
+			rate = i * IEEE80211_MRR_GROUP_NRATES + j;
+			if ((ni->ni_flags & (IEEE80211_NODE_VHT |
+			    IEEE80211_NODE_HE)) == 0 &&
+			    (!isset(ni->ni_rxmcs, g->min_mcs + j) ||
+			    !isset(ic->ic_sup_mcs, g->min_mcs + j)))
+				continue;
+			mn->valid_rates |= 1ULL << rate;
+			mn->sample_seq[n++] = rate;
+		}
+	}
+	if (n == 0) {
+		mn->ngroups = 0;
+		return;
+	}
+
+	/* Sample the other rates in a random order. */
+	for (i = n - 1; i > 0; i--) {
+		j = arc4random_uniform(i + 1);
+		tmp = mn->sample_seq[i];
+		mn->sample_seq[i] = mn->sample_seq[j];
+		mn->sample_seq[j] = tmp;
+	}
+	for (; n < IEEE80211_MRR_MAX_RATES; n++)
+		mn->sample_seq[n] = IEEE80211_MRR_MAX_RATES;
+
+	/* Start at the most robust rate; sampling will find better ones. */
+	mn->max_tp[0] = mn->max_tp[1] = mn->max_prob = mrr_lowest_rate(mn);
+	mn->chain[0].rate = mn->max_tp[0];
+	mn->chain[0].tries = MRR_TRIES_PROB;
+	mn->nchain = 1;
+	ni->ni_txmcs = ieee80211_mrr_mcs(mn, mn->chain[0].rate);
+}
+
+static uint32_t
+mrr_tp(const struct ieee80211_mrr_node *mn, int rate)
+{
+	uint32_t prob = mn->st[rate].prob;
+
+	/* Below 10% the rate is useless; above 90% do not over-trust it. */
+	if (prob < MRR_PROB(10))
+		return 0;
+	if (prob > MRR_PROB(90))
+		prob = MRR_PROB(90);
+	return ((uint64_t)mrr_rate_kbps(mn, rate) * prob) >> MRR_PROB_SHIFT;
+}
+
+static void
+mrr_update_stats(struct ieee80211_mrr_node *mn)
+{
+	struct ieee80211_mrr_stats *st;
+	uint32_t prob;
+	int rate, tp0 = -1, tp1 = -1, maxprob = -1;
+
+	for (rate = 0; rate < IEEE80211_MRR_MAX_RATES; rate++) {
+		if (!mrr_valid(mn, rate))
+			continue;
+		st = &mn->st[rate];
+		if (st->attempts == 0) {
+			st->sample_skipped++;
+		} else {
+			prob = ((uint64_t)st->success << MRR_PROB_SHIFT) /
+			    st->attempts;
+			if (st->total_attempts == 0)
+				st->prob = prob;
+			else
+				st->prob = (st->prob * (100 - MRR_EWMA_WEIGHT) +
+				    prob * MRR_EWMA_WEIGHT) / 100;
+			st->total_attempts += st->attempts;
+			st->total_success += st->success;
+			st->attempts = st->success = 0;
+			st->sample_skipped = 0;
+		}
+		st->tp = mrr_tp(mn, rate);
+
+		if (tp0 == -1 || st->tp > mn->st[tp0].tp) {
+			tp1 = tp0;
+			tp0 = rate;
+		} else if (tp1 == -1 || st->tp > mn->st[tp1].tp)
+			tp1 = rate;
+
+		/* Among reliable rates prefer throughput, else reliability. */
+		if (maxprob == -1)
+			maxprob = rate;
+		else if (st->prob >= MRR_PROB(95) &&
+		    mn->st[maxprob].prob >= MRR_PROB(95)) {
+			if (st->tp > mn->st[maxprob].tp)
+				maxprob = rate;
+		} else if (st->prob > mn->st[maxprob].prob)
+			maxprob = rate;
+	}
+
+	if (mn->st[tp0].tp == 0) {
+		/* Nothing works; fall back to the most robust rate. */
+		tp0 = tp1 = maxprob = mrr_lowest_rate(mn);
+	} else if (tp1 == -1 || mn->st[tp1].tp == 0)
+		tp1 = maxprob;
+	mn->max_tp[0] = tp0;
+	mn->max_tp[1] = tp1;
+	mn->max_prob = maxprob;
+}
+
+/*
+ * Pick the next rate to sample.  Rates which could not beat the second
+ * best throughput even without loss are only sampled when stale.
+ */
+static int
+mrr_next_sample(struct ieee80211_mrr_node *mn)
+{
+	struct ieee80211_mrr_stats *st;
+	int i, rate;
+
+	for (i = 0; i < IEEE80211_MRR_MAX_RATES; i++) {
+		rate = mn->sample_seq[mn->sample_idx];
+		if (++mn->sample_idx == IEEE80211_MRR_MAX_RATES ||
+		    mn->sample_seq[mn->sample_idx] == IEEE80211_MRR_MAX_RATES)
+			mn->sample_idx = 0;
+		if (!mrr_valid(mn, rate) || rate == mn->max_tp[0] ||
+		    rate == mn->max_tp[1] || rate == mn->max_prob)
+			continue;
+		st = &mn->st[rate];
+		if (mrr_rate_kbps(mn, rate) * 9 / 10 <=
+		    mn->st[mn->max_tp[1]].tp &&
+		    st->sample_skipped < MRR_SAMPLE_STALE)
+			continue;
+		return rate;
+	}
+	return -1;
+}
+
+static int
+mrr_add_stage(struct ieee80211_mrr_node *mn, struct ieee80211_mrr_entry *e,
+    int n, int rate, int tries)
+{
+	int i, mimo_ok = 1;
+
+	for (i = 0; i < n; i++) {
+		if (e[i].rate == rate)
+			return n;
+		if (ieee80211_mrr_group(mn, e[i].rate)->nss == 1)
+			mimo_ok = 0;
+	}
+	/* Firmware retry tables keep multi-stream rates first. */
+	if (!mimo_ok && ieee80211_mrr_group(mn, rate)->nss > 1)
+		return n;
+	if (n == IEEE80211_MRR_MAX_CHAIN)
+		return n;
+	e[n].rate = rate;
+	e[n].tries = tries;
+	return n + 1;
+}
+
+static int
+mrr_build_chain(struct ieee80211_mrr_node *mn,
+    struct ieee80211_mrr_entry *e)
+{
+	int n = 0;
+
+	if (mn->sample_rate >= 0 && mn->sample_first)
+		n = mrr_add_stage(mn, e, n, mn->sample_rate, MRR_TRIES_SAMPLE);
+	n = mrr_add_stage(mn, e, n, mn->max_tp[0], MRR_TRIES_TP);
+	if (mn->sample_rate >= 0 && !mn->sample_first)
+		n = mrr_add_stage(mn, e, n, mn->sample_rate, MRR_TRIES_SAMPLE);
+	n = mrr_add_stage(mn, e, n, mn->max_tp[1], MRR_TRIES_TP);
+	n = mrr_add_stage(mn, e, n, mn->max_prob, MRR_TRIES_PROB);
+	n = mrr_add_stage(mn, e, n, mrr_lowest_rate(mn), MRR_TRIES_PROB);
+	return n;
+}
+
+static int
+mrr_rate_matches(const struct ieee80211_mrr_node *mn, int rate, int mcs,
+    int nss, int sgi)
+{
+	const struct ieee80211_mrr_group *g = ieee80211_mrr_group(mn, rate);
+
+	if (ieee80211_mrr_mcs(mn, rate) != mcs)
+		return 0;
+	if (nss != 0 && g->nss != nss)
+		return 0;
+	return sgi == -1 || g->sgi == sgi;
+}
+
+/*
+ * Find the retry chain a Tx report refers to.  Frames may still be
+ * reported against the chain which was in use before the last update.
+ */
+static const struct ieee80211_mrr_entry *
+mrr_find_chain(struct ieee80211_mrr_node *mn, int mcs, int nss, int sgi,
+    int *n)
+{
+	if (mn->nchain > 0 &&
+	    mrr_rate_matches(mn, mn->chain[0].rate, mcs, nss, sgi)) {
+		*n = mn->nchain;
+		return mn->chain;
+	}
+	if (mn->nprev > 0 &&
+	    mrr_rate_matches(mn, mn->prev[0].rate, mcs, nss, sgi)) {
+		*n = mn->nprev;
+		return mn->prev;
+	}
+	return NULL;
+}
+
+int
+ieee80211_mrr_tx_done(struct ieee80211_mrr_node *mn, struct ieee80211com *ic,
+    struct ieee80211_node *ni, int mcs, int nss, int sgi, u_int ackfailcnt,
+    int txfail)
+{
+	const struct ieee80211_mrr_entry *e;
+	struct ieee80211_mrr_stats *st;
+	u_int left = ackfailcnt, k;
+	int i, n, s;
+
+	if (!ieee80211_mrr_active(mn))
+		return 0;
+
+	s = splnet();
+
+	if (mn->sample_wait > 0)
+		mn->sample_wait--;
+
+	e = mrr_find_chain(mn, mcs, nss, sgi, &n);
+	if (e == NULL) {
+		splx(s);
+		return 0;
+	}
+
+	/* Attempts beyond the chain were made at the driver's basic rate. */
+	for (i = 0; i < n; i++) {
+		st = &mn->st[e[i].rate];
+		k = MIN(left, e[i].tries);
+		st->attempts += k;
+		left -= k;
+		if (k < e[i].tries) {
+			if (!txfail) {
+				st->attempts++;
+				st->success++;
+			}
+			break;
+		}
+	}
+
+	/* A sample is used for one frame, whether or not it was reached. */
+	if (e == mn->chain)
+		mn->sample_rate = -1;
+
+	splx(s);
+	return 1;
+}
+
+void
+ieee80211_mrr_add_stats(struct ieee80211_mrr_node *mn,
+    struct ieee80211com *ic, struct ieee80211_node *ni, int mcs,
+    u_int total, u_int fail)
+{
+	const struct ieee80211_mrr_entry *e;
+	struct ieee80211_mrr_stats *st;
+	int n, s;
+
+	if (!ieee80211_mrr_active(mn) || total == 0)
+		return;
+
+	s = splnet();
+
+	if (mn->sample_wait > 0)
+		mn->sample_wait--;
+
+	e = mrr_find_chain(mn, mcs, 0, -1, &n);
+	if (e != NULL) {
+		st = &mn->st[e[0].rate];
+		st->attempts += total;
+		st->success += total - MIN(fail, total);
+		if (e == mn->chain)
+			mn->sample_rate = -1;
+	}
+
+	splx(s);
+}
+
+int
+ieee80211_mrr_choose(struct ieee80211_mrr_node *mn, struct ieee80211com *ic,
+    struct ieee80211_node *ni)
+{
+	struct ieee80211_mrr_entry e[IEEE80211_MRR_MAX_CHAIN];
+	uint64_t now;
+	int n, s, rate, changed;
+
+	if (!ieee80211_mrr_active(mn))
+		return 0;
+
+	s = splnet();
+
+	now = nsecuptime();
+	if (now >= mn->next_update) {
+		mrr_update_stats(mn);
+		mn->next_update = now + MRR_UPDATE_INTERVAL;
+	}
+
+	if (mn->sample_rate == -1 && mn->sample_wait == 0) {
+		rate = mrr_next_sample(mn);
+		if (rate >= 0) {
+			mn->sample_rate = rate;
+			mn->sample_first = mrr_rate_kbps(mn, rate) >
+			    mn->st[mn->max_tp[0]].tp;
+		}
+		mn->sample_wait = MRR_SAMPLE_INTERVAL;
+	}
+
+	n = mrr_build_chain(mn, e);
+	changed = (n != mn->nchain ||
+	    memcmp(e, mn->chain, n * sizeof(e[0])) != 0);
+	if (changed) {
+		memcpy(mn->prev, mn->chain, sizeof(mn->prev));
+		mn->nprev = mn->nchain;
+		memcpy(mn->chain, e, sizeof(mn->chain));
+		mn->nchain = n;
+	}
+	/* The first stage is what goes on the air, sample or not. */
+	ni->ni_txmcs = ieee80211_mrr_mcs(mn, mn->chain[0].rate);
+
+	splx(s);
+	return changed;
+}
@@ -0,0 +1,134 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NET80211_IEEE80211_MRR_H_
+#define _NET80211_IEEE80211_MRR_H_
+
+/*
+ * Multi-rate retry rate control for HT/VHT/HE devices which program a
+ * retry table into firmware, in the style of Linux's Minstrel-HT.
+ *
+ * Success probability is tracked per rate as an EWMA.  The rates with
+ * the best throughput and the most reliable rate form a retry chain
+ * which the driver copies into its link quality command.  Other rates
+ * are sampled by placing them in the first slot of the chain, if they
+ * could beat the current best rate, or in a retry slot otherwise.
+ */
+
+/* One group per (spatial streams, guard interval) at the node's width. */
+#define IEEE80211_MRR_MAX_GROUPS	4
+#define IEEE80211_MRR_GROUP_NRATES	12
+#define IEEE80211_MRR_MAX_RATES	\
+	(IEEE80211_MRR_MAX_GROUPS * IEEE80211_MRR_GROUP_NRATES)
+
+/* Maximum number of stages in a retry chain. */
+#define IEEE80211_MRR_MAX_CHAIN	5
+
+struct ieee80211_mrr_group {
+	int		nss;
+	int		sgi;
+	int		min_mcs;	/* MCS of the first rate */
+	int		nrates;
+	uint32_t	rates[IEEE80211_MRR_GROUP_NRATES]; /* 500 kbit/s units */
+};
+
+struct ieee80211_mrr_stats {
+	uint32_t	attempts;	/* in the current interval */
+	uint32_t	success;
+	uint32_t	prob;		/* EWMA success probability */
+	uint32_t	tp;		/* expected throughput, kbit/s */
+	uint32_t	sample_skipped;
+	uint64_t	total_attempts;
+	uint64_t	total_success;
+};
+
+/* A stage of the retry chain: 'tries' attempts at rate 'rate'. */
+struct ieee80211_mrr_entry {
+	uint8_t		rate;
+	uint8_t		tries;
+};
+
+struct ieee80211_mrr_node {
+	int		ngroups;
+	struct ieee80211_mrr_group groups[IEEE80211_MRR_MAX_GROUPS];
+	uint64_t	valid_rates;	/* bitmap of rate indices */
+	struct ieee80211_mrr_stats st[IEEE80211_MRR_MAX_RATES];
+
+	int		max_tp[2];
+	int		max_prob;
+	uint64_t	next_update;	/* nsecuptime() */
+
+	/* Sampling state. */
+	int		sample_rate;	/* -1 if not sampling */
+	int		sample_first;	/* sample_rate is in the first slot */
+	uint32_t	sample_wait;	/* Tx reports until the next sample */
+	int		sample_idx;
+	uint8_t		sample_seq[IEEE80211_MRR_MAX_RATES];
+
+	/* Retry chain as last handed to the driver, and the one before. */
+	int		nchain;
+	struct ieee80211_mrr_entry chain[IEEE80211_MRR_MAX_CHAIN];
+	int		nprev;
+	struct ieee80211_mrr_entry prev[IEEE80211_MRR_MAX_CHAIN];
+};
+
+void	ieee80211_mrr_node_init(struct ieee80211com *,
+	    struct ieee80211_mrr_node *, struct ieee80211_node *);
+
+/*
+ * Drivers call this for each single-frame Tx report.  The first rate
+ * is given as MCS, spatial streams (0 for HT, where the MCS implies
+ * it) and guard interval; ackfailcnt attempts failed before the frame
+ * was ACKed, or before the firmware gave up if txfail is set.
+ * Returns 0 if the report does not match a recent retry chain.
+ */
+int	ieee80211_mrr_tx_done(struct ieee80211_mrr_node *,
+	    struct ieee80211com *, struct ieee80211_node *,
+	    int mcs, int nss, int sgi, u_int ackfailcnt, int txfail);
+
+/* Drivers call this to report A-MPDU subframes sent at the first rate. */
+void	ieee80211_mrr_add_stats(struct ieee80211_mrr_node *,
+	    struct ieee80211com *, struct ieee80211_node *,
+	    int mcs, u_int total, u_int fail);
+
+/*
+ * Drivers call this after reporting Tx results.  Sets ni->ni_txmcs to
+ * the first stage of the chain and returns 1 if the retry chain has
+ * changed and must be sent to firmware.
+ */
+int	ieee80211_mrr_choose(struct ieee80211_mrr_node *,
+	    struct ieee80211com *, struct ieee80211_node *);
+
+/* Describe rate index 'rate' of the node's rate table. */
+static inline const struct ieee80211_mrr_group *
+ieee80211_mrr_group(const struct ieee80211_mrr_node *mn, int rate)
+{
+	return &mn->groups[rate / IEEE80211_MRR_GROUP_NRATES];
+}
+
+static inline int
+ieee80211_mrr_mcs(const struct ieee80211_mrr_node *mn, int rate)
+{
+	return ieee80211_mrr_group(mn, rate)->min_mcs +
+	    rate % IEEE80211_MRR_GROUP_NRATES;
+}
+
+/* Whether the node's Tx rate is chosen by this module. */
+static inline int
+ieee80211_mrr_active(const struct ieee80211_mrr_node *mn)
+{
+	return mn->ngroups != 0;
+}
+
+#endif /* _NET80211_IEEE80211_MRR_H_ */
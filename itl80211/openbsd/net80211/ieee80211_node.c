@@ -718,6 +718,14 @@ ieee80211_node_attach(struct _ifnet *ifp)
     ic->ic_scangen = 1;
     ic->ic_max_nnodes = ieee80211_cache_size;
     
+    /* keep the node index at most half full */
+    ic->ic_node_hashbits = 4;
+    while ((1 << ic->ic_node_hashbits) < 2 * ic->ic_max_nnodes)
+        ic->ic_node_hashbits++;
+    ic->ic_node_hash = (struct ieee80211_node **)
+    _MallocZero(sizeof(*ic->ic_node_hash) << ic->ic_node_hashbits);
+    ic->ic_node_last = NULL;
+    
     if (ic->ic_max_aid == 0)
         ic->ic_max_aid = IEEE80211_AID_DEF;
     else if (ic->ic_max_aid > IEEE80211_AID_MAX)
@@ -790,6 +798,11 @@ ieee80211_node_detach(struct _ifnet *ifp)
     }
     ieee80211_del_ess(ic, NULL, 0, 1);
     ieee80211_free_allnodes(ic, 1);
+    if (ic->ic_node_hash != NULL) {
+        IOFree(ic->ic_node_hash,
+               sizeof(*ic->ic_node_hash) << ic->ic_node_hashbits);
+        ic->ic_node_hash = NULL;
+    }
 #ifndef IEEE80211_STA_ONLY
     IOFree(ic->ic_aid_bitmap,
            howmany(ic->ic_max_aid, 32) * sizeof(u_int32_t));
@@ -1590,9 +1603,10 @@ ieee80211_choose_rsnparams(struct ieee80211com *ic)
             ni->ni_rsnakms = IEEE80211_AKM_SHA256_8021X;
         else
             ni->ni_rsnakms = IEEE80211_AKM_8021X;
-        /* check if we have a cached PMK for this AP */
+        /* check if we have a cached PMK for this AP, or for its ESS */
         if (ni->ni_rsnprotos == IEEE80211_PROTO_RSN &&
-            (pmk = ieee80211_pmksa_find(ic, ni, NULL)) != NULL) {
+            ((pmk = ieee80211_pmksa_find(ic, ni, NULL)) != NULL ||
+             (pmk = ieee80211_pmksa_okc(ic, ni)) != NULL)) {
             memcpy(ni->ni_pmkid, pmk->pmk_pmkid,
                    IEEE80211_PMKID_LEN);
             ni->ni_flags |= IEEE80211_NODE_PMKID;
@@ -1653,8 +1667,17 @@ ieee80211_node_cleanup(struct ieee80211com *ic, struct ieee80211_node *ni)
         ni->ni_rsnie_tlv = NULL;
         ni->ni_rsnie_tlv_len = 0;
     }
+#ifndef IEEE80211_STA_ONLY
+    timeout_free(&ni->ni_eapol_to);
+    timeout_free(&ni->ni_sa_query_to);
+#endif
     ieee80211_ba_del(ni);
     ieee80211_ba_free(ni);
+    if (ni->ni_txhdr != NULL) {
+        IOFree(ni->ni_txhdr,
+               (IEEE80211_NUM_TID + 1) * sizeof(struct ieee80211_txhdr));
+        ni->ni_txhdr = NULL;
+    }
     IOFree(ni->ni_unref_arg, ni->ni_unref_arg_size);
     ni->ni_unref_arg = NULL;
     ni->ni_unref_arg_size = 0;
@@ -1680,12 +1703,16 @@ ieee80211_node_copy(struct ieee80211com *ic,
     dst->ni_rsnie = NULL;
     if (src->ni_rsnie != NULL)
         ieee80211_save_ie(src->ni_rsnie, &dst->ni_rsnie);
+    dst->ni_txhdr = NULL;
     dst->ni_rsnie_tlv = NULL;
     dst->ni_rsnie_tlv_len = 0;
     if (src->ni_rsnie_tlv != NULL) {
         ieee80211_save_ie_tlv(src->ni_rsnie_tlv, &dst->ni_rsnie_tlv, &dst->ni_rsnie_tlv_len, src->ni_rsnie_tlv_len);
     }
     ieee80211_node_set_timeouts(dst);
+    /* Block Ack agreements, their timers and buffers stay with src. */
+    memset(dst->ni_tx_ba, 0, sizeof(dst->ni_tx_ba));
+    memset(dst->ni_rx_ba, 0, sizeof(dst->ni_rx_ba));
 #ifndef IEEE80211_STA_ONLY
     mq_init(&dst->ni_savedq, IEEE80211_PS_MAX_QUEUE, IPL_NET);
 #endif
@@ -1720,28 +1747,47 @@ ieee80211_node_checkrssi(struct ieee80211com *ic,
     return (ni->ni_rssi >= (u_int8_t)thres);
 }
 
+/*
+ * Per-node timeouts are created the first time they are armed, so that
+ * the many nodes which only ever hold a scan result do not carry any.
+ */
 void
 ieee80211_node_set_timeouts(struct ieee80211_node *ni)
 {
     int i;
     
-    memset(ni->ni_addba_req_to, 0, sizeof(ni->ni_addba_req_to) * nitems(ni->ni_addba_req_to));
+    memset(ni->ni_addba_req_to, 0, sizeof(ni->ni_addba_req_to));
 #ifndef IEEE80211_STA_ONLY
-    timeout_set(&ni->ni_eapol_to, ieee80211_eapol_timeout, ni);
-    timeout_set(&ni->ni_sa_query_to, ieee80211_sa_query_timeout, ni);
+    ni->ni_eapol_to = NULL;
+    ni->ni_sa_query_to = NULL;
 #endif
-    timeout_set(&ni->ni_addba_req_to[EDCA_AC_BE],
-                ieee80211_node_addba_request_ac_be_to, ni);
-    timeout_set(&ni->ni_addba_req_to[EDCA_AC_BK],
-                ieee80211_node_addba_request_ac_bk_to, ni);
-    timeout_set(&ni->ni_addba_req_to[EDCA_AC_VI],
-                ieee80211_node_addba_request_ac_vi_to, ni);
-    timeout_set(&ni->ni_addba_req_to[EDCA_AC_VO],
-                ieee80211_node_addba_request_ac_vo_to, ni);
     for (i = 0; i < nitems(ni->ni_addba_req_intval); i++)
         ni->ni_addba_req_intval[i] = 1;
 }
 
+static void
+ieee80211_node_addba_req_to_set(struct ieee80211_node *ni, int tid)
+{
+    switch (tid) {
+    case EDCA_AC_BE:
+        timeout_set(&ni->ni_addba_req_to[tid],
+                    ieee80211_node_addba_request_ac_be_to, ni);
+        break;
+    case EDCA_AC_BK:
+        timeout_set(&ni->ni_addba_req_to[tid],
+                    ieee80211_node_addba_request_ac_bk_to, ni);
+        break;
+    case EDCA_AC_VI:
+        timeout_set(&ni->ni_addba_req_to[tid],
+                    ieee80211_node_addba_request_ac_vi_to, ni);
+        break;
+    case EDCA_AC_VO:
+        timeout_set(&ni->ni_addba_req_to[tid],
+                    ieee80211_node_addba_request_ac_vo_to, ni);
+        break;
+    }
+}
+
 void
 ieee80211_setup_node(struct ieee80211com *ic,
                      struct ieee80211_node *ni, const u_int8_t *macaddr)
@@ -1763,8 +1809,10 @@ ieee80211_setup_node(struct ieee80211com *ic,
     ieee80211_node_set_timeouts(ni);
     
     s = splnet();
-    RB_INSERT(ieee80211_tree, &ic->ic_tree, ni);
+    if (RB_INSERT(ieee80211_tree, &ic->ic_tree, ni) == NULL)
+        ieee80211_node_hash_insert(ic, ni);
     ic->ic_nnodes++;
+    ic->ic_node_gen++;
     splx(s);
 }
 
@@ -1796,12 +1844,89 @@ ieee80211_dup_bss(struct ieee80211com *ic, const u_int8_t *macaddr)
     return ni;
 }
 
+/*
+ * ic_tree is mirrored by an open-addressed hash table with linear probing
+ * so that the per-frame lookups in ieee80211_find_rxnode() do not have to
+ * walk the tree; the tree is kept for ordered iteration.  Removal shifts
+ * the rest of the probe run back instead of leaving tombstones.
+ */
+static inline u_int
+ieee80211_node_hash(const struct ieee80211com *ic, const u_int8_t *macaddr)
+{
+    u_int32_t h;
+    
+    h = (macaddr[2] << 24 | macaddr[3] << 16 | macaddr[4] << 8 | macaddr[5]) ^
+        (macaddr[0] << 8 | macaddr[1]);
+    return (h * 0x9e3779b1U) >> (32 - ic->ic_node_hashbits);
+}
+
+void
+ieee80211_node_hash_insert(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+    u_int i, mask;
+    
+    if (ic->ic_node_hash == NULL)
+        return;
+    mask = (1U << ic->ic_node_hashbits) - 1;
+    for (i = ieee80211_node_hash(ic, ni->ni_macaddr);
+         ic->ic_node_hash[i] != NULL; i = (i + 1) & mask)
+        ;
+    ic->ic_node_hash[i] = ni;
+}
+
+void
+ieee80211_node_hash_remove(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+    struct ieee80211_node **tab = ic->ic_node_hash;
+    u_int i, j, k, mask;
+    
+    if (ic->ic_node_last == ni)
+        ic->ic_node_last = NULL;
+    if (tab == NULL)
+        return;
+    mask = (1U << ic->ic_node_hashbits) - 1;
+    for (i = ieee80211_node_hash(ic, ni->ni_macaddr); tab[i] != ni;
+         i = (i + 1) & mask) {
+        if (tab[i] == NULL)
+            return;
+    }
+    for (j = i;;) {
+        tab[i] = NULL;
+        do {
+            j = (j + 1) & mask;
+            if (tab[j] == NULL)
+                return;
+            k = ieee80211_node_hash(ic, tab[j]->ni_macaddr);
+            /* tab[j] may fill the hole unless its home lies in (i, j] */
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        tab[i] = tab[j];
+        i = j;
+    }
+}
+
 struct ieee80211_node *
 ieee80211_find_node(struct ieee80211com *ic, const u_int8_t *macaddr)
 {
     struct ieee80211_node *ni;
+    u_int i, mask;
     int cmp;
     
+    ni = ic->ic_node_last;
+    if (ni != NULL && IEEE80211_ADDR_EQ(ni->ni_macaddr, macaddr))
+        return ni;
+    
+    if (ic->ic_node_hash != NULL) {
+        mask = (1U << ic->ic_node_hashbits) - 1;
+        for (i = ieee80211_node_hash(ic, macaddr);
+             (ni = ic->ic_node_hash[i]) != NULL; i = (i + 1) & mask) {
+            if (IEEE80211_ADDR_EQ(ni->ni_macaddr, macaddr)) {
+                ic->ic_node_last = ni;
+                break;
+            }
+        }
+        return ni;
+    }
+    
     /* similar to RBT_FIND except we compare keys, not nodes */
     ni = RB_ROOT(&ic->ic_tree);
     while (ni != NULL) {
@@ -1816,6 +1941,30 @@ ieee80211_find_node(struct ieee80211com *ic, const u_int8_t *macaddr)
     return ni;
 }
 
+/*
+ * Return the first node whose address is not below macaddr, or NULL.
+ * Lets callers walk ic_tree across calls without holding a node pointer.
+ */
+struct ieee80211_node *
+ieee80211_find_node_geq(struct ieee80211com *ic, const u_int8_t *macaddr)
+{
+    struct ieee80211_node *ni, *res = NULL;
+    int cmp;
+    
+    ni = RB_ROOT(&ic->ic_tree);
+    while (ni != NULL) {
+        cmp = memcmp(macaddr, ni->ni_macaddr, IEEE80211_ADDR_LEN);
+        if (cmp < 0) {
+            res = ni;
+            ni = RB_LEFT(ni, ni_node);
+        } else if (cmp > 0)
+            ni = RB_RIGHT(ni, ni_node);
+        else
+            return ni;
+    }
+    return res;
+}
+
 /*
  * Return a reference to the appropriate node for sending
  * a data frame.  This handles node discovery in adhoc networks.
@@ -2059,6 +2208,48 @@ ieee80211_ba_del(struct ieee80211_node *ni)
     timeout_del(&ni->ni_addba_req_to[EDCA_AC_VO]);
 }
 
+/*
+ * Allocate the reordering buffer of an RX Block Ack agreement once its
+ * window size is known: a power of two number of slots, at least 64 so
+ * that the occupancy bitmap is made of whole words.
+ */
+int
+ieee80211_rx_ba_buf_alloc(struct ieee80211_rx_ba *ba)
+{
+    u_int16_t bufsz = 64;
+    size_t size;
+
+    while (bufsz < ba->ba_winsize)
+        bufsz <<= 1;
+    size = (bufsz / 64) * sizeof(uint64_t) + bufsz * sizeof(*ba->ba_buf);
+    ba->ba_bitmap = (uint64_t *)_MallocZero(size);
+    if (ba->ba_bitmap == NULL)
+        return ENOMEM;
+    ba->ba_buf = (struct ieee80211_ba_buf *)&ba->ba_bitmap[bufsz / 64];
+    ba->ba_bufsz = bufsz;
+    ba->ba_head = 0;
+    return 0;
+}
+
+/* Free the reordering buffer and any frames still stored in it. */
+void
+ieee80211_rx_ba_buf_free(struct ieee80211_rx_ba *ba)
+{
+    int i;
+
+    if (ba->ba_bitmap == NULL)
+        return;
+    for (i = 0; i < ba->ba_bufsz; i++) {
+        if (ba->ba_buf[i].m != NULL)
+            mbuf_freem(ba->ba_buf[i].m);
+    }
+    IOFree(ba->ba_bitmap, (ba->ba_bufsz / 64) * sizeof(uint64_t) +
+        ba->ba_bufsz * sizeof(*ba->ba_buf));
+    ba->ba_bitmap = NULL;
+    ba->ba_buf = NULL;
+    ba->ba_bufsz = 0;
+}
+
 void ieee80211_ba_free(struct ieee80211_node *ni)
 {
     int tid;
@@ -2099,8 +2290,10 @@ ieee80211_free_node(struct ieee80211com *ic, struct ieee80211_node *ni)
 #endif
     ieee80211_ba_del(ni);
     ieee80211_ba_free(ni);
+    ieee80211_node_hash_remove(ic, ni);
     RB_REMOVE(ieee80211_tree, &ic->ic_tree, ni);
     ic->ic_nnodes--;
+    ic->ic_node_gen++;
 #ifndef IEEE80211_STA_ONLY
     if (mq_purge(&ni->ni_savedq) > 0) {
         if (ic->ic_set_tim != NULL)
@@ -2553,6 +2746,8 @@ ieee80211_node_trigger_addba_req(struct ieee80211_node *ni, int tid)
 {
     if (ni->ni_tx_ba[tid].ba_state == IEEE80211_BA_INIT &&
         !timeout_pending(&ni->ni_addba_req_to[tid])) {
+        if (ni->ni_addba_req_to[tid] == NULL)
+            ieee80211_node_addba_req_to_set(ni, tid);
         timeout_add_sec(&ni->ni_addba_req_to[tid],
                         ni->ni_addba_req_intval[tid]);
     }
@@ -2856,23 +3051,13 @@ ieee80211_node_join(struct ieee80211com *ic, struct ieee80211_node *ni,
 void
 ieee80211_node_leave_ht(struct ieee80211com *ic, struct ieee80211_node *ni)
 {
-    struct ieee80211_rx_ba *ba;
     u_int8_t tid;
-    int i;
     
     /* free all Block Ack records */
     ieee80211_ba_del(ni);
     ieee80211_ba_free(ni);
-    for (tid = 0; tid < IEEE80211_NUM_TID; tid++) {
-        ba = &ni->ni_rx_ba[tid];
-        if (ba->ba_buf != NULL) {
-            for (i = 0; i < IEEE80211_BA_MAX_WINSZ; i++)
-                mbuf_freem(ba->ba_buf[i].m);
-            IOFree(ba->ba_buf,
-                   IEEE80211_BA_MAX_WINSZ * sizeof(*ba->ba_buf));
-            ba->ba_buf = NULL;
-        }
-    }
+    for (tid = 0; tid < IEEE80211_NUM_TID; tid++)
+        ieee80211_rx_ba_buf_free(&ni->ni_rx_ba[tid]);
     
     ieee80211_clear_htcaps(ni);
 }
@@ -240,6 +240,7 @@ struct ieee80211_tx_ba {
 	struct ieee80211_node	*ba_ni;	/* backpointer for callbacks */
 	CTimeout*		ba_to;
 	int			ba_timeout_val;
+	u_int64_t		ba_lastact;	/* nsecuptime() of last use */
 	int			ba_state;
 #define IEEE80211_BA_INIT	0
 #define IEEE80211_BA_REQUESTED	1
@@ -255,6 +256,8 @@ struct ieee80211_tx_ba {
 	/* Number of A-MPDU subframes in reorder buffer. */
 	u_int16_t		ba_winsize;
 #define IEEE80211_BA_MAX_WINSZ	64	/* corresponds to maximum ADDBA BUFSZ */
+#define IEEE80211_HE_BA_MAX_WINSZ	256
+#define IEEE80211_EHT_BA_MAX_WINSZ	1024
 
 	u_int8_t		ba_token;
 
@@ -262,16 +265,39 @@ struct ieee80211_tx_ba {
 	uint64_t		ba_bitmap;
 };
 
+/*
+ * Cached 802.11 header and LLC/SNAP header put in front of data frames
+ * to a node, one per TID plus one for non-QoS frames.  Sequence number,
+ * ethertype and the addresses taken from the Ethernet header are filled
+ * in per frame.  th_key encodes the settings the template was built for
+ * and is 0 until it has been built.
+ */
+#define IEEE80211_TXHDR_LEN	(sizeof(struct ieee80211_qosframe) + 8)
+
+struct ieee80211_txhdr {
+	u_int32_t	th_key;
+	u_int8_t	th_hdr[IEEE80211_TXHDR_LEN];
+};
+
 struct ieee80211_ba_buf {
     mbuf_t m;
     struct ieee80211_rxinfo    rxi;
 };
 
+/*
+ * The reordering buffer is a ring of ba_bufsz slots (a power of two of at
+ * least the window size, allocated when the agreement is set up), with
+ * one bit per slot in ba_bitmap telling whether a frame is stored there.
+ * Slot ba_head holds the frame with sequence number ba_winstart.
+ */
 struct ieee80211_rx_ba {
 	struct ieee80211_node	*ba_ni;	/* backpointer for callbacks */
 	struct ieee80211_ba_buf	*ba_buf;
+	uint64_t		*ba_bitmap;
+	u_int16_t		ba_bufsz;
 	CTimeout*		ba_to;
 	int			ba_timeout_val;
+	u_int64_t		ba_lastact;	/* nsecuptime() of last use */
 	int			ba_state;
 	u_int16_t		ba_params;
 	u_int16_t		ba_winstart;
@@ -329,9 +355,7 @@ struct ieee80211_node {
 	u_int8_t		*ni_country;	/* country information XXX */
 	struct ieee80211_channel *ni_chan;
 	u_int8_t		ni_erp;		/* 11g only */
-#ifdef AIRPORT
-    u_int64_t       ni_age_ts;
-#endif
+    u_int64_t       ni_age_ts;	/* last beacon/probe resp, msec */
 
 	/* DTIM and contention free period (CFP) */
 	u_int8_t		ni_dtimcount;
@@ -440,6 +464,7 @@ struct ieee80211_node {
 	u_int16_t		ni_txseq;	/* seq to be transmitted */
 	u_int16_t		ni_rxseq;	/* seq previous received */
 	u_int16_t		ni_qos_txseqs[IEEE80211_NUM_TID];
+	struct ieee80211_txhdr	*ni_txhdr;	/* IEEE80211_NUM_TID + 1 */
 	u_int16_t		ni_qos_rxseqs[IEEE80211_NUM_TID];
 	int			ni_fails;	/* failure count to associate */
 	uint32_t		ni_assoc_fail;	/* assoc failure reasons */
@@ -487,8 +512,6 @@ struct ieee80211_node {
 					struct ieee80211_node *);
 	void *			ni_unref_arg;
 	size_t 			ni_unref_arg_size;
-    
-    uint8_t verb[0x1024];//冗余信息 zxy
 };
 
 RB_HEAD(ieee80211_tree, ieee80211_node);
@@ -615,8 +638,16 @@ struct ieee80211_node *ieee80211_dup_bss(struct ieee80211com *,
 		const u_int8_t *);
 struct ieee80211_node *ieee80211_find_node(struct ieee80211com *,
 		const u_int8_t *);
+struct ieee80211_node *ieee80211_find_node_geq(struct ieee80211com *,
+		const u_int8_t *);
+void ieee80211_node_hash_insert(struct ieee80211com *,
+		struct ieee80211_node *);
+void ieee80211_node_hash_remove(struct ieee80211com *,
+		struct ieee80211_node *);
 void ieee80211_ba_del(struct ieee80211_node *);
 void ieee80211_ba_free(struct ieee80211_node *ni);
+int ieee80211_rx_ba_buf_alloc(struct ieee80211_rx_ba *);
+void ieee80211_rx_ba_buf_free(struct ieee80211_rx_ba *);
 struct ieee80211_node *ieee80211_find_rxnode(struct ieee80211com *,
 		const struct ieee80211_frame *);
 struct ieee80211_node *ieee80211_find_txnode(struct ieee80211com *,
@@ -78,6 +78,8 @@ int	ieee80211_mgmt_output(struct _ifnet *, struct ieee80211_node *,
 	    mbuf_t, int);
 int	ieee80211_can_use_ampdu(struct ieee80211com *,
 	    struct ieee80211_node *);
+const u_int8_t *ieee80211_encap_txhdr(struct ieee80211com *,
+	    struct ieee80211_node *, int, u_int, u_int8_t *);
 u_int8_t *ieee80211_add_rsn_body(u_int8_t *, struct ieee80211com *,
 	    const struct ieee80211_node *, int);
 mbuf_t ieee80211_getmgmt(int, int, u_int);
@@ -426,29 +428,36 @@ ieee80211_up_to_ac(struct ieee80211com *ic, int up)
 int
 ieee80211_classify(struct ieee80211com *ic, mbuf_t m)
 {
-	struct ether_header eh;
+	const u_int8_t *p;
+	u_int8_t hdr[ETHER_HDR_LEN + 2];
+	u_int16_t type;
 	u_int8_t ds_field;
 #if NVLAN > 0
 	if (m->m_flags & M_VLANTAG)	/* use VLAN 802.1D user-priority */
 		return EVL_PRIOFTAG(m->m_pkthdr.ether_vtag);
 #endif
-    mbuf_copydata(m, 0, sizeof(eh), (caddr_t)&eh);
-    if (eh.ether_type == htons(ETHERTYPE_IP)) {
-        struct ip ip;
-        mbuf_copydata(m, sizeof(eh), sizeof(ip), (caddr_t)&ip);
-        if (ip.ip_v != 4)
+    /*
+     * Only the ethertype and the first two bytes of the IP header are
+     * needed; read them in place when the first mbuf holds them.
+     */
+    if (mbuf_len(m) >= sizeof(hdr))
+        p = mtod(m, const u_int8_t *);
+    else if (mbuf_copydata(m, 0, sizeof(hdr), hdr) == 0)
+        p = hdr;
+    else
+        return 0;
+    type = (p[12] << 8) | p[13];
+    if (type == ETHERTYPE_IP) {
+        if ((p[ETHER_HDR_LEN] >> 4) != 4)
             return 0;
-        ds_field = ip.ip_tos;
+        ds_field = p[ETHER_HDR_LEN + 1];
     }
 #ifdef INET6
-    else if (eh.ether_type == htons(ETHERTYPE_IPV6)) {
-        struct ip6_hdr ip6;
-        u_int32_t flowlabel;
-        mbuf_copydata(m, sizeof(eh), sizeof(ip6), (caddr_t)&ip6);
-        flowlabel = ntohl(ip6.ip6_flow);
-        if ((flowlabel >> 28) != 6)
+    else if (type == ETHERTYPE_IPV6) {
+        /* version and traffic class straddle the first two bytes */
+        if ((p[ETHER_HDR_LEN] >> 4) != 6)
             return 0;
-        ds_field = (flowlabel >> 20) & 0xff;
+        ds_field = (p[ETHER_HDR_LEN] << 4) | (p[ETHER_HDR_LEN + 1] >> 4);
     }
 #endif    /* INET6 */
     else    /* neither IPv4 nor IPv6 */
@@ -512,6 +521,96 @@ ieee80211_tx_compressed_bar(struct ieee80211com *ic, struct ieee80211_node *ni,
         ieee80211_release_node(ic, ni);
 }
 
+/*
+ * Return the 802.11 and LLC/SNAP headers for data frames to ni on slot
+ * (a TID, or IEEE80211_NUM_TID for non-QoS frames), rebuilding the
+ * node's cached copy if the settings it depends on have changed.  Falls
+ * back to building into scratch if the cache cannot be allocated.
+ * Returns NULL in operating modes which do not send data frames.
+ */
+const u_int8_t *
+ieee80211_encap_txhdr(struct ieee80211com *ic, struct ieee80211_node *ni,
+    int slot, u_int hdrlen, u_int8_t *scratch)
+{
+	struct ieee80211_frame *wh;
+	struct llc *llc;
+	struct ieee80211_txhdr *th;
+	u_int8_t *hdr;
+	u_int32_t key;
+	int protect, noack;
+
+	protect = (ic->ic_flags & IEEE80211_F_WEPON) ||
+	    ((ic->ic_flags & IEEE80211_F_RSNON) &&
+	     (ni->ni_flags & IEEE80211_NODE_TXPROT));
+	noack = slot < IEEE80211_NUM_TID && (ic->ic_tid_noack & (1 << slot));
+	key = 1 | (protect << 1) | (noack << 2) | (ic->ic_opmode << 3);
+
+	if (ni->ni_txhdr == NULL)
+		ni->ni_txhdr = (struct ieee80211_txhdr *)_MallocZero(
+		    (IEEE80211_NUM_TID + 1) * sizeof(struct ieee80211_txhdr));
+	if (ni->ni_txhdr != NULL) {
+		th = &ni->ni_txhdr[slot];
+		wh = (struct ieee80211_frame *)th->th_hdr;
+		if (th->th_key == key &&
+		    (ic->ic_opmode != IEEE80211_M_STA ||
+		     IEEE80211_ADDR_EQ(wh->i_addr1, ni->ni_bssid)) &&
+		    (ic->ic_opmode != IEEE80211_M_HOSTAP ||
+		     IEEE80211_ADDR_EQ(wh->i_addr2, ni->ni_bssid)))
+			return th->th_hdr;
+		hdr = th->th_hdr;
+	} else {
+		th = NULL;
+		hdr = scratch;
+	}
+
+	memset(hdr, 0, IEEE80211_TXHDR_LEN);
+	wh = (struct ieee80211_frame *)hdr;
+	wh->i_fc[0] = IEEE80211_FC0_VERSION_0 | IEEE80211_FC0_TYPE_DATA;
+	if (slot < IEEE80211_NUM_TID) {
+		struct ieee80211_qosframe *qwh =
+		    (struct ieee80211_qosframe *)wh;
+		u_int16_t qos = slot;
+
+		if (noack)
+			qos |= IEEE80211_QOS_ACK_POLICY_NOACK;
+		else {
+			/* Use HT immediate block-ack. */
+			qos |= IEEE80211_QOS_ACK_POLICY_NORMAL;
+		}
+		qwh->i_fc[0] |= IEEE80211_FC0_SUBTYPE_QOS;
+		*(u_int16_t *)qwh->i_qos = htole16(qos);
+	}
+	switch (ic->ic_opmode) {
+	case IEEE80211_M_STA:
+		wh->i_fc[1] = IEEE80211_FC1_DIR_TODS;
+		IEEE80211_ADDR_COPY(wh->i_addr1, ni->ni_bssid);
+		break;
+#ifndef IEEE80211_STA_ONLY
+	case IEEE80211_M_IBSS:
+	case IEEE80211_M_AHDEMO:
+		wh->i_fc[1] = IEEE80211_FC1_DIR_NODS;
+		break;
+	case IEEE80211_M_HOSTAP:
+		wh->i_fc[1] = IEEE80211_FC1_DIR_FROMDS;
+		IEEE80211_ADDR_COPY(wh->i_addr2, ni->ni_bssid);
+		break;
+#endif
+	default:
+		/* should not get there */
+		return NULL;
+	}
+	if (protect)
+		wh->i_fc[1] |= IEEE80211_FC1_PROTECTED;
+
+	llc = (struct llc *)(hdr + hdrlen);
+	llc->llc_dsap = llc->llc_ssap = LLC_SNAP_LSAP;
+	llc->llc_control = LLC_UI;
+
+	if (th != NULL)
+		th->th_key = key;
+	return hdr;
+}
+
 /*
  * Encapsulate an outbound data frame.  The mbuf chain is updated and
  * a reference to the destination node is returned.  If an error is
@@ -532,7 +631,9 @@ ieee80211_encap(struct _ifnet *ifp, mbuf_t m, struct ieee80211_node **pni)
 	mbuf_tag_id_t mtag;
 	u_int8_t *addr;
 	u_int dlt, hdrlen;
-	int addqos, tid = 0;
+	int addqos, tid = 0, delta;
+	const u_int8_t *th;
+	u_int8_t scratch[IEEE80211_TXHDR_LEN];
 
 	/* Handle raw frames if mbuf is tagged as 802.11 */
     if (0) {
@@ -636,41 +737,48 @@ fallback:
         } else {
             hdrlen = sizeof(struct ieee80211_qosframe);
             addqos = 1;
+            /* push back the Block Ack inactivity deadline */
+            if (ba->ba_timeout_val != 0)
+                ba->ba_lastact = nsecuptime();
         }
     } else {
         hdrlen = sizeof(struct ieee80211_frame);
         addqos = 0;
     }
-    mbuf_adj(m, sizeof(struct ether_header) - LLC_SNAPFRAMELEN);
-    llc = mtod(m, struct llc *);
-    llc->llc_dsap = llc->llc_ssap = LLC_SNAP_LSAP;
-    llc->llc_control = LLC_UI;
-    llc->llc_snap.org_code[0] = 0;
-    llc->llc_snap.org_code[1] = 0;
-    llc->llc_snap.org_code[2] = 0;
-    llc->llc_snap.ether_type = eh.ether_type;
-    mbuf_prepend(&m, hdrlen, MBUF_DONTWAIT);
-    if (m == NULL) {
-        ic->ic_stats.is_tx_nombuf++;
+    th = ieee80211_encap_txhdr(ic, ni, addqos ? tid : IEEE80211_NUM_TID,
+        hdrlen, scratch);
+    if (th == NULL)
         goto bad;
+
+    /*
+     * Replace the Ethernet header with the 802.11 and LLC/SNAP headers.
+     * Usually the first mbuf has enough leading space to do this in one
+     * step; otherwise strip it and prepend a new one.
+     */
+    delta = hdrlen + LLC_SNAPFRAMELEN - ETHER_HDR_LEN;
+    if (mbuf_leadingspace(m) >= delta) {
+        mbuf_setdata(m, mtod(m, u_int8_t *) - delta, mbuf_len(m) + delta);
+        mbuf_pkthdr_setlen(m, mbuf_pkthdr_len(m) + delta);
+    } else {
+        mbuf_adj(m, ETHER_HDR_LEN);
+        mbuf_prepend(&m, hdrlen + LLC_SNAPFRAMELEN, MBUF_DONTWAIT);
+        if (m == NULL) {
+            ic->ic_stats.is_tx_nombuf++;
+            goto bad;
+        }
     }
+    /* two fixed-size copies: a variable one is a slow string move */
+    if (addqos)
+        memcpy(mtod(m, u_int8_t *), th,
+            sizeof(struct ieee80211_qosframe) + LLC_SNAPFRAMELEN);
+    else
+        memcpy(mtod(m, u_int8_t *), th,
+            sizeof(struct ieee80211_frame) + LLC_SNAPFRAMELEN);
     wh = mtod(m, struct ieee80211_frame *);
-    wh->i_fc[0] = IEEE80211_FC0_VERSION_0 | IEEE80211_FC0_TYPE_DATA;
-    *(u_int16_t *)&wh->i_dur[0] = 0;
+    llc = (struct llc *)(mtod(m, u_int8_t *) + hdrlen);
+    llc->llc_snap.ether_type = eh.ether_type;
     if (addqos) {
-        struct ieee80211_qosframe *qwh =
-        (struct ieee80211_qosframe *)wh;
-        u_int16_t qos = tid;
-        
-        if (ic->ic_tid_noack & (1 << tid))
-            qos |= IEEE80211_QOS_ACK_POLICY_NOACK;
-        else {
-            /* Use HT immediate block-ack. */
-            qos |= IEEE80211_QOS_ACK_POLICY_NORMAL;
-        }
-        qwh->i_fc[0] |= IEEE80211_FC0_SUBTYPE_QOS;
-        *(u_int16_t *)qwh->i_qos = htole16(qos);
-        *(u_int16_t *)qwh->i_seq =
+        *(u_int16_t *)wh->i_seq =
         htole16(ni->ni_qos_txseqs[tid] << IEEE80211_SEQ_SEQ_SHIFT);
         ni->ni_qos_txseqs[tid] = (ni->ni_qos_txseqs[tid] + 1) & 0xfff;
     } else {
@@ -680,36 +788,25 @@ fallback:
     }
     switch (ic->ic_opmode) {
         case IEEE80211_M_STA:
-            wh->i_fc[1] = IEEE80211_FC1_DIR_TODS;
-            IEEE80211_ADDR_COPY(wh->i_addr1, ni->ni_bssid);
             IEEE80211_ADDR_COPY(wh->i_addr2, eh.ether_shost);
             IEEE80211_ADDR_COPY(wh->i_addr3, eh.ether_dhost);
             break;
 #ifndef IEEE80211_STA_ONLY
         case IEEE80211_M_IBSS:
         case IEEE80211_M_AHDEMO:
-            wh->i_fc[1] = IEEE80211_FC1_DIR_NODS;
             IEEE80211_ADDR_COPY(wh->i_addr1, eh.ether_dhost);
             IEEE80211_ADDR_COPY(wh->i_addr2, eh.ether_shost);
             IEEE80211_ADDR_COPY(wh->i_addr3, ic->ic_bss->ni_bssid);
             break;
         case IEEE80211_M_HOSTAP:
-            wh->i_fc[1] = IEEE80211_FC1_DIR_FROMDS;
             IEEE80211_ADDR_COPY(wh->i_addr1, eh.ether_dhost);
-            IEEE80211_ADDR_COPY(wh->i_addr2, ni->ni_bssid);
             IEEE80211_ADDR_COPY(wh->i_addr3, eh.ether_shost);
             break;
 #endif
         default:
-            /* should not get there */
-            goto bad;
+            break;
     }
     
-    if ((ic->ic_flags & IEEE80211_F_WEPON) ||
-        ((ic->ic_flags & IEEE80211_F_RSNON) &&
-         (ni->ni_flags & IEEE80211_NODE_TXPROT)))
-        wh->i_fc[1] |= IEEE80211_FC1_PROTECTED;
-    
 #ifndef IEEE80211_STA_ONLY
     if (ic->ic_opmode == IEEE80211_M_HOSTAP &&
         ieee80211_pwrsave(ic, m, ni) != 0) {
@@ -727,6 +824,366 @@ bad:
     return NULL;
 }
 
+/*
+ * Deal with the TCP/UDP checksum the network stack left for the
+ * interface to compute on an encapsulated data frame.  If offload is
+ * set and the frame is an unfragmented IPv4 or IPv6 TCP/UDP packet, the
+ * checksum field is cleared for the hardware and 1 is returned.  In any
+ * other case the pending checksums are computed here and 0 is returned.
+ */
+int
+ieee80211_tx_csum(struct ieee80211com *ic, mbuf_t m, u_int hdrlen,
+    int offload)
+{
+	mbuf_csum_request_flags_t req;
+	u_int32_t value;
+	u_int8_t hdr[LLC_SNAPFRAMELEN + 40];	/* fixed IPv6 header */
+	u_int16_t zero = 0;
+	int off, family, iplen, proto, csumoff;
+
+	if (mbuf_get_csum_requested(m, &req, &value) != 0 ||
+	    (req & (MBUF_CSUM_REQ_IP | MBUF_CSUM_REQ_TCP | MBUF_CSUM_REQ_UDP |
+	    MBUF_CSUM_REQ_TCPIPV6 | MBUF_CSUM_REQ_UDPIPV6)) == 0)
+		return 0;
+
+	off = hdrlen + LLC_SNAPFRAMELEN;
+	if (mbuf_copydata(m, hdrlen, LLC_SNAPFRAMELEN + sizeof(struct ip),
+	    hdr) != 0)
+		return 0;
+	switch ((hdr[6] << 8) | hdr[7]) {
+	case ETHERTYPE_IP:
+		family = PF_INET;
+		iplen = (hdr[LLC_SNAPFRAMELEN] & 0x0f) << 2;
+		proto = hdr[LLC_SNAPFRAMELEN + 9];
+		/* fragments carry no L4 header the hardware could find */
+		if (((hdr[LLC_SNAPFRAMELEN + 6] << 8) |
+		    hdr[LLC_SNAPFRAMELEN + 7]) & (IP_MF | IP_OFFMASK))
+			offload = 0;
+		break;
+	case ETHERTYPE_IPV6:
+		family = PF_INET6;
+		iplen = 40;
+		if (mbuf_copydata(m, hdrlen, sizeof(hdr), hdr) != 0)
+			return 0;
+		/* no extension headers */
+		proto = hdr[LLC_SNAPFRAMELEN + 6];
+		break;
+	default:
+		return 0;
+	}
+
+	/* the IPv4 header checksum is never left to the hardware */
+	if (req & MBUF_CSUM_REQ_IP)
+		offload = 0;
+	if (proto == IPPROTO_TCP &&
+	    (req & (MBUF_CSUM_REQ_TCP | MBUF_CSUM_REQ_TCPIPV6)))
+		csumoff = 16;	/* th_sum */
+	else if (proto == IPPROTO_UDP &&
+	    (req & (MBUF_CSUM_REQ_UDP | MBUF_CSUM_REQ_UDPIPV6)))
+		csumoff = 6;	/* uh_sum */
+	else
+		offload = 0;
+
+	/* the hardware computes the pseudo-header sum itself */
+	if (offload && off + iplen + csumoff + 2 <= mbuf_pkthdr_len(m) &&
+	    mbuf_copyback(m, off + iplen + csumoff, sizeof(zero), &zero,
+	    MBUF_DONTWAIT) == 0)
+		return 1;
+
+	mbuf_outbound_finalize(m, family, off);
+	return 0;
+}
+
+/*
+ * Largest A-MSDU body the peer accepts inside an A-MPDU, capped by what
+ * the driver can send.
+ */
+static int
+ieee80211_amsdu_maxlen(struct ieee80211com *ic, struct ieee80211_node *ni,
+    u_int hdrlen)
+{
+	int len;
+
+	if (ni->ni_flags & (IEEE80211_NODE_VHT | IEEE80211_NODE_HE)) {
+		switch (ni->ni_vhtcaps & IEEE80211_VHTCAP_MAX_MPDU_MASK) {
+		case IEEE80211_VHTCAP_MAX_MPDU_LENGTH_11454:
+			len = IEEE80211_MAX_MPDU_LEN_VHT_11454;
+			break;
+		case IEEE80211_VHTCAP_MAX_MPDU_LENGTH_7991:
+			len = IEEE80211_MAX_MPDU_LEN_VHT_7991;
+			break;
+		default:
+			len = IEEE80211_MAX_MPDU_LEN_VHT_3895;
+			break;
+		}
+	} else {
+		len = (ni->ni_htcaps & IEEE80211_HTCAP_AMSDU7935) ?
+		    IEEE80211_MAX_MPDU_LEN_HT_7935 :
+		    IEEE80211_MAX_MPDU_LEN_HT_3839;
+		/* HT limits MPDUs within an A-MPDU to 4095 bytes */
+		len = min(len, IEEE80211_MAX_MPDU_LEN_HT_BA);
+	}
+	len = min(len, ic->ic_tx_amsdu_maxlen);
+	return len - hdrlen - IEEE80211_CCMP_HDRLEN - IEEE80211_CCMP_MICLEN -
+	    IEEE80211_CRC_LEN;
+}
+
+/*
+ * Return the TID of an encapsulated frame if it may be carried in an
+ * A-MSDU, or -1.
+ */
+static int
+ieee80211_amsdu_tid(struct ieee80211com *ic, mbuf_t m,
+    struct ieee80211_node *ni)
+{
+	struct ieee80211_frame *wh = mtod(m, struct ieee80211_frame *);
+	struct ieee80211_tx_ba *ba;
+	struct ieee80211_key *k;
+	int tid;
+
+	if (ic->ic_tx_amsdu_maxlen == 0 ||
+	    (wh->i_fc[0] & (IEEE80211_FC0_TYPE_MASK |
+	     IEEE80211_FC0_SUBTYPE_MASK)) !=
+	    (IEEE80211_FC0_TYPE_DATA | IEEE80211_FC0_SUBTYPE_QOS) ||
+	    IEEE80211_IS_MULTICAST(wh->i_addr1))
+		return -1;
+	tid = ieee80211_get_qos(wh) & IEEE80211_QOS_TID;
+	ba = &ni->ni_tx_ba[tid];
+	if (ba->ba_state != IEEE80211_BA_AGREED ||
+	    !(ba->ba_params & IEEE80211_ADDBA_AMSDU))
+		return -1;
+	/*
+	 * When the firmware sets up the agreement we never see the
+	 * peer's ADDBA response; VHT and HE peers must accept A-MSDUs
+	 * in A-MPDUs, HT peers may not.
+	 */
+	if ((ic->ic_caps & IEEE80211_C_TX_AMPDU_SETUP_IN_HW) &&
+	    !(ni->ni_flags & (IEEE80211_NODE_VHT | IEEE80211_NODE_HE)))
+		return -1;
+	/* only hardware CCMP protects the aggregate as a whole */
+	if (wh->i_fc[1] & IEEE80211_FC1_PROTECTED) {
+		k = ieee80211_get_txkey(ic, wh, ni);
+		if (k->k_cipher != IEEE80211_CIPHER_CCMP)
+			return -1;
+	}
+	return tid;
+}
+
+static void
+ieee80211_amsdu_addrs(const struct ieee80211_frame *wh, u_int8_t *da,
+    u_int8_t *sa)
+{
+	switch (wh->i_fc[1] & IEEE80211_FC1_DIR_MASK) {
+	case IEEE80211_FC1_DIR_TODS:
+		IEEE80211_ADDR_COPY(da, wh->i_addr3);
+		IEEE80211_ADDR_COPY(sa, wh->i_addr2);
+		break;
+	case IEEE80211_FC1_DIR_FROMDS:
+		IEEE80211_ADDR_COPY(da, wh->i_addr1);
+		IEEE80211_ADDR_COPY(sa, wh->i_addr3);
+		break;
+	default:
+		IEEE80211_ADDR_COPY(da, wh->i_addr1);
+		IEEE80211_ADDR_COPY(sa, wh->i_addr2);
+		break;
+	}
+}
+
+/*
+ * Turn the pending frame into the first subframe of an A-MSDU: insert
+ * the subframe header after the 802.11 header, put the BSSID in the
+ * address field it replaces (see 9.3.2.1.2) and set the A-MSDU present
+ * bit.  Returns non-zero if the frame had to be dropped.
+ */
+static int
+ieee80211_amsdu_head(struct ieee80211com *ic, struct ieee80211_amsdu *am)
+{
+	struct ieee80211_frame *wh;
+	struct ether_header *eh;
+	u_int8_t da[IEEE80211_ADDR_LEN], sa[IEEE80211_ADDR_LEN];
+	mbuf_t m = am->am_head;
+	u_int hdrlen = am->am_hdrlen;
+
+	ieee80211_amsdu_addrs(mtod(m, struct ieee80211_frame *), da, sa);
+	if (mbuf_prepend(&m, ETHER_HDR_LEN, MBUF_DONTWAIT) != 0 ||
+	    (mbuf_len(m) < hdrlen + ETHER_HDR_LEN &&
+	     mbuf_pullup(&m, hdrlen + ETHER_HDR_LEN) != 0)) {
+		ic->ic_stats.is_tx_nombuf++;
+		ieee80211_release_node(ic, am->am_ni);
+		am->am_head = NULL;
+		return 1;
+	}
+	memmove(mtod(m, u_int8_t *), mtod(m, u_int8_t *) + ETHER_HDR_LEN,
+	    hdrlen);
+	wh = mtod(m, struct ieee80211_frame *);
+	eh = (struct ether_header *)(mtod(m, u_int8_t *) + hdrlen);
+	IEEE80211_ADDR_COPY(eh->ether_dhost, da);
+	IEEE80211_ADDR_COPY(eh->ether_shost, sa);
+	eh->ether_type = htons(am->am_len);
+	switch (wh->i_fc[1] & IEEE80211_FC1_DIR_MASK) {
+	case IEEE80211_FC1_DIR_TODS:
+		IEEE80211_ADDR_COPY(wh->i_addr3, wh->i_addr1);
+		break;
+	case IEEE80211_FC1_DIR_FROMDS:
+		IEEE80211_ADDR_COPY(wh->i_addr3, wh->i_addr2);
+		break;
+	}
+	*(u_int16_t *)((struct ieee80211_qosframe *)wh)->i_qos |=
+	    htole16(IEEE80211_QOS_AMSDU);
+
+	am->am_head = m;
+	for (am->am_tail = m; mbuf_next(am->am_tail) != NULL;
+	    am->am_tail = mbuf_next(am->am_tail))
+		;
+	am->am_len += ETHER_HDR_LEN;
+	return 0;
+}
+
+/*
+ * Hold an encapsulated frame returned by ieee80211_encap() so that the
+ * frames following it to the same RA/TID can be appended as A-MSDU
+ * subframes.  Returns non-zero if the frame is not eligible, in which
+ * case it should be sent as is.
+ */
+int
+ieee80211_amsdu_start(struct ieee80211com *ic, struct ieee80211_amsdu *am,
+    mbuf_t m, struct ieee80211_node *ni)
+{
+	int tid;
+
+	if ((tid = ieee80211_amsdu_tid(ic, m, ni)) == -1)
+		return 1;
+	am->am_hdrlen = ieee80211_get_hdrlen(mtod(m, struct ieee80211_frame *));
+	am->am_len = mbuf_pkthdr_len(m) - am->am_hdrlen;
+	am->am_maxlen = ieee80211_amsdu_maxlen(ic, ni, am->am_hdrlen);
+	/* don't bother if no other subframe could follow */
+	if (ETHER_HDR_LEN + am->am_len + 3 + ETHER_HDR_LEN +
+	    LLC_SNAPFRAMELEN > am->am_maxlen)
+		return 1;
+	am->am_head = m;
+	am->am_tail = NULL;
+	am->am_ni = ni;
+	am->am_tid = tid;
+	am->am_nframes = 1;
+	return 0;
+}
+
+/*
+ * Append an encapsulated frame to the pending A-MSDU.  The frame's
+ * sequence number is handed back since the A-MSDU goes out under the
+ * number of its first frame.  Returns 0 if the frame was consumed,
+ * non-zero if it does not belong to or no longer fits the A-MSDU.
+ */
+int
+ieee80211_amsdu_append(struct ieee80211com *ic, struct ieee80211_amsdu *am,
+    mbuf_t m, struct ieee80211_node *ni)
+{
+	struct ieee80211_frame *wh;
+	struct ether_header *eh;
+	u_int8_t da[IEEE80211_ADDR_LEN], sa[IEEE80211_ADDR_LEN];
+	mbuf_t n, t;
+	u_int16_t seq;
+	int cur, len, pad;
+
+	if (am->am_head == NULL || ni != am->am_ni ||
+	    am->am_nframes >= IEEE80211_AMSDU_TX_MAXSUB ||
+	    ieee80211_amsdu_tid(ic, m, ni) != am->am_tid)
+		return 1;
+	wh = mtod(m, struct ieee80211_frame *);
+	if ((wh->i_fc[1] ^ mtod(am->am_head,
+	    struct ieee80211_frame *)->i_fc[1]) & IEEE80211_FC1_PROTECTED)
+		return 1;
+	/* only the most recently numbered frame can give its number back */
+	seq = letoh16(*(u_int16_t *)wh->i_seq) >> IEEE80211_SEQ_SEQ_SHIFT;
+	if (((seq + 1) & 0xfff) != ni->ni_qos_txseqs[am->am_tid])
+		return 1;
+
+	len = mbuf_pkthdr_len(m) - am->am_hdrlen;
+	cur = am->am_len + (am->am_nframes == 1 ? ETHER_HDR_LEN : 0);
+	/* subframes start on a 4-byte boundary */
+	pad = -cur & 3;
+	if (cur + pad + ETHER_HDR_LEN + len > am->am_maxlen)
+		return 1;
+
+	/*
+	 * The hardware cannot checksum subframes that carry different
+	 * flows; finish pending checksums before aggregating.
+	 */
+	if (am->am_nframes == 1) {
+		ieee80211_tx_csum(ic, am->am_head, am->am_hdrlen, 0);
+		if (ieee80211_amsdu_head(ic, am) != 0)
+			return 1;
+	}
+	ieee80211_tx_csum(ic, m, am->am_hdrlen, 0);
+	n = NULL;
+	if (pad > 0 && mbuf_trailingspace(am->am_tail) < pad) {
+		if (mbuf_get(MBUF_DONTWAIT, MBUF_TYPE_DATA, &n) != 0)
+			return 1;
+		mbuf_setlen(n, 0);
+	}
+
+	/*
+	 * From here the frame is consumed, either as a subframe under the
+	 * number of the first one or dropped; either way its number is free.
+	 */
+	ni->ni_qos_txseqs[am->am_tid] = seq;
+
+	/* replace the 802.11 header with the subframe header */
+	ieee80211_amsdu_addrs(wh, da, sa);
+	mbuf_adj(m, am->am_hdrlen);
+	if (mbuf_prepend(&m, ETHER_HDR_LEN, MBUF_DONTWAIT) != 0) {
+		if (n != NULL)
+			mbuf_free(n);
+		ic->ic_stats.is_tx_nombuf++;
+		ieee80211_release_node(ic, ni);
+		return 0;
+	}
+	/* only the head of the chain carries a packet header */
+	mbuf_setflags(m, mbuf_flags(m) & ~MBUF_PKTHDR);
+	eh = mtod(m, struct ether_header *);
+	IEEE80211_ADDR_COPY(eh->ether_dhost, da);
+	IEEE80211_ADDR_COPY(eh->ether_shost, sa);
+	eh->ether_type = htons(len);
+
+	if (pad > 0) {
+		if (n != NULL) {
+			mbuf_setnext(am->am_tail, n);
+			am->am_tail = n;
+		}
+		t = am->am_tail;
+		memset(mtod(t, u_int8_t *) + mbuf_len(t), 0, pad);
+		mbuf_setlen(t, mbuf_len(t) + pad);
+	}
+	mbuf_setnext(am->am_tail, m);
+	for (t = m; mbuf_next(t) != NULL; t = mbuf_next(t))
+		;
+	am->am_tail = t;
+	mbuf_pkthdr_setlen(am->am_head, mbuf_pkthdr_len(am->am_head) + pad +
+	    ETHER_HDR_LEN + len);
+	am->am_len = cur + pad + ETHER_HDR_LEN + len;
+	am->am_nframes++;
+
+	/* the A-MSDU holds a reference already */
+	ieee80211_release_node(ic, ni);
+	return 0;
+}
+
+/*
+ * Return the pending frame, if any, and its node reference.
+ */
+mbuf_t
+ieee80211_amsdu_take(struct ieee80211com *ic, struct ieee80211_amsdu *am,
+    struct ieee80211_node **pni)
+{
+	mbuf_t m = am->am_head;
+
+	*pni = am->am_ni;
+	am->am_head = am->am_tail = NULL;
+	am->am_ni = NULL;
+	am->am_nframes = 0;
+	return m;
+}
+
 /*
  * Add a Capability Information field to a frame (see 7.3.1.4).
  */
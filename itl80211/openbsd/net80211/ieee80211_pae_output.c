@@ -135,8 +135,11 @@ ieee80211_send_eapol_key(struct ieee80211com *ic, mbuf_t m,
     
 #ifndef IEEE80211_STA_ONLY
     /* start a 100ms timeout if an answer is expected from supplicant */
-    if (info & EAPOL_KEY_KEYACK)
+    if (info & EAPOL_KEY_KEYACK) {
+        if (ni->ni_eapol_to == NULL)
+            timeout_set(&ni->ni_eapol_to, ieee80211_eapol_timeout, ni);
         timeout_add_msec(&ni->ni_eapol_to, 100);
+    }
 #endif
     
     if (!ifp->if_snd->lockEnqueue(m)) {
@@ -567,6 +567,9 @@ ieee80211_sa_query_request(struct ieee80211com *ic, struct ieee80211_node *ni)
 	/* send SA Query Request */
 	IEEE80211_SEND_ACTION(ic, ni, IEEE80211_CATEG_SA_QUERY,
 	    IEEE80211_ACTION_SA_QUERY_REQ, 0);
+	if (ni->ni_sa_query_to == NULL)
+		timeout_set(&ni->ni_sa_query_to, ieee80211_sa_query_timeout,
+		    ni);
 	timeout_add_msec(&ni->ni_sa_query_to, 10);
 }
 #endif	/* IEEE80211_STA_ONLY */
@@ -935,6 +938,25 @@ ieee80211_sta_set_rx_nss(struct ieee80211com *ic, struct ieee80211_node *ni)
     XYLog("%s ni_rx_nss: %d\n", __FUNCTION__, ni->ni_rx_nss);
 }
 
+/*
+ * Block Ack inactivity timeouts are lazy: the data path only records the
+ * time of last use in ba_lastact and the timeout, armed once when the
+ * agreement is set up, re-arms itself for the time remaining when it
+ * fires early.  Returns the number of microseconds left before an
+ * agreement last used at lastact times out, or 0 if it has.
+ */
+int
+ieee80211_inact_left(u_int64_t lastact, int timeout_usec)
+{
+	u_int64_t now, deadline;
+
+	now = nsecuptime();
+	deadline = lastact + (u_int64_t)timeout_usec * 1000;
+	if (now >= deadline)
+		return 0;
+	return (int)((deadline - now + 999) / 1000);
+}
+
 void
 ieee80211_tx_ba_timeout(void *arg)
 {
@@ -942,7 +964,7 @@ ieee80211_tx_ba_timeout(void *arg)
 	struct ieee80211_node *ni = ba->ba_ni;
 	struct ieee80211com *ic = ni->ni_ic;
 	u_int8_t tid;
-	int s;
+	int s, left;
 
 	s = splnet();
 	tid = ((caddr_t)ba - (caddr_t)ni->ni_tx_ba) / sizeof(*ba);
@@ -960,6 +982,13 @@ ieee80211_tx_ba_timeout(void *arg)
 		    IEEE80211_ACTION_DELBA,
 		    IEEE80211_REASON_SETUP_REQUIRED << 16 | 1 << 8 | tid);
 	} else if (ba->ba_state == IEEE80211_BA_AGREED) {
+		left = ieee80211_inact_left(ba->ba_lastact,
+		    ba->ba_timeout_val);
+		if (left > 0) {
+			timeout_add_usec(&ba->ba_to, left);
+			splx(s);
+			return;
+		}
 		/* Block Ack inactivity timeout */
 		ic->ic_stats.is_ht_tx_ba_timeout++;
 		ieee80211_delba_request(ic, ni, IEEE80211_REASON_TIMEOUT,
@@ -975,12 +1004,19 @@ ieee80211_rx_ba_timeout(void *arg)
 	struct ieee80211_node *ni = ba->ba_ni;
 	struct ieee80211com *ic = ni->ni_ic;
 	u_int8_t tid;
-	int s;
-
-	ic->ic_stats.is_ht_rx_ba_timeout++;
+	int s, left;
 
 	s = splnet();
 
+	left = ieee80211_inact_left(ba->ba_lastact, ba->ba_timeout_val);
+	if (ba->ba_state == IEEE80211_BA_AGREED && left > 0) {
+		timeout_add_usec(&ba->ba_to, left);
+		splx(s);
+		return;
+	}
+
+	ic->ic_stats.is_ht_rx_ba_timeout++;
+
 	/* Block Ack inactivity timeout */
 	tid = ((caddr_t)ba - (caddr_t)ni->ni_rx_ba) / sizeof(*ba);
 	ieee80211_delba_request(ic, ni, IEEE80211_REASON_TIMEOUT, 0, tid);
@@ -1057,7 +1093,6 @@ ieee80211_delba_request(struct ieee80211com *ic, struct ieee80211_node *ni,
 	} else {
 		/* MLME-DELBA.confirm(Recipient) */
 		struct ieee80211_rx_ba *ba = &ni->ni_rx_ba[tid];
-		int i;
 
 		if (ic->ic_ampdu_rx_stop != NULL)
 			ic->ic_ampdu_rx_stop(ic, ni, tid);
@@ -1067,15 +1102,8 @@ ieee80211_delba_request(struct ieee80211com *ic, struct ieee80211_node *ni,
 		timeout_del(&ba->ba_to);
 		timeout_del(&ba->ba_gap_to);
 
-		if (ba->ba_buf != NULL) {
-			/* free all MSDUs stored in reordering buffer */
-			for (i = 0; i < IEEE80211_BA_MAX_WINSZ; i++)
-				mbuf_freem(ba->ba_buf[i].m);
-			/* free reordering buffer */
-			IOFree(ba->ba_buf,
-			    IEEE80211_BA_MAX_WINSZ * sizeof(*ba->ba_buf));
-			ba->ba_buf = NULL;
-		}
+		/* free all MSDUs stored in reordering buffer */
+		ieee80211_rx_ba_buf_free(ba);
 	}
 }
 
@@ -76,6 +76,23 @@ extern	void ieee80211_proto_detach(struct _ifnet *);
 struct ieee80211_node;
 struct ieee80211_rxinfo;
 struct ieee80211_rsnparams;
+
+/*
+ * A-MSDU being built on transmit by ieee80211_amsdu_start() and
+ * ieee80211_amsdu_append() from frames returned by ieee80211_encap().
+ * am_head is NULL when nothing is pending.
+ */
+struct ieee80211_amsdu {
+	mbuf_t			am_head;	/* MPDU being built */
+	mbuf_t			am_tail;	/* last mbuf of am_head */
+	struct ieee80211_node	*am_ni;
+	int			am_tid;
+	u_int			am_hdrlen;
+	int			am_len;		/* MPDU body length */
+	int			am_maxlen;
+	int			am_nframes;	/* MSDUs in am_head */
+};
+#define IEEE80211_AMSDU_TX_MAXSUB	8
 extern	void ieee80211_set_link_state(struct ieee80211com *, int);
 extern	u_int ieee80211_get_hdrlen(const struct ieee80211_frame *);
 extern	int ieee80211_classify(struct ieee80211com *, mbuf_t);
@@ -96,6 +113,13 @@ extern	void ieee80211_tx_compressed_bar(struct ieee80211com *,
 		struct ieee80211_node *, int, uint16_t);
 extern	mbuf_t ieee80211_encap(struct _ifnet *, mbuf_t,
 		struct ieee80211_node **);
+extern	int ieee80211_tx_csum(struct ieee80211com *, mbuf_t, u_int, int);
+extern	int ieee80211_amsdu_start(struct ieee80211com *,
+		struct ieee80211_amsdu *, mbuf_t, struct ieee80211_node *);
+extern	int ieee80211_amsdu_append(struct ieee80211com *,
+		struct ieee80211_amsdu *, mbuf_t, struct ieee80211_node *);
+extern	mbuf_t ieee80211_amsdu_take(struct ieee80211com *,
+		struct ieee80211_amsdu *, struct ieee80211_node **);
 extern	mbuf_t ieee80211_get_rts(struct ieee80211com *,
 		const struct ieee80211_frame *, u_int16_t);
 extern	mbuf_t ieee80211_get_cts_to_self(struct ieee80211com *,
@@ -194,6 +218,7 @@ extern  void ieee80211_he_negotiate(struct ieee80211com *,
 extern  void ieee80211_sta_set_rx_nss(struct ieee80211com *, struct ieee80211_node *);
 extern	void ieee80211_tx_ba_timeout(void *);
 extern	void ieee80211_rx_ba_timeout(void *);
+extern	int ieee80211_inact_left(u_int64_t, int);
 extern	int ieee80211_addba_request(struct ieee80211com *,
 	    struct ieee80211_node *,  u_int16_t, u_int8_t);
 extern	void ieee80211_delba_request(struct ieee80211com *,
@@ -492,7 +492,11 @@ struct ieee80211com {
 	u_int8_t		ic_max_rssi;
 	struct ieee80211_tree	ic_tree;
 	int			ic_nnodes;	/* length of ic_nnodes */
+	u_int32_t		ic_node_gen;	/* bumped on ic_tree changes */
 	int			ic_max_nnodes;	/* max length of ic_nnodes */
+	struct ieee80211_node	**ic_node_hash;	/* ic_tree index by MAC */
+	u_int			ic_node_hashbits;
+	struct ieee80211_node	*ic_node_last;	/* last find_node() hit */
 	u_int16_t		ic_lintval;	/* listen interval */
 	int16_t			ic_txpower;	/* tx power setting (dBm) */
 	int			ic_bmissthres;	/* beacon miss threshold */
@@ -532,7 +536,9 @@ struct ieee80211com {
 	CTimeout*		ic_tkip_micfail_timeout;
 #endif
 
-	TAILQ_HEAD(, ieee80211_pmk) ic_pmksa;	/* PMKSA cache */
+	TAILQ_HEAD(, ieee80211_pmk) ic_pmksa;	/* PMKSA cache, LRU order */
+	LIST_HEAD(, ieee80211_pmk) ic_pmksa_hash[IEEE80211_PMKSA_HASHSZ];
+	int			ic_npmksa;
 	u_int			ic_rsnprotos;
 	u_int			ic_rsnakms;
 	u_int			ic_rsnciphers;
@@ -553,6 +559,8 @@ struct ieee80211com {
     uint32_t        ic_vhtcaps;
     uint32_t        ic_hecaps;
 	u_int8_t		ic_ampdu_params;
+	u_int16_t		ic_rx_ba_maxwin; /* largest RX BA window, 0: 64 */
+	u_int16_t		ic_tx_amsdu_maxlen; /* 0: no TX A-MSDU */
 	u_int8_t		ic_sup_mcs[howmany(80, NBBY)];
 	u_int16_t		ic_max_rxrate;	/* in Mb/s, 0 <= rate <= 1023 */
 	u_int8_t		ic_tx_mcs_set;
@@ -38,14 +38,25 @@ void splx(int s)
 {
 }
 
+void initTimeout(IOWorkLoop *workloop)
+{
+    if (!CTimeout::wheelInit(workloop))
+        IOLog("itlwm: unable to set up the timeout wheel\n");
+}
+
+void releaseTimeout()
+{
+    CTimeout::wheelRelease();
+}
+
 void timeout_set(CTimeout **t, void (*fn)(void *), void *arg)
 {
-    _fCommandGate->runAction(&CTimeout::timeout_set, t, (void*)fn, arg);
+    CTimeout::timeout_set(t, fn, arg);
 }
 
 int timeout_add_msec(CTimeout **to, int msecs)
 {
-    return _fCommandGate->runAction(&CTimeout::timeout_add_msec, to, _fWorkloop, &msecs) == kIOReturnSuccess ? 1 : 0;
+    return CTimeout::timeout_add_usec(to, msecs < 0 ? 0 : (uint64_t)msecs * 1000);
 }
 
 int timeout_add_sec(CTimeout **to, int secs)
@@ -55,13 +66,12 @@ int timeout_add_sec(CTimeout **to, int secs)
 
 int timeout_add_usec(CTimeout **to, int usecs)
 {
-    return timeout_add_msec(to, (int) usecs / 1000);
+    return CTimeout::timeout_add_usec(to, usecs < 0 ? 0 : usecs);
 }
 
 int timeout_del(CTimeout **to)
 {
-    //    IOLog("timeout_del\n");
-    return _fCommandGate->runAction(&CTimeout::timeout_del, to, _fWorkloop) == kIOReturnSuccess ? 1 : 0;
+    return CTimeout::timeout_del(to);
 }
 
 int timeout_free(CTimeout **to)
@@ -71,7 +81,7 @@ int timeout_free(CTimeout **to)
 
 int timeout_pending(CTimeout **to)
 {
-    return _fCommandGate->runAction(&CTimeout::timeout_pending, to) == kIOReturnSuccess ? 1 : 0;
+    return CTimeout::timeout_pending(to);
 }
 
 int timeout_initialized(CTimeout **to)
@@ -24,29 +24,63 @@
 #define CTimeout_h
 
 #include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IOWorkLoop.h>
+#include <IOKit/IOLocks.h>
 #include <libkern/c++/OSObject.h>
+#include <sys/queue.h>
+
+/*
+ * All timeouts hang off one hierarchical timing wheel that is driven by a
+ * single IOTimerEventSource on the driver workloop. Arming, cancelling and
+ * pending checks only take the wheel mutex, never the command gate;
+ * callbacks still run on the workloop with the gate held, as before.
+ *
+ * A tick is one microsecond. Every level has 64 slots, so level n slot
+ * spans 64^n ticks and the top level reaches ~19 hours; anything further
+ * out is parked in the last slot and re-filed when it comes around.
+ */
+#define TIMEOUT_WHEEL_BITS      6
+#define TIMEOUT_WHEEL_SIZE      (1 << TIMEOUT_WHEEL_BITS)
+#define TIMEOUT_WHEEL_MASK      (TIMEOUT_WHEEL_SIZE - 1)
+#define TIMEOUT_WHEEL_LEVELS    6
+
+enum {
+    TO_S_IDLE,
+    TO_S_PENDING,       /* filed in a wheel slot */
+    TO_S_FIRING,        /* expired, waiting on the run list */
+};
+
+class CTimeout;
+TAILQ_HEAD(ctimeout_list, CTimeout);
 
 class CTimeout : public OSObject {
     OSDeclareDefaultStructors(CTimeout)
     
 public:
-    static void timeoutOccurred(OSObject* owner, IOTimerEventSource* timer);
+    static bool wheelInit(IOWorkLoop *wl);
     
-    static IOReturn timeout_add_msec(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3);
+    static void wheelRelease();
     
-    static IOReturn timeout_del(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3);
+    static void wheelOccurred(OSObject* owner, IOTimerEventSource* timer);
     
-    static IOReturn timeout_free(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3);
+    static CTimeout *timeout_set(CTimeout **cto, void (*fn)(void *), void *arg);
+    
+    static int timeout_add_usec(CTimeout **cto, uint64_t usecs);
     
-    static IOReturn timeout_set(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3);
+    static int timeout_del(CTimeout **cto);
     
-    static IOReturn timeout_pending(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3);
+    static int timeout_pending(CTimeout **cto);
+    
+    static IOReturn timeout_free(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3);
     
 public:
-    IOTimerEventSource* tm;
+    TAILQ_ENTRY(CTimeout) to_list;
+    uint64_t to_time;               /* absolute expiry, in ticks */
     void (*to_func)(void *);        /* function to call */
     void *to_arg;                /* function argument */
-    bool isPending;
+    uint8_t to_state;
+    uint8_t to_level;
+    uint8_t to_slot;
 };
 
 #endif /* CTimeout_h */
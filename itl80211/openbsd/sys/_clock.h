@@ -27,4 +27,14 @@ absolutetime_to_nanoseconds(t, &k);  \
 (int)((k * hz) / 1000000000);  \
 })
 
+static inline uint64_t
+nsecuptime(void)
+{
+    uint64_t t, ns;
+
+    clock_get_uptime(&t);
+    absolutetime_to_nanoseconds(t, &ns);
+    return ns;
+}
+
 #endif /* _clock_h */
@@ -58,6 +58,7 @@
 #include <net/if.h>
 #include <net/if_var.h>
 #include <sys/queue.h>
+#include <sys/_task.h>
 #include <sys/CTimeout.hpp>
 #include <sys/_if_media.h>
 #include <net/if_dl.h>
@@ -157,6 +158,28 @@ struct ether_multi {
     LIST_ENTRY(ether_multi) enm_list;
 };
 
+/*
+ * Receive handoff ring between the driver RX path and the delivery task,
+ * see if_input().  Producers are serialized by the command gate [g]; the
+ * delivery task [d] is the only consumer.
+ */
+#define IFIQ_SLOTS    1024        /* power of two */
+#define IFIQ_MASK     (IFIQ_SLOTS - 1)
+
+struct ifiqueue {
+    mbuf_t ifiq_ring[IFIQ_SLOTS];
+    volatile UInt32 ifiq_prod;    /* [g] next slot to fill */
+    volatile UInt32 ifiq_cons;    /* [d] next slot to drain */
+    volatile UInt32 ifiq_sched;    /* delivery task queued or running */
+    volatile UInt32 ifiq_dying;
+    struct taskq *ifiq_tq;
+    struct task ifiq_task;
+    uint64_t ifiq_packets;    /* [d] frames handed to the stack */
+    uint64_t ifiq_batches;    /* [d] input queue flushes */
+    uint64_t ifiq_qdrops;    /* [g] frames dropped, ring full */
+    UInt32 ifiq_hiwat;    /* [g] highest ring occupancy seen */
+};
+
 struct _ifnet {                /* and the entries */
     IOEthernetInterface *iface;
     IOOutputQueue* output_queue;
@@ -228,12 +251,13 @@ struct _ifnet {                /* and the entries */
 
     /* queues */
     IOPacketQueue *if_snd;        /* transmit queue */
+    volatile unsigned int if_snd_oactive; /* [N] if_snd stopped by driver */
     struct    ifqueue **if_ifqs;    /* [I] pointer to an array of sndqs */
     void    (*if_qstart)(struct ifqueue *);
     unsigned int if_nifqs;        /* [I] number of output queues */
     unsigned int if_txmit;        /* [c] txmitigation amount */
 
-//    struct    ifiqueue if_rcv;    /* rx/input queue */
+    struct    ifiqueue if_rcv;    /* rx/input queue */
 //    struct    ifiqueue **if_iqs;    /* [I] pointer to the array of iqs */
     unsigned int if_niqs;        /* [I] number of input queues */
 
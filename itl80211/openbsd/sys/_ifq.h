@@ -22,26 +22,33 @@
 #ifndef _ifq_h
 #define _ifq_h
 #include <net/if_var.h>
+#include <sys/_if_ether.h>
 #include <IOKit/network/IOPacketQueue.h>
 
-static int ifq_oactive;
+/*
+ * The output-active state lives in the interface that owns the send
+ * queue, so every translation unit sees the same flag.  Callers always
+ * pass &ifp->if_snd.
+ */
+#define IFQ_IFP(_ifq)    \
+    ((struct _ifnet *)((char *)(_ifq) - offsetof(struct _ifnet, if_snd)))
 
 static inline void
 ifq_set_oactive(IOPacketQueue **ifq)
 {
-    ifq_oactive = 1;
+    IFQ_IFP(ifq)->if_snd_oactive = 1;
 }
 
 static inline void
 ifq_clr_oactive(IOPacketQueue **ifq)
 {
-    ifq_oactive = 0;
+    IFQ_IFP(ifq)->if_snd_oactive = 0;
 }
 
 static inline unsigned int
 ifq_is_oactive(IOPacketQueue **ifq)
 {
-    return (ifq_oactive);
+    return (IFQ_IFP(ifq)->if_snd_oactive);
 }
 
 static inline mbuf_t
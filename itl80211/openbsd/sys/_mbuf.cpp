@@ -20,18 +20,116 @@
 */
 
 #include <sys/_mbuf.h>
+#include <sys/_if_ether.h>
+#include <sys/_task.h>
 
 #include <IOKit/IOCommandGate.h>
+#include <IOKit/IOLib.h>
 
 extern IOCommandGate *_fCommandGate;
 
-static IOReturn _if_input(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
+/*
+ * RX delivery.  if_input() only moves the frames onto the interface's
+ * handoff ring under the command gate and schedules the delivery task,
+ * which passes them to the network stack without holding the gate, so
+ * input processing no longer serializes with scans, ioctls, timeouts and
+ * TX start.  A full ring drops at the producer and counts the drops.
+ */
+static void
+ifiq_deliver(void *arg)
+{
+    struct _ifnet *ifp = (struct _ifnet *)arg;
+    struct ifiqueue *ifiq = &ifp->if_rcv;
+    UInt32 cons, prod;
+    mbuf_t m;
+    int n;
+
+    cons = ifiq->ifiq_cons;
+    for (;;) {
+        prod = ifiq->ifiq_prod;
+        OSMemoryBarrier();    /* see the slots published before prod */
+        if (cons == prod) {
+            ifiq->ifiq_sched = 0;
+            OSMemoryBarrier();
+            /* recheck, the producer skips task_add while sched is set */
+            if (ifiq->ifiq_prod == cons ||
+                !OSCompareAndSwap(0, 1, &ifiq->ifiq_sched))
+                break;
+            continue;
+        }
+        n = 0;
+        while (cons != prod) {
+            m = ifiq->ifiq_ring[cons & IFIQ_MASK];
+            ifiq->ifiq_ring[cons & IFIQ_MASK] = NULL;
+            cons++;
+            if (ifp->iface == NULL || ifiq->ifiq_dying) {
+                mbuf_freem(m);
+                continue;
+            }
+            ifp->iface->inputPacket(m, 0,
+                IONetworkInterface::kInputOptionQueuePacket);
+            n++;
+        }
+        OSMemoryBarrier();    /* slots are cleared before they are released */
+        ifiq->ifiq_cons = cons;
+        if (n == 0)
+            continue;
+        ifp->iface->flushInputQueue();
+        if (ifp->netStat != NULL)
+            ifp->netStat->inputPackets += n;
+        ifiq->ifiq_packets += n;
+        ifiq->ifiq_batches++;
+    }
+}
+
+int
+ifiq_init(struct _ifnet *ifp)
+{
+    struct ifiqueue *ifiq = &ifp->if_rcv;
+
+    memset(ifiq, 0, sizeof(*ifiq));
+    task_set(&ifiq->ifiq_task, ifiq_deliver, ifp, "ifiq_deliver");
+    task_set_prio(&ifiq->ifiq_task, TASK_PRIO_HIGH);
+    ifiq->ifiq_tq = taskq_create("ifiq", 1, IPL_NET, TASKQ_MPSAFE);
+    if (ifiq->ifiq_tq == NULL) {
+        XYLog("%s: no delivery thread, RX is delivered inline\n",
+            __FUNCTION__);
+        return ENOMEM;
+    }
+    return 0;
+}
+
+void
+ifiq_destroy(struct _ifnet *ifp)
+{
+    struct ifiqueue *ifiq = &ifp->if_rcv;
+    int i;
+
+    if (ifiq->ifiq_tq == NULL)
+        return;
+    ifiq->ifiq_dying = 1;
+    OSMemoryBarrier();
+    /* let a running delivery pass finish, it frees what it drains */
+    for (i = 0; i < 100 && ifiq->ifiq_sched; i++)
+        IOSleep(1);
+    taskq_destroy(ifiq->ifiq_tq);
+    ifiq->ifiq_tq = NULL;
+    for (; ifiq->ifiq_cons != ifiq->ifiq_prod; ifiq->ifiq_cons++) {
+        mbuf_freem(ifiq->ifiq_ring[ifiq->ifiq_cons & IFIQ_MASK]);
+        ifiq->ifiq_ring[ifiq->ifiq_cons & IFIQ_MASK] = NULL;
+    }
+    XYLog("%s: %llu packets in %llu batches, %llu dropped, high water %u\n",
+        __FUNCTION__, ifiq->ifiq_packets, ifiq->ifiq_batches,
+        ifiq->ifiq_qdrops, ifiq->ifiq_hiwat);
+}
+
+/* Deliver inline, for interfaces without a delivery thread. */
+static void
+_if_input_direct(struct _ifnet *ifq, struct mbuf_list *ml)
 {
     mbuf_t m;
     bool isEmpty = true;
-    struct _ifnet *ifq = (struct _ifnet *)arg0;
-    struct mbuf_list *ml = (struct mbuf_list *)arg1;
-    
+
     MBUF_LIST_FOREACH(ml, m) {
         if (ifq->iface == NULL) {
             panic("%s ifq->iface == NULL!!!\n", __FUNCTION__);
@@ -41,7 +139,6 @@ static IOReturn _if_input(OSObject *target, void *arg0, void *arg1, void *arg2,
             XYLog("%s m == NULL!!!\n", __FUNCTION__);
             continue;
         }
-        //        XYLog("%s %d 啊啊啊啊 ifq->iface->inputPacket(m) hdr_len=%d len=%d\n", __FUNCTION__, __LINE__, mbuf_pkthdr_len(m), mbuf_len(m));
         isEmpty = false;
         ifq->iface->inputPacket(m, 0, IONetworkInterface::kInputOptionQueuePacket);
         if (ifq->netStat != NULL) {
@@ -51,11 +148,54 @@ static IOReturn _if_input(OSObject *target, void *arg0, void *arg1, void *arg2,
     if (!isEmpty) {
         ifq->iface->flushInputQueue();
     }
-    return kIOReturnSuccess;
+}
+
+static IOReturn
+_if_input(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
+{
+    struct _ifnet *ifq = (struct _ifnet *)arg0;
+    struct mbuf_list *ml = (struct mbuf_list *)arg1;
+    struct ifiqueue *ifiq = &ifq->if_rcv;
+    UInt32 prod, cons;
+    int drops = 0;
+    mbuf_t m;
+
+    if (ifiq->ifiq_tq == NULL) {
+        _if_input_direct(ifq, ml);
+        return kIOReturnSuccess;
+    }
+
+    prod = ifiq->ifiq_prod;
+    cons = ifiq->ifiq_cons;
+    OSMemoryBarrier();    /* don't refill slots the consumer still reads */
+    while ((m = ml_dequeue(ml)) != NULL) {
+        if (prod - cons == IFIQ_SLOTS) {
+            cons = ifiq->ifiq_cons;
+            OSMemoryBarrier();
+        }
+        if (prod - cons == IFIQ_SLOTS || ifiq->ifiq_dying) {
+            mbuf_freem(m);
+            drops++;
+            continue;
+        }
+        ifiq->ifiq_ring[prod & IFIQ_MASK] = m;
+        prod++;
+    }
+    OSMemoryBarrier();    /* publish the slots before prod */
+    ifiq->ifiq_prod = prod;
+
+    if (prod - cons > ifiq->ifiq_hiwat)
+        ifiq->ifiq_hiwat = prod - cons;
+    if (drops) {
+        ifiq->ifiq_qdrops += drops;
+        ifq->if_ierrors += drops;
+    }
+    if (!ifiq->ifiq_dying && OSCompareAndSwap(0, 1, &ifiq->ifiq_sched))
+        task_add(ifiq->ifiq_tq, &ifiq->ifiq_task);
+    return drops ? kIOReturnOutputDropped : kIOReturnSuccess;
 }
 
 int if_input(struct _ifnet *ifq, struct mbuf_list *ml)
 {
     return _fCommandGate->runAction((IOCommandGate::Action)_if_input, ifq, ml);
 }
-
@@ -467,6 +467,8 @@ fail:
 }
 
 int if_input(struct _ifnet *ifq, struct mbuf_list *ml);
+int ifiq_init(struct _ifnet *ifp);
+void ifiq_destroy(struct _ifnet *ifp);
 
 extern int TX_TYPE_MGMT;
 extern int TX_TYPE_FRAME;
@@ -41,7 +41,7 @@ struct taskq {
     const char        *tq_name;
 
     IORecursiveLock *tq_mtx;
-    struct task_list     tq_worklist;
+    struct task_list     tq_worklist[TASK_NPRIO];
 };
 
 static const char taskq_sys_name[] = "systq";
@@ -57,6 +57,29 @@ struct taskq taskq_sys = {
 
 struct taskq *const systq = &taskq_sys;
 
+static void
+taskq_init_worklists(struct taskq *tq)
+{
+    unsigned int prio;
+
+    for (prio = 0; prio < TASK_NPRIO; prio++)
+        TAILQ_INIT(&tq->tq_worklist[prio]);
+}
+
+/* The first task of the highest priority class that has one. */
+static struct task *
+taskq_first(struct taskq *tq)
+{
+    struct task *t;
+    unsigned int prio;
+
+    for (prio = 0; prio < TASK_NPRIO; prio++) {
+        if ((t = TAILQ_FIRST(&tq->tq_worklist[prio])) != NULL)
+            return t;
+    }
+    return NULL;
+}
+
 int
 taskq_next_work(struct taskq *tq, struct task *work)
 {
@@ -65,7 +88,7 @@ taskq_next_work(struct taskq *tq, struct task *work)
     //    IOLog("itlwm: taskq %s lock\n", __FUNCTION__);
     IORecursiveLockLock(tq->tq_mtx);
     
-    while ((next = TAILQ_FIRST(&tq->tq_worklist)) == NULL) {
+    while ((next = taskq_first(tq)) == NULL) {
         if (tq->tq_state != TQ_S_RUNNING) {
             IORecursiveLockUnlock(tq->tq_mtx);
             return (0);
@@ -73,12 +96,12 @@ taskq_next_work(struct taskq *tq, struct task *work)
         IORecursiveLockSleep(tq->tq_mtx, tq, THREAD_INTERRUPTIBLE);
     }
 
-    TAILQ_REMOVE(&tq->tq_worklist, next, t_entry);
+    TAILQ_REMOVE(&tq->tq_worklist[next->t_prio], next, t_entry);
     CLR(next->t_flags, TASK_ONQUEUE);
 
     *work = *next; /* copy to caller to avoid races */
 
-    next = TAILQ_FIRST(&tq->tq_worklist);
+    next = taskq_first(tq);
     IORecursiveLockUnlock(tq->tq_mtx);
 //    IOLog("itlwm: taskq %s unlock\n", __FUNCTION__);
 
@@ -108,23 +131,21 @@ taskq_thread(void *xtq)
         (*work.t_func)(work.t_arg);
 //        IOLog("itlwm: taskq worker thread=%lld work=%s done", thread_tid(current_thread()), work.name);
 //        WITNESS_UNLOCK(&tq->tq_lock_object, 0);
-//        sched_pause(yield);
-        IOSleep(1);
     }
     
     IOLog("itlwm: taskq %s schedule task done\n", __FUNCTION__);
 
     IORecursiveLockLock(tq->tq_mtx);
     last = (--tq->tq_running == 0);
-    IORecursiveLockUnlock(tq->tq_mtx);
-
-//    if (ISSET(tq->tq_flags, TASKQ_MPSAFE))
-//        KERNEL_LOCK();
-
+    /* under the lock: taskq_destroy() frees tq once it sees 0 */
     if (last) {
         IOLog("itlwm: taskq %s schedule task wakeup\n", __FUNCTION__);
         IORecursiveLockWakeup(tq->tq_mtx, tq, false);
     }
+    IORecursiveLockUnlock(tq->tq_mtx);
+
+//    if (ISSET(tq->tq_flags, TASKQ_MPSAFE))
+//        KERNEL_LOCK();
 
 //    kthread_exit(0);
     thread_terminate(current_thread());
@@ -192,7 +213,7 @@ void
 taskq_init(void)
 {
     systq->tq_mtx = IORecursiveLockAlloc();
-    TAILQ_INIT(&systq->tq_worklist);
+    taskq_init_worklists(systq);
     thread_t new_thread;
     kernel_thread_start((thread_continue_t)taskq_create_thread, systq, &new_thread);
     thread_deallocate(new_thread);
@@ -217,7 +238,7 @@ taskq_create(const char *name, unsigned int nthreads, int ipl,
     tq->tq_mtx = IORecursiveLockAlloc();
 
     //    mtx_init_flags(&tq->tq_mtx, ipl, name, 0);
-    TAILQ_INIT(&tq->tq_worklist);
+    taskq_init_worklists(tq);
     thread_t new_thread;
     /* try to create a thread to guarantee that tasks will be serviced */
     kernel_thread_start((thread_continue_t)taskq_create_thread, tq, &new_thread);
@@ -269,9 +290,19 @@ task_set(struct task *t, void (*fn)(void *), void *arg, const char *name)
     t->t_func = fn;
     t->t_arg = arg;
     t->t_flags = 0;
+    t->t_prio = TASK_PRIO_NORMAL;
     memcpy(t->name, name, sizeof(t->name));
 }
 
+/* Only while the task is not queued: task_del() looks it up by class. */
+void
+task_set_prio(struct task *t, unsigned int prio)
+{
+    if (prio >= TASK_NPRIO)
+        prio = TASK_NPRIO - 1;
+    t->t_prio = prio;
+}
+
 int
 task_add(struct taskq *tq, struct task *w)
 {
@@ -280,15 +311,13 @@ task_add(struct taskq *tq, struct task *w)
 
     IORecursiveLockLock(tq->tq_mtx);
     if (ISSET(w->t_flags, TASK_ONQUEUE)) {
-        IOLog("itlwm: taskq task_add %s is already on queue\n", w->name);
         IORecursiveLockUnlock(tq->tq_mtx);
         return (0);
     }
     if (!ISSET(w->t_flags, TASK_ONQUEUE)) {
-        IOLog("itlwm: taskq task_add %s add to queue\n", w->name);
         rv = 1;
         SET(w->t_flags, TASK_ONQUEUE);
-        TAILQ_INSERT_TAIL(&tq->tq_worklist, w, t_entry);
+        TAILQ_INSERT_TAIL(&tq->tq_worklist[w->t_prio], w, t_entry);
     }
     IORecursiveLockUnlock(tq->tq_mtx);
 
@@ -308,7 +337,7 @@ task_del(struct taskq *tq, struct task *w)
     if (ISSET(w->t_flags, TASK_ONQUEUE)) {
         rv = 1;
         CLR(w->t_flags, TASK_ONQUEUE);
-        TAILQ_REMOVE(&tq->tq_worklist, w, t_entry);
+        TAILQ_REMOVE(&tq->tq_worklist[w->t_prio], w, t_entry);
     }
     IORecursiveLockUnlock(tq->tq_mtx);
 
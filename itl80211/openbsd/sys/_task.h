@@ -32,17 +32,27 @@ struct task {
     void        (*t_func)(void *);
     void        *t_arg;
     unsigned int    t_flags;
+    unsigned int    t_prio;
     char name[256];
 };
 
 #define TASK_ONQUEUE        1
 #define TASK_BARRIER        2
 
+/*
+ * Priority classes, dequeued strictly in order. State machine work
+ * (init, newstate) must not wait behind BA/context housekeeping.
+ */
+#define TASK_PRIO_HIGH      0
+#define TASK_PRIO_NORMAL    1
+#define TASK_PRIO_LOW       2
+#define TASK_NPRIO          3
+
 TAILQ_HEAD(task_list, task);
 
 #define TASKQ_MPSAFE        (1 << 0)
 
-#define TASK_INITIALIZER(_f, _a)  {{ NULL, NULL }, (_f), (_a), 0 }
+#define TASK_INITIALIZER(_f, _a)  {{ NULL, NULL }, (_f), (_a), 0, TASK_PRIO_NORMAL }
 
 #define task_pending(_t)    ((_t)->t_flags & TASK_ONQUEUE)
 
@@ -56,6 +66,7 @@ void         taskq_barrier(struct taskq *);
 void         taskq_del_barrier(struct taskq *, struct task *);
 
 void         task_set(struct task *, void (*)(void *), void *, const char *);
+void         task_set_prio(struct task *, unsigned int);
 int         task_add(struct taskq *, struct task *);
 int         task_del(struct taskq *, struct task *);
 
@@ -32,6 +32,8 @@ const IOControlMethodAction ItlNetworkUserClient::sMethods[IOCTL_ID_MAX] {
     sSCAN_RESULT,
     sTX_POWER_LEVEL,
     sNW_BSSID,
+    sSCAN_RESULTS,
+    sRX_POLL,
 };
 
 bool ItlNetworkUserClient::initWithTask(task_t owningTask, void *securityID, UInt32 type, OSDictionary *properties)
@@ -81,13 +83,20 @@ IOReturn ItlNetworkUserClient::externalMethod(uint32_t selector, IOExternalMetho
     bool isSet = selector & IOCTL_MASK;
     selector &= ~IOCTL_MASK;
 //    IOLog("externalMethod invoke. selector=0x%X isSet=%d\n", selector, isSet);
-    if (selector < 0 || selector > IOCTL_ID_MAX) {
+    if (selector < 0 || selector >= IOCTL_ID_MAX) {
         return super::externalMethod(selector, arguments, NULL, this, NULL);
     }
     void *data = isSet ? (void *)arguments->structureInput : (void *)arguments->structureOutput;
     if (!data) {
         return kIOReturnError;
     }
+    uint32_t size = isSet ? arguments->structureInputSize : arguments->structureOutputSize;
+    if (selector == IOCTL_80211_SCAN_RESULTS && size < sizeof(struct ioctl_scan_results)) {
+        return kIOReturnBadArgument;
+    }
+    if (selector == IOCTL_80211_RX_POLL && size < sizeof(struct ioctl_rx_poll)) {
+        return kIOReturnBadArgument;
+    }
     return sMethods[selector](this, data, isSet);
 }
 
@@ -399,8 +408,93 @@ sSCAN_RESULT(OSObject* target, void* data, bool isSet)
     return kIOReturnSuccess;
 }
 
+IOReturn ItlNetworkUserClient::
+sSCAN_RESULTSGated(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3)
+{
+    ItlNetworkUserClient *that = (ItlNetworkUserClient *)arg0;
+    struct ioctl_scan_results *sr = (struct ioctl_scan_results *)arg1;
+    bool isSet = arg2 != NULL;
+    ieee80211com *ic = that->fDriver->fHalService->get80211Controller();
+    struct ieee80211_node *ni;
+    struct ioctl_scan_record *rec;
+    uint64_t now = airport_up_time();
+    int16_t noise = that->fDriverInfo->getBSSNoise();
+    uint32_t reclen, ie_len;
+    
+    if (isSet) {
+        memcpy(that->fScanCursor, sr->cursor, ETHER_ADDR_LEN);
+        return kIOReturnSuccess;
+    }
+    ni = ieee80211_find_node_geq(ic, that->fScanCursor);
+    if (ni == NULL && RB_EMPTY(&ic->ic_tree))
+        return kIONoScanResult;
+    sr->version = IOCTL_VERSION;
+    sr->generation = ic->ic_node_gen;
+    sr->count = 0;
+    sr->len = 0;
+    for (; ni != NULL; ni = RB_NEXT(ieee80211_tree, &ic->ic_tree, ni)) {
+        ie_len = ni->ni_rsnie_tlv != NULL ? ni->ni_rsnie_tlv_len : 0;
+        // A record must fit an empty buffer, or the cursor never moves.
+        ie_len = MIN(ie_len, sizeof(sr->buf) - sizeof(*rec));
+        reclen = roundup(sizeof(*rec) + ie_len, 4);
+        if (sr->len + reclen > sizeof(sr->buf))
+            break;
+        rec = (struct ioctl_scan_record *)&sr->buf[sr->len];
+        bzero(rec, sizeof(*rec));
+        rec->len = reclen;
+        rec->ie_len = ie_len;
+        memcpy(rec->bssid, ni->ni_bssid, ETHER_ADDR_LEN);
+        rec->ssid_len = ni->ni_esslen;
+        memcpy(rec->ssid, ni->ni_essid, ni->ni_esslen);
+        rec->channel = ieee80211_chan2ieee(ic, ni->ni_chan);
+        rec->rssi = -(0 - IWM_MIN_DBM - ni->ni_rssi);
+        rec->noise = noise;
+        rec->age = (uint32_t)(now - ni->ni_age_ts);
+        rec->capinfo = ni->ni_capinfo;
+        if (ie_len > 0)
+            memcpy(rec->ie, ni->ni_rsnie_tlv, ie_len);
+        sr->len += reclen;
+        sr->count++;
+    }
+    if (ni != NULL) {
+        memcpy(that->fScanCursor, ni->ni_macaddr, ETHER_ADDR_LEN);
+        sr->more = 1;
+    } else {
+        memset(that->fScanCursor, 0, ETHER_ADDR_LEN);
+        sr->more = 0;
+    }
+    memcpy(sr->cursor, that->fScanCursor, ETHER_ADDR_LEN);
+    return kIOReturnSuccess;
+}
+
+IOReturn ItlNetworkUserClient::
+sSCAN_RESULTS(OSObject* target, void* data, bool isSet)
+{
+    ItlNetworkUserClient *that = OSDynamicCast(ItlNetworkUserClient, target);
+    
+    // The node tree is changed by scans and beacons on the workloop.
+    return that->fDriver->getCommandGate()->runAction(sSCAN_RESULTSGated, that, data, isSet ? (void *)1 : NULL);
+}
+
 IOReturn ItlNetworkUserClient::
 sTX_POWER_LEVEL(OSObject* target, void* data, bool isSet)
 {
     return kIOReturnSuccess;
 }
+
+IOReturn ItlNetworkUserClient::
+sRX_POLL(OSObject* target, void* data, bool isSet)
+{
+    ItlNetworkUserClient *that = OSDynamicCast(ItlNetworkUserClient, target);
+    struct ioctl_rx_poll *st = (struct ioctl_rx_poll *)data;
+    
+    if (isSet) {
+        return kIOReturnError;
+    }
+    memset(st, 0, sizeof(*st));
+    st->version = IOCTL_VERSION;
+    if (!that->fDriverInfo->getRxPollStats(st)) {
+        return kIOReturnUnsupported;
+    }
+    return kIOReturnSuccess;
+}
@@ -52,6 +52,9 @@ private:
     static IOReturn sSCAN_RESULT(OSObject* target, void* data, bool isSet);
     static IOReturn sTX_POWER_LEVEL(OSObject* target, void* data, bool isSet);
     static IOReturn sNW_BSSID(OSObject* target, void* data, bool isSet);
+    static IOReturn sSCAN_RESULTS(OSObject* target, void* data, bool isSet);
+    static IOReturn sSCAN_RESULTSGated(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3);
+    static IOReturn sRX_POLL(OSObject* target, void* data, bool isSet);
     static const IOControlMethodAction sMethods[IOCTL_ID_MAX];
     
 private:
@@ -65,6 +68,7 @@ private:
 protected:
     bool fScanResultWrapping;
     ieee80211_node *fNextNodeToSend;
+    uint8_t fScanCursor[ETHER_ADDR_LEN];
 };
 
 
@@ -13,6 +13,7 @@
 */
 
 #include "ItlIwm.hpp"
+#include <ClientKit/Common.h>
 
 #define super ItlHalService
 OSDefineMetaClassAndStructors(ItlIwm, ItlHalService)
@@ -26,6 +27,8 @@ detach(IOPCIDevice *device)
     for (int txq_i = 0; txq_i < nitems(sc->txq); txq_i++)
         iwm_free_tx_ring(sc, &sc->txq[txq_i]);
     iwm_free_rx_ring(sc, &sc->rxq);
+    timeout_del(&sc->sc_rx_poll_to);
+    timeout_free(&sc->sc_rx_poll_to);
     iwm_dma_contig_free(&sc->ict_dma);
     iwm_dma_contig_free(&sc->kw_dma);
     iwm_dma_contig_free(&sc->sched_dma);
@@ -182,6 +185,19 @@ supportedFeatures()
     return kIONetworkFeatureMultiPages;
 }
 
+UInt32 ItlIwm::
+supportedChecksums(bool isOutput)
+{
+    /* 7000 series firmware has no checksum offload. */
+    if (com.sc_device_family < IWM_DEVICE_FAMILY_8000)
+        return 0;
+    return (isOutput ? 0 : IONetworkController::kChecksumIP) |
+        IONetworkController::kChecksumTCP |
+        IONetworkController::kChecksumUDP |
+        IONetworkController::kChecksumTCPIPv6 |
+        IONetworkController::kChecksumUDPIPv6;
+}
+
 const char *ItlIwm::
 getFirmwareCountryCode()
 {
@@ -194,6 +210,18 @@ getTxQueueSize()
     return IWM_TX_RING_COUNT;
 }
 
+bool ItlIwm::
+getRxPollStats(struct ioctl_rx_poll *st)
+{
+    static_assert(nitems(com.sc_rx_round_hist) == RX_POLL_HIST,
+                  "RX round histogram size");
+    st->rounds = com.sc_rx_rounds;
+    st->exhausted = com.sc_rx_exhausted;
+    st->entries = com.sc_rx_frames;
+    memcpy(st->round_hist, com.sc_rx_round_hist, sizeof(st->round_hist));
+    return true;
+}
+
 int16_t ItlIwm::
 getBSSNoise()
 {
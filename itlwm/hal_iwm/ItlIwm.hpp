@@ -71,9 +71,13 @@ public:
     
     virtual UInt32 supportedFeatures() override;
 
+    virtual UInt32 supportedChecksums(bool isOutput) override;
+
     virtual const char *getFirmwareCountryCode() override;
 
     virtual uint32_t getTxQueueSize() override;
+
+    virtual bool getRxPollStats(struct ioctl_rx_poll *st) override;
     
     //driver controller
     virtual void clearScanningFlags() override;
@@ -242,6 +246,8 @@ public:
     void    iwm_rx_rx_phy_cmd(struct iwm_softc *, struct iwm_rx_packet *,
                               struct iwm_rx_data *);
     int    iwm_get_noise(const struct iwm_statistics_rx_non_phy *);
+    void    iwm_rx_csum(struct iwm_softc *, mbuf_t, uint32_t);
+    void    iwm_rx_csum_mq(struct iwm_softc *, mbuf_t, uint16_t);
     int    iwm_rx_hwdecrypt(struct iwm_softc *, mbuf_t, uint32_t,
                struct ieee80211_rxinfo *);
     int    iwm_ccmp_decap(struct iwm_softc *, mbuf_t,
@@ -286,7 +292,15 @@ public:
     void iwm_txd_done(struct iwm_softc *, struct iwm_tx_data *);
     void iwm_ampdu_txq_advance(struct iwm_softc *, struct iwm_tx_ring *, int);
     void iwm_clear_oactive(struct iwm_softc *, struct iwm_tx_ring *);
+    void iwm_tx_ring_stop(struct iwm_softc *, struct iwm_tx_ring *);
+    void iwm_tx_ring_wake(struct iwm_softc *, struct iwm_tx_ring *);
+    void iwm_tx_defer_purge(struct iwm_softc *);
+    int iwm_tx_qid(struct iwm_softc *, struct ieee80211_node *, mbuf_t);
+    int iwm_start_frame(struct iwm_softc *, mbuf_t, struct ieee80211_node *);
+    int iwm_tx_submit(struct iwm_softc *, mbuf_t, struct ieee80211_node *);
     void iwm_ra_choose(struct iwm_softc *, struct ieee80211_node *);
+    void iwm_mrr_tx_done(struct iwm_softc *, struct iwm_node *, uint32_t, int, int);
+    int iwm_mrr_fill_lq(struct iwm_node *, struct iwm_lq_cmd *, int);
     int    iwm_tx(struct iwm_softc *, mbuf_t, struct ieee80211_node *, int);
     int    iwm_flush_tx_path(struct iwm_softc *, int);
     void    iwm_led_enable(struct iwm_softc *);
@@ -397,7 +411,13 @@ public:
     int    iwm_rx_pkt_valid(struct iwm_rx_packet *);
     void    iwm_rx_pkt(struct iwm_softc *, struct iwm_rx_data *,
                        struct mbuf_list *);
-    void    iwm_notif_intr(struct iwm_softc *);
+    void    iwm_intr_moderate(struct iwm_softc *, int);
+    int    iwm_rx_ring_count(struct iwm_softc *);
+    uint16_t    iwm_rx_closed(struct iwm_softc *);
+    int    iwm_rx_poll(struct iwm_softc *, int);
+    void    iwm_rx_poll_mask(struct iwm_softc *, int);
+    void    iwm_rx_intr(struct iwm_softc *);
+    static void    iwm_rx_poll_timeout(void *);
     static int    iwm_intr(OSObject *object, IOInterruptEventSource* sender, int count);
     static int    iwm_intr_msix(OSObject *object, IOInterruptEventSource* sender, int count);
     static int    iwm_match(IOPCIDevice *);
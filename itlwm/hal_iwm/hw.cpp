@@ -618,6 +618,8 @@ iwm_stop_device(struct iwm_softc *sc)
     
     iwm_disable_interrupts(sc);
     sc->sc_flags &= ~IWM_FLAG_USE_ICT;
+    timeout_del(&sc->sc_rx_poll_to);
+    sc->sc_rx_polling = 0;
     
     /* Stop all DMA channels. */
     if (iwm_nic_lock(sc)) {
@@ -795,7 +797,10 @@ iwm_nic_rx_mq_init(struct iwm_softc *sc)
     
     iwm_nic_unlock(sc);
     
-    IWM_WRITE_1(sc, IWM_CSR_INT_COALESCING, IWM_HOST_INT_TIMEOUT_DEF);
+    sc->sc_int_timeout = IWM_HOST_INT_TIMEOUT_DEF;
+    sc->sc_rx_mod_start = nsecuptime();
+    sc->sc_rx_mod_frames = 0;
+    IWM_WRITE_1(sc, IWM_CSR_INT_COALESCING, sc->sc_int_timeout);
     
     IWM_WRITE(sc, IWM_RFH_Q0_FRBDCB_WIDX_TRG, 8);
     
@@ -835,7 +840,10 @@ iwm_nic_rx_legacy_init(struct iwm_softc *sc)
               IWM_FH_RCSR_RX_CONFIG_REG_VAL_RB_SIZE_4K        |
               IWM_RX_QUEUE_SIZE_LOG << IWM_FH_RCSR_RX_CONFIG_RBDCB_SIZE_POS);
     
-    IWM_WRITE_1(sc, IWM_CSR_INT_COALESCING, IWM_HOST_INT_TIMEOUT_DEF);
+    sc->sc_int_timeout = IWM_HOST_INT_TIMEOUT_DEF;
+    sc->sc_rx_mod_start = nsecuptime();
+    sc->sc_rx_mod_frames = 0;
+    IWM_WRITE_1(sc, IWM_CSR_INT_COALESCING, sc->sc_int_timeout);
     
     /* W/A for interrupt coalescing bug in 7260 and 3160 */
     if (sc->host_interrupt_operation_mode)
@@ -912,5 +920,11 @@ iwm_nic_init(struct iwm_softc *sc)
 void ItlIwm::
 iwm_restore_interrupts(struct iwm_softc *sc)
 {
-    IWM_WRITE(sc, IWM_CSR_INT_MASK, sc->sc_intmask);
+    uint32_t mask = sc->sc_intmask;
+    
+    /* RX causes stay masked while polling rounds are pending. */
+    if (sc->sc_rx_polling)
+        mask &= ~(IWM_CSR_INT_BIT_FH_RX | IWM_CSR_INT_BIT_SW_RX |
+                  IWM_CSR_INT_BIT_RX_PERIODIC);
+    IWM_WRITE(sc, IWM_CSR_INT_MASK, mask);
 }
@@ -3118,6 +3118,8 @@ struct iwm_rx_mpdu_res_start {
  * @IWM_RX_MPDU_RES_STATUS_EXT_IV_BIT_CMP:
  * @IWM_RX_MPDU_RES_STATUS_KEY_ID_CMP_BIT:
  * @IWM_RX_MPDU_RES_STATUS_ROBUST_MNG_FRAME: this frame is an 11w management frame
+ * @IWM_RX_MPDU_RES_STATUS_CSUM_DONE: checksum was checked by the hardware
+ * @IWM_RX_MPDU_RES_STATUS_CSUM_OK: checksum was found to be valid
  * @IWM_RX_MPDU_RES_STATUS_HASH_INDEX_MSK:
  * @IWM_RX_MPDU_RES_STATUS_STA_ID_MSK:
  * @IWM_RX_MPDU_RES_STATUS_RRF_KILL:
@@ -3146,6 +3148,8 @@ struct iwm_rx_mpdu_res_start {
 #define IWM_RX_MPDU_RES_STATUS_EXT_IV_BIT_CMP        (1 << 13)
 #define IWM_RX_MPDU_RES_STATUS_KEY_ID_CMP_BIT        (1 << 14)
 #define IWM_RX_MPDU_RES_STATUS_ROBUST_MNG_FRAME        (1 << 15)
+#define IWM_RX_MPDU_RES_STATUS_CSUM_DONE        (1 << 16)
+#define IWM_RX_MPDU_RES_STATUS_CSUM_OK            (1 << 17)
 #define IWM_RX_MPDU_RES_STATUS_HASH_INDEX_MSK        (0x3F0000)
 #define IWM_RX_MPDU_RES_STATUS_STA_ID_MSK        (0x1f000000)
 #define IWM_RX_MPDU_RES_STATUS_RRF_KILL            (1 << 29)
@@ -3169,6 +3173,28 @@ struct iwm_rx_mpdu_res_start {
 #define IWM_RX_MPDU_PHY_NCCK_ADDTL_NTFY        (1 << 7)
 #define IWM_RX_MPDU_PHY_TSF_OVERLOAD        (1 << 8)
 
+/*
+ * l3l4_flags in the RX MPDU descriptor: checksum results of the hardware
+ * parser and the protocols it found.
+ */
+#define IWM_RX_L3L4_IP_HDR_CSUM_OK        (1 << 0)
+#define IWM_RX_L3L4_TCP_UDP_CSUM_OK        (1 << 1)
+#define IWM_RX_L3L4_TCP_FIN_SYN_RST_PSH    (1 << 2)
+#define IWM_RX_L3L4_TCP_ACK            (1 << 3)
+#define IWM_RX_L3L4_L3_PROTO_MASK        (0xf << 4)
+#define IWM_RX_L3L4_L4_PROTO_MASK        (0xf << 8)
+#define IWM_RX_L3_PROTO_POS            4
+#define IWM_RX_L4_PROTO_POS            8
+
+#define IWM_RX_L3_TYPE_NONE            0
+#define IWM_RX_L3_TYPE_IPV4            1
+#define IWM_RX_L3_TYPE_IPV4_FRAG        2
+#define IWM_RX_L3_TYPE_IPV6_FRAG        3
+#define IWM_RX_L3_TYPE_IPV6            4
+#define IWM_RX_L3_TYPE_IPV6_IN_IPV4        5
+#define IWM_RX_L3_TYPE_ARP            6
+#define IWM_RX_L3_TYPE_EAPOL            7
+
 struct iwm_rx_mpdu_desc_v1 {
     union {
         uint32_t rss_hash;
@@ -119,6 +119,7 @@
 #include <net80211/ieee80211_var.h>
 #include <net80211/ieee80211_amrr.h>
 #include <net80211/ieee80211_ra.h>
+#include <net80211/ieee80211_mrr.h>
 #include <net80211/ieee80211_radiotap.h>
 
 #include <IOKit/network/IOMbufMemoryCursor.h>
@@ -303,8 +304,33 @@ struct iwm_tx_ring {
     int            cur;
     int            read;
     int            tail;
+    int            stopped;    /* queued crossed IWM_TX_RING_HIMARK */
+    int            parked;     /* frames waiting on sc_txdefer */
+    uint64_t        stall_start;    /* uptime (ns) the ring stopped */
+    uint64_t        stall_ns;    /* total time spent stopped */
+    uint32_t        stalls;        /* number of stop events */
 };
 
+/*
+ * Encapsulated frames whose TX ring is stopped are parked per access
+ * category so that traffic for other rings keeps flowing.  Once an AC
+ * has this many frames parked the send queue is marked output-active.
+ */
+#define IWM_TX_DEFER_MAX    64
+
+/*
+ * RX interrupt moderation: each polling round processes at most
+ * IWM_RX_POLL_BUDGET ring entries.  If entries remain, RX interrupts
+ * stay masked and the next round runs from the workloop.  The entry
+ * rate over each IWM_INTR_MOD_WINDOW selects the interrupt coalescing
+ * timer.  Rounds are also counted in IWM_RX_POLL_HIST log2 buckets by
+ * the number of entries they processed; IOCTL_80211_RX_POLL reads the
+ * counters.
+ */
+#define IWM_RX_POLL_BUDGET    64
+#define IWM_RX_POLL_HIST    8
+#define IWM_INTR_MOD_WINDOW    100000000ULL    /* ns */
+
 #define IWM_RX_MQ_RING_COUNT    512
 #define IWM_RX_RING_COUNT    256
 /* Linux driver optionally uses 8k buffer */
@@ -313,6 +339,7 @@ struct iwm_tx_ring {
 struct iwm_rx_data {
     mbuf_t m;
     bus_dmamap_t    map;
+    struct rxpool_buf    *pbuf;    /* backing pool buffer, if any */
 };
 
 struct iwm_rx_ring {
@@ -323,6 +350,7 @@ struct iwm_rx_ring {
     void            *desc;
     struct iwm_rb_status    *stat;
     struct iwm_rx_data    data[IWM_RX_MQ_RING_COUNT];
+    struct rxpool        *pool;
     int            cur;
 };
 
@@ -450,9 +478,9 @@ struct iwm_reorder_buf_entry {
  * @sta_id: station id
  * @tid: tid of the session
  * @baid: baid of the session
- * @timeout: the timeout set in the addba request
+ * @timeout: the timeout set in the addba request, in usec
  * @entries_per_queue: # of buffers per queue
- * @last_rx: last rx timestamp, updated only if timeout passed from last update
+ * @last_rx: nsecuptime() of the last frame received in the session
  * @session_timer: timer to check if BA session expired, runs at 2 * timeout
  * @sc: softc pointer, needed for timer context
  * @reorder_buf: reorder buffer
@@ -462,9 +490,9 @@ struct iwm_rxba_data {
     uint8_t sta_id;
     uint8_t tid;
     uint8_t baid;
-    uint16_t timeout;
+    uint32_t timeout;
     uint16_t entries_per_queue;
-    struct timeval last_rx;
+    uint64_t last_rx;
     CTimeout *session_timer;
     struct iwm_softc *sc;
     struct iwm_reorder_buffer reorder_buf;
@@ -542,7 +570,16 @@ struct iwm_softc {
 	/* TX/RX rings. */
 	struct iwm_tx_ring txq[IWM_MAX_QUEUES];
 	struct iwm_rx_ring rxq;
-	int qfullmsk;
+	struct mbuf_list sc_txdefer[EDCA_NUM_AC]; /* frames held for a stopped ring */
+	CTimeout *sc_rx_poll_to;	/* runs the next RX polling round */
+	int sc_rx_polling;		/* RX interrupts masked, round pending */
+	uint8_t sc_int_timeout;		/* IWM_CSR_INT_COALESCING in use */
+	uint64_t sc_rx_mod_start;	/* uptime (ns) the rate window opened */
+	uint32_t sc_rx_mod_frames;	/* entries seen in this window */
+	uint64_t sc_rx_rounds;		/* RX polling rounds */
+	uint64_t sc_rx_exhausted;	/* rounds that ran out of budget */
+	uint64_t sc_rx_frames;		/* ring entries processed */
+	uint64_t sc_rx_round_hist[IWM_RX_POLL_HIST];
     int cmdqid;
     
     uint8_t sc_mgmt_last_antenna_idx;
@@ -697,6 +734,7 @@ struct iwm_node {
 
     struct ieee80211_amrr_node in_amn;
     struct ieee80211_ra_node in_rn;
+    struct ieee80211_mrr_node in_mn;
     int lq_rate_mismatch;
     uint32_t next_ampdu_id;
     
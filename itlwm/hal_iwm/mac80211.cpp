@@ -340,7 +340,7 @@ iwm_clear_reorder_buffer(struct iwm_softc *sc, struct iwm_rxba_data *rxba)
     reorder_buf->removed = 1;
     timeout_del(&reorder_buf->reorder_timer);
     timeout_free(&reorder_buf->reorder_timer);
-    timerclear(&rxba->last_rx);
+    rxba->last_rx = 0;
     timeout_del(&rxba->session_timer);
     timeout_free(&rxba->session_timer);
     rxba->baid = IWM_RX_REORDER_DATA_INVALID_BAID;
@@ -353,18 +353,15 @@ iwm_rx_ba_session_expired(void *arg)
     struct iwm_softc *sc = rxba->sc;
     struct ieee80211com *ic = &sc->sc_ic;
     struct ieee80211_node *ni = ic->ic_bss;
-    struct timeval now, timeout, expiry;
-    int s;
+    int s, left;
     
     s = splnet();
     if ((sc->sc_flags & IWM_FLAG_SHUTDOWN) == 0 &&
         ic->ic_state == IEEE80211_S_RUN &&
         rxba->baid != IWM_RX_REORDER_DATA_INVALID_BAID) {
-        getmicrouptime(&now);
-        USEC_TO_TIMEVAL(RX_REORDER_BUF_TIMEOUT_MQ_USEC, &timeout);
-        timeradd(&rxba->last_rx, &timeout, &expiry);
-        if (timercmp(&now, &expiry, <)) {
-            timeout_add_usec(&rxba->session_timer, rxba->timeout);
+        left = ieee80211_inact_left(rxba->last_rx, rxba->timeout);
+        if (left > 0) {
+            timeout_add_usec(&rxba->session_timer, left);
         } else {
             ic->ic_stats.is_ht_rx_ba_timeout++;
             ieee80211_delba_request(ic, ni,
@@ -584,7 +581,7 @@ iwm_sta_rx_agg(struct iwm_softc *sc, struct ieee80211_node *ni, uint8_t tid,
             rxba->tid = tid;
             rxba->baid = baid;
             rxba->timeout = timeout_val;
-            getmicrouptime(&rxba->last_rx);
+            rxba->last_rx = nsecuptime();
             iwm_init_reorder_buffer(&rxba->reorder_buf, ssn,
                                     winsize);
             if (timeout_val != 0) {
@@ -879,6 +876,51 @@ out:
     return ret;
 }
 
+/*
+ * Pass the hardware's checksum verdict on to the network stack.  The
+ * legacy RX path reports a single status per MPDU, so A-MSDUs, which
+ * are split up in software, are left unmarked.
+ */
+void ItlIwm::
+iwm_rx_csum(struct iwm_softc *sc, mbuf_t m, uint32_t rx_pkt_status)
+{
+    struct ieee80211_frame *wh = mtod(m, struct ieee80211_frame *);
+    
+    if (!isset(sc->sc_enabled_capa, IWM_UCODE_TLV_CAPA_CSUM_SUPPORT) ||
+        (rx_pkt_status & (IWM_RX_MPDU_RES_STATUS_CSUM_DONE |
+                          IWM_RX_MPDU_RES_STATUS_CSUM_OK)) !=
+        (IWM_RX_MPDU_RES_STATUS_CSUM_DONE | IWM_RX_MPDU_RES_STATUS_CSUM_OK))
+        return;
+    if (ieee80211_has_qos(wh) &&
+        (ieee80211_get_qos(wh) & IEEE80211_QOS_AMSDU))
+        return;
+    mbuf_set_csum_performed(m, MBUF_CSUM_DID_IP | MBUF_CSUM_IP_GOOD |
+                            MBUF_CSUM_DID_DATA | MBUF_CSUM_PSEUDO_HDR, 0xffff);
+}
+
+/*
+ * Same for the multi-queue RX descriptor, which reports the IP header
+ * and TCP/UDP checksum results separately.
+ */
+void ItlIwm::
+iwm_rx_csum_mq(struct iwm_softc *sc, mbuf_t m, uint16_t l3l4_flags)
+{
+    mbuf_csum_performed_flags_t csum = 0;
+    int l3;
+    
+    if (!isset(sc->sc_enabled_capa, IWM_UCODE_TLV_CAPA_CSUM_SUPPORT))
+        return;
+    l3 = (l3l4_flags & IWM_RX_L3L4_L3_PROTO_MASK) >> IWM_RX_L3_PROTO_POS;
+    if (l3 == IWM_RX_L3_TYPE_IPV4 &&
+        (l3l4_flags & IWM_RX_L3L4_IP_HDR_CSUM_OK))
+        csum |= MBUF_CSUM_DID_IP | MBUF_CSUM_IP_GOOD;
+    if ((l3l4_flags & IWM_RX_L3L4_TCP_UDP_CSUM_OK) &&
+        (csum != 0 || l3 == IWM_RX_L3_TYPE_IPV6))
+        csum |= MBUF_CSUM_DID_DATA | MBUF_CSUM_PSEUDO_HDR;
+    if (csum != 0)
+        mbuf_set_csum_performed(m, csum, 0xffff);
+}
+
 void ItlIwm::
 iwm_rx_frame(struct iwm_softc *sc, mbuf_t m, int chanidx,
              uint32_t rx_pkt_status, int is_shortpre, int rate_n_flags,
@@ -1039,8 +1081,12 @@ iwm_ampdu_rate_control(struct iwm_softc *sc, struct ieee80211_node *ni,
              * before failing an A-MPDU subframe the firmware
              * sends it as a single frame at least once.
              */
-            ieee80211_ra_add_stats_ht(&wn->in_rn, ic, ni,
-                                      txdata->ampdu_txmcs, 1, 0);
+            if (ieee80211_mrr_active(&wn->in_mn))
+                ieee80211_mrr_add_stats(&wn->in_mn, ic, ni,
+                                        txdata->ampdu_txmcs, 1, 0);
+            else
+                ieee80211_ra_add_stats_ht(&wn->in_rn, ic, ni,
+                                          txdata->ampdu_txmcs, 1, 0);
 
             /* Report this frame only once. */
             txdata->ampdu_nframes = 0;
@@ -1249,7 +1295,12 @@ iwm_ampdu_tx_done(struct iwm_softc *sc, struct iwm_cmd_header *cmd_hdr,
      * Don't report frames to MiRA which were sent at a different
      * Tx rate than ni->ni_txmcs.
      */
-    if (ic->ic_fixed_mcs == -1) {
+    if (ic->ic_fixed_mcs == -1 && ieee80211_mrr_active(&in->in_mn)) {
+        if (txdata->ampdu_nframes > 1)
+            ieee80211_mrr_add_stats(&in->in_mn, ic, ni,
+                                    txdata->ampdu_txmcs, 1, 1);
+        iwm_mrr_tx_done(sc, in, initial_rate, failure_frame, txfail);
+    } else if (ic->ic_fixed_mcs == -1) {
         if (txdata->ampdu_nframes > 1) {
             /*
              * This frame was once part of an A-MPDU.
@@ -1320,6 +1371,10 @@ iwm_rx_tx_cmd_single(struct iwm_softc *sc, struct iwm_tx_resp *tx_resp,
             if (tx_resp->failure_frame > 0)
                 in->in_amn.amn_retrycnt++;
         }
+    } else if (ieee80211_mrr_active(&in->in_mn)) {
+        if (ic->ic_fixed_mcs == -1 && ic->ic_state == IEEE80211_S_RUN)
+            iwm_mrr_tx_done(sc, in, le32toh(tx_resp->initial_rate),
+                            tx_resp->failure_frame, txfail);
     } else if (ic->ic_fixed_mcs == -1 && ic->ic_state == IEEE80211_S_RUN &&
                (le32toh(tx_resp->initial_rate) & IWM_RATE_MCS_HT_MSK)) {
         uint32_t fw_txmcs = le32toh(tx_resp->initial_rate) &
@@ -1391,6 +1446,13 @@ iwm_ra_choose(struct iwm_softc *sc, struct ieee80211_node *ni)
     int old_nss = in->in_rn.nss;
     int old_sgi = in->in_rn.sgi;
     
+    if (ieee80211_mrr_active(&in->in_mn)) {
+        /* MRR's retry chain is the LQ table itself. */
+        if (ieee80211_mrr_choose(&in->in_mn, ic, ni))
+            iwm_setrates(in, 1);
+        return;
+    }
+    
     ieee80211_ra_choose(&in->in_rn, ic, ni);
     
     /* Update firmware's LQ retry table if RA has chosen a new MCS. */
@@ -1398,6 +1460,97 @@ iwm_ra_choose(struct iwm_softc *sc, struct ieee80211_node *ni)
         iwm_setrates(in, 1);
 }
 
+/*
+ * Report a single-frame Tx attempt to MRR. The firmware walked our LQ
+ * table from its first entry, whose rate is given in initial_rate.
+ */
+void ItlIwm::
+iwm_mrr_tx_done(struct iwm_softc *sc, struct iwm_node *in,
+    uint32_t initial_rate, int ackfailcnt, int txfail)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct ieee80211_node *ni = &in->in_ni;
+    int mcs, nss, sgi = (initial_rate & IWM_RATE_MCS_SGI_MSK) != 0;
+    
+    if (initial_rate & IWM_RATE_MCS_VHT_MSK) {
+        mcs = initial_rate & IWM_RATE_VHT_MCS_RATE_CODE_MSK;
+        nss = ((initial_rate & IWM_RATE_VHT_MCS_NSS_MSK) >>
+               IWM_RATE_VHT_MCS_NSS_POS) + 1;
+    } else if (initial_rate & IWM_RATE_MCS_HT_MSK) {
+        /* HT MCS numbers imply the number of spatial streams. */
+        mcs = initial_rate & (IWM_RATE_HT_MCS_RATE_CODE_MSK |
+                              IWM_RATE_HT_MCS_NSS_MSK);
+        nss = 0;
+    } else
+        return;
+    
+    /* Ignore Tx reports which don't match our recent LQ commands. */
+    if (!ieee80211_mrr_tx_done(&in->in_mn, ic, ni, mcs, nss, sgi,
+                               ackfailcnt, txfail)) {
+        if (++in->lq_rate_mismatch > 15) {
+            /* Try to sync firmware with the driver... */
+            iwm_setrates(in, 1);
+            in->lq_rate_mismatch = 0;
+        }
+        return;
+    }
+    
+    in->lq_rate_mismatch = 0;
+    iwm_ra_choose(sc, ni);
+}
+
+/*
+ * Expand MRR's retry chain into the LQ rate table, each stage repeated
+ * for its number of tries. Returns the number of entries used.
+ */
+int ItlIwm::
+iwm_mrr_fill_lq(struct iwm_node *in, struct iwm_lq_cmd *lqcmd, int ldpc)
+{
+    struct ieee80211_node *ni = &in->in_ni;
+    struct ieee80211_mrr_node *mn = &in->in_mn;
+    const struct ieee80211_mrr_group *g;
+    uint32_t tab;
+    int i, k, mcs, ridx, j = 0;
+    
+    lqcmd->mimo_delim = 0;
+    for (i = 0; i < mn->nchain; i++) {
+        g = ieee80211_mrr_group(mn, mn->chain[i].rate);
+        mcs = ieee80211_mrr_mcs(mn, mn->chain[i].rate);
+        if (ni->ni_flags & IEEE80211_NODE_VHT) {
+            ridx = (g->nss > 1 ? iwm_vht_mimo_mcs2ridx[mcs] :
+                    iwm_vht_siso_mcs2ridx[mcs]);
+            tab = iwm_rates[ridx].vht_plcp | IWM_RATE_MCS_VHT_MSK;
+            if (ni->ni_chw == IEEE80211_CHAN_WIDTH_80)
+                tab |= IWM_RATE_MCS_CHAN_WIDTH_80;
+            else if (ni->ni_chw == IEEE80211_CHAN_WIDTH_80P80 ||
+                     ni->ni_chw == IEEE80211_CHAN_WIDTH_160)
+                tab |= IWM_RATE_MCS_CHAN_WIDTH_160;
+        } else {
+            ridx = iwm_mcs2ridx[mcs];
+            tab = iwm_rates[ridx].ht_plcp | IWM_RATE_MCS_HT_MSK;
+            /* 40MHz Tx in the 2GHz band fails; see iwm_setrates(). */
+            if (ni->ni_chw == IEEE80211_CHAN_WIDTH_40 &&
+                IEEE80211_IS_CHAN_5GHZ(ni->ni_chan))
+                tab |= IWM_RATE_MCS_CHAN_WIDTH_40;
+        }
+        if (g->sgi)
+            tab |= IWM_RATE_MCS_SGI_MSK;
+        if (ldpc)
+            tab |= IWM_RATE_MCS_LDPC_MSK;
+        tab |= (g->nss > 1 ? IWM_RATE_MCS_ANT_AB_MSK :
+                IWM_RATE_MCS_ANT_A_MSK);
+        
+        for (k = 0; k < mn->chain[i].tries &&
+             j < nitems(lqcmd->rs_table); k++)
+            lqcmd->rs_table[j++] = htole32(tab);
+        /* Multi-stream stages always lead the chain. */
+        if (g->nss > 1)
+            lqcmd->mimo_delim = j;
+    }
+    
+    return j;
+}
+
 void ItlIwm::
 iwm_txd_done(struct iwm_softc *sc, struct iwm_tx_data *txd)
 {
@@ -1429,8 +1582,9 @@ iwm_clear_oactive(struct iwm_softc *sc, struct iwm_tx_ring *ring)
     struct _ifnet *ifp = &ic->ic_if;
 
     if (ring->queued < IWM_TX_RING_LOMARK) {
-        sc->qfullmsk &= ~(1 << ring->qid);
-        if (sc->qfullmsk == 0 && ifq_is_oactive(&ifp->if_snd)) {
+        if (ring->stopped) {
+            /* Frames parked on this ring go out before new ones. */
+            iwm_tx_ring_wake(sc, ring);
             ifq_clr_oactive(&ifp->if_snd);
             (*ifp->if_start)(ifp);
         }
@@ -1440,6 +1594,49 @@ iwm_clear_oactive(struct iwm_softc *sc, struct iwm_tx_ring *ring)
     }
 }
 
+void ItlIwm::
+iwm_tx_ring_stop(struct iwm_softc *sc, struct iwm_tx_ring *ring)
+{
+    if (ring->stopped)
+        return;
+    ring->stopped = 1;
+    ring->stall_start = nsecuptime();
+    ring->stalls++;
+}
+
+void ItlIwm::
+iwm_tx_ring_wake(struct iwm_softc *sc, struct iwm_tx_ring *ring)
+{
+    if (!ring->stopped)
+        return;
+    ring->stopped = 0;
+    ring->stall_ns += nsecuptime() - ring->stall_start;
+}
+
+/*
+ * Drop frames parked for stopped rings, releasing the node references
+ * taken by ieee80211_encap().
+ */
+void ItlIwm::
+iwm_tx_defer_purge(struct iwm_softc *sc)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct ieee80211_node *ni;
+    mbuf_t m;
+    int ac, qid;
+    
+    for (ac = 0; ac < EDCA_NUM_AC; ac++) {
+        while ((m = ml_dequeue(&sc->sc_txdefer[ac])) != NULL) {
+            ni = (struct ieee80211_node *)mbuf_pkthdr_rcvif(m);
+            mbuf_freem(m);
+            if (ni != NULL)
+                ieee80211_release_node(ic, ni);
+        }
+    }
+    for (qid = 0; qid < nitems(sc->txq); qid++)
+        sc->txq[qid].parked = 0;
+}
+
 void ItlIwm::
 iwm_rx_tx_cmd(struct iwm_softc *sc, struct iwm_rx_packet *pkt,
               struct iwm_rx_data *data)
@@ -1630,6 +1827,30 @@ iwm_tx_fill_cmd(struct iwm_softc *sc, struct iwm_node *in,
     return rinfo;
 }
 
+/*
+ * Select the TX ring iwm_tx() will use for an encapsulated frame.
+ */
+int ItlIwm::
+iwm_tx_qid(struct iwm_softc *sc, struct ieee80211_node *ni, mbuf_t m)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct ieee80211_frame *wh = mtod(m, struct ieee80211_frame *);
+    int ac = EDCA_AC_BE;
+    int tid;
+    
+    if (ieee80211_has_qos(wh)) {
+        tid = ieee80211_get_qos(wh) & IEEE80211_QOS_TID;
+        ac = ieee80211_up_to_ac(ic, tid);
+        if (ni != NULL && sc->sc_tx_ba[tid].wn == (struct iwm_node *)ni &&
+            !IEEE80211_IS_MULTICAST(wh->i_addr1) &&
+            ni->ni_tx_ba[tid].ba_state == IEEE80211_BA_AGREED)
+            return sc->first_agg_txq + tid;
+    }
+    if (isset(sc->sc_enabled_capa, IWM_UCODE_TLV_CAPA_DQA_SUPPORT))
+        return IWM_DQA_MIN_MGMT_QUEUE + ac;
+    return ac;
+}
+
 #define TB0_SIZE 20
 int ItlIwm::
 iwm_tx(struct iwm_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
@@ -1687,7 +1908,7 @@ iwm_tx(struct iwm_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
                  ba->ba_state == IEEE80211_BA_AGREED) {
                  qid = sc->first_agg_txq + tid;
                  DPRINTFN(3, ("%s agg packet qid=%d send\n", __FUNCTION__, qid));
-                 if (sc->qfullmsk & (1 << qid)) {
+                 if (sc->txq[qid].stopped) {
                      mbuf_freem(m);
                      return ENOBUFS;
                  }
@@ -1751,6 +1972,8 @@ iwm_tx(struct iwm_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
         k = ieee80211_get_txkey(ic, wh, ni);
         if ((k->k_flags & IEEE80211_KEY_GROUP) ||
             (k->k_cipher != IEEE80211_CIPHER_CCMP)) {
+            /* Checksums must be final before software encryption. */
+            ieee80211_tx_csum(ic, m, hdrlen, 0);
             if ((m = ieee80211_encrypt(ic, m, k)) == NULL)
                 return ENOBUFS;
             /* 802.11 header may have moved. */
@@ -1763,6 +1986,17 @@ iwm_tx(struct iwm_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
         }
     }
     
+    /*
+     * Offsets are in words: the IP header follows the 4-word LLC/SNAP
+     * header, and the MAC header size includes the CCMP IV we insert.
+     */
+    if (ieee80211_tx_csum(ic, m, hdrlen,
+                          isset(sc->sc_enabled_capa, IWM_UCODE_TLV_CAPA_CSUM_SUPPORT)))
+        tx->offload_assist |= htole16(IWM_TX_CMD_OFFLD_L4_EN |
+            IWM_TX_CMD_OFFLD_IP_HDR(4) |
+            IWM_TX_CMD_OFFLD_MH_SIZE((hdrlen +
+            (k != NULL ? IEEE80211_CCMP_HDRLEN : 0)) / 2));
+    
     flags = 0;
     if (!IEEE80211_IS_MULTICAST(wh->i_addr1))
         flags |= IWM_TX_CMD_FLG_ACK;
@@ -1916,10 +2150,10 @@ iwm_tx(struct iwm_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
     ring->cur = (ring->cur + 1) % IWM_TX_RING_COUNT;
     IWM_WRITE(sc, IWM_HBUS_TARG_WRPTR, ring->qid << 8 | ring->cur);
     
-    /* Mark TX ring as full if we reach a certain threshold. */
+    /* Stop this TX ring if we reach a certain threshold. */
     if (++ring->queued > IWM_TX_RING_HIMARK) {
-//        XYLog("%s sc->qfullmsk is FULL ring->cur=%d ring->queued=%d\n", __FUNCTION__, ring->cur, ring->queued);
-        sc->qfullmsk |= 1 << ring->qid;
+//        XYLog("%s TX ring is FULL ring->cur=%d ring->queued=%d\n", __FUNCTION__, ring->cur, ring->queued);
+        iwm_tx_ring_stop(sc, ring);
     }
     
     return 0;
@@ -2518,6 +2752,7 @@ iwm_run(struct iwm_softc *sc)
     
     ieee80211_amrr_node_init(&sc->sc_amrr, &in->in_amn);
     ieee80211_ra_node_init(ic, &in->in_rn, &in->in_ni);
+    ieee80211_mrr_node_init(ic, &in->in_mn, &in->in_ni);
     
     if (ic->ic_opmode == IEEE80211_M_MONITOR) {
         iwm_led_blink_start(sc);
@@ -2784,6 +3019,10 @@ iwm_setrates(struct iwm_node *in, int async)
      */
     j = 0;
     ridx_min = iwm_rval2ridx(ieee80211_min_basic_rate(ic));
+    if (ieee80211_mrr_active(&in->in_mn)) {
+        j = iwm_mrr_fill_lq(in, &lqcmd, ldpc);
+        goto fill;
+    }
     mimo = ra_rate->nss > 1;
     ridx_max = (mimo ? IWM_RIDX_MAX : ((ni->ni_flags & IEEE80211_NODE_VHT) ? IWM_LAST_VHT_SISO_RATE : IWM_LAST_HT_SISO_RATE));
     for (ridx = ridx_max; ridx >= ridx_min; ridx--) {
@@ -2871,6 +3110,7 @@ iwm_setrates(struct iwm_node *in, int async)
     
     lqcmd.mimo_delim = (mimo ? j : 0);
     
+fill:
     /* Fill the rest with the lowest possible rate */
     while (j < nitems(lqcmd.rs_table)) {
         tab = iwm_rates[ridx_min].plcp;
@@ -3640,34 +3880,133 @@ iwm_init(struct _ifnet *ifp)
     return 0;
 }
 
+/*
+ * Hand one encapsulated frame to the hardware.  Returns non-zero if the
+ * frame was dropped.
+ */
+int ItlIwm::
+iwm_start_frame(struct iwm_softc *sc, mbuf_t m, struct ieee80211_node *ni)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct _ifnet *ifp = &ic->ic_if;
+    int ac = EDCA_AC_BE; /* XXX */
+    
+#if NBPFILTER > 0
+    if (ic->ic_rawbpf != NULL)
+        bpf_mtap(ic->ic_rawbpf, m, BPF_DIRECTION_OUT);
+#endif
+    if (iwm_tx(sc, m, ni, ac) != 0) {
+        XYLog("%s %d iwm_tx OUTPUT_ERROR\n", __FUNCTION__, __LINE__);
+        ieee80211_release_node(ic, ni);
+        ifp->netStat->outputErrors++;
+        return 1;
+    }
+    ifp->netStat->outputPackets++;
+    
+    if (ifp->if_flags & IFF_UP) {
+        sc->sc_tx_timer = 15;
+        ifp->if_timer = 1;
+    }
+    return 0;
+}
+
+/*
+ * Send a frame unless its ring is stopped or earlier frames for the same
+ * ring are parked, in which case it joins them.  Returns non-zero once the
+ * parking list is full and the caller should stop dequeuing.
+ */
+int ItlIwm::
+iwm_tx_submit(struct iwm_softc *sc, mbuf_t m, struct ieee80211_node *ni)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct _ifnet *ifp = &ic->ic_if;
+    struct ieee80211_frame *wh;
+    struct mbuf_list *ml;
+    int ac, qid;
+    
+    /*
+     * A stopped ring only holds back its own access category;
+     * park the frame and keep serving the other ACs.
+     */
+    wh = mtod(m, struct ieee80211_frame *);
+    ac = ieee80211_has_qos(wh) ? ieee80211_up_to_ac(ic,
+        ieee80211_get_qos(wh) & IEEE80211_QOS_TID) : EDCA_AC_BE;
+    ml = &sc->sc_txdefer[ac];
+    qid = iwm_tx_qid(sc, ni, m);
+    if (sc->txq[qid].stopped || sc->txq[qid].parked != 0) {
+        mbuf_pkthdr_setrcvif(m, (ifnet_t)ni);
+        ml_enqueue(ml, m);
+        sc->txq[qid].parked++;
+        if (ml_len(ml) >= IWM_TX_DEFER_MAX) {
+            ifq_set_oactive(&ifp->if_snd);
+            return 1;
+        }
+        return 0;
+    }
+    
+    iwm_start_frame(sc, m, ni);
+    return 0;
+}
+
 IOReturn ItlIwm::
 _iwm_start_task(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
 {
+    static const int acprio[EDCA_NUM_AC] = {
+        EDCA_AC_VO, EDCA_AC_VI, EDCA_AC_BE, EDCA_AC_BK
+    };
     struct _ifnet *ifp = (struct _ifnet *)arg0;
     struct iwm_softc *sc = (struct iwm_softc*)ifp->if_softc;
     ItlIwm *that = container_of(sc, ItlIwm, com);
     struct ieee80211com *ic = &sc->sc_ic;
-    struct ieee80211_node *ni;
+    struct ieee80211_node *ni, *ni0;
+    struct ieee80211_amsdu am;
     struct ether_header *eh;
-    mbuf_t m;
-    int ac = EDCA_AC_BE; /* XXX */
+    struct mbuf_list *ml, keep;
+    mbuf_t m, m0;
+    int i, qid, stop;
     
     if (!(ifp->if_flags & IFF_RUNNING) || ifq_is_oactive(&ifp->if_snd)) {
         return kIOReturnOutputDropped;
     }
     
-    for (;;) {
-        /* why isn't this done per-queue? */
-        if (sc->qfullmsk != 0) {
-            ifq_set_oactive(&ifp->if_snd);
-            break;
+    /*
+     * Frames parked behind a stopped ring go first, highest AC first.
+     * Frames for a ring that is still stopped keep their order on the
+     * list; frames for other rings are sent.  The per-ring parked counts
+     * are rebuilt from the frames that stay, as a frame's ring changes
+     * if a block ack session starts or ends while it waits.
+     */
+    for (i = 0; i < EDCA_NUM_AC && ml_empty(&sc->sc_txdefer[i]); i++)
+        ;
+    if (i < EDCA_NUM_AC) {
+        for (qid = 0; qid < nitems(sc->txq); qid++)
+            sc->txq[qid].parked = 0;
+        for (i = 0; i < EDCA_NUM_AC; i++) {
+            ml = &sc->sc_txdefer[acprio[i]];
+            ml_init(&keep);
+            while ((m = ml_dequeue(ml)) != NULL) {
+                ni = (struct ieee80211_node *)mbuf_pkthdr_rcvif(m);
+                qid = that->iwm_tx_qid(sc, ni, m);
+                if (sc->txq[qid].stopped) {
+                    ml_enqueue(&keep, m);
+                    sc->txq[qid].parked++;
+                    continue;
+                }
+                that->iwm_start_frame(sc, m, ni);
+            }
+            ml_enlist(ml, &keep);
         }
-        
+    }
+    
+    memset(&am, 0, sizeof(am));
+    for (;;) {
         /* need to send management frames even if we're not RUNning */
         m = mq_dequeue(&ic->ic_mgtq);
         if (m) {
             ni = (struct ieee80211_node *)mbuf_pkthdr_rcvif(m);
-            goto sendit;
+            if (that->iwm_tx_submit(sc, m, ni))
+                break;
+            continue;
         }
         
         if (
@@ -3696,26 +4035,27 @@ _iwm_start_task(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3
             ifp->netStat->outputErrors++;
             continue;
         }
-//        XYLog("%s if_snd->send\n", __FUNCTION__);
         
-    sendit:
-#if NBPFILTER > 0
-        if (ic->ic_rawbpf != NULL)
-            bpf_mtap(ic->ic_rawbpf, m, BPF_DIRECTION_OUT);
-#endif
-        if (that->iwm_tx(sc, m, ni, ac) != 0) {
-            XYLog("%s %d iwm_tx OUTPUT_ERROR\n", __FUNCTION__, __LINE__);
-            ieee80211_release_node(ic, ni);
-            ifp->netStat->outputErrors++;
+        /*
+         * Pack back-to-back QoS data for the same RA/TID into one
+         * A-MSDU. The pending one goes out as soon as a frame does
+         * not fit or the send queue runs dry, so no frame waits for
+         * traffic that has not been queued yet.
+         */
+        if (ieee80211_amsdu_append(ic, &am, m, ni) == 0) {
+            ifp->netStat->outputPackets++;
             continue;
         }
-        ifp->netStat->outputPackets++;
-        
-        if (ifp->if_flags & IFF_UP) {
-            sc->sc_tx_timer = 15;
-            ifp->if_timer = 1;
-        }
+        stop = 0;
+        if ((m0 = ieee80211_amsdu_take(ic, &am, &ni0)) != NULL)
+            stop = that->iwm_tx_submit(sc, m0, ni0);
+        if (!stop && ieee80211_amsdu_start(ic, &am, m, ni) == 0)
+            continue;
+        if (that->iwm_tx_submit(sc, m, ni) || stop)
+            break;
     }
+    if ((m = ieee80211_amsdu_take(ic, &am, &ni)) != NULL)
+        that->iwm_tx_submit(sc, m, ni);
     
     return kIOReturnSuccess;
 }
@@ -3768,6 +4108,33 @@ iwm_stop(struct _ifnet *ifp)
     ifp->if_snd->flush();
     ifq_clr_oactive(&ifp->if_snd);
     
+    if (sc->sc_rx_rounds != 0) {
+        XYLog("%s: RX rounds=%llu exhausted=%llu entries=%llu\n",
+              DEVNAME(sc), sc->sc_rx_rounds, sc->sc_rx_exhausted,
+              sc->sc_rx_frames);
+        XYLog("%s: RX entries per round 0:%llu 1:%llu 2-3:%llu 4-7:%llu "
+              "8-15:%llu 16-31:%llu 32-63:%llu 64+:%llu\n", DEVNAME(sc),
+              sc->sc_rx_round_hist[0], sc->sc_rx_round_hist[1],
+              sc->sc_rx_round_hist[2], sc->sc_rx_round_hist[3],
+              sc->sc_rx_round_hist[4], sc->sc_rx_round_hist[5],
+              sc->sc_rx_round_hist[6], sc->sc_rx_round_hist[7]);
+    }
+    sc->sc_rx_rounds = 0;
+    sc->sc_rx_exhausted = 0;
+    sc->sc_rx_frames = 0;
+    memset(sc->sc_rx_round_hist, 0, sizeof(sc->sc_rx_round_hist));
+    iwm_tx_defer_purge(sc);
+    for (i = 0; i < nitems(sc->txq); i++) {
+        struct iwm_tx_ring *txq = &sc->txq[i];
+        
+        iwm_tx_ring_wake(sc, txq);
+        if (txq->stalls != 0)
+            XYLog("%s: TX ring %d stalls=%u stall_ms=%llu\n", DEVNAME(sc),
+                  i, txq->stalls, txq->stall_ns / 1000000ULL);
+        txq->stalls = 0;
+        txq->stall_ns = 0;
+    }
+    
     in->in_phyctxt = NULL;
     in->in_ni.ni_chw = IEEE80211_CHAN_WIDTH_20_NOHT;
     
@@ -4133,41 +4500,178 @@ iwm_nic_error(struct iwm_softc *sc)
 }
 #endif
 
-#define ADVANCE_RXQ(sc) (sc->rxq.cur = (sc->rxq.cur + 1) % count);
+/*
+ * Interrupt coalescing timer (32 usec units) by RX ring entry rate.
+ * Quiet links get prompt interrupts; busy ones batch up to the
+ * firmware default used without moderation.
+ */
+static const struct {
+    uint32_t rate;      /* entries per second below which to use ... */
+    uint8_t timeout;    /* ... this IWM_CSR_INT_COALESCING value */
+} iwm_intr_mod_levels[] = {
+    { 1000,         0x02 },     /*   64 usec */
+    { 5000,         0x08 },     /*  256 usec */
+    { 20000,        0x10 },     /*  512 usec */
+    { UINT32_MAX,   IWM_HOST_INT_TIMEOUT_DEF },
+};
 
 void ItlIwm::
-iwm_notif_intr(struct iwm_softc *sc)
+iwm_intr_moderate(struct iwm_softc *sc, int n)
 {
-    struct mbuf_list ml = MBUF_LIST_INITIALIZER();
-    uint32_t wreg;
-    uint16_t hw;
-    int count;
+    uint64_t now, elapsed, rate;
+    int i;
     
+    sc->sc_rx_mod_frames += n;
+    now = nsecuptime();
+    elapsed = now - sc->sc_rx_mod_start;
+    if (elapsed < IWM_INTR_MOD_WINDOW)
+        return;
+    
+    rate = sc->sc_rx_mod_frames * 1000000000ULL / elapsed;
+    for (i = 0; i < nitems(iwm_intr_mod_levels) - 1; i++)
+        if (rate < iwm_intr_mod_levels[i].rate)
+            break;
+    if (iwm_intr_mod_levels[i].timeout != sc->sc_int_timeout) {
+        /* Only the low byte; 7260/3160 keep IWM_HOST_INT_OPER_MODE set. */
+        sc->sc_int_timeout = iwm_intr_mod_levels[i].timeout;
+        IWM_WRITE_1(sc, IWM_CSR_INT_COALESCING, sc->sc_int_timeout);
+    }
+    sc->sc_rx_mod_start = now;
+    sc->sc_rx_mod_frames = 0;
+}
+
+int ItlIwm::
+iwm_rx_ring_count(struct iwm_softc *sc)
+{
+    return sc->sc_mqrx_supported ? IWM_RX_MQ_RING_COUNT : IWM_RX_RING_COUNT;
+}
+
+uint16_t ItlIwm::
+iwm_rx_closed(struct iwm_softc *sc)
+{
     //        bus_dmamap_sync(sc->sc_dmat, sc->rxq.stat_dma.map,
     //            0, sc->rxq.stat_dma.size, BUS_DMASYNC_POSTREAD);
     
-    if (sc->sc_mqrx_supported) {
-        count = IWM_RX_MQ_RING_COUNT;
-        wreg = IWM_RFH_Q0_FRBDCB_WIDX_TRG;
-    } else {
-        count = IWM_RX_RING_COUNT;
-        wreg = IWM_FH_RSCSR_CHNL0_WPTR;
-    }
+    return (le16toh(sc->rxq.stat->closed_rb_num) & 0xfff) &
+        (iwm_rx_ring_count(sc) - 1);
+}
+
+#define ADVANCE_RXQ(sc) (sc->rxq.cur = (sc->rxq.cur + 1) % count);
+
+/*
+ * One RX polling round: process at most budget ring entries closed by
+ * the firmware.  Returns non-zero if closed entries are left over.
+ */
+int ItlIwm::
+iwm_rx_poll(struct iwm_softc *sc, int budget)
+{
+    struct mbuf_list ml = MBUF_LIST_INITIALIZER();
+    uint32_t wreg;
+    uint16_t hw;
+    int count, n = 0, b;
     
-    hw = le16toh(sc->rxq.stat->closed_rb_num) & 0xfff;
-    hw &= (count - 1);
-    while (sc->rxq.cur != hw) {
+    count = iwm_rx_ring_count(sc);
+    wreg = sc->sc_mqrx_supported ? IWM_RFH_Q0_FRBDCB_WIDX_TRG :
+        IWM_FH_RSCSR_CHNL0_WPTR;
+    
+    hw = iwm_rx_closed(sc);
+    while (sc->rxq.cur != hw && n < budget) {
         struct iwm_rx_data *data = &sc->rxq.data[sc->rxq.cur];
         iwm_rx_pkt(sc, data, &ml);
         ADVANCE_RXQ(sc);
+        n++;
     }
     if_input(&sc->sc_ic.ic_if, &ml);
     /*
      * Tell the firmware what we have processed.
      * Seems like the hardware gets upset unless we align the write by 8??
      */
+    hw = sc->rxq.cur;
     hw = (hw == 0) ? count - 1 : hw - 1;
     IWM_WRITE(sc, wreg, hw & ~7);
+    
+    sc->sc_rx_rounds++;
+    sc->sc_rx_frames += n;
+    for (b = 0; n >> b != 0 && b < IWM_RX_POLL_HIST - 1; b++)
+        ;
+    sc->sc_rx_round_hist[b]++;
+    if ((sc->sc_ic.ic_userflags & IEEE80211_F_NOINTRMOD) == 0)
+        iwm_intr_moderate(sc, n);
+    
+    if (sc->rxq.cur == iwm_rx_closed(sc))
+        return 0;
+    if (n == budget)
+        sc->sc_rx_exhausted++;
+    return 1;
+}
+
+/*
+ * Mask or unmask the RX interrupt causes while polling rounds run.
+ */
+void ItlIwm::
+iwm_rx_poll_mask(struct iwm_softc *sc, int polling)
+{
+    sc->sc_rx_polling = polling;
+    if (!sc->sc_msix) {
+        iwm_restore_interrupts(sc);
+    } else {
+        uint32_t fh_mask = sc->sc_fh_mask;
+        
+        if (polling)
+            fh_mask &= ~(IWM_MSIX_FH_INT_CAUSES_Q0 |
+                         IWM_MSIX_FH_INT_CAUSES_Q1);
+        IWM_WRITE(sc, IWM_CSR_MSIX_FH_INT_MASK_AD, ~fh_mask);
+    }
+}
+
+/*
+ * RX interrupt.  With moderation disabled the ring is drained at once.
+ * Otherwise one budgeted round runs here and, if the budget ran out,
+ * the rest is left to iwm_rx_poll_timeout() with RX interrupts masked
+ * so other work on the workloop gets a turn in between.  Entries that
+ * are already closed raise no further interrupt, so if no round can be
+ * scheduled they are drained here instead.
+ */
+void ItlIwm::
+iwm_rx_intr(struct iwm_softc *sc)
+{
+    if (sc->sc_rx_polling)
+        return;
+    if (sc->sc_ic.ic_userflags & IEEE80211_F_NOINTRMOD) {
+        iwm_rx_poll(sc, iwm_rx_ring_count(sc));
+        return;
+    }
+    if (iwm_rx_poll(sc, IWM_RX_POLL_BUDGET)) {
+        if (timeout_add_usec(&sc->sc_rx_poll_to, 0))
+            iwm_rx_poll_mask(sc, 1);
+        else
+            iwm_rx_poll(sc, iwm_rx_ring_count(sc));
+    }
+}
+
+void ItlIwm::
+iwm_rx_poll_timeout(void *arg)
+{
+    struct iwm_softc *sc = (struct iwm_softc *)arg;
+    ItlIwm *that = container_of(sc, ItlIwm, com);
+    int s = splnet();
+    
+    if (!sc->sc_rx_polling) {
+        splx(s);
+        return;
+    }
+    if (that->iwm_rx_poll(sc, IWM_RX_POLL_BUDGET) == 0) {
+        that->iwm_rx_poll_mask(sc, 0);
+        /* Entries closed before the unmask raise no interrupt. */
+        if (sc->rxq.cur != that->iwm_rx_closed(sc))
+            that->iwm_rx_poll_mask(sc, 1);
+    }
+    if (sc->sc_rx_polling && !timeout_add_usec(&sc->sc_rx_poll_to, 0)) {
+        /* No next round: unmask, then drain what is already closed. */
+        that->iwm_rx_poll_mask(sc, 0);
+        that->iwm_rx_poll(sc, that->iwm_rx_ring_count(sc));
+    }
+    splx(s);
 }
 
 int ItlIwm::
@@ -4307,7 +4811,7 @@ iwm_intr(OSObject *arg, IOInterruptEventSource* sender, int count)
             IWM_WRITE_1(sc, IWM_CSR_INT_PERIODIC_REG,
                         IWM_CSR_INT_PERIODIC_ENA);
         
-        that->iwm_notif_intr(sc);
+        that->iwm_rx_intr(sc);
     }
     
     rv = 1;
@@ -4335,7 +4839,7 @@ iwm_intr_msix(OSObject *object, IOInterruptEventSource* sender, int count)
     
     if (inta_fh & IWM_MSIX_FH_INT_CAUSES_Q0 ||
         inta_fh & IWM_MSIX_FH_INT_CAUSES_Q1) {
-        that->iwm_notif_intr(sc);
+        that->iwm_rx_intr(sc);
     }
     
     /* firmware chunk loaded */
@@ -4891,6 +5395,7 @@ iwm_attach(struct iwm_softc *sc, struct pci_attach_args *pa)
     ic->ic_txbfcaps = 0;
     ic->ic_aselcaps = 0;
     ic->ic_ampdu_params = (IEEE80211_AMPDU_PARAM_SS_4 | 0x3 /* 64k */);
+    ic->ic_tx_amsdu_maxlen = IEEE80211_MAX_MPDU_LEN_HT_3839;
     ic->ic_caps |= (IEEE80211_C_QOS | IEEE80211_C_TX_AMPDU | IEEE80211_C_AMSDU_IN_AMPDU);
     ic->ic_caps |= IEEE80211_C_SUPPORTS_VHT_EXT_NSS_BW;
     
@@ -4939,11 +5444,14 @@ iwm_attach(struct iwm_softc *sc, struct pci_attach_args *pa)
         for (j = 0; j < nitems(rxba->entries); j++)
             ml_init(&rxba->entries[j].frames);
     }
+    timeout_set(&sc->sc_rx_poll_to, iwm_rx_poll_timeout, sc);
     task_set(&sc->init_task, iwm_init_task, sc, "init_task");
     task_set(&sc->newstate_task, iwm_newstate_task, sc, "newstate_task");
     task_set(&sc->ba_task, iwm_ba_task, sc, "ba_task");
     task_set(&sc->mac_ctxt_task, iwm_mac_ctxt_task, sc, "mac_ctxt_task");
     task_set(&sc->chan_ctxt_task, iwm_chan_ctxt_task, sc, "chan_ctxt_task");
+    task_set_prio(&sc->init_task, TASK_PRIO_HIGH);
+    task_set_prio(&sc->newstate_task, TASK_PRIO_HIGH);
     
     ic->ic_node_alloc = iwm_node_alloc;
     ic->ic_bgscan_start = iwm_bgscan;
@@ -5094,6 +5602,7 @@ iwm_chan_ctxt_task(void *arg)
     if (in->in_rn.bw != in->in_ni.ni_chw) {
         ieee80211_ra_node_init(ic, &in->in_rn, &in->in_ni);
         ieee80211_ra_choose(&in->in_rn, ic, &in->in_ni);
+        ieee80211_mrr_node_init(ic, &in->in_mn, &in->in_ni);
     }
     that->iwm_setrates((struct iwm_node *)ic->ic_bss, 0);
     
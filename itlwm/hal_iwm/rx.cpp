@@ -190,6 +190,13 @@ iwm_free_rx_ring(struct iwm_softc *sc, struct iwm_rx_ring *ring)
             data->map = NULL;
         }
     }
+    if (ring->pool != NULL) {
+        XYLog("%s: RX pool hit=%llu miss=%llu starved=%llu\n", DEVNAME(sc),
+              ring->pool->rp_stats.hit, ring->pool->rp_stats.miss,
+              ring->pool->rp_stats.starved);
+        rxpool_destroy(ring->pool);
+        ring->pool = NULL;
+    }
 }
 
 int ItlIwm::
@@ -240,6 +247,11 @@ iwm_alloc_rx_ring(struct iwm_softc *sc, struct iwm_rx_ring *ring)
         }
     }
     
+    /* Leave headroom for buffers still held by the stack or reorder queues. */
+    ring->pool = rxpool_create(IWM_RBUF_SIZE, count + count / 2);
+    if (ring->pool == NULL)
+        XYLog("%s: no RX buffer pool, allocating per frame\n", DEVNAME(sc));
+    
     for (i = 0; i < count; i++) {
         struct iwm_rx_data *data = &ring->data[i];
         
@@ -276,9 +288,17 @@ iwm_rx_addbuf(struct iwm_softc *sc, int size, int idx)
     
 //    mbuf_allocpacket(MBUF_WAITOK, size, NULL, &m);
     
+    m = rxpool_get(ring->pool, &seg, &data->pbuf);
+    if (m != NULL) {
+        data->map->dm_nsegs = 1;
+        goto done;
+    }
+    data->pbuf = NULL;
     m = getController()->allocatePacket(size);
 //
     if (m == NULL) {
+        if (ring->pool != NULL)
+            ring->pool->rp_stats.starved++;
         XYLog("%s allocatePacket==NULL\n", __FUNCTION__);
         return ENOMEM;
     }
@@ -315,6 +335,7 @@ iwm_rx_addbuf(struct iwm_softc *sc, int size, int idx)
         mbuf_freem(m);
         return ENOMEM;
     }
+done:
     data->m = m;
     //    bus_dmamap_sync(sc->sc_dmat, data->map, 0, size, BUS_DMASYNC_PREREAD);
     
@@ -409,6 +430,7 @@ iwm_rx_mpdu(struct iwm_softc *sc, mbuf_t m, void *pktdata,
         mbuf_freem(m);
         return;
     }
+    iwm_rx_csum(sc, m, rx_pkt_status);
     
     chanidx = letoh32(phy_info->channel);
     device_timestamp = le32toh(phy_info->system_timestamp);
@@ -675,7 +697,7 @@ iwm_rx_reorder(struct iwm_softc *sc, mbuf_t m, int chanidx,
         return 0;
     
     if (rxba->timeout != 0)
-        getmicrouptime(&rxba->last_rx);
+        rxba->last_rx = nsecuptime();
     
     /* Bypass A-MPDU re-ordering in net80211. */
     rxi->rxi_flags |= IEEE80211_RXI_AMPDU_DONE;
@@ -936,6 +958,7 @@ iwm_rx_mpdu_mq(struct iwm_softc *sc, mbuf_t m, void *pktdata,
         mbuf_freem(m);
         return;
     }
+    iwm_rx_csum_mq(sc, m, le16toh(desc->l3l4_flags));
     
     if (iwm_detect_duplicate(sc, m, desc, &rxi)) {
         mbuf_freem(m);
@@ -991,12 +1014,14 @@ iwm_rx_pkt(struct iwm_softc *sc, struct iwm_rx_data *data, struct mbuf_list *ml)
     struct iwm_rx_packet *pkt, *nextpkt;
     uint32_t offset = 0, nextoff = 0, nmpdu = 0, len;
     mbuf_t m0, m = NULL;
+    struct rxpool_buf *pbuf;
     const size_t minsz = sizeof(pkt->len_n_flags) + sizeof(pkt->hdr);
     int qid, idx, code, handled = 1;
     
     //    bus_dmamap_sync(sc->sc_dmat, data->map, 0, IWM_RBUF_SIZE,
     //        BUS_DMASYNC_POSTREAD);
     m0 = data->m;
+    pbuf = data->pbuf;
     while (m0 && offset + minsz < IWM_RBUF_SIZE) {
         pkt = (struct iwm_rx_packet *)((uint8_t*)mbuf_data(m0) + offset);
         qid = pkt->hdr.qid;
@@ -1035,6 +1060,27 @@ iwm_rx_pkt(struct iwm_softc *sc, struct iwm_rx_data *data, struct mbuf_list *ml)
                 ((uint8_t*)mbuf_data(m0) + nextoff);
                 if (nextoff + minsz >= IWM_RBUF_SIZE ||
                     !iwm_rx_pkt_valid(nextpkt)) {
+                    if (nmpdu > 1 && pbuf != NULL) {
+                        /*
+                         * Earlier frames were handed up as slices of
+                         * this buffer; m0's headroom overlaps them, so
+                         * the last frame becomes a slice too.
+                         */
+                        m = rxpool_slice(pbuf, offset, len);
+                        mbuf_freem(m0);
+                        m0 = NULL;
+                        if (m == NULL) {
+                            ifp->netStat->inputErrors++;
+                            break;
+                        }
+                        if (sc->sc_mqrx_supported)
+                            iwm_rx_mpdu_mq(sc, m, pkt->data,
+                                           len - minsz, ml);
+                        else
+                            iwm_rx_mpdu(sc, m, pkt->data,
+                                        len - minsz, ml);
+                        break;
+                    }
                     /* No need to copy last frame in buffer. */
                     if (offset > 0)
                         mbuf_adj(m0, offset);
@@ -1045,6 +1091,24 @@ iwm_rx_pkt(struct iwm_softc *sc, struct iwm_rx_data *data, struct mbuf_list *ml)
                         iwm_rx_mpdu(sc, m0, pkt->data,
                                     maxlen, ml);
                     m0 = NULL; /* stack owns m0 now; abort loop */
+                } else if (pbuf != NULL) {
+                    /*
+                     * Point a new mbuf at this packet inside the
+                     * shared receive buffer instead of copying it.
+                     */
+                    m = rxpool_slice(pbuf, offset, len);
+                    if (m == NULL) {
+                        ifp->netStat->inputErrors++;
+                        mbuf_freem(m0);
+                        m0 = NULL;
+                        break;
+                    }
+                    if (sc->sc_mqrx_supported)
+                        iwm_rx_mpdu_mq(sc, m, pkt->data,
+                                       len - minsz, ml);
+                    else
+                        iwm_rx_mpdu(sc, m, pkt->data,
+                                    len - minsz, ml);
                 } else {
                     /*
                      * Create an mbuf which points to the current
@@ -163,7 +163,7 @@ iwm_reset_tx_ring(struct iwm_softc *sc, struct iwm_tx_ring *ring)
     memset(ring->desc, 0, ring->desc_dma.size);
 //    bus_dmamap_sync(sc->sc_dmat, ring->desc_dma.map, 0,
 //        ring->desc_dma.size, BUS_DMASYNC_PREWRITE);
-    sc->qfullmsk &= ~(1 << ring->qid);
+    iwm_tx_ring_wake(sc, ring);
     /* 7000 family NICs are locked while commands are in progress. */
     if (ring->qid == sc->cmdqid && ring->queued > 0) {
         if (sc->sc_device_family == IWM_DEVICE_FAMILY_7000)
@@ -198,6 +198,12 @@ supportedFeatures()
     return kIONetworkFeatureMultiPages;
 }
 
+UInt32 ItlIwn::
+supportedChecksums(bool isOutput)
+{
+    return 0;
+}
+
 const char *ItlIwn::
 getFirmwareCountryCode()
 {
@@ -210,6 +216,13 @@ getTxQueueSize()
     return IWN_TX_RING_COUNT;
 }
 
+bool ItlIwn::
+getRxPollStats(struct ioctl_rx_poll *st)
+{
+    /* RX is not polled in rounds here. */
+    return false;
+}
+
 int16_t ItlIwn::
 getBSSNoise()
 {
@@ -605,6 +618,7 @@ iwn_attach(struct iwn_softc *sc, struct pci_attach_args *pa)
     timeout_set(&sc->calib_to, iwn_calib_timeout, sc);
 //    rw_init(&sc->sc_rwlock, "iwnlock");
     task_set(&sc->init_task, iwn_init_task, sc, "iwn_init_task");
+    task_set_prio(&sc->init_task, TASK_PRIO_HIGH);
     return true;
 
     /* Free allocated memory if something failed during attachment. */
@@ -1224,6 +1238,13 @@ iwn_alloc_rx_ring(struct iwn_softc *sc, struct iwn_rx_ring *ring)
         goto fail;
     }
 
+    /* Leave headroom for buffers still held by the stack. */
+    ring->pool = rxpool_create(IWN_RBUF_SIZE,
+        IWN_RX_RING_COUNT + IWN_RX_RING_COUNT / 2);
+    if (ring->pool == NULL)
+        XYLog("%s: no RX buffer pool, allocating per frame\n",
+            sc->sc_dev.dv_xname);
+
     /*
      * Allocate and map RX buffers.
      */
@@ -1239,17 +1260,22 @@ iwn_alloc_rx_ring(struct iwn_softc *sc, struct iwn_rx_ring *ring)
             goto fail;
         }
 
-        m = getController()->allocatePacket(IWN_RBUF_SIZE);
-        if (m == NULL) {
-            XYLog("could not allocate RX mbuf\n");
-            error = ENOBUFS;
-            goto fail;
-        }
-        data->map->dm_nsegs = data->map->cursor->getPhysicalSegments(m, &data->map->dm_segs[0], 1);
-        if (data->map->dm_nsegs == 0) {
-            mbuf_freem(m);
-            error = ENOMEM;
-            goto fail;
+        m = rxpool_get(ring->pool, &data->map->dm_segs[0], NULL);
+        if (m != NULL)
+            data->map->dm_nsegs = 1;
+        else {
+            m = getController()->allocatePacket(IWN_RBUF_SIZE);
+            if (m == NULL) {
+                XYLog("could not allocate RX mbuf\n");
+                error = ENOBUFS;
+                goto fail;
+            }
+            data->map->dm_nsegs = data->map->cursor->getPhysicalSegments(m, &data->map->dm_segs[0], 1);
+            if (data->map->dm_nsegs == 0) {
+                mbuf_freem(m);
+                error = ENOMEM;
+                goto fail;
+            }
         }
         
         data->m = m;
@@ -1326,6 +1352,13 @@ iwn_free_rx_ring(struct iwn_softc *sc, struct iwn_rx_ring *ring)
             data->map = NULL;
         }
     }
+    if (ring->pool != NULL) {
+        XYLog("%s: RX pool hit=%llu miss=%llu starved=%llu\n",
+            sc->sc_dev.dv_xname, ring->pool->rp_stats.hit,
+            ring->pool->rp_stats.miss, ring->pool->rp_stats.starved);
+        rxpool_destroy(ring->pool);
+        ring->pool = NULL;
+    }
 }
 
 int ItlIwn::
@@ -2131,19 +2164,26 @@ iwn_rx_done(struct iwn_softc *sc, struct iwn_rx_desc *desc,
         return;
     }
     
-    m1 = getController()->allocatePacket(IWN_RBUF_SIZE);
-    if (m1 == NULL) {
-        XYLog("could not allocate RX mbuf\n");
-        ic->ic_stats.is_rx_nombuf++;
-        ifp->netStat->inputErrors++;
-        return;
-    }
-    data->map->dm_nsegs = data->map->cursor->getPhysicalSegments(m1, &data->map->dm_segs[0], 1);
-    if (data->map->dm_nsegs == 0) {
-        XYLog("could not map RX mbuf\n");
-        mbuf_freem(m1);
-        ifp->netStat->inputErrors++;
-        return;
+    m1 = rxpool_get(ring->pool, &data->map->dm_segs[0], NULL);
+    if (m1 != NULL)
+        data->map->dm_nsegs = 1;
+    else {
+        m1 = getController()->allocatePacket(IWN_RBUF_SIZE);
+        if (m1 == NULL) {
+            XYLog("could not allocate RX mbuf\n");
+            if (ring->pool != NULL)
+                ring->pool->rp_stats.starved++;
+            ic->ic_stats.is_rx_nombuf++;
+            ifp->netStat->inputErrors++;
+            return;
+        }
+        data->map->dm_nsegs = data->map->cursor->getPhysicalSegments(m1, &data->map->dm_segs[0], 1);
+        if (data->map->dm_nsegs == 0) {
+            XYLog("could not map RX mbuf\n");
+            mbuf_freem(m1);
+            ifp->netStat->inputErrors++;
+            return;
+        }
     }
     
 //    m1 = MCLGETI(NULL, M_DONTWAIT, NULL, IWN_RBUF_SIZE);
@@ -2328,6 +2368,13 @@ iwn_ra_choose(struct iwn_softc *sc, struct ieee80211_node *ni)
     struct iwn_node *wn = (struct iwn_node *)ni;
     int old_txmcs = ni->ni_txmcs;
 
+    if (ieee80211_mrr_active(&wn->mn)) {
+        /* MRR's retry chain is the LQ table itself. */
+        if (ieee80211_mrr_choose(&wn->mn, ic, ni))
+            iwn_set_link_quality(sc, ni);
+        return;
+    }
+
     ieee80211_ra_choose(&wn->rn, ic, ni);
 
     /* Update firmware's LQ retry table if RA has chosen a new MCS. */
@@ -2335,6 +2382,49 @@ iwn_ra_choose(struct iwn_softc *sc, struct ieee80211_node *ni)
         iwn_set_link_quality(sc, ni);
 }
 
+/*
+ * Expand MRR's retry chain into the link quality retry table, each
+ * stage repeated for its number of tries. Returns the number of
+ * entries used.
+ */
+int ItlIwn::
+iwn_mrr_fill_lq(struct iwn_softc *sc, struct ieee80211_node *ni,
+    struct iwn_cmd_link_quality *linkq, uint8_t txant)
+{
+    struct iwn_node *wn = (struct iwn_node *)ni;
+    struct ieee80211_mrr_node *mn = &wn->mn;
+    const struct ieee80211_mrr_group *g;
+    uint8_t rflags;
+    int i, k, j = 0;
+
+    linkq->mimo = 0;
+    for (i = 0; i < mn->nchain; i++) {
+        g = ieee80211_mrr_group(mn, mn->chain[i].rate);
+        rflags = IWN_RFLAG_MCS;
+        if (g->sgi)
+            rflags |= IWN_RFLAG_SGI;
+        if (ni->ni_chw == IEEE80211_CHAN_WIDTH_40)
+            rflags |= IWN_RFLAG_HT40;
+        if (g->nss > 1)
+            rflags |= IWN_RFLAG_ANT(sc->txchainmask);
+        else
+            rflags |= IWN_RFLAG_ANT(txant);
+
+        for (k = 0; k < mn->chain[i].tries && j < IWN_MAX_TX_RETRIES;
+             k++) {
+            linkq->retry[j].plcp = iwn_rates[iwn_mcs2ridx[
+                ieee80211_mrr_mcs(mn, mn->chain[i].rate)]].ht_plcp;
+            linkq->retry[j].rflags = rflags;
+            j++;
+        }
+        /* Multi-stream stages always lead the chain. */
+        if (g->nss > 1)
+            linkq->mimo = j;
+    }
+
+    return j;
+}
+
 void ItlIwn::
 iwn_ampdu_rate_control(struct iwn_softc *sc, struct ieee80211_node *ni,
     struct iwn_tx_ring *txq, uint16_t seq, uint16_t ssn)
@@ -2357,8 +2447,12 @@ iwn_ampdu_rate_control(struct iwn_softc *sc, struct ieee80211_node *ni,
              * before failing an A-MPDU subframe the firmware
              * sends it as a single frame at least once.
              */
-            ieee80211_ra_add_stats_ht(&wn->rn, ic, ni,
-                                      txdata->ampdu_txmcs, 1, 0);
+            if (ieee80211_mrr_active(&wn->mn))
+                ieee80211_mrr_add_stats(&wn->mn, ic, ni,
+                                        txdata->ampdu_txmcs, 1, 0);
+            else
+                ieee80211_ra_add_stats_ht(&wn->rn, ic, ni,
+                                          txdata->ampdu_txmcs, 1, 0);
             
             /* Report this frame only once. */
             txdata->ampdu_nframes = 0;
@@ -2381,6 +2475,23 @@ iwn_ht_single_rate_control(struct iwn_softc *sc, struct ieee80211_node *ni,
     ieee80211_ra_get_rateset(&wn->rn, ic, ni, rate);
     unsigned int retries = 0, i;
     
+    if (ieee80211_mrr_active(&wn->mn)) {
+        /* The firmware walked our LQ table from its first entry. */
+        if (!ieee80211_mrr_tx_done(&wn->mn, ic, ni, rate, 0,
+                                   (rflags & IWN_RFLAG_SGI) != 0,
+                                   ackfailcnt, txfail)) {
+            if (++wn->lq_rate_mismatch > 15) {
+                /* Try to sync firmware with driver. */
+                iwn_set_link_quality(sc, ni);
+                wn->lq_rate_mismatch = 0;
+            }
+            return;
+        }
+        wn->lq_rate_mismatch = 0;
+        iwn_ra_choose(sc, ni);
+        return;
+    }
+    
     /*
      * Ignore Tx reports which don't match our last LQ command.
      */
@@ -2721,8 +2832,12 @@ iwn_ampdu_tx_done(struct iwn_softc *sc, struct iwn_tx_ring *txq,
              * The firmware might have made several such
              * attempts but we don't keep track of this.
              */
-            ieee80211_ra_add_stats_ht(&wn->rn, ic, ni,
-                                      txdata->ampdu_txmcs, 1, 1);
+            if (ieee80211_mrr_active(&wn->mn))
+                ieee80211_mrr_add_stats(&wn->mn, ic, ni,
+                                        txdata->ampdu_txmcs, 1, 1);
+            else
+                ieee80211_ra_add_stats_ht(&wn->rn, ic, ni,
+                                          txdata->ampdu_txmcs, 1, 1);
         }
         
         /* Report the final single-frame Tx attempt. */
@@ -4101,6 +4216,10 @@ iwn_set_link_quality(struct iwn_softc *sc, struct ieee80211_node *ni)
      */
     j = 0;
     ridx_min = iwn_rval2ridx(ieee80211_min_basic_rate(ic));
+    if (ieee80211_mrr_active(&wn->mn)) {
+        j = iwn_mrr_fill_lq(sc, ni, &linkq, txant);
+        goto fill;
+    }
     mimo = iwn_is_mimo_mcs(ni->ni_txmcs);
     ridx_max = (mimo ? IWN_LAST_HT_RATE : IWN_LAST_HT_SISO_RATE);
     for (ridx = ridx_max; ridx >= ridx_min; ridx--) {
@@ -4160,6 +4279,7 @@ iwn_set_link_quality(struct iwn_softc *sc, struct ieee80211_node *ni)
     
     linkq.mimo = (mimo ? j : 0);
     
+fill:
     /* Fill the rest with the lowest possible rate */
     while (j < IWN_MAX_TX_RETRIES) {
         tab = iwn_rates[ridx_min].plcp;
@@ -5879,6 +5999,7 @@ iwn_run(struct iwn_softc *sc)
     timeout_add_msec(&sc->calib_to, 500);
 
     ieee80211_ra_node_init(ic, &wn->rn, &wn->ni);
+    ieee80211_mrr_node_init(ic, &wn->mn, &wn->ni);
 
     /* Link LED always on while associated. */
     iwn_set_led(sc, IWN_LED_LINK, 0, 1);
@@ -103,9 +103,13 @@ public:
     
     virtual UInt32 supportedFeatures() override;
 
+    virtual UInt32 supportedChecksums(bool isOutput) override;
+
     virtual const char *getFirmwareCountryCode() override;
     
     virtual uint32_t getTxQueueSize() override;
+
+    virtual bool getRxPollStats(struct ioctl_rx_poll *st) override;
     
     //driver controller
     virtual void clearScanningFlags() override;
@@ -170,6 +174,8 @@ public:
     void        iwn_rx_done(struct iwn_softc *, struct iwn_rx_desc *,
                 struct iwn_rx_data *, struct mbuf_list *);
     void        iwn_ra_choose(struct iwn_softc *, struct ieee80211_node *);
+    int        iwn_mrr_fill_lq(struct iwn_softc *, struct ieee80211_node *,
+                struct iwn_cmd_link_quality *, uint8_t);
     void        iwn_ampdu_rate_control(struct iwn_softc *, struct ieee80211_node *,
                 struct iwn_tx_ring *, uint16_t, uint16_t);
     void        iwn_ht_single_rate_control(struct iwn_softc *,
@@ -33,6 +33,7 @@
 #include <net80211/ieee80211_var.h>
 #include <net80211/ieee80211_amrr.h>
 #include <net80211/ieee80211_ra.h>
+#include <net80211/ieee80211_mrr.h>
 #include <net80211/ieee80211_radiotap.h>
 #include <net80211/ieee80211_priv.h>
 
@@ -118,6 +119,7 @@ struct iwn_rx_ring {
     uint32_t        *desc;
     struct iwn_rx_status    *stat;
     struct iwn_rx_data    data[IWN_RX_RING_COUNT];
+    struct rxpool        *pool;
     int            cur;
 };
 
@@ -125,6 +127,7 @@ struct iwn_node {
     struct    ieee80211_node        ni;    /* must be the first */
     struct    ieee80211_amrr_node    amn;
     struct    ieee80211_ra_node    rn;
+    struct    ieee80211_mrr_node    mn;
     uint16_t            disable_tid;
     uint8_t                id;
     uint8_t                ridx[IEEE80211_RATE_MAXSIZE];
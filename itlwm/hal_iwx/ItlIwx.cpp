@@ -116,6 +116,7 @@
 #include <IOKit/IOCommandGate.h>
 #include <IOKit/network/IONetworkMedium.h>
 #include <net/ethernet.h>
+#include <ClientKit/Common.h>
 
 #include <sys/_task.h>
 #include <sys/pcireg.h>
@@ -162,6 +163,8 @@ detach(IOPCIDevice *device)
     iwx_free_rx_ring(sc, &sc->rxq);
     iwx_dma_contig_free(&sc->ict_dma);
     iwx_dma_contig_free(&com.ctxt_info_dma);
+    timeout_del(&sc->sc_rx_poll_to);
+    timeout_free(&sc->sc_rx_poll_to);
     ieee80211_ifdetach(ifp);
     taskq_destroy(systq);
     taskq_destroy(com.sc_nswq);
@@ -286,6 +289,19 @@ supportedFeatures()
     return kIONetworkFeatureMultiPages;
 }
 
+UInt32 ItlIwx::
+supportedChecksums(bool isOutput)
+{
+    /* AX210 only reports a raw receive checksum, which is not used. */
+    if (!isOutput && com.sc_device_family >= IWX_DEVICE_FAMILY_AX210)
+        return 0;
+    return (isOutput ? 0 : IONetworkController::kChecksumIP) |
+        IONetworkController::kChecksumTCP |
+        IONetworkController::kChecksumUDP |
+        IONetworkController::kChecksumTCPIPv6 |
+        IONetworkController::kChecksumUDPIPv6;
+}
+
 const char *ItlIwx::
 getFirmwareCountryCode()
 {
@@ -298,6 +314,18 @@ getTxQueueSize()
     return com.sc_device_family >= IWX_DEVICE_FAMILY_AX210 ? IWX_TFD_QUEUE_SIZE_MAX_GEN3 : IWX_DEFAULT_QUEUE_SIZE;
 }
 
+bool ItlIwx::
+getRxPollStats(struct ioctl_rx_poll *st)
+{
+    static_assert(nitems(com.sc_rx_round_hist) == RX_POLL_HIST,
+                  "RX round histogram size");
+    st->rounds = com.sc_rx_rounds;
+    st->exhausted = com.sc_rx_exhausted;
+    st->entries = com.sc_rx_frames;
+    memcpy(st->round_hist, com.sc_rx_round_hist, sizeof(st->round_hist));
+    return true;
+}
+
 int16_t ItlIwx::
 getBSSNoise()
 {
@@ -2356,6 +2384,12 @@ iwx_alloc_rx_ring(struct iwx_softc *sc, struct iwx_rx_ring *ring)
         goto fail;
     }
     
+    /* Leave headroom for buffers still held by the stack or reorder queues. */
+    ring->pool = rxpool_create(IWX_RBUF_SIZE,
+                               IWX_RX_MQ_RING_COUNT + IWX_RX_MQ_RING_COUNT / 2);
+    if (ring->pool == NULL)
+        XYLog("%s: no RX buffer pool, allocating per frame\n", DEVNAME(sc));
+    
     for (i = 0; i < IWX_RX_MQ_RING_COUNT; i++) {
         struct iwx_rx_data *data = &ring->data[i];
         
@@ -2445,6 +2479,13 @@ iwx_free_rx_ring(struct iwx_softc *sc, struct iwx_rx_ring *ring)
             data->map = NULL;
         }
     }
+    if (ring->pool != NULL) {
+        XYLog("%s: RX pool hit=%llu miss=%llu starved=%llu\n", DEVNAME(sc),
+              ring->pool->rp_stats.hit, ring->pool->rp_stats.miss,
+              ring->pool->rp_stats.starved);
+        rxpool_destroy(ring->pool);
+        ring->pool = NULL;
+    }
 }
 
 void ItlIwx::
@@ -2579,10 +2620,13 @@ iwx_reset_tx_ring(struct iwx_softc *sc, struct iwx_tx_ring *ring)
     memset(ring->desc, 0, ring->desc_dma.size);
     //    bus_dmamap_sync(sc->sc_dmat, ring->desc_dma.map, 0,
     //        ring->desc_dma.size, BUS_DMASYNC_PREWRITE);
-    sc->qfullmsk &= ~(1 << ring->qid);
+    if (ring->qid < 32)
+        sc->sc_tx_dbmsk &= ~(1 << ring->qid);
     ring->queued = 0;
     ring->cur = 0;
     ring->tail = 0;
+    ring->db_pending = 0;
+    iwx_tx_ring_wake(sc, ring);
 }
 
 void ItlIwx::
@@ -2708,7 +2752,13 @@ iwx_enable_fwload_interrupt(struct iwx_softc *sc)
 void ItlIwx::
 iwx_restore_interrupts(struct iwx_softc *sc)
 {
-    IWX_WRITE(sc, IWX_CSR_INT_MASK, sc->sc_intmask);
+    uint32_t mask = sc->sc_intmask;
+    
+    /* RX causes stay masked while polling rounds are pending. */
+    if (sc->sc_rx_polling)
+        mask &= ~(IWX_CSR_INT_BIT_FH_RX | IWX_CSR_INT_BIT_SW_RX |
+                  IWX_CSR_INT_BIT_RX_PERIODIC);
+    IWX_WRITE(sc, IWX_CSR_INT_MASK, mask);
 }
 
 void ItlIwx::
@@ -2961,7 +3011,7 @@ iwx_conf_msix_hw(struct iwx_softc *sc, int stopped)
     /* Map fallback-queue (command/mgmt) to a single vector */
     IWX_WRITE_1(sc, IWX_CSR_MSIX_RX_IVAR(0),
                 vector | IWX_MSIX_NON_AUTO_CLEAR_CAUSE);
-    /* Map RSS queue (data) to the same vector */
+    /* Map RSS queue (data) to the same vector, see iwx_attach() */
     IWX_WRITE_1(sc, IWX_CSR_MSIX_RX_IVAR(1),
                 vector | IWX_MSIX_NON_AUTO_CLEAR_CAUSE);
     
@@ -3077,6 +3127,8 @@ iwx_stop_device(struct iwx_softc *sc)
     
     iwx_disable_interrupts(sc);
     sc->sc_flags &= ~IWX_FLAG_USE_ICT;
+    timeout_del(&sc->sc_rx_poll_to);
+    sc->sc_rx_polling = 0;
     
     iwx_disable_rx_dma(sc);
     iwx_reset_rx_ring(sc, &sc->rxq);
@@ -3170,7 +3222,10 @@ iwx_nic_config(struct iwx_softc *sc)
 int ItlIwx::
 iwx_nic_rx_init(struct iwx_softc *sc)
 {
-    IWX_WRITE_1(sc, IWX_CSR_INT_COALESCING, IWX_HOST_INT_TIMEOUT_DEF);
+    sc->sc_int_timeout = IWX_HOST_INT_TIMEOUT_DEF;
+    sc->sc_rx_mod_start = nsecuptime();
+    sc->sc_rx_mod_frames = 0;
+    IWX_WRITE_1(sc, IWX_CSR_INT_COALESCING, sc->sc_int_timeout);
     
     /*
      * We don't configure the RFH; the firmware will do that.
@@ -3766,16 +3821,21 @@ iwx_clear_reorder_buffer(struct iwx_softc *sc, struct iwx_rxba_data *rxba)
     struct iwx_reorder_buffer *reorder_buf = &rxba->reorder_buf;
     struct iwx_reorder_buf_entry *entry;
     
-    for (i = 0; i < reorder_buf->buf_size; i++) {
-        entry = &rxba->entries[i];
-        ml_purge(&entry->frames);
-        timerclear(&entry->reorder_time);
+    if (rxba->entries != NULL) {
+        for (i = 0; i < reorder_buf->buf_size; i++) {
+            entry = &rxba->entries[i];
+            ml_purge(&entry->frames);
+        }
+        IOFree(rxba->entries, reorder_buf->buf_size * sizeof(*entry));
+        rxba->entries = NULL;
     }
     
+    reorder_buf->buf_size = 0;
+    reorder_buf->num_stored = 0;
     reorder_buf->removed = 1;
     timeout_del(&reorder_buf->reorder_timer);
     timeout_free(&reorder_buf->reorder_timer);
-    timerclear(&rxba->last_rx);
+    rxba->last_rx = 0;
     timeout_del(&rxba->session_timer);
     timeout_free(&rxba->session_timer);
     rxba->baid = IWX_RX_REORDER_DATA_INVALID_BAID;
@@ -3791,18 +3851,15 @@ iwx_rx_ba_session_expired(void *arg)
     struct iwx_softc *sc = rxba->sc;
     struct ieee80211com *ic = &sc->sc_ic;
     struct ieee80211_node *ni = ic->ic_bss;
-    struct timeval now, timeout, expiry;
-    int s;
+    int s, left;
     
     s = splnet();
     if ((sc->sc_flags & IWX_FLAG_SHUTDOWN) == 0 &&
         ic->ic_state == IEEE80211_S_RUN &&
         rxba->baid != IWX_RX_REORDER_DATA_INVALID_BAID) {
-        getmicrouptime(&now);
-        USEC_TO_TIMEVAL(RX_REORDER_BUF_TIMEOUT_MQ_USEC, &timeout);
-        timeradd(&rxba->last_rx, &timeout, &expiry);
-        if (timercmp(&now, &expiry, <)) {
-            timeout_add_usec(&rxba->session_timer, rxba->timeout);
+        left = ieee80211_inact_left(rxba->last_rx, rxba->timeout);
+        if (left > 0) {
+            timeout_add_usec(&rxba->session_timer, left);
         } else {
             ic->ic_stats.is_ht_rx_ba_timeout++;
             ieee80211_delba_request(ic, ni,
@@ -4107,11 +4164,22 @@ iwx_sta_rx_agg(struct iwx_softc *sc, struct ieee80211_node *ni, uint8_t tid,
         splx(s);
         return;
     }
+    if (start) {
+        rxba->entries = (struct iwx_reorder_buf_entry *)
+        _MallocZero(winsize * sizeof(*rxba->entries));
+        if (rxba->entries == NULL) {
+            ieee80211_addba_req_refuse(ic, ni, tid);
+            splx(s);
+            return;
+        }
+        for (int i = 0; i < winsize; i++)
+            ml_init(&rxba->entries[i].frames);
+    }
     rxba->sta_id = IWX_STATION_ID;
     rxba->tid = tid;
     rxba->baid = baid;
     rxba->timeout = timeout_val;
-    getmicrouptime(&rxba->last_rx);
+    rxba->last_rx = nsecuptime();
     iwx_init_reorder_buffer(&rxba->reorder_buf, ssn,
                             winsize);
     if (timeout_val != 0) {
@@ -4803,6 +4871,12 @@ iwx_rx_addbuf(struct iwx_softc *sc, int size, int idx)
     int err;
     int fatal = 0;
     
+    m = rxpool_get(ring->pool, &data->map->dm_segs[0], &data->pbuf);
+    if (m != NULL) {
+        data->map->dm_nsegs = 1;
+        goto done;
+    }
+    data->pbuf = NULL;
     m = getController()->allocatePacket(size);
     
     //    m = m_gethdr(M_DONTWAIT, MT_DATA);
@@ -4828,6 +4902,8 @@ iwx_rx_addbuf(struct iwx_softc *sc, int size, int idx)
     //    err = bus_dmamap_load_mbuf(sc->sc_dmat, data->map, m,
     //        BUS_DMA_READ|BUS_DMA_NOWAIT);
     if (m == NULL) {
+        if (ring->pool != NULL)
+            ring->pool->rp_stats.starved++;
         XYLog("could not allocate RX mbuf\n");
         return ENOMEM;
     }
@@ -4839,6 +4915,7 @@ iwx_rx_addbuf(struct iwx_softc *sc, int size, int idx)
         mbuf_freem(m);
         return ENOMEM;
     }
+done:
     data->m = m;
     //    bus_dmamap_sync(sc->sc_dmat, data->map, 0, size, BUS_DMASYNC_PREREAD);
     
@@ -5012,6 +5089,31 @@ out:
     return ret;
 }
 
+/*
+ * Pass the hardware's checksum verdict on to the network stack.  AX210
+ * devices only report a raw sum over the frame, which is left unused.
+ */
+void ItlIwx::
+iwx_rx_csum(struct iwx_softc *sc, mbuf_t m, struct iwx_rx_mpdu_desc *desc)
+{
+    mbuf_csum_performed_flags_t csum = 0;
+    uint16_t flags;
+    int l3;
+    
+    if (sc->sc_device_family >= IWX_DEVICE_FAMILY_AX210 ||
+        !isset(sc->sc_enabled_capa, IWX_UCODE_TLV_CAPA_CSUM_SUPPORT))
+        return;
+    flags = le16toh(desc->l3l4_flags);
+    l3 = (flags & IWX_RX_L3L4_L3_PROTO_MASK) >> IWX_RX_L3_PROTO_POS;
+    if (l3 == IWX_RX_L3_TYPE_IPV4 && (flags & IWX_RX_L3L4_IP_HDR_CSUM_OK))
+        csum |= MBUF_CSUM_DID_IP | MBUF_CSUM_IP_GOOD;
+    if ((flags & IWX_RX_L3L4_TCP_UDP_CSUM_OK) &&
+        (csum != 0 || l3 == IWX_RX_L3_TYPE_IPV6))
+        csum |= MBUF_CSUM_DID_DATA | MBUF_CSUM_PSEUDO_HDR;
+    if (csum != 0)
+        mbuf_set_csum_performed(m, csum, 0xffff);
+}
+
 void ItlIwx::
 iwx_rx_frame(struct iwx_softc *sc, mbuf_t m, int chanidx,
              uint32_t rx_pkt_status, int is_shortpre, int rate_n_flags,
@@ -5355,7 +5457,7 @@ iwx_rx_reorder(struct iwx_softc *sc, mbuf_t m, int chanidx,
         return 0;
     
     if (rxba->timeout != 0)
-        getmicrouptime(&rxba->last_rx);
+        rxba->last_rx = nsecuptime();
 
     /* Bypass A-MPDU re-ordering in net80211. */
     rxi->rxi_flags |= IEEE80211_RXI_AMPDU_DONE;
@@ -5620,6 +5722,7 @@ iwx_rx_mpdu_mq(struct iwx_softc *sc, mbuf_t m, void *pktdata,
         mbuf_freem(m);
         return;
     }
+    iwx_rx_csum(sc, m, desc);
     
     if (iwx_detect_duplicate(sc, m, desc, &rxi)) {
         mbuf_freem(m);
@@ -5705,8 +5808,9 @@ iwx_clear_oactive(struct iwx_softc *sc, struct iwx_tx_ring *ring)
     struct _ifnet *ifp = &ic->ic_if;
 
     if (ring->queued < ring->low_mark) {
-        sc->qfullmsk &= ~(1 << ring->qid);
-        if (sc->qfullmsk == 0 && ifq_is_oactive(&ifp->if_snd)) {
+        if (ring->stopped) {
+            /* Frames parked on this ring go out before new ones. */
+            iwx_tx_ring_wake(sc, ring);
             ifq_clr_oactive(&ifp->if_snd);
             (*ifp->if_start)(ifp);
         }
@@ -5716,6 +5820,49 @@ iwx_clear_oactive(struct iwx_softc *sc, struct iwx_tx_ring *ring)
     }
 }
 
+void ItlIwx::
+iwx_tx_ring_stop(struct iwx_softc *sc, struct iwx_tx_ring *ring)
+{
+    if (ring->stopped)
+        return;
+    ring->stopped = 1;
+    ring->stall_start = nsecuptime();
+    ring->stalls++;
+}
+
+void ItlIwx::
+iwx_tx_ring_wake(struct iwx_softc *sc, struct iwx_tx_ring *ring)
+{
+    if (!ring->stopped)
+        return;
+    ring->stopped = 0;
+    ring->stall_ns += nsecuptime() - ring->stall_start;
+}
+
+/*
+ * Drop frames parked for stopped rings, releasing the node references
+ * taken by ieee80211_encap().
+ */
+void ItlIwx::
+iwx_tx_defer_purge(struct iwx_softc *sc)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct ieee80211_node *ni;
+    mbuf_t m;
+    int ac, qid;
+    
+    for (ac = 0; ac < EDCA_NUM_AC; ac++) {
+        while ((m = ml_dequeue(&sc->sc_txdefer[ac])) != NULL) {
+            ni = (struct ieee80211_node *)mbuf_pkthdr_rcvif(m);
+            mbuf_freem(m);
+            if (ni != NULL)
+                ieee80211_release_node(ic, ni);
+        }
+    }
+    for (qid = 0; qid < nitems(sc->txq); qid++)
+        sc->txq[qid].parked = 0;
+}
+
 void ItlIwx::
 iwx_rx_tx_ba_notif(struct iwx_softc *sc, struct iwx_rx_packet *pkt, struct iwx_rx_data *data)
 {
@@ -6530,6 +6677,45 @@ iwx_tx_update_byte_tbl(struct iwx_softc *sc, struct iwx_tx_ring *txq, int idx, u
     }
 }
 
+/*
+ * Select the TX ring for an encapsulated frame: the TID's aggregation
+ * queue once a BA agreement is in place, the default data queue
+ * otherwise.
+ */
+int ItlIwx::
+iwx_tx_qid(struct iwx_softc *sc, struct ieee80211_node *ni, mbuf_t m,
+           uint8_t *tidp)
+{
+    struct ieee80211_frame *wh = mtod(m, struct ieee80211_frame *);
+    uint8_t type = wh->i_fc[0] & IEEE80211_FC0_TYPE_MASK;
+    uint8_t subtype = wh->i_fc[0] & IEEE80211_FC0_SUBTYPE_MASK;
+    uint8_t tid = IWX_MGMT_TID;
+    int qid = IWX_INVALID_QUEUE;
+    int hasqos = 0;
+    uint16_t qos;
+
+    if (!IEEE80211_IS_MULTICAST(wh->i_addr1) && (hasqos = ieee80211_has_qos(wh)) && !ieee80211_is_qos_nullfunc(wh)) {
+        /* Select EDCA Access Category and TX ring for this frame. */
+        qos = ieee80211_get_qos(wh);
+        int q_tid = qos & IEEE80211_QOS_TID;
+        if (ni->ni_tx_ba[q_tid].ba_state == IEEE80211_BA_AGREED) {
+            tid = q_tid;
+            qid = sc->sc_tid_data[tid].qid;
+        } else {
+            DPRINTFN(1, ("%s qid=%d is not BA negotiated state=%d\n", __FUNCTION__, qid, ni->ni_tx_ba[q_tid].ba_state));
+        }
+    }
+
+    if (tid == IWX_MGMT_TID) {
+        DPRINTFN(3, ("%s type=%d qos=%d multicast=%d len=%zu subtype=%d qid=%d using mgmt tid\n", __FUNCTION__, type, hasqos, IEEE80211_IS_MULTICAST(wh->i_addr1), mbuf_len(m), subtype, qid));
+        qid = sc->first_data_qid;
+    }
+
+    if (tidp != NULL)
+        *tidp = tid;
+    return qid;
+}
+
 int ItlIwx::
 iwx_tx(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
 {
@@ -6554,41 +6740,22 @@ iwx_tx(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
     uint16_t cmd_size = 0;
 
     uint16_t num_tbs;
-    uint8_t tid, type, subtype;
-    int i, totlen, hasqos = 0;
+    uint8_t tid, type;
+    int i, totlen;
     int qid = IWX_INVALID_QUEUE;
-    uint16_t qos;
     int idx;
 
     wh = mtod(m, struct ieee80211_frame *);
     type = wh->i_fc[0] & IEEE80211_FC0_TYPE_MASK;
-    subtype = wh->i_fc[0] & IEEE80211_FC0_SUBTYPE_MASK;
     if (type == IEEE80211_FC0_TYPE_CTL) {
         hdrlen = sizeof(struct ieee80211_frame_min);
     } else {
         hdrlen = ieee80211_get_hdrlen(wh);
     }
 
-    tid = IWX_MGMT_TID;
-    if (!IEEE80211_IS_MULTICAST(wh->i_addr1) && (hasqos = ieee80211_has_qos(wh)) && !ieee80211_is_qos_nullfunc(wh)) {
-        /* Select EDCA Access Category and TX ring for this frame. */
-        qos = ieee80211_get_qos(wh);
-        int q_tid = qos & IEEE80211_QOS_TID;
-        if (ni->ni_tx_ba[q_tid].ba_state == IEEE80211_BA_AGREED) {
-            tid = q_tid;
-            qid = sc->sc_tid_data[tid].qid;
-        } else {
-            DPRINTFN(1, ("%s qid=%d is not BA negotiated state=%d\n", __FUNCTION__, qid, ni->ni_tx_ba[q_tid].ba_state));
-        }
-    }
-
-    if (tid == IWX_MGMT_TID) {
-        DPRINTFN(3, ("%s type=%d qos=%d multicast=%d len=%zu subtype=%d qid=%d using mgmt tid\n", __FUNCTION__, type, hasqos, IEEE80211_IS_MULTICAST(wh->i_addr1), mbuf_len(m), subtype, qid));
-        qid = sc->first_data_qid;
-    }
-
-    if (qid == IWX_INVALID_QUEUE || sc->qfullmsk & (1 << qid)) {
-        DPRINTFN(1, ("%s qid=%d fullmsk=%d\n", __FUNCTION__, qid, sc->qfullmsk));
+    qid = iwx_tx_qid(sc, ni, m, &tid);
+    if (qid == IWX_INVALID_QUEUE || sc->txq[qid].stopped) {
+        DPRINTFN(1, ("%s qid=%d stopped\n", __FUNCTION__, qid));
         mbuf_freem(m);
         return ENOBUFS;
     }
@@ -6638,6 +6805,8 @@ iwx_tx(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
     if (wh->i_fc[1] & IEEE80211_FC1_PROTECTED) {
         k = ieee80211_get_txkey(ic, wh, ni);
         if (k->k_cipher != IEEE80211_CIPHER_CCMP) {
+            /* Checksums must be final before software encryption. */
+            ieee80211_tx_csum(ic, m, hdrlen, 0);
             if ((m = ieee80211_encrypt(ic, m, k)) == NULL)
                 return ENOBUFS;
             /* 802.11 header may have moved. */
@@ -6652,9 +6821,23 @@ iwx_tx(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
     //    totlen = m->m_pkthdr.len;
     totlen = mbuf_pkthdr_len(m);
     
-    if (hdrlen % 4)
+    /* A-MSDU subframe headers keep the payload aligned. */
+    if (ieee80211_has_qos(wh) &&
+        (ieee80211_get_qos(wh) & IEEE80211_QOS_AMSDU))
+        offload_assist |= IWX_TX_CMD_OFFLD_AMSDU;
+    else if (hdrlen % 4)
         offload_assist |= IWX_TX_CMD_OFFLD_PAD;
     
+    /*
+     * Offsets are in words: the IP header follows the 4-word LLC/SNAP
+     * header, and the IV is added by firmware so the MAC header size
+     * does not include it.
+     */
+    if (ieee80211_tx_csum(ic, m, hdrlen,
+                          isset(sc->sc_enabled_capa, IWX_UCODE_TLV_CAPA_CSUM_SUPPORT)))
+        offload_assist |= IWX_TX_CMD_OFFLD_L4_EN |
+            IWX_TX_CMD_OFFLD_IP_HDR(4) | IWX_TX_CMD_OFFLD_MH_SIZE(hdrlen / 2);
+    
     if (sc->sc_device_family >= IWX_DEVICE_FAMILY_AX210) {
         tx_gen3 = (struct iwx_tx_cmd_gen3 *)cmd->data;
         
@@ -6736,18 +6919,74 @@ iwx_tx(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni, int ac)
     //        sizeof (*desc), BUS_DMASYNC_PREWRITE);
     
     iwx_tx_update_byte_tbl(sc, ring, idx, totlen, num_tbs);
+    iwx_tx_publish(sc, ring);
     
-    /* Kick TX ring. */
+    return 0;
+}
+
+/*
+ * Advance the ring past the descriptor just filled and kick it.  Inside
+ * a start batch the doorbell is deferred until enough frames have
+ * accumulated on this queue or the ring filled up.
+ */
+void ItlIwx::
+iwx_tx_publish(struct iwx_softc *sc, struct iwx_tx_ring *ring)
+{
     ring->cur = (ring->cur + 1) % getTxQueueSize();
-    IWX_WRITE(sc, IWX_HBUS_TARG_WRPTR, ring->qid << 16 | ring->cur);
+    ring->db_pending++;
     
-    /* Mark TX ring as full if we reach a certain threshold. */
+    /* Stop this TX ring if we reach a certain threshold. */
     if (++ring->queued > ring->hi_mark) {
-//        XYLog("%s sc->qfullmsk is FULL qid=%d ring->cur=%d ring->queued=%d\n", __FUNCTION__, ring->qid, ring->cur, ring->queued);
-        sc->qfullmsk |= 1 << ring->qid;
+//        XYLog("%s TX ring is FULL qid=%d ring->cur=%d ring->queued=%d\n", __FUNCTION__, ring->qid, ring->cur, ring->queued);
+        iwx_tx_ring_stop(sc, ring);
     }
     
-    return 0;
+    if (sc->sc_tx_batch && ring->qid < 32 &&
+        ring->db_pending < IWX_TX_BATCH_MAX && !ring->stopped)
+        sc->sc_tx_dbmsk |= 1 << ring->qid;
+    else
+        iwx_tx_kick(sc, ring);
+}
+
+void ItlIwx::
+iwx_tx_kick(struct iwx_softc *sc, struct iwx_tx_ring *ring)
+{
+    if (ring->qid < 32)
+        sc->sc_tx_dbmsk &= ~(1 << ring->qid);
+    if (ring->db_pending == 0)
+        return;
+    IWX_WRITE(sc, IWX_HBUS_TARG_WRPTR, ring->qid << 16 | ring->cur);
+    sc->sc_tx_doorbells++;
+    sc->sc_tx_db_frames += ring->db_pending;
+    ring->db_pending = 0;
+}
+
+void ItlIwx::
+iwx_tx_kick_all(struct iwx_softc *sc)
+{
+    uint32_t msk = sc->sc_tx_dbmsk;
+    int qid;
+    
+    while (msk != 0) {
+        qid = __builtin_ctz(msk);
+        msk &= msk - 1;
+        iwx_tx_kick(sc, &sc->txq[qid]);
+    }
+}
+
+/* Bound the latency of frames sitting behind a deferred doorbell. */
+void ItlIwx::
+iwx_tx_kick_late(struct iwx_softc *sc)
+{
+    uint64_t now;
+    
+    if (sc->sc_tx_dbmsk == 0)
+        return;
+    now = nsecuptime();
+    if (now - sc->sc_tx_batch_start >= IWX_TX_BATCH_USEC * 1000ULL) {
+        iwx_tx_kick_all(sc);
+        sc->sc_tx_batch_start = now;
+    }
 }
 
 int ItlIwx::
@@ -8494,9 +8733,22 @@ static uint8_t iwx_rs_fw_bw_from_sta_bw(uint8_t bw)
 
 static uint16_t iwx_rs_fw_get_max_amsdu_len(struct ieee80211_node *ni)
 {
-    if (ni->ni_flags & IEEE80211_NODE_HE) {
-        return 0;
+    if (ni->ni_flags & (IEEE80211_NODE_VHT | IEEE80211_NODE_HE)) {
+        switch (ni->ni_vhtcaps & IEEE80211_VHTCAP_MAX_MPDU_MASK) {
+        case IEEE80211_VHTCAP_MAX_MPDU_LENGTH_11454:
+            return IEEE80211_MAX_MPDU_LEN_VHT_11454;
+        case IEEE80211_VHTCAP_MAX_MPDU_LENGTH_7991:
+            return IEEE80211_MAX_MPDU_LEN_VHT_7991;
+        default:
+            return IEEE80211_MAX_MPDU_LEN_VHT_3895;
+        }
     }
+    if (ni->ni_flags & IEEE80211_NODE_HT) {
+        if (ni->ni_htcaps & IEEE80211_HTCAP_AMSDU7935)
+            return IEEE80211_MAX_MPDU_LEN_HT_7935;
+        return IEEE80211_MAX_MPDU_LEN_HT_3839;
+    }
+    /* no A-MSDUs in legacy mode */
     return 0;
 }
 
@@ -9989,35 +10241,140 @@ iwx_init(struct _ifnet *ifp)
     return 0;
 }
 
+/*
+ * Hand one encapsulated frame to the hardware.  Returns non-zero if the
+ * frame was dropped.
+ */
+int ItlIwx::
+iwx_start_frame(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct _ifnet *ifp = &ic->ic_if;
+    int ac = EDCA_AC_BE; /* XXX */
+    
+#if NBPFILTER > 0
+    if (ic->ic_rawbpf != NULL)
+        bpf_mtap(ic->ic_rawbpf, m, BPF_DIRECTION_OUT);
+#endif
+    if (iwx_tx(sc, m, ni, ac) != 0) {
+        ieee80211_release_node(ic, ni);
+        ifp->netStat->outputErrors++;
+        return 1;
+    }
+    ifp->netStat->outputPackets++;
+    
+    if (ifp->if_flags & IFF_UP) {
+        sc->sc_tx_timer = 15;
+        ifp->if_timer = 1;
+    }
+    
+    iwx_tx_kick_late(sc);
+    return 0;
+}
+
+/*
+ * Send a frame unless its ring is stopped or earlier frames for the same
+ * ring are parked, in which case it joins them.  Returns non-zero once the
+ * parking list is full and the caller should stop dequeuing.
+ */
+int ItlIwx::
+iwx_tx_submit(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni)
+{
+    struct ieee80211com *ic = &sc->sc_ic;
+    struct _ifnet *ifp = &ic->ic_if;
+    struct ieee80211_frame *wh;
+    struct mbuf_list *ml;
+    int ac, qid;
+    
+    /*
+     * A stopped ring only holds back its own access category;
+     * park the frame and keep serving the other ACs.
+     */
+    wh = mtod(m, struct ieee80211_frame *);
+    ac = ieee80211_has_qos(wh) ? ieee80211_up_to_ac(ic,
+        ieee80211_get_qos(wh) & IEEE80211_QOS_TID) : EDCA_AC_BE;
+    ml = &sc->sc_txdefer[ac];
+    qid = iwx_tx_qid(sc, ni, m, NULL);
+    if (qid != IWX_INVALID_QUEUE &&
+        (sc->txq[qid].stopped || sc->txq[qid].parked != 0)) {
+        mbuf_pkthdr_setrcvif(m, (ifnet_t)ni);
+        ml_enqueue(ml, m);
+        sc->txq[qid].parked++;
+        if (ml_len(ml) >= IWX_TX_DEFER_MAX) {
+            ifq_set_oactive(&ifp->if_snd);
+            return 1;
+        }
+        return 0;
+    }
+    
+    iwx_start_frame(sc, m, ni);
+    return 0;
+}
+
 IOReturn ItlIwx::
 _iwx_start_task(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3)
 {
+    static const int acprio[EDCA_NUM_AC] = {
+        EDCA_AC_VO, EDCA_AC_VI, EDCA_AC_BE, EDCA_AC_BK
+    };
     struct _ifnet *ifp = (struct _ifnet *)arg0;
     struct iwx_softc *sc = (struct iwx_softc *)ifp->if_softc;
     ItlIwx *that = container_of(sc, ItlIwx, com);
     struct ieee80211com *ic = &sc->sc_ic;
-    struct ieee80211_node *ni;
+    struct ieee80211_node *ni, *ni0;
+    struct ieee80211_amsdu am;
     struct ether_header *eh;
-    mbuf_t m;
-    int ac = EDCA_AC_BE; /* XXX */
+    struct mbuf_list *ml, keep;
+    mbuf_t m, m0;
+    int i, qid, stop;
     
     if (!(ifp->if_flags & IFF_RUNNING) ||  ifq_is_oactive(&ifp->if_snd)) {
         return kIOReturnError;
     }
     
-    for (;;) {
-        /* why isn't this done per-queue? */
-        if (sc->qfullmsk != 0) {
-            ifq_set_oactive(&ifp->if_snd);
-            break;
+    /* Publish descriptors in batches; one doorbell per queue per batch. */
+    sc->sc_tx_batch = 1;
+    sc->sc_tx_batch_start = nsecuptime();
+    
+    /*
+     * Frames parked behind a stopped ring go first, highest AC first.
+     * Frames for a ring that is still stopped keep their order on the
+     * list; frames for other rings are sent.  The per-ring parked counts
+     * are rebuilt from the frames that stay, as a frame's ring changes
+     * if a block ack session starts or ends while it waits.
+     */
+    for (i = 0; i < EDCA_NUM_AC && ml_empty(&sc->sc_txdefer[i]); i++)
+        ;
+    if (i < EDCA_NUM_AC) {
+        for (qid = 0; qid < nitems(sc->txq); qid++)
+            sc->txq[qid].parked = 0;
+        for (i = 0; i < EDCA_NUM_AC; i++) {
+            ml = &sc->sc_txdefer[acprio[i]];
+            ml_init(&keep);
+            while ((m = ml_dequeue(ml)) != NULL) {
+                ni = (struct ieee80211_node *)mbuf_pkthdr_rcvif(m);
+                qid = that->iwx_tx_qid(sc, ni, m, NULL);
+                if (qid != IWX_INVALID_QUEUE && sc->txq[qid].stopped) {
+                    ml_enqueue(&keep, m);
+                    sc->txq[qid].parked++;
+                    continue;
+                }
+                that->iwx_start_frame(sc, m, ni);
+            }
+            ml_enlist(ml, &keep);
         }
-        
+    }
+    
+    memset(&am, 0, sizeof(am));
+    for (;;) {
         /* need to send management frames even if we're not RUNning */
         m = mq_dequeue(&ic->ic_mgtq);
         if (m) {
             //            ni = m->m_pkthdr.ph_cookie;
             ni = (struct ieee80211_node *)mbuf_pkthdr_rcvif(m);
-            goto sendit;
+            if (that->iwx_tx_submit(sc, m, ni))
+                break;
+            continue;
         }
         
         if (
@@ -10045,23 +10402,29 @@ _iwx_start_task(OSObject *target, void *arg0, void *arg1, void *arg2, void *arg3
             continue;
         }
         
-    sendit:
-#if NBPFILTER > 0
-        if (ic->ic_rawbpf != NULL)
-            bpf_mtap(ic->ic_rawbpf, m, BPF_DIRECTION_OUT);
-#endif
-        if (that->iwx_tx(sc, m, ni, ac) != 0) {
-            ieee80211_release_node(ic, ni);
-            ifp->netStat->outputErrors++;
+        /*
+         * Pack back-to-back QoS data for the same RA/TID into one
+         * A-MSDU. The pending one goes out as soon as a frame does
+         * not fit or the send queue runs dry, so no frame waits for
+         * traffic that has not been queued yet.
+         */
+        if (ieee80211_amsdu_append(ic, &am, m, ni) == 0) {
+            ifp->netStat->outputPackets++;
             continue;
         }
-        ifp->netStat->outputPackets++;
-        
-        if (ifp->if_flags & IFF_UP) {
-            sc->sc_tx_timer = 15;
-            ifp->if_timer = 1;
-        }
+        stop = 0;
+        if ((m0 = ieee80211_amsdu_take(ic, &am, &ni0)) != NULL)
+            stop = that->iwx_tx_submit(sc, m0, ni0);
+        if (!stop && ieee80211_amsdu_start(ic, &am, m, ni) == 0)
+            continue;
+        if (that->iwx_tx_submit(sc, m, ni) || stop)
+            break;
     }
+    if ((m = ieee80211_amsdu_take(ic, &am, &ni)) != NULL)
+        that->iwx_tx_submit(sc, m, ni);
+    
+    that->iwx_tx_kick_all(sc);
+    sc->sc_tx_batch = 0;
     
     return kIOReturnSuccess;
 }
@@ -10109,6 +10472,38 @@ iwx_stop(struct _ifnet *ifp)
     ifq_clr_oactive(&ifp->if_snd);
     ifp->if_snd->flush();
     
+    if (sc->sc_tx_doorbells != 0)
+        XYLog("%s: TX doorbells=%llu frames=%llu\n", DEVNAME(sc),
+              sc->sc_tx_doorbells, sc->sc_tx_db_frames);
+    sc->sc_tx_doorbells = 0;
+    sc->sc_tx_db_frames = 0;
+    if (sc->sc_rx_rounds != 0) {
+        XYLog("%s: RX rounds=%llu exhausted=%llu entries=%llu\n",
+              DEVNAME(sc), sc->sc_rx_rounds, sc->sc_rx_exhausted,
+              sc->sc_rx_frames);
+        XYLog("%s: RX entries per round 0:%llu 1:%llu 2-3:%llu 4-7:%llu "
+              "8-15:%llu 16-31:%llu 32-63:%llu 64+:%llu\n", DEVNAME(sc),
+              sc->sc_rx_round_hist[0], sc->sc_rx_round_hist[1],
+              sc->sc_rx_round_hist[2], sc->sc_rx_round_hist[3],
+              sc->sc_rx_round_hist[4], sc->sc_rx_round_hist[5],
+              sc->sc_rx_round_hist[6], sc->sc_rx_round_hist[7]);
+    }
+    sc->sc_rx_rounds = 0;
+    sc->sc_rx_exhausted = 0;
+    sc->sc_rx_frames = 0;
+    memset(sc->sc_rx_round_hist, 0, sizeof(sc->sc_rx_round_hist));
+    iwx_tx_defer_purge(sc);
+    for (i = 0; i < nitems(sc->txq); i++) {
+        struct iwx_tx_ring *txq = &sc->txq[i];
+        
+        iwx_tx_ring_wake(sc, txq);
+        if (txq->stalls != 0)
+            XYLog("%s: TX ring %d stalls=%u stall_ms=%llu\n", DEVNAME(sc),
+                  i, txq->stalls, txq->stall_ns / 1000000ULL);
+        txq->stalls = 0;
+        txq->stall_ns = 0;
+    }
+    
     if (in != NULL) {
         in->in_phyctxt = NULL;
         in->in_ni.ni_chw = IEEE80211_CHAN_WIDTH_20_NOHT;
@@ -10527,6 +10922,7 @@ iwx_rx_pkt(struct iwx_softc *sc, struct iwx_rx_data *data, struct mbuf_list *ml)
     struct iwx_rx_packet *pkt, *nextpkt;
     uint32_t offset = 0, nextoff = 0, nmpdu = 0, len;
     mbuf_t m0, m;
+    struct rxpool_buf *pbuf;
     const size_t minsz = sizeof(pkt->len_n_flags) + sizeof(pkt->hdr);
     int qid, idx, code, handled = 1;
     
@@ -10534,6 +10930,7 @@ iwx_rx_pkt(struct iwx_softc *sc, struct iwx_rx_data *data, struct mbuf_list *ml)
     //        BUS_DMASYNC_POSTREAD);
     
     m0 = data->m;
+    pbuf = data->pbuf;
     while (m0 && offset + minsz < IWX_RBUF_SIZE) {
         pkt = (struct iwx_rx_packet *)((uint8_t*)mbuf_data(m0) + offset);
         qid = pkt->hdr.qid;
@@ -10586,11 +10983,40 @@ iwx_rx_pkt(struct iwx_softc *sc, struct iwx_rx_data *data, struct mbuf_list *ml)
                 ((uint8_t*)mbuf_data(m0) + nextoff);
                 if (nextoff + minsz >= IWX_RBUF_SIZE ||
                     !iwx_rx_pkt_valid(nextpkt)) {
+                    if (nmpdu > 1 && pbuf != NULL) {
+                        /*
+                         * Earlier frames were handed up as slices of
+                         * this buffer; m0's headroom overlaps them, so
+                         * the last frame becomes a slice too.
+                         */
+                        m = rxpool_slice(pbuf, offset, len);
+                        mbuf_freem(m0);
+                        m0 = NULL;
+                        if (m == NULL) {
+                            ifp->netStat->inputErrors++;
+                            break;
+                        }
+                        iwx_rx_mpdu_mq(sc, m, pkt->data, len - minsz, ml);
+                        break;
+                    }
                     /* No need to copy last frame in buffer. */
                     if (offset > 0)
                         mbuf_adj(m0, offset);
                     iwx_rx_mpdu_mq(sc, m0, pkt->data, maxlen, ml);
                     m0 = NULL; /* stack owns m0 now; abort loop */
+                } else if (pbuf != NULL) {
+                    /*
+                     * Point a new mbuf at this packet inside the
+                     * shared receive buffer instead of copying it.
+                     */
+                    m = rxpool_slice(pbuf, offset, len);
+                    if (m == NULL) {
+                        ifp->netStat->inputErrors++;
+                        mbuf_freem(m0);
+                        m0 = NULL;
+                        break;
+                    }
+                    iwx_rx_mpdu_mq(sc, m, pkt->data, len - minsz, ml);
                 } else {
                     /*
                      * Create an mbuf which points to the current
@@ -10940,10 +11366,48 @@ iwx_rx_pkt(struct iwx_softc *sc, struct iwx_rx_data *data, struct mbuf_list *ml)
         mbuf_freem(m0);
 }
 
+/*
+ * Interrupt coalescing timer (32 usec units) by RX ring entry rate.
+ * Quiet links get prompt interrupts; busy ones batch up to the
+ * firmware default used without moderation.
+ */
+static const struct {
+    uint32_t rate;      /* entries per second below which to use ... */
+    uint8_t timeout;    /* ... this IWX_CSR_INT_COALESCING value */
+} iwx_intr_mod_levels[] = {
+    { 1000,         0x02 },     /*   64 usec */
+    { 5000,         0x08 },     /*  256 usec */
+    { 20000,        0x10 },     /*  512 usec */
+    { UINT32_MAX,   IWX_HOST_INT_TIMEOUT_DEF },
+};
+
 void ItlIwx::
-iwx_notif_intr(struct iwx_softc *sc)
+iwx_intr_moderate(struct iwx_softc *sc, int n)
+{
+    uint64_t now, elapsed, rate;
+    int i;
+    
+    sc->sc_rx_mod_frames += n;
+    now = nsecuptime();
+    elapsed = now - sc->sc_rx_mod_start;
+    if (elapsed < IWX_INTR_MOD_WINDOW)
+        return;
+    
+    rate = sc->sc_rx_mod_frames * 1000000000ULL / elapsed;
+    for (i = 0; i < nitems(iwx_intr_mod_levels) - 1; i++)
+        if (rate < iwx_intr_mod_levels[i].rate)
+            break;
+    if (iwx_intr_mod_levels[i].timeout != sc->sc_int_timeout) {
+        sc->sc_int_timeout = iwx_intr_mod_levels[i].timeout;
+        IWX_WRITE_1(sc, IWX_CSR_INT_COALESCING, sc->sc_int_timeout);
+    }
+    sc->sc_rx_mod_start = now;
+    sc->sc_rx_mod_frames = 0;
+}
+
+uint16_t ItlIwx::
+iwx_rx_closed(struct iwx_softc *sc)
 {
-    struct mbuf_list ml = MBUF_LIST_INITIALIZER();
     uint16_t hw;
     
     //    bus_dmamap_sync(sc->sc_dmat, sc->rxq.stat_dma.map,
@@ -10953,12 +11417,27 @@ iwx_notif_intr(struct iwx_softc *sc)
         hw = le16toh(*(uint16_t *)(sc->rxq.stat)) & 0xfff;
     else
         hw = le16toh(((struct iwx_rb_status *)sc->rxq.stat)->closed_rb_num) & 0xfff;
-    hw &= (IWX_RX_MQ_RING_COUNT - 1);
+    return hw & (IWX_RX_MQ_RING_COUNT - 1);
+}
+
+/*
+ * One RX polling round: process at most budget ring entries closed by
+ * the firmware.  Returns non-zero if closed entries are left over.
+ */
+int ItlIwx::
+iwx_rx_poll(struct iwx_softc *sc, int budget)
+{
+    struct mbuf_list ml = MBUF_LIST_INITIALIZER();
+    uint16_t hw;
+    int n = 0, b;
+    
+    hw = iwx_rx_closed(sc);
     DPRINTFN(3, ("%s hw=%d\n", __FUNCTION__, hw));
-    while (sc->rxq.cur != hw) {
+    while (sc->rxq.cur != hw && n < budget) {
         struct iwx_rx_data *data = &sc->rxq.data[sc->rxq.cur];
         iwx_rx_pkt(sc, data, &ml);
         sc->rxq.cur = (sc->rxq.cur + 1) % IWX_RX_MQ_RING_COUNT;
+        n++;
     }
     if_input(&sc->sc_ic.ic_if, &ml);
     
@@ -10966,8 +11445,92 @@ iwx_notif_intr(struct iwx_softc *sc)
      * Tell the firmware what we have processed.
      * Seems like the hardware gets upset unless we align the write by 8??
      */
+    hw = sc->rxq.cur;
     hw = (hw == 0) ? IWX_RX_MQ_RING_COUNT - 1 : hw - 1;
     IWX_WRITE(sc, IWX_RFH_Q0_FRBDCB_WIDX_TRG, hw & ~7);
+    
+    sc->sc_rx_rounds++;
+    sc->sc_rx_frames += n;
+    for (b = 0; n >> b != 0 && b < IWX_RX_POLL_HIST - 1; b++)
+        ;
+    sc->sc_rx_round_hist[b]++;
+    if ((sc->sc_ic.ic_userflags & IEEE80211_F_NOINTRMOD) == 0)
+        iwx_intr_moderate(sc, n);
+    
+    if (sc->rxq.cur == iwx_rx_closed(sc))
+        return 0;
+    if (n == budget)
+        sc->sc_rx_exhausted++;
+    return 1;
+}
+
+/*
+ * Mask or unmask the RX interrupt causes while polling rounds run.
+ */
+void ItlIwx::
+iwx_rx_poll_mask(struct iwx_softc *sc, int polling)
+{
+    sc->sc_rx_polling = polling;
+    if (!sc->sc_msix) {
+        iwx_restore_interrupts(sc);
+    } else {
+        uint32_t fh_mask = sc->sc_fh_mask;
+        
+        if (polling)
+            fh_mask &= ~(IWX_MSIX_FH_INT_CAUSES_Q0 |
+                         IWX_MSIX_FH_INT_CAUSES_Q1);
+        IWX_WRITE(sc, IWX_CSR_MSIX_FH_INT_MASK_AD, ~fh_mask);
+    }
+}
+
+/*
+ * RX interrupt.  With moderation disabled the ring is drained at once.
+ * Otherwise one budgeted round runs here and, if the budget ran out,
+ * the rest is left to iwx_rx_poll_timeout() with RX interrupts masked
+ * so other work on the workloop gets a turn in between.  Entries that
+ * are already closed raise no further interrupt, so if no round can be
+ * scheduled they are drained here instead.
+ */
+void ItlIwx::
+iwx_rx_intr(struct iwx_softc *sc)
+{
+    if (sc->sc_rx_polling)
+        return;
+    if (sc->sc_ic.ic_userflags & IEEE80211_F_NOINTRMOD) {
+        iwx_rx_poll(sc, IWX_RX_MQ_RING_COUNT);
+        return;
+    }
+    if (iwx_rx_poll(sc, IWX_RX_POLL_BUDGET)) {
+        if (timeout_add_usec(&sc->sc_rx_poll_to, 0))
+            iwx_rx_poll_mask(sc, 1);
+        else
+            iwx_rx_poll(sc, IWX_RX_MQ_RING_COUNT);
+    }
+}
+
+void ItlIwx::
+iwx_rx_poll_timeout(void *arg)
+{
+    struct iwx_softc *sc = (struct iwx_softc *)arg;
+    ItlIwx *that = container_of(sc, ItlIwx, com);
+    int s = splnet();
+    
+    if (!sc->sc_rx_polling) {
+        splx(s);
+        return;
+    }
+    if (that->iwx_rx_poll(sc, IWX_RX_POLL_BUDGET) == 0) {
+        that->iwx_rx_poll_mask(sc, 0);
+        /* Entries closed before the unmask raise no interrupt. */
+        if (sc->rxq.cur != that->iwx_rx_closed(sc))
+            that->iwx_rx_poll_mask(sc, 1);
+    }
+    if (sc->sc_rx_polling && !timeout_add_usec(&sc->sc_rx_poll_to, 0)) {
+        /* No next round: unmask, then drain what is already closed. */
+        that->iwx_rx_poll_mask(sc, 0);
+        that->iwx_rx_poll(sc, IWX_RX_MQ_RING_COUNT);
+    }
+    splx(s);
 }
 
 int ItlIwx::
@@ -11112,7 +11675,7 @@ iwx_intr(OSObject *object, IOInterruptEventSource* sender, int count)
             IWX_WRITE_1(sc, IWX_CSR_INT_PERIODIC_REG,
                         IWX_CSR_INT_PERIODIC_ENA);
         
-        that->iwx_notif_intr(sc);
+        that->iwx_rx_intr(sc);
     }
     
     rv = 1;
@@ -11141,7 +11704,7 @@ iwx_intr_msix(OSObject *object, IOInterruptEventSource* sender, int count)
     
     if (inta_fh & IWX_MSIX_FH_INT_CAUSES_Q0 ||
         inta_fh & IWX_MSIX_FH_INT_CAUSES_Q1) {
-        that->iwx_notif_intr(sc);
+        that->iwx_rx_intr(sc);
     }
     
     /* firmware chunk loaded */
@@ -12485,7 +13048,7 @@ iwx_attach(struct iwx_softc *sc, struct pci_attach_args *pa)
     struct ieee80211com *ic = &sc->sc_ic;
     struct _ifnet *ifp = &ic->ic_if;
     int err;
-    int txq_i, i, j;
+    int txq_i, i;
     
     sc->sc_pct = pa->pa_pc;
     sc->sc_pcitag = pa->pa_tag;
@@ -12521,6 +13084,14 @@ iwx_attach(struct iwx_softc *sc, struct pci_attach_args *pa)
         XYLog("%s: can't map mem space\n", DEVNAME(sc));
         return false;
     }
+    /*
+     * MSI-X stays off.  The port services the device from one interrupt
+     * event source on the driver workloop, and net80211 RX (node table,
+     * BA reorder state, keys) runs under the command gate, so more RX
+     * vectors could not move any work to other CPUs.  Multi-queue RX,
+     * with RSS over several RFH queues and per-queue rings and reorder
+     * state, is dropped until RX processing no longer needs the gate.
+     */
     if (0) {
         sc->sc_msix = 1;
         XYLog("msix intr mode\n");
@@ -12750,6 +13321,8 @@ iwx_attach(struct iwx_softc *sc, struct pci_attach_args *pa)
     ic->ic_txbfcaps = 0;
     ic->ic_aselcaps = 0;
     ic->ic_ampdu_params = (IEEE80211_AMPDU_PARAM_SS_4 | 0x3 /* 64k */);
+    ic->ic_rx_ba_maxwin = IEEE80211_HE_BA_MAX_WINSZ;
+    ic->ic_tx_amsdu_maxlen = IEEE80211_MAX_MPDU_LEN_VHT_7991;
     ic->ic_caps |= (IEEE80211_C_QOS | IEEE80211_C_TX_AMPDU | IEEE80211_C_AMSDU_IN_AMPDU);
     ic->ic_caps |= IEEE80211_C_SUPPORTS_VHT_EXT_NSS_BW;
     
@@ -12790,14 +13363,15 @@ iwx_attach(struct iwx_softc *sc, struct pci_attach_args *pa)
                     rxba);
         timeout_set(&rxba->reorder_buf.reorder_timer,
                     iwx_reorder_timer_expired, &rxba->reorder_buf);
-        for (j = 0; j < nitems(rxba->entries); j++)
-        ml_init(&rxba->entries[j].frames);
     }
+    timeout_set(&sc->sc_rx_poll_to, iwx_rx_poll_timeout, sc);
     task_set(&sc->init_task, iwx_init_task, sc, "iwx_init_task");
     task_set(&sc->newstate_task, iwx_newstate_task, sc, "iwx_newstate_task");
     task_set(&sc->ba_task, iwx_ba_task, sc, "iwx_ba_task");
     task_set(&sc->mac_ctxt_task, iwx_mac_ctxt_task, sc, "iwx_mac_ctxt_task");
     task_set(&sc->chan_ctxt_task, iwx_chan_ctxt_task, sc, "iwx_chan_ctxt_task");
+    task_set_prio(&sc->init_task, TASK_PRIO_HIGH);
+    task_set_prio(&sc->newstate_task, TASK_PRIO_HIGH);
     
     ic->ic_node_alloc = iwx_node_alloc;
     ic->ic_bgscan_start = iwx_bgscan;
@@ -174,9 +174,13 @@ public:
     
     virtual UInt32 supportedFeatures() override;
 
+    virtual UInt32 supportedChecksums(bool isOutput) override;
+
     virtual const char *getFirmwareCountryCode() override;
 
     virtual uint32_t getTxQueueSize() override;
+
+    virtual bool getRxPollStats(struct ioctl_rx_poll *st) override;
     
     //driver controller
     virtual void clearScanningFlags() override;
@@ -327,6 +331,7 @@ public:
     void    iwx_rx_rx_phy_cmd(struct iwx_softc *, struct iwx_rx_packet *,
             struct iwx_rx_data *);
     int    iwx_get_noise(const uint8_t *);
+    void    iwx_rx_csum(struct iwx_softc *, mbuf_t, struct iwx_rx_mpdu_desc *);
     int    iwx_rx_hwdecrypt(struct iwx_softc *, mbuf_t, uint32_t,
             struct ieee80211_rxinfo *);
     int    iwx_ccmp_decap(struct iwx_softc *, mbuf_t,
@@ -368,6 +373,16 @@ public:
     void    iwx_toggle_tx_ant(struct iwx_softc *sc, uint8_t *ant);
     void    iwx_tx_update_byte_tbl(struct iwx_softc *, struct iwx_tx_ring *, int, uint16_t, uint16_t);
     int    iwx_tx(struct iwx_softc *, mbuf_t, struct ieee80211_node *, int);
+    int    iwx_tx_qid(struct iwx_softc *, struct ieee80211_node *, mbuf_t, uint8_t *);
+    void    iwx_tx_publish(struct iwx_softc *, struct iwx_tx_ring *);
+    void    iwx_tx_kick(struct iwx_softc *, struct iwx_tx_ring *);
+    void    iwx_tx_kick_all(struct iwx_softc *);
+    void    iwx_tx_kick_late(struct iwx_softc *);
+    void    iwx_tx_ring_stop(struct iwx_softc *, struct iwx_tx_ring *);
+    void    iwx_tx_ring_wake(struct iwx_softc *, struct iwx_tx_ring *);
+    void    iwx_tx_defer_purge(struct iwx_softc *);
+    int    iwx_start_frame(struct iwx_softc *, mbuf_t, struct ieee80211_node *);
+    int    iwx_tx_submit(struct iwx_softc *, mbuf_t, struct ieee80211_node *);
     int    iwx_flush_sta_tids(struct iwx_softc *, int, uint16_t);
     int    iwx_flush_sta(struct iwx_softc *, struct iwx_node *);
     int    iwx_beacon_filter_send_cmd(struct iwx_softc *,
@@ -465,7 +480,12 @@ public:
     int    iwx_rx_pkt_valid(struct iwx_rx_packet *);
     void    iwx_rx_pkt(struct iwx_softc *, struct iwx_rx_data *,
             struct mbuf_list *);
-    void    iwx_notif_intr(struct iwx_softc *);
+    void    iwx_intr_moderate(struct iwx_softc *, int);
+    uint16_t    iwx_rx_closed(struct iwx_softc *);
+    int    iwx_rx_poll(struct iwx_softc *, int);
+    void    iwx_rx_poll_mask(struct iwx_softc *, int);
+    void    iwx_rx_intr(struct iwx_softc *);
+    static void    iwx_rx_poll_timeout(void *);
     static int    iwx_intr(OSObject *object, IOInterruptEventSource* sender, int count);
     static int    iwx_intr_msix(OSObject *object, IOInterruptEventSource* sender, int count);
     static int    iwx_match(IOPCIDevice *);
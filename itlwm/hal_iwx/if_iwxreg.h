@@ -3620,6 +3620,28 @@ struct iwx_rx_mpdu_res_start {
 #define IWX_RX_MPDU_PHY_NCCK_ADDTL_NTFY        (1 << 7)
 #define IWX_RX_MPDU_PHY_TSF_OVERLOAD        (1 << 8)
 
+/*
+ * l3l4_flags in the RX MPDU descriptor: checksum results of the hardware
+ * parser and the protocols it found.
+ */
+#define IWX_RX_L3L4_IP_HDR_CSUM_OK        (1 << 0)
+#define IWX_RX_L3L4_TCP_UDP_CSUM_OK        (1 << 1)
+#define IWX_RX_L3L4_TCP_FIN_SYN_RST_PSH    (1 << 2)
+#define IWX_RX_L3L4_TCP_ACK            (1 << 3)
+#define IWX_RX_L3L4_L3_PROTO_MASK        (0xf << 4)
+#define IWX_RX_L3L4_L4_PROTO_MASK        (0xf << 8)
+#define IWX_RX_L3_PROTO_POS            4
+#define IWX_RX_L4_PROTO_POS            8
+
+#define IWX_RX_L3_TYPE_NONE            0
+#define IWX_RX_L3_TYPE_IPV4            1
+#define IWX_RX_L3_TYPE_IPV4_FRAG        2
+#define IWX_RX_L3_TYPE_IPV6_FRAG        3
+#define IWX_RX_L3_TYPE_IPV6            4
+#define IWX_RX_L3_TYPE_IPV6_IN_IPV4        5
+#define IWX_RX_L3_TYPE_ARP            6
+#define IWX_RX_L3_TYPE_EAPOL            7
+
 #define IWX_RX_REORDER_DATA_INVALID_BAID    0x7f
 
 #define IWX_RX_MPDU_REORDER_NSSN_MASK        0x00000fff
@@ -352,8 +352,43 @@ struct iwx_tx_ring {
 	int			queued;
 	int			cur;
 	int			tail;
+	int			db_pending;	/* frames queued since last doorbell */
+	int			stopped;	/* queued crossed hi_mark */
+	int			parked;		/* frames waiting on sc_txdefer */
+	uint64_t		stall_start;	/* uptime (ns) the ring stopped */
+	uint64_t		stall_ns;	/* total time spent stopped */
+	uint32_t		stalls;		/* number of stop events */
 };
 
+/*
+ * TX doorbell batching: _iwx_start_task publishes descriptors and defers
+ * the write pointer update until a queue has IWX_TX_BATCH_MAX frames
+ * pending, the batch has been open for IWX_TX_BATCH_USEC, or the send
+ * loop runs dry.
+ */
+#define IWX_TX_BATCH_MAX	16
+#define IWX_TX_BATCH_USEC	200
+
+/*
+ * Encapsulated frames whose TX ring is stopped are parked per access
+ * category so that traffic for other rings keeps flowing.  Once an AC
+ * has this many frames parked the send queue is marked output-active.
+ */
+#define IWX_TX_DEFER_MAX	64
+
+/*
+ * RX interrupt moderation: each polling round processes at most
+ * IWX_RX_POLL_BUDGET ring entries.  If entries remain, RX interrupts
+ * stay masked and the next round runs from the workloop.  The entry
+ * rate over each IWX_INTR_MOD_WINDOW selects the interrupt coalescing
+ * timer.  Rounds are also counted in IWX_RX_POLL_HIST log2 buckets by
+ * the number of entries they processed; IOCTL_80211_RX_POLL reads the
+ * counters.
+ */
+#define IWX_RX_POLL_BUDGET	64
+#define IWX_RX_POLL_HIST	8
+#define IWX_INTR_MOD_WINDOW	100000000ULL	/* ns */
+
 #define IWX_RX_MQ_RING_COUNT	512
 /* Linux driver optionally uses 8k buffer */
 #define IWX_RBUF_SIZE		4096
@@ -361,6 +396,7 @@ struct iwx_tx_ring {
 struct iwx_rx_data {
 	mbuf_t m;
 	bus_dmamap_t	map;
+	struct rxpool_buf	*pbuf;	/* backing pool buffer, if any */
 };
 
 struct iwx_rx_ring {
@@ -371,6 +407,7 @@ struct iwx_rx_ring {
 	void			*desc;
 	void	        *stat;
 	struct iwx_rx_data	data[IWX_RX_MQ_RING_COUNT];
+	struct rxpool		*pool;
 	int			cur;
 };
 
@@ -543,25 +580,26 @@ struct iwx_reorder_buf_entry {
  * @sta_id: station id
  * @tid: tid of the session
  * @baid: baid of the session
- * @timeout: the timeout set in the addba request
+ * @timeout: the timeout set in the addba request, in usec
  * @entries_per_queue: # of buffers per queue
- * @last_rx: last rx timestamp, updated only if timeout passed from last update
+ * @last_rx: nsecuptime() of the last frame received in the session
  * @session_timer: timer to check if BA session expired, runs at 2 * timeout
  * @sc: softc pointer, needed for timer context
  * @reorder_buf: reorder buffer
- * @reorder_buf_data: buffered frames, one entry per sequence number
+ * @entries: buffered frames, one entry per sequence number; allocated
+ *	with reorder_buf.buf_size entries when the session starts
  */
 struct iwx_rxba_data {
     uint8_t sta_id;
     uint8_t tid;
     uint8_t baid;
-    uint16_t timeout;
+    uint32_t timeout;
     uint16_t entries_per_queue;
-    struct timeval last_rx;
+    uint64_t last_rx;
     CTimeout *session_timer;
     struct iwx_softc *sc;
     struct iwx_reorder_buffer reorder_buf;
-    struct iwx_reorder_buf_entry entries[IEEE80211_BA_MAX_WINSZ];
+    struct iwx_reorder_buf_entry *entries;
 };
 
 static inline struct iwx_rxba_data *
@@ -626,7 +664,21 @@ struct iwx_softc {
 	/* TX/RX rings. */
 	struct iwx_tx_ring txq[IWX_MAX_TVQM_QUEUES];
 	struct iwx_rx_ring rxq;
-	int qfullmsk;
+	struct mbuf_list sc_txdefer[EDCA_NUM_AC]; /* frames held for a stopped ring */
+	int sc_tx_batch;		/* defer doorbells while set */
+	uint32_t sc_tx_dbmsk;		/* queues with a deferred doorbell */
+	uint64_t sc_tx_batch_start;	/* uptime (ns) the batch opened */
+	uint64_t sc_tx_doorbells;	/* WRPTR writes for data frames */
+	uint64_t sc_tx_db_frames;	/* frames published by those writes */
+	CTimeout *sc_rx_poll_to;	/* runs the next RX polling round */
+	int sc_rx_polling;		/* RX interrupts masked, round pending */
+	uint8_t sc_int_timeout;		/* IWX_CSR_INT_COALESCING in use */
+	uint64_t sc_rx_mod_start;	/* uptime (ns) the rate window opened */
+	uint32_t sc_rx_mod_frames;	/* entries seen in this window */
+	uint64_t sc_rx_rounds;		/* RX polling rounds */
+	uint64_t sc_rx_exhausted;	/* rounds that ran out of budget */
+	uint64_t sc_rx_frames;		/* ring entries processed */
+	uint64_t sc_rx_round_hist[IWX_RX_POLL_HIST];
     struct iwx_tx_ring sc_tvqm_ring;
     int first_data_qid;
 
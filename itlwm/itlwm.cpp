@@ -177,6 +177,38 @@ bool itlwm::createMediumTables(const IONetworkMedium **primary)
     return result;
 }
 
+void itlwm::derivePSK(const char *pwd, const uint8_t *ssid, size_t ssid_len,
+                      uint8_t psk[32])
+{
+    struct itlwm_psk_entry *e, *victim = &fPskCache[0];
+    uint8_t tag[SHA1_DIGEST_LENGTH];
+    uint8_t len = (uint8_t)ssid_len;
+    SHA1_CTX ctx;
+    int i;
+    
+    SHA1Init(&ctx);
+    SHA1Update(&ctx, &len, sizeof(len));
+    SHA1Update(&ctx, ssid, (unsigned int)ssid_len);
+    SHA1Update(&ctx, pwd, (unsigned int)strlen(pwd));
+    SHA1Final(tag, &ctx);
+    
+    for (i = 0; i < ITLWM_PSK_CACHE_SIZE; i++) {
+        e = &fPskCache[i];
+        if (e->stamp != 0 && memcmp(e->tag, tag, sizeof(tag)) == 0) {
+            e->stamp = ++fPskCacheStamp;
+            memcpy(psk, e->psk, sizeof(e->psk));
+            return;
+        }
+        if (e->stamp < victim->stamp)
+            victim = e;
+    }
+    
+    pbkdf2_sha1(pwd, ssid, ssid_len, 4096, psk, 32);
+    memcpy(victim->tag, tag, sizeof(tag));
+    memcpy(victim->psk, psk, sizeof(victim->psk));
+    victim->stamp = ++fPskCacheStamp;
+}
+
 ieee80211_wpaparams wpa;
 ieee80211_wpapsk psk;
 ieee80211_nwkey nwkey;
@@ -204,8 +236,8 @@ void itlwm::joinSSID(const char *ssid_name, const char *ssid_pwd)
         memset(&psk, 0, sizeof(ieee80211_wpapsk));
         memcpy(psk.i_name, "zxy", strlen("zxy"));
         psk.i_enabled = 1;
-        pbkdf2_sha1(ssid_pwd, (const uint8_t*)ssid_name, strlen(ssid_name),
-                    4096, psk.i_psk , 32);
+        derivePSK(ssid_pwd, (const uint8_t*)ssid_name, strlen(ssid_name),
+                  psk.i_psk);
         memset(&nwkey, 0, sizeof(ieee80211_nwkey));
         nwkey.i_wepon = 0;
         nwkey.i_defkid = 0;
@@ -266,8 +298,7 @@ void itlwm::associateSSID(const char *ssid, const char *pwd)
                   "8 and 63 characters");
         if (nwid.i_len == 0)
             XYLog("wpakey: nwid not set");
-        pbkdf2_sha1(pwd, (const uint8_t*)ssid, nwid.i_len, 4096,
-                    psk.i_psk, 32);
+        derivePSK(pwd, (const uint8_t*)ssid, nwid.i_len, psk.i_psk);
         psk.i_enabled = 1;
         if (psk.i_enabled) {
             ic->ic_flags |= IEEE80211_F_PSK;
@@ -341,6 +372,7 @@ bool itlwm::start(IOService *provider)
         return false;
     }
     _fWorkloop->addEventSource(_fCommandGate);
+    initTimeout(_fWorkloop);
     const IONetworkMedium *primaryMedium;
     if (!createMediumTables(&primaryMedium) ||
         !setCurrentMedium(primaryMedium) || !setSelectedMedium(primaryMedium)) {
@@ -354,6 +386,10 @@ bool itlwm::start(IOService *provider)
         fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_NOVHT;
     if (PE_parse_boot_argn("-noht40", &boot_value, sizeof(boot_value)))
         fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_NOHT40;
+    if (PE_parse_boot_argn("-nointrmod", &boot_value, sizeof(boot_value)))
+        fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_NOINTRMOD;
+    if (PE_parse_boot_argn("-mrr", &boot_value, sizeof(boot_value)))
+        fHalService->get80211Controller()->ic_userflags |= IEEE80211_F_MRR;
     
     if (!fHalService->attach(pciNub)) {
         XYLog("attach fail\n");
@@ -498,6 +534,7 @@ void itlwm::releaseAll()
         fHalService = NULL;
     }
     if (_fWorkloop) {
+        releaseTimeout();
         if (_fCommandGate) {
 //            _fCommandGate->disable();
             _fWorkloop->removeEventSource(_fCommandGate);
@@ -525,6 +562,7 @@ void itlwm::free()
         fHalService->release();
         fHalService = NULL;
     }
+    bzero(fPskCache, sizeof(fPskCache));
     super::free();
 }
 
@@ -560,7 +598,7 @@ setLinkStatus(UInt32 status, const IONetworkMedium * activeMedium, UInt64 speed,
 #ifdef __PRIVATE_SPI__
             fNetIf->startOutputThread();
 #endif
-            ifq_set_oactive(&ifq->if_snd);
+            fLinkTxActive = true;
         } else if (!(status & kIONetworkLinkNoNetworkChange)) {
 #ifdef __PRIVATE_SPI__
             fNetIf->stopOutputThread();
@@ -568,7 +606,7 @@ setLinkStatus(UInt32 status, const IONetworkMedium * activeMedium, UInt64 speed,
 #endif
             ifq->if_snd->lockFlush();
             mq_purge(&fHalService->get80211Controller()->ic_mgtq);
-            ifq_clr_oactive(&ifq->if_snd);
+            fLinkTxActive = false;
         }
     }
     return ret;
@@ -601,12 +639,12 @@ IOReturn itlwm::outputStart(IONetworkInterface *interface, IOOptionBits options)
 {
     _ifnet *ifp = &fHalService->get80211Controller()->ic_ac.ac_if;
     mbuf_t m = NULL;
-    if (!ifq_is_oactive(&ifp->if_snd)) {
+    if (!fLinkTxActive || ifq_is_oactive(&ifp->if_snd)) {
         return kIOReturnNoResources;
     }
     while (kIOReturnSuccess == interface->dequeueOutputPackets(1, &m)) {
         outputPacket(m, NULL);
-        if (!ifq_is_oactive(&ifp->if_snd)) {
+        if (!fLinkTxActive || ifq_is_oactive(&ifp->if_snd)) {
             return kIOReturnNoResources;
         }
     }
@@ -655,6 +693,14 @@ UInt32 itlwm::getFeatures() const
     return fHalService->getDriverInfo()->supportedFeatures();
 }
 
+IOReturn itlwm::getChecksumSupport(UInt32 *checksumMask, UInt32 checksumFamily, bool isOutput)
+{
+    if (checksumFamily != kChecksumFamilyTCPIP)
+        return kIOReturnUnsupported;
+    *checksumMask = fHalService->getDriverInfo()->supportedChecksums(isOutput);
+    return kIOReturnSuccess;
+}
+
 IOReturn itlwm::setPromiscuousMode(IOEnetPromiscuousMode mode)
 {
     return kIOReturnSuccess;
@@ -26,6 +26,7 @@
 #include <libkern/OSKextLib.h>
 #include <libkern/c++/OSMetaClass.h>
 #include <IOKit/IOFilterInterruptEventSource.h>
+#include <crypto/sha1.h>
 
 #include "ItlIwm.hpp"
 #include "ItlIwx.hpp"
@@ -40,6 +41,19 @@ enum
 
 #define kWatchDogTimerPeriod 1000
 
+/*
+ * PSKs derived from a passphrase, so that reconnecting to a network
+ * does not run PBKDF2 again.  Entries are keyed by a SHA-1 digest of
+ * the SSID and passphrase rather than the passphrase itself.
+ */
+#define ITLWM_PSK_CACHE_SIZE    8
+
+struct itlwm_psk_entry {
+    uint8_t     tag[SHA1_DIGEST_LENGTH];
+    uint8_t     psk[32];
+    uint32_t    stamp;      /* last use, 0: empty */
+};
+
 class itlwm : public IOEthernetController {
     OSDeclareDefaultStructors(itlwm)
     
@@ -76,6 +90,7 @@ public:
     virtual IOReturn getPacketFilters(const OSSymbol *group, UInt32 *filters) const override;
     virtual IOReturn selectMedium(const IONetworkMedium *medium) override;
     virtual UInt32 getFeatures() const override;
+    virtual IOReturn getChecksumSupport(UInt32 *checksumMask, UInt32 checksumFamily, bool isOutput) override;
     virtual IOReturn registerWithPolicyMaker( IOService * policyMaker ) override;
     virtual IOReturn setPowerState( unsigned long powerStateOrdinal,
                                     IOService *   policyMaker) override;
@@ -84,6 +99,8 @@ public:
     void releaseAll();
     void joinSSID(const char *ssid, const char *pwd);
     void associateSSID(const char *ssid, const char *pwd);
+    void derivePSK(const char *pwd, const uint8_t *ssid, size_t ssid_len,
+                   uint8_t psk[32]);
     void watchdogAction(IOTimerEventSource *timer);
     
     bool initPCIPowerManagment(IOPCIDevice *provider);
@@ -115,4 +132,8 @@ public:
     UInt8 pmPCICapPtr;
     bool magicPacketEnabled;
     bool magicPacketSupported;
+    bool fLinkTxActive;     /* link is up, output thread may run */
+    
+    struct itlwm_psk_entry fPskCache[ITLWM_PSK_CACHE_SIZE];
+    uint32_t fPskCacheStamp;
 };
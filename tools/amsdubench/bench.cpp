@@ -0,0 +1,656 @@
+/*
+ * amsdubench: A-MSDU deaggregation, built on the host from net80211 and
+ * fed A-MSDUs of 2 to 64 subframes sliced out of the RX buffer pool.
+ *
+ * ieee80211_amsdu_decap() and ieee80211_amsdu_decap_validate() are
+ * extracted from ieee80211_input.c at build time, and the buffer pool
+ * from compat.cpp (see tools/Makefile).  Each A-MSDU is written into a
+ * pool buffer of IWM_RBUF_SIZE bytes and handed up as an rxpool_slice(),
+ * as iwm_rx_pkt() does for a buffer holding several MPDUs.  The shim's
+ * mbuf_pullup() behaves like XNU's, which always moves the head of a
+ * cluster mbuf into a new mbuf.  Before subframes were carved in place,
+ * ieee80211_amsdu_decap() pulled up every subframe; that version is
+ * written out below as amsdu_decap_old() and run on the same frames.
+ *
+ * The tool checks that:
+ * - every subframe reaches ieee80211_enqueue_data() with the bytes a
+ *   separate parse of the A-MSDU expects, LLC/SNAP rewritten to
+ *   Ethernet II and other 802.3 frames left alone, in order;
+ * - a subframe that is too short, runs past the A-MSDU, or fails
+ *   ieee80211_amsdu_decap_validate() drops the whole A-MSDU and counts
+ *   is_rx_decap once, in station and hostap mode;
+ * - a subframe header straddling two mbufs is pulled up;
+ * - the pool buffer comes back once the last subframe is freed, and the
+ *   old version delivers the same subframes, except where a subframe
+ *   fails validation and it leaked the buffer;
+ * - unchained, the new version allocates one mbuf per split and copies
+ *   nothing, with every subframe pointing into the pool buffer.
+ *
+ * It then reports, per A-MSDU, the time to deaggregate it and free the
+ * subframes, mbufs allocated and bytes mbuf_pullup() copied.
+ * Exits non-zero on failure.
+ */
+#include <random>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/mbuf.h>
+#include <IOKit/IOLib.h>
+
+#include <net80211/ieee80211.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+#include "../rxpool/iokit.h"
+#include "rxpool.inc"
+
+/* The largest A-MSDU without IEEE80211_HTCAP_AMSDU7935, as iwm runs. */
+#define AMSDU_MAX	3839
+#define QOS_HDRLEN	(sizeof(struct ieee80211_qosframe))
+#define NBUFS		4
+
+/* As in net/ethernet.h, net/if_llc.h and sys/_if_ether.h. */
+#define ETHER_ADDR_LEN	6
+#define ETHER_HDR_LEN	14
+#define ETHERTYPE_IP	0x0800
+
+struct ether_header {
+	u_int8_t		 ether_dhost[ETHER_ADDR_LEN];
+	u_int8_t		 ether_shost[ETHER_ADDR_LEN];
+	u_int16_t		 ether_type;
+} __packed;
+
+#define LLC_UI		0x03
+#define LLC_SNAP_LSAP	0xaa
+#define LLC_SNAPFRAMELEN	8
+
+struct llc {
+	u_int8_t		 llc_dsap;
+	u_int8_t		 llc_ssap;
+	u_int8_t		 llc_control;
+	struct {
+		u_int8_t	 org_code[3];
+		u_int16_t	 ether_type;
+	} __packed		 llc_snap;
+} __packed;
+
+#define ETHER_IS_EQ(a1, a2)	(memcmp((a1), (a2), ETHER_ADDR_LEN) == 0)
+
+#define DPRINTF(x)
+
+/* As in ieee80211_var.h; the kext builds the hostap checks. */
+#undef IEEE80211_STA_ONLY
+enum ieee80211_opmode {
+	IEEE80211_M_STA		= 1,
+	IEEE80211_M_HOSTAP	= 6,
+	IEEE80211_M_MONITOR	= 8
+};
+
+/* The ieee80211com and node fields the extracted code uses. */
+struct ieee80211com {
+	enum ieee80211_opmode	 ic_opmode;
+	u_int8_t		 ic_myaddr[IEEE80211_ADDR_LEN];
+	struct {
+		u_int32_t	 is_rx_decap;
+	}			 ic_stats;
+};
+
+struct ieee80211_node {
+	u_int8_t		 ni_macaddr[IEEE80211_ADDR_LEN];
+};
+
+/* As in sys/_mbuf.h. */
+struct mbuf_list {
+	mbuf_t			 ml_head;
+	mbuf_t			 ml_tail;
+	u_int			 ml_len;
+};
+
+#define MBUF_LIST_INITIALIZER()	{ NULL, NULL, 0 }
+
+static void
+ml_enqueue(struct mbuf_list *ml, mbuf_t m)
+{
+	if (ml->ml_tail == NULL)
+		ml->ml_head = ml->ml_tail = m;
+	else {
+		mbuf_setnextpkt(ml->ml_tail, m);
+		ml->ml_tail = m;
+	}
+	mbuf_setnextpkt(m, NULL);
+	ml->ml_len++;
+}
+
+static mbuf_t
+ml_dequeue(struct mbuf_list *ml)
+{
+	mbuf_t m;
+
+	m = ml->ml_head;
+	if (m != NULL) {
+		ml->ml_head = mbuf_nextpkt(m);
+		if (ml->ml_head == NULL)
+			ml->ml_tail = NULL;
+		mbuf_setnextpkt(m, NULL);
+		ml->ml_len--;
+	}
+	return m;
+}
+
+static void
+ml_purge(struct mbuf_list *ml)
+{
+	mbuf_t m;
+
+	while ((m = ml_dequeue(ml)) != NULL)
+		mbuf_freem(m);
+}
+
+static int last_mcast;
+
+static void
+ieee80211_enqueue_data(struct ieee80211com *ic, mbuf_t m,
+    struct ieee80211_node *ni, int mcast, struct mbuf_list *ml)
+{
+	(void)ic;
+	(void)ni;
+	last_mcast = mcast;
+	ml_enqueue(ml, m);
+}
+
+#include "amsdu_decap.inc"
+
+/*
+ * ieee80211_amsdu_decap() before subframes were carved in place.  It split
+ * before validating, and lost the rest of the A-MSDU, with its reference
+ * to the receive buffer, when a subframe failed validation.
+ */
+static void
+amsdu_decap_old(struct ieee80211com *ic, mbuf_t m, struct ieee80211_node *ni,
+    int hdrlen, struct mbuf_list *ml)
+{
+	mbuf_t n;
+	struct ether_header *eh;
+	struct llc *llc;
+	int len, pad, mcast;
+	struct ieee80211_frame *wh;
+	struct mbuf_list subframes = MBUF_LIST_INITIALIZER();
+
+	wh = mtod(m, struct ieee80211_frame *);
+	mcast = IEEE80211_IS_MULTICAST(wh->i_addr1);
+
+	mbuf_adj(m, hdrlen);
+
+	while (mbuf_pkthdr_len(m) >= ETHER_HDR_LEN + LLC_SNAPFRAMELEN) {
+		mbuf_pullup(&m, ETHER_HDR_LEN + LLC_SNAPFRAMELEN);
+		if (m == NULL)
+			break;
+		eh = mtod(m, struct ether_header *);
+		len = ntohs(eh->ether_type);
+		if (len < LLC_SNAPFRAMELEN) {
+			ic->ic_stats.is_rx_decap++;
+			ml_purge(&subframes);
+			mbuf_freem(m);
+			return;
+		}
+		llc = (struct llc *)&eh[1];
+		if (llc->llc_dsap == LLC_SNAP_LSAP &&
+		    llc->llc_ssap == LLC_SNAP_LSAP &&
+		    llc->llc_control == LLC_UI &&
+		    llc->llc_snap.org_code[0] == 0 &&
+		    llc->llc_snap.org_code[1] == 0 &&
+		    llc->llc_snap.org_code[2] == 0) {
+			eh->ether_type = llc->llc_snap.ether_type;
+			memmove((u_int8_t *)eh + LLC_SNAPFRAMELEN, eh,
+			    ETHER_HDR_LEN);
+			mbuf_adj(m, LLC_SNAPFRAMELEN);
+			len -= LLC_SNAPFRAMELEN;
+		}
+		len += ETHER_HDR_LEN;
+		if (len > mbuf_pkthdr_len(m)) {
+			ic->ic_stats.is_rx_decap++;
+			ml_purge(&subframes);
+			mbuf_freem(m);
+			return;
+		}
+		mbuf_split(m, len, MBUF_DONTWAIT, &n);
+		if (n == NULL) {
+			ic->ic_stats.is_rx_decap++;
+			ml_purge(&subframes);
+			mbuf_freem(m);
+			return;
+		}
+		if (ieee80211_amsdu_decap_validate(ic, m, ni)) {
+			ic->ic_stats.is_rx_decap++;
+			ml_purge(&subframes);
+			mbuf_freem(m);
+			return;		/* and n, the rest, leaks */
+		}
+		ml_enqueue(&subframes, m);
+		m = n;
+		pad = ((len + 3) & ~3) - len;
+		mbuf_adj(m, pad);
+	}
+
+	while ((n = ml_dequeue(&subframes)) != NULL)
+		ieee80211_enqueue_data(ic, n, ni, mcast, ml);
+
+	mbuf_freem(m);
+}
+
+typedef void decap_fn(struct ieee80211com *, mbuf_t, struct ieee80211_node *,
+    int, struct mbuf_list *);
+
+static const u_int8_t myaddr[IEEE80211_ADDR_LEN] =
+    { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const u_int8_t apaddr[IEEE80211_ADDR_LEN] =
+    { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+
+enum fault {
+	F_NONE,
+	F_SHORT,	/* subframe length below the LLC/SNAP header */
+	F_LONG,		/* subframe length past the end of the A-MSDU */
+	F_DA,		/* not addressed to us (station mode) */
+	F_LLC_DA,	/* DA that reads as an LLC/SNAP header */
+	F_SA,		/* not from the transmitter (hostap mode) */
+	F_COUNT
+};
+
+/* An A-MSDU, and the subframes ieee80211_enqueue_data() must see. */
+struct amsdu {
+	std::vector<u_int8_t>			frame;
+	std::vector<std::vector<u_int8_t> >	want;
+	enum ieee80211_opmode			opmode;
+	int					mcast;
+	size_t					split;	/* 0: one slice */
+	enum fault				fault;
+};
+
+/*
+ * Lay out nsub subframes of the given payload sizes behind a QoS data
+ * header.  A subframe either carries LLC/SNAP, which decapsulation turns
+ * into an Ethernet II header, or is a plain 802.3 frame delivered as is.
+ * All but the last subframe are padded to four bytes.
+ */
+static void
+amsdu_build(struct amsdu *a, const std::vector<int> &payload,
+    const std::vector<int> &snap, size_t junk, std::mt19937 &rng)
+{
+	struct ieee80211_qosframe wh;
+	struct ether_header eh;
+	struct llc llc;
+	size_t i, j, len, sub;
+	int bad = -1;
+
+	memset(&wh, 0, sizeof(wh));
+	wh.i_fc[0] = IEEE80211_FC0_VERSION_0 | IEEE80211_FC0_TYPE_DATA |
+	    IEEE80211_FC0_SUBTYPE_QOS;
+	wh.i_fc[1] = IEEE80211_FC1_DIR_FROMDS;
+	wh.i_qos[0] = IEEE80211_QOS_AMSDU;
+	memcpy(wh.i_addr1, myaddr, IEEE80211_ADDR_LEN);
+	if (a->mcast)
+		wh.i_addr1[0] |= 0x01;
+	memcpy(wh.i_addr2, apaddr, IEEE80211_ADDR_LEN);
+	memcpy(wh.i_addr3, apaddr, IEEE80211_ADDR_LEN);
+	a->frame.assign((u_int8_t *)&wh, (u_int8_t *)&wh + sizeof(wh));
+	a->want.clear();
+
+	if (a->fault != F_NONE)
+		bad = rng() % payload.size();
+	for (i = 0; i < payload.size(); i++) {
+		memcpy(eh.ether_dhost, myaddr, ETHER_ADDR_LEN);
+		if (a->opmode == IEEE80211_M_HOSTAP)
+			memcpy(eh.ether_shost, apaddr, ETHER_ADDR_LEN);
+		else
+			for (j = 0; j < ETHER_ADDR_LEN; j++)
+				eh.ether_shost[j] = rng();
+		len = payload[i] + (snap[i] ? LLC_SNAPFRAMELEN : 0);
+		if ((int)i == bad) {
+			switch (a->fault) {
+			case F_SHORT:
+				len = rng() % LLC_SNAPFRAMELEN;
+				break;
+			case F_LONG:
+				len += 1 + rng() % 64 + AMSDU_MAX;
+				break;
+			case F_DA:
+				eh.ether_dhost[5] ^= 0x80;
+				break;
+			case F_LLC_DA:
+				memcpy(eh.ether_dhost,
+				    "\xaa\xaa\x03\x00\x00\x00", ETHER_ADDR_LEN);
+				break;
+			case F_SA:
+				eh.ether_shost[5] ^= 0x80;
+				break;
+			default:
+				break;
+			}
+		}
+		eh.ether_type = htons(len);
+		sub = a->frame.size();
+		a->frame.insert(a->frame.end(), (u_int8_t *)&eh,
+		    (u_int8_t *)&eh + sizeof(eh));
+		if (snap[i]) {
+			llc.llc_dsap = llc.llc_ssap = LLC_SNAP_LSAP;
+			llc.llc_control = LLC_UI;
+			memset(llc.llc_snap.org_code, 0, 3);
+			llc.llc_snap.ether_type = htons(ETHERTYPE_IP);
+			a->frame.insert(a->frame.end(), (u_int8_t *)&llc,
+			    (u_int8_t *)&llc + sizeof(llc));
+		}
+		for (j = 0; j < (size_t)payload[i]; j++)
+			a->frame.push_back(rng());
+		/* a plain 802.3 payload must not read as LLC/SNAP */
+		if (!snap[i] && payload[i] > 0)
+			a->frame[sub + sizeof(eh)] = 0x42;
+
+		std::vector<u_int8_t> w(a->frame.begin() + sub, a->frame.end());
+		if (snap[i]) {
+			w.erase(w.begin() + 2 * ETHER_ADDR_LEN,
+			    w.begin() + ETHER_HDR_LEN + LLC_SNAPFRAMELEN - 2);
+		}
+		a->want.push_back(w);
+
+		if (i + 1 < payload.size())
+			while (a->frame.size() % 4 != sizeof(wh) % 4)
+				a->frame.push_back(0);
+	}
+	for (j = 0; j < junk; j++)
+		a->frame.push_back(rng());
+	if (a->fault != F_NONE)
+		a->want.clear();
+}
+
+/*
+ * Put the A-MSDU into a pool buffer and hand it up as the driver does:
+ * a slice of the buffer, or a small head mbuf with the rest of the frame
+ * behind it when a split point is given.
+ */
+static mbuf_t
+amsdu_load(struct rxpool *pool, const struct amsdu *a)
+{
+	IOPhysicalSegment seg;
+	struct rxpool_buf *buf;
+	mbuf_t m0, m, n;
+
+	m0 = rxpool_get(pool, &seg, &buf);
+	if (m0 == NULL)
+		return NULL;
+	memcpy(buf->rb_vaddr, a->frame.data(), a->frame.size());
+	if (a->split == 0) {
+		m = rxpool_slice(buf, 0, a->frame.size());
+	} else {
+		m = NULL;
+		if (mbuf_gethdr(MBUF_DONTWAIT, MBUF_TYPE_DATA, &m) == 0) {
+			memcpy(mbuf_data(m), a->frame.data(), a->split);
+			mbuf_setlen(m, a->split);
+			n = rxpool_slice(buf, a->split,
+			    a->frame.size() - a->split);
+			if (n == NULL) {
+				mbuf_freem(m);
+				m = NULL;
+			} else {
+				mbuf_setflags(n, 0);
+				mbuf_setnext(m, n);
+				mbuf_pkthdr_setlen(m, a->frame.size());
+			}
+		}
+	}
+	mbuf_freem(m0);
+	return m;
+}
+
+static int
+pool_free_bufs(struct rxpool *pool)
+{
+	struct rxpool_buf *buf;
+	int n = 0;
+
+	SLIST_FOREACH(buf, &pool->rp_free, rb_next)
+		n++;
+	return n;
+}
+
+/* Run one A-MSDU through decap and compare what comes out. */
+static int
+amsdu_run(struct rxpool *pool, const struct amsdu *a, decap_fn *decap,
+    int in_place)
+{
+	static struct ieee80211com ic;
+	static struct ieee80211_node ni;
+	struct mbuf_list ml = MBUF_LIST_INITIALIZER();
+	u_int8_t got[IWM_RBUF_SIZE];
+	const u_int8_t *base = NULL;
+	u_int32_t drops;
+	size_t i, len;
+	mbuf_t m;
+	int ok = 1;
+
+	ic.ic_opmode = a->opmode;
+	memcpy(ic.ic_myaddr, myaddr, IEEE80211_ADDR_LEN);
+	memcpy(ni.ni_macaddr, apaddr, IEEE80211_ADDR_LEN);
+	drops = ic.ic_stats.is_rx_decap;
+
+	m = amsdu_load(pool, a);
+	if (m == NULL)
+		return 0;
+	if (a->split == 0)
+		base = (const u_int8_t *)mbuf_datastart(m);
+	decap(&ic, m, &ni, QOS_HDRLEN, &ml);
+
+	ok &= ml.ml_len == a->want.size();
+	ok &= ic.ic_stats.is_rx_decap - drops == (a->fault != F_NONE);
+	for (i = 0; (m = ml_dequeue(&ml)) != NULL; i++) {
+		len = mbuf_pkthdr_len(m);
+		if (i < a->want.size() && len == a->want[i].size()) {
+			mbuf_copydata(m, 0, len, got);
+			ok &= memcmp(got, a->want[i].data(), len) == 0;
+		} else
+			ok = 0;
+		if (in_place && base != NULL)
+			ok &= mbuf_next(m) == NULL &&
+			    (const u_int8_t *)mbuf_data(m) >= base &&
+			    (const u_int8_t *)mbuf_data(m) + len <=
+			    base + a->frame.size();
+		mbuf_freem(m);
+	}
+	ok &= a->want.empty() || last_mcast == a->mcast;
+	ok &= pool_free_bufs(pool) == NBUFS;
+	return ok;
+}
+
+/* A-MSDU of nsub LLC/SNAP subframes filling AMSDU_MAX. */
+static void
+amsdu_full(struct amsdu *a, int nsub, std::mt19937 &rng)
+{
+	int sub = ((AMSDU_MAX - QOS_HDRLEN) / nsub) & ~3;
+
+	a->opmode = IEEE80211_M_STA;
+	a->mcast = 0;
+	a->split = 0;
+	a->fault = F_NONE;
+	amsdu_build(a, std::vector<int>(nsub,
+	    sub - ETHER_HDR_LEN - LLC_SNAPFRAMELEN), std::vector<int>(nsub, 1),
+	    0, rng);
+}
+
+static void
+check_random(struct rxpool *pool, int ncases)
+{
+	std::mt19937 rng(1);
+	std::vector<int> payload, snap;
+	struct amsdu a;
+	int i, j, nsub, left, bad[2] = { 0, 0 }, faults[F_COUNT] = { 0 };
+	int chained = 0;
+
+	for (i = 0; i < ncases; i++) {
+		a.opmode = rng() % 4 == 0 ? IEEE80211_M_HOSTAP :
+		    IEEE80211_M_STA;
+		a.mcast = rng() % 4 == 0;
+		a.fault = rng() % 3 ? F_NONE : (enum fault)(1 + rng() %
+		    (F_COUNT - 1));
+		if (a.fault == F_SA && a.opmode != IEEE80211_M_HOSTAP)
+			a.fault = F_DA;
+		if (a.fault == F_DA && a.opmode != IEEE80211_M_STA)
+			a.fault = F_SA;
+		nsub = 1 + rng() % 64;
+		left = AMSDU_MAX - QOS_HDRLEN - 21 - nsub *
+		    (ETHER_HDR_LEN + LLC_SNAPFRAMELEN + 3);
+		payload.clear();
+		snap.clear();
+		for (j = 0; j < nsub; j++) {
+			snap.push_back(rng() % 4 != 0);
+			payload.push_back(rng() % (left / nsub + 1));
+			if (!snap.back() && payload.back() < LLC_SNAPFRAMELEN)
+				payload.back() = LLC_SNAPFRAMELEN;
+		}
+		amsdu_build(&a, payload, snap, rng() % 22, rng);
+		a.split = 0;
+		if (rng() % 3 == 0) {
+			/* somewhere in the first subframes' headers */
+			a.split = QOS_HDRLEN + 1 + rng() %
+			    MIN(a.frame.size() - QOS_HDRLEN - 1, (size_t)120);
+			chained++;
+		}
+		faults[a.fault]++;
+		bad[0] += !amsdu_run(pool, &a, ieee80211_amsdu_decap, 0);
+		if (a.fault != F_DA && a.fault != F_LLC_DA && a.fault != F_SA)
+			bad[1] += !amsdu_run(pool, &a, amsdu_decap_old, 0);
+	}
+	CHECK(bad[0] == 0, "ieee80211_amsdu_decap() delivers the subframes");
+	CHECK(bad[1] == 0, "the old decap delivers the same subframes");
+	CHECK(chained > 0, "chained A-MSDUs covered");
+	for (i = 1; i < F_COUNT; i++)
+		CHECK(faults[i] > 0, "every malformed case covered");
+}
+
+struct result {
+	double		 ns;
+	double		 allocs;
+	double		 copied;
+};
+
+static uint64_t
+wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct result
+bench(struct rxpool *pool, int nsub, decap_fn *decap, int iters)
+{
+	static struct ieee80211com ic;
+	static struct ieee80211_node ni;
+	std::mt19937 rng(nsub);
+	struct mbuf_list ml = MBUF_LIST_INITIALIZER();
+	struct result res;
+	struct amsdu a;
+	uint64_t ns = 0, allocs = 0, copied = 0, t0, a0, c0;
+	mbuf_t m;
+	int i;
+
+	ic.ic_opmode = IEEE80211_M_STA;
+	memcpy(ic.ic_myaddr, myaddr, IEEE80211_ADDR_LEN);
+	amsdu_full(&a, nsub, rng);
+	for (i = 0; i < iters; i++) {
+		m = amsdu_load(pool, &a);
+		if (m == NULL)
+			break;
+		a0 = shim_mbuf_allocs;
+		c0 = shim_pullup_bytes;
+		t0 = wall_ns();
+		decap(&ic, m, &ni, QOS_HDRLEN, &ml);
+		ml_purge(&ml);
+		ns += wall_ns() - t0;
+		allocs += shim_mbuf_allocs - a0;
+		copied += shim_pullup_bytes - c0;
+	}
+	res.ns = (double)ns / iters;
+	res.allocs = (double)allocs / iters;
+	res.copied = (double)copied / iters;
+	return res;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: amsdubench [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int nsubs[] = { 2, 4, 8, 16, 32, 64 };
+	struct result old, cur;
+	struct rxpool *pool;
+	std::mt19937 rng(0);
+	struct amsdu a;
+	char label[32];
+	int ch, iters = 20000, ncases = 2000;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			iters = 200;
+			ncases = 300;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	pool = rxpool_create(IWM_RBUF_SIZE, NBUFS);
+	CHECK(pool != NULL, "rxpool_create");
+	if (pool == NULL)
+		return 1;
+
+	for (i = 0; i < nitems(nsubs); i++) {
+		amsdu_full(&a, nsubs[i], rng);
+		CHECK(amsdu_run(pool, &a, ieee80211_amsdu_decap, 1),
+		    "subframes carved out of the pool buffer");
+		CHECK(amsdu_run(pool, &a, amsdu_decap_old, 0),
+		    "the old decap agrees");
+	}
+	check_random(pool, ncases);
+
+	printf("%-24s %9s %7s %7s %9s %7s %7s\n", "", "old ns", "allocs",
+	    "copied", "new ns", "allocs", "copied");
+	for (i = 0; i < nitems(nsubs); i++) {
+		old = bench(pool, nsubs[i], amsdu_decap_old, iters);
+		cur = bench(pool, nsubs[i], ieee80211_amsdu_decap, iters);
+		snprintf(label, sizeof(label), "%d subframes", nsubs[i]);
+		printf("%-24s %9.0f %7.1f %7.0f %9.0f %7.1f %7.0f\n", label,
+		    old.ns, old.allocs, old.copied, cur.ns, cur.allocs,
+		    cur.copied);
+		CHECK(cur.allocs == nsubs[i] - 1,
+		    "one mbuf per split, none for the last subframe");
+		CHECK(cur.copied == 0, "nothing pulled up");
+	}
+
+	rxpool_destroy(pool);
+	CHECK(live_mem == 0, "pool freed");
+
+	printf("amsdubench: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
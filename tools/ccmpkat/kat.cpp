@@ -0,0 +1,213 @@
+/*
+ * ccmpkat: known-answer and robustness tests for the software CCMP
+ * cipher, built on the host from ieee80211_crypto_ccmp.c.
+ *
+ * The IEEE Std 802.11-2016 J.6.4 vector is encrypted, then decrypted from
+ * chains split at various points inside the 802.11 and CCMP headers,
+ * with both private and shared clusters.  Replayed and tampered frames
+ * must be dropped and counted without advancing the RSC, and shared
+ * clusters must never be written.  Exits non-zero on any failure.
+ */
+#include <sys/param.h>
+#include <sys/mbuf.h>
+
+#include <net80211/ieee80211_var.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+static size_t
+unhex(const char *s, uint8_t *out)
+{
+	size_t n = 0;
+	unsigned int v;
+
+	for (; s[0] != '\0' && s[1] != '\0'; s += 2) {
+		sscanf(s, "%2x", &v);
+		out[n++] = v;
+	}
+	return n;
+}
+
+/*
+ * Build a packet holding buf, with a new mbuf starting at each offset in
+ * cuts[].  Every mbuf has its own cluster with headroom, as the RX path
+ * delivers them.  If shared is set, *ref receives a second reference to
+ * the first cluster, so the cipher sees mbuf_mclhasreference() != 0.
+ */
+static mbuf_t
+mkchain(const uint8_t *buf, size_t len, const size_t *cuts, size_t ncuts,
+    int shared, mbuf_t *ref)
+{
+	mbuf_t m0 = NULL, m, prev = NULL;
+	size_t off = 0, end, i;
+
+	for (i = 0; i <= ncuts; i++) {
+		end = i < ncuts ? cuts[i] : len;
+		m = NULL;
+		if ((i == 0 ? mbuf_gethdr(MBUF_WAITOK, MBUF_TYPE_DATA, &m) :
+		    mbuf_get(MBUF_WAITOK, MBUF_TYPE_DATA, &m)) != 0 ||
+		    mbuf_mclget(MBUF_WAITOK, MBUF_TYPE_DATA, &m) != 0) {
+			mbuf_freem(m);
+			mbuf_freem(m0);
+			return NULL;
+		}
+		mbuf_setdata(m, (uint8_t *)mbuf_datastart(m) + 64, end - off);
+		memcpy(mbuf_data(m), buf + off, end - off);
+		if (prev == NULL)
+			m0 = m;
+		else
+			mbuf_setnext(prev, m);
+		prev = m;
+		off = end;
+	}
+	mbuf_pkthdr_setlen(m0, len);
+	if (shared && mbuf_copym(m0, 0, MBUF_COPYALL, MBUF_WAITOK, ref) != 0) {
+		mbuf_freem(m0);
+		return NULL;
+	}
+	return m0;
+}
+
+static size_t
+flatten(mbuf_t m, uint8_t *out, size_t max)
+{
+	size_t len = mbuf_pkthdr_len(m);
+
+	if (len > max || mbuf_copydata(m, 0, len, out) != 0)
+		return 0;
+	return len;
+}
+
+int
+main(void)
+{
+	/* IEEE Std 802.11-2016 J.6.4: CCMP test vector */
+	static const char tk_hex[] = "c97c1f67ce371185514a8a19f2bdd52f";
+	static const char hdr_hex[] =
+	    "0848c32c0fd2e128a57c5030f1844408abaea5b8fcba8033";
+	static const char pt_hex[] =
+	    "f8ba1a55d02f85ae967bb62fb6cda8eb7e78a050";
+	static const char ct_hex[] =
+	    "0848c32c0fd2e128a57c5030f1844408abaea5b8fcba8033"
+	    "0ce70020769703b5"
+	    "f3d0a2fe9a3dbf2342a643e43246e80c3c04d019"
+	    "7845ce0b16f97623";
+	/* split points: none, after the MAC header, inside the CCMP header,
+	 * after it, and scattered through header, body and MIC */
+	static const struct {
+		size_t	n;
+		size_t	cuts[3];
+	} layouts[] = {
+		{ 0, { 0 } },
+		{ 1, { 24 } },
+		{ 1, { 30 } },
+		{ 2, { 32, 40 } },
+		{ 3, { 26, 33, 50 } },
+	};
+	struct ieee80211com ic;
+	struct ieee80211_key k;
+	uint8_t tk[16], hdr[24], pt[20], ct[60], plain[44], out[128];
+	uint8_t bad[60];
+	const size_t flips[] = { 40, sizeof(ct) - 1 };	/* body, MIC */
+	mbuf_t m, ref;
+	size_t n, i;
+	int shared;
+
+	unhex(tk_hex, tk);
+	unhex(hdr_hex, hdr);
+	unhex(pt_hex, pt);
+	unhex(ct_hex, ct);
+
+	/* decryption clears the protected bit */
+	memcpy(plain, hdr, sizeof(hdr));
+	plain[1] &= ~IEEE80211_FC1_PROTECTED;
+	memcpy(plain + sizeof(hdr), pt, sizeof(pt));
+
+	memset(&ic, 0, sizeof(ic));
+	memset(&k, 0, sizeof(k));
+	k.k_cipher = IEEE80211_CIPHER_CCMP;
+	k.k_len = sizeof(tk);
+	memcpy(k.k_key, tk, sizeof(tk));
+	if (ieee80211_ccmp_set_key(&ic, &k) != 0) {
+		printf("FAIL set_key\n");
+		return 1;
+	}
+
+	/* encryption reproduces the vector; PN is pre-incremented */
+	k.k_tsc = 0xb5039776e70cULL - 1;
+	m = mkchain(plain, sizeof(plain), NULL, 0, 0, NULL);
+	CHECK(m != NULL, "mkchain");
+	memcpy(mbuf_data(m), hdr, sizeof(hdr));
+	m = ieee80211_ccmp_encrypt(&ic, m, &k);
+	CHECK(m != NULL, "encrypt");
+	if (m != NULL) {
+		n = flatten(m, out, sizeof(out));
+		CHECK(n == sizeof(ct) && memcmp(out, ct, n) == 0,
+		    "encrypt vector");
+		mbuf_freem(m);
+	}
+
+	for (shared = 0; shared < 2; shared++) {
+		for (i = 0; i < nitems(layouts); i++) {
+			/* decryption of every layout recovers the plaintext */
+			memset(k.k_rsc, 0, sizeof(k.k_rsc));
+			ref = NULL;
+			m = mkchain(ct, sizeof(ct), layouts[i].cuts,
+			    layouts[i].n, shared, &ref);
+			m = ieee80211_ccmp_decrypt(&ic, m, &k);
+			CHECK(m != NULL, "decrypt");
+			if (m != NULL) {
+				n = flatten(m, out, sizeof(out));
+				CHECK(n == sizeof(plain) &&
+				    memcmp(out, plain, n) == 0,
+				    "decrypt vector");
+				mbuf_freem(m);
+			}
+			CHECK(k.k_rsc[0] == 0xb5039776e70cULL,
+			    "RSC advanced");
+			if (ref != NULL) {
+				n = flatten(ref, out, sizeof(out));
+				CHECK(n == sizeof(ct) &&
+				    memcmp(out, ct, n) == 0,
+				    "shared cluster untouched");
+				mbuf_freem(ref);
+			}
+
+			/* the same PN again is a replay */
+			m = mkchain(ct, sizeof(ct), layouts[i].cuts,
+			    layouts[i].n, shared, &ref);
+			n = ic.ic_stats.is_ccmp_replays;
+			CHECK(ieee80211_ccmp_decrypt(&ic, m, &k) == NULL &&
+			    ic.ic_stats.is_ccmp_replays == n + 1, "replay");
+			if (shared)
+				mbuf_freem(ref);
+
+			/* a flipped body or MIC bit fails, RSC unchanged */
+			for (size_t j = 0; j < nitems(flips); j++) {
+				memset(k.k_rsc, 0, sizeof(k.k_rsc));
+				memcpy(bad, ct, sizeof(ct));
+				bad[flips[j]] ^= 1;
+				m = mkchain(bad, sizeof(bad), layouts[i].cuts,
+				    layouts[i].n, shared, &ref);
+				n = ic.ic_stats.is_ccmp_dec_errs;
+				CHECK(ieee80211_ccmp_decrypt(&ic, m, &k) ==
+				    NULL && ic.ic_stats.is_ccmp_dec_errs ==
+				    n + 1 && k.k_rsc[0] == 0, "tamper");
+				if (shared)
+					mbuf_freem(ref);
+			}
+		}
+	}
+
+	ieee80211_ccmp_delete_key(&ic, &k);
+	printf("ccmpkat: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
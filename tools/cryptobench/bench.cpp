@@ -0,0 +1,627 @@
+/*
+ * cryptobench: throughput of the itl80211 crypto primitives and of the
+ * 802.11 cipher wrappers, built on the host from the kext's sources.
+ *
+ * Every case is timed over frame/message sizes from 64 B to a 7935 B
+ * A-MSDU.  Results are printed as a table and, with -j, written as JSON
+ * so that runs can be compared.  Cycles are TSC ticks where the host
+ * has a TSC and nanoseconds otherwise.
+ *
+ * The wrapper cases check that each decrypted frame matches what was
+ * encrypted, so -q (one short pass) doubles as a smoke test.
+ */
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/param.h>
+#include <sys/mbuf.h>
+
+#include <net80211/ieee80211_var.h>
+
+#include <crypto/aes.h>
+#include <crypto/aes_blk.h>
+#include <crypto/arc4.h>
+#include <crypto/chachapoly.h>
+#include <crypto/cmac.h>
+#include <crypto/gmac.h>
+#include <crypto/md5.h>
+#include <crypto/sha1.h>
+#include <crypto/sha2.h>
+#include <crypto/hmac.h>
+#include <crypto/key_wrap.h>
+#include <crypto/michael.h>
+#include <crypto/rijndael.h>
+
+#include <getopt.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC	1
+static inline uint64_t rdcycles(void) { return __rdtsc(); }
+#else
+#define HAVE_TSC	0
+static inline uint64_t
+rdcycles(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static double
+walltime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const size_t sizes[] = { 64, 128, 256, 512, 1024, 1500, 2304,
+    3839, 7935 };
+
+struct result {
+	std::string	name;
+	size_t		bytes;
+	double		ops_per_sec;
+	double		mb_per_sec;
+	double		cycles_per_byte;
+};
+
+static std::vector<result> results;
+static double budget = 0.2;	/* seconds per case and size */
+static const char *filter;
+static int failures;
+
+#define BATCH	64
+
+static uint8_t buf[16384], out[16384 + 64];
+
+static void
+record(const char *name, size_t bytes, uint64_t ops, double secs,
+    uint64_t cycles)
+{
+	result r;
+
+	r.name = name;
+	r.bytes = bytes;
+	r.ops_per_sec = ops / secs;
+	r.mb_per_sec = ops * bytes / secs / 1e6;
+	r.cycles_per_byte = (double)cycles / ((double)ops * bytes);
+	results.push_back(r);
+	printf("%-24s %6zu B %12.0f ops/s %9.1f MB/s %8.2f c/B\n",
+	    name, bytes, r.ops_per_sec, r.mb_per_sec, r.cycles_per_byte);
+}
+
+static bool
+selected(const char *name)
+{
+	return filter == NULL || strstr(name, filter) != NULL;
+}
+
+/*
+ * Time fn() on a buffer of each size until the per-size budget is used.
+ * fn() runs BATCH operations per call.
+ */
+static void
+run(const char *name, const std::function<void(size_t)> &fn,
+    size_t maxsize = sizeof(buf))
+{
+	if (!selected(name))
+		return;
+	for (size_t len : sizes) {
+		uint64_t ops = 0, cycles = 0;
+		double secs = 0;
+
+		if (len > maxsize)
+			continue;
+		do {
+			double t0 = walltime();
+			uint64_t c0 = rdcycles();
+
+			fn(len);
+			cycles += rdcycles() - c0;
+			secs += walltime() - t0;
+			ops += BATCH;
+		} while (secs < budget);
+		record(name, len, ops, secs, cycles);
+	}
+}
+
+static void
+bench_primitives(void)
+{
+	static const uint8_t key[32] = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+		0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+		0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+		0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+	};
+	uint8_t iv[16] = { 0 }, tag[64];
+
+	run("aes128-ecb", [&](size_t len) {
+		AES_CTX ctx;
+
+		AES_Setkey(&ctx, key, 16);
+		for (int i = 0; i < BATCH; i++)
+			AES_Encrypt_ECB(&ctx, buf, out, len / 16);
+	});
+	run("aes256-ecb", [&](size_t len) {
+		AES_CTX ctx;
+
+		AES_Setkey(&ctx, key, 32);
+		for (int i = 0; i < BATCH; i++)
+			AES_Encrypt_ECB(&ctx, buf, out, len / 16);
+	});
+	run("rijndael128", [&](size_t len) {
+		rijndael_ctx ctx;
+
+		rijndael_set_key_enc_only(&ctx, key, 128);
+		for (int i = 0; i < BATCH; i++)
+			for (size_t off = 0; off + 16 <= len; off += 16)
+				rijndael_encrypt(&ctx, buf + off, out + off);
+	});
+	run("aes128-ccm-blk", [&](size_t len) {
+		AES_BLK_CTX ctx;
+
+		AES_Blk_Setkey(&ctx, key, 16);
+		for (int i = 0; i < BATCH; i++) {
+			struct aes_ccm_stream st;
+
+			memset(&st, 0, sizeof(st));
+			st.ctr = 1;
+			st.a[15] = 1;
+			AES_Blk_Encrypt(&ctx, st.a, st.s);
+			AES_CCM_Update(&ctx, &st, buf, len, 1);
+			AES_CCM_Final(&ctx, &st);
+		}
+	});
+	run("aes128-gcm-blk", [&](size_t len) {
+		AES_BLK_CTX ctx;
+
+		AES_Blk_Setkey(&ctx, key, 16);
+		for (int i = 0; i < BATCH; i++) {
+			struct aes_gcm_stream st;
+
+			AES_GCM_Init(&ctx, &st, iv, key, 22);
+			AES_GCM_Update(&ctx, &st, buf, len, 1);
+			AES_GCM_Final(&ctx, &st, tag);
+		}
+	});
+	run("aes128-cmac", [&](size_t len) {
+		AES_CMAC_CTX ctx;
+
+		AES_CMAC_SetKey(&ctx, key);
+		for (int i = 0; i < BATCH; i++) {
+			AES_CMAC_Init(&ctx);
+			AES_CMAC_Update(&ctx, buf, len);
+			AES_CMAC_Final(tag, &ctx);
+		}
+	});
+	run("aes128-gmac", [&](size_t len) {
+		AES_GMAC_CTX ctx;
+
+		AES_GMAC_Init(&ctx);
+		AES_GMAC_Setkey(&ctx, key, 16 + 4);
+		for (int i = 0; i < BATCH; i++) {
+			AES_GMAC_Reinit(&ctx, iv, 8);
+			AES_GMAC_Update(&ctx, buf, len);
+			AES_GMAC_Final(tag, &ctx);
+		}
+	});
+	run("chacha20-poly1305", [&](size_t len) {
+		CHACHA20_POLY1305_CTX ctx;
+
+		Chacha20_Poly1305_Init(&ctx);
+		Chacha20_Poly1305_Setkey(&ctx, key, 32 + 4);
+		for (int i = 0; i < BATCH; i++) {
+			Chacha20_Poly1305_Reinit(&ctx, iv, 8);
+			Chacha20_Poly1305_Update(&ctx, buf, len);
+			Chacha20_Poly1305_Final(tag, &ctx);
+		}
+	});
+	run("arc4", [&](size_t len) {
+		struct rc4_ctx ctx;
+
+		rc4_keysetup(&ctx, (u_char *)key, 16);
+		for (int i = 0; i < BATCH; i++)
+			rc4_crypt(&ctx, buf, out, len);
+	});
+	run("michael", [&](size_t len) {
+		MICHAEL_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			michael_init(&ctx);
+			michael_key(key, &ctx);
+			michael_update(&ctx, buf, len);
+			michael_final(tag, &ctx);
+		}
+	});
+	run("md5", [&](size_t len) {
+		MD5_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			MD5Init(&ctx);
+			MD5Update(&ctx, buf, len);
+			MD5Final(tag, &ctx);
+		}
+	});
+	run("sha1", [&](size_t len) {
+		SHA1_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			SHA1Init(&ctx);
+			SHA1Update(&ctx, buf, len);
+			SHA1Final(tag, &ctx);
+		}
+	});
+	run("sha256", [&](size_t len) {
+		SHA2_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			SHA256Init(&ctx);
+			SHA256Update(&ctx, buf, len);
+			SHA256Final(tag, &ctx);
+		}
+	});
+	run("sha512", [&](size_t len) {
+		SHA2_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			SHA512Init(&ctx);
+			SHA512Update(&ctx, buf, len);
+			SHA512Final(tag, &ctx);
+		}
+	});
+	run("hmac-md5", [&](size_t len) {
+		HMAC_MD5_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			HMAC_MD5_Init(&ctx, key, 16);
+			HMAC_MD5_Update(&ctx, buf, len);
+			HMAC_MD5_Final(tag, &ctx);
+		}
+	});
+	run("hmac-sha1", [&](size_t len) {
+		HMAC_SHA1_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			HMAC_SHA1_Init(&ctx, key, 16);
+			HMAC_SHA1_Update(&ctx, buf, len);
+			HMAC_SHA1_Final(tag, &ctx);
+		}
+	});
+	run("hmac-sha256", [&](size_t len) {
+		HMAC_SHA256_CTX ctx;
+
+		for (int i = 0; i < BATCH; i++) {
+			HMAC_SHA256_Init(&ctx, key, 16);
+			HMAC_SHA256_Update(&ctx, buf, len);
+			HMAC_SHA256_Final(tag, &ctx);
+		}
+	});
+	/* Key wrap only ever sees keys; time it at the GTK sizes. */
+	if (selected("aes-key-wrap")) {
+		for (size_t len : { (size_t)16, (size_t)32 }) {
+			aes_key_wrap_ctx ctx;
+			uint64_t ops = 0, cycles = 0;
+			double secs = 0;
+
+			aes_key_wrap_set_key(&ctx, key, 16);
+			do {
+				double t0 = walltime();
+				uint64_t c0 = rdcycles();
+
+				for (int i = 0; i < BATCH; i++) {
+					aes_key_wrap(&ctx, buf, len / 8, out);
+					aes_key_unwrap(&ctx, out, buf, len / 8);
+				}
+				cycles += rdcycles() - c0;
+				secs += walltime() - t0;
+				ops += BATCH;
+			} while (secs < budget);
+			record("aes-key-wrap", len, ops, secs, cycles);
+		}
+	}
+	/* PBKDF2 is per passphrase, not per byte: one WPA PSK derivation. */
+	if (selected("pbkdf2-sha1")) {
+		uint64_t ops = 0, cycles = 0;
+		double secs = 0;
+
+		do {
+			double t0 = walltime();
+			uint64_t c0 = rdcycles();
+
+			pbkdf2_sha1("passphrase", (const u8 *)"IEEE", 4, 4096,
+			    out, 32);
+			cycles += rdcycles() - c0;
+			secs += walltime() - t0;
+			ops++;
+		} while (secs < budget);
+		record("pbkdf2-sha1", 32, ops, secs, cycles);
+	}
+}
+
+/*
+ * 802.11 wrappers.  Frames are built the way they reach the ciphers in
+ * the kext: with headroom for the cipher header, in a chain of 2 KB
+ * clusters.  Management frames always fit in the first one.
+ */
+static struct ieee80211com ic;
+
+static mbuf_t
+mkframe(size_t bodylen, int mgmt, uint8_t seed)
+{
+	struct ieee80211_qosframe *wh;
+	size_t hdrlen = mgmt ? sizeof(struct ieee80211_frame) :
+	    sizeof(struct ieee80211_qosframe);
+	size_t len = hdrlen + bodylen, off = 0;
+	mbuf_t m0, m;
+	uint8_t hdr[sizeof(*wh)];
+
+	wh = (struct ieee80211_qosframe *)hdr;
+	memset(hdr, 0, sizeof(hdr));
+	if (mgmt) {
+		wh->i_fc[0] = IEEE80211_FC0_VERSION_0 | IEEE80211_FC0_TYPE_MGT |
+		    IEEE80211_FC0_SUBTYPE_ACTION;
+		memset(wh->i_addr1, 0xff, IEEE80211_ADDR_LEN);
+	} else {
+		wh->i_fc[0] = IEEE80211_FC0_VERSION_0 |
+		    IEEE80211_FC0_TYPE_DATA | IEEE80211_FC0_SUBTYPE_QOS;
+		wh->i_fc[1] = IEEE80211_FC1_DIR_TODS;
+		wh->i_qos[0] = 0x80;	/* A-MSDU present, TID 0 */
+	}
+	if (mbuf_gethdr(MBUF_WAITOK, MBUF_TYPE_DATA, &m0) != 0)
+		return NULL;
+	if (len + 32 > mbuf_get_mhlen())
+		mbuf_mclget(MBUF_WAITOK, MBUF_TYPE_DATA, &m0);
+	wh->i_addr2[0] = 0x02;
+	wh->i_addr3[5] = seed;
+
+	/* leave room for the cipher header in front */
+	mbuf_setdata(m0, (uint8_t *)mbuf_datastart(m0) + 32, 0);
+	mbuf_pkthdr_setlen(m0, len);
+	for (m = m0; off < len; ) {
+		size_t n = MIN(len - off, mbuf_trailingspace(m));
+
+		for (size_t i = 0; i < n; i++) {
+			size_t o = off + i;
+
+			((uint8_t *)mbuf_data(m))[mbuf_len(m) + i] = o < hdrlen ?
+			    hdr[o] : (uint8_t)(o * 7 + seed);
+		}
+		mbuf_setlen(m, mbuf_len(m) + n);
+		off += n;
+		if (off < len) {
+			mbuf_t n0;
+
+			if (mbuf_get(MBUF_WAITOK, MBUF_TYPE_DATA, &n0) != 0 ||
+			    mbuf_mclget(MBUF_WAITOK, MBUF_TYPE_DATA, &n0) != 0) {
+				mbuf_freem(m0);
+				return NULL;
+			}
+			mbuf_setnext(m, n0);
+			m = n0;
+		}
+	}
+	return m0;
+}
+
+/* Compare a decrypted frame body with what mkframe() put there. */
+static bool
+checkframe(mbuf_t m, size_t bodylen, int mgmt, uint8_t seed)
+{
+	size_t hdrlen = mgmt ? sizeof(struct ieee80211_frame) :
+	    sizeof(struct ieee80211_qosframe);
+	static uint8_t tmp[16384];
+
+	if (m == NULL || mbuf_pkthdr_len(m) != hdrlen + bodylen)
+		return false;
+	mbuf_copydata(m, 0, hdrlen + bodylen, tmp);
+	for (size_t o = hdrlen; o < hdrlen + bodylen; o++)
+		if (tmp[o] != (uint8_t)(o * 7 + seed))
+			return false;
+	return true;
+}
+
+struct cipher {
+	const char		*name;
+	enum ieee80211_cipher	 cipher;
+	int			 mgmt;
+	int	(*set_key)(struct ieee80211com *, struct ieee80211_key *);
+	void	(*delete_key)(struct ieee80211com *, struct ieee80211_key *);
+	mbuf_t	(*encrypt)(struct ieee80211com *, mbuf_t,
+		    struct ieee80211_key *);
+	mbuf_t	(*decrypt)(struct ieee80211com *, mbuf_t,
+		    struct ieee80211_key *);
+};
+
+static const struct cipher ciphers[] = {
+	{ "ccmp", IEEE80211_CIPHER_CCMP, 0, ieee80211_ccmp_set_key,
+	    ieee80211_ccmp_delete_key, ieee80211_ccmp_encrypt,
+	    ieee80211_ccmp_decrypt },
+	{ "gcmp", IEEE80211_CIPHER_GCMP, 0, ieee80211_gcmp_set_key,
+	    ieee80211_gcmp_delete_key, ieee80211_gcmp_encrypt,
+	    ieee80211_gcmp_decrypt },
+	{ "gcmp256", IEEE80211_CIPHER_GCMP_256, 0, ieee80211_gcmp_set_key,
+	    ieee80211_gcmp_delete_key, ieee80211_gcmp_encrypt,
+	    ieee80211_gcmp_decrypt },
+	{ "tkip", IEEE80211_CIPHER_TKIP, 0, ieee80211_tkip_set_key,
+	    ieee80211_tkip_delete_key, ieee80211_tkip_encrypt,
+	    ieee80211_tkip_decrypt },
+	/*
+	 * Not WEP-104: ieee80211_crypto.h redefines IEEE80211_WEP_IVLEN as 4,
+	 * which overflows the 16-byte RC4 seed for a 13-byte key.
+	 */
+	{ "wep40", IEEE80211_CIPHER_WEP40, 0, ieee80211_wep_set_key,
+	    ieee80211_wep_delete_key, ieee80211_wep_encrypt,
+	    ieee80211_wep_decrypt },
+	{ "bip", IEEE80211_CIPHER_BIP, 1, ieee80211_bip_set_key,
+	    ieee80211_bip_delete_key, ieee80211_bip_encap,
+	    ieee80211_bip_decap },
+};
+
+static void
+setup_key(const struct cipher *c, struct ieee80211_key *k)
+{
+	memset(k, 0, sizeof(*k));
+	k->k_cipher = c->cipher;
+	k->k_len = ieee80211_cipher_keylen(c->cipher);
+	for (u_int i = 0; i < sizeof(k->k_key); i++)
+		k->k_key[i] = 0x40 + i;
+	/* TKIP: same Michael key both ways so one key decrypts its own TX */
+	if (c->cipher == IEEE80211_CIPHER_TKIP)
+		memcpy(&k->k_key[24], &k->k_key[16], 8);
+	k->k_tsc = 1;
+	if (c->set_key(&ic, k) != 0) {
+		fprintf(stderr, "%s: set_key failed\n", c->name);
+		exit(1);
+	}
+}
+
+static void
+bench_wrapper(const struct cipher *c)
+{
+	std::string encname = std::string(c->name) + "-encrypt";
+	std::string decname = std::string(c->name) + "-decrypt";
+	struct ieee80211_key tx, rx;
+	mbuf_t m[BATCH];
+
+	if (!selected(encname.c_str()) && !selected(decname.c_str()))
+		return;
+	setup_key(c, &tx);
+	setup_key(c, &rx);
+
+	for (size_t len : sizes) {
+		uint64_t eops = 0, ecycles = 0, dops = 0, dcycles = 0;
+		double esecs = 0, dsecs = 0;
+
+		/* management frames are contiguous, so one cluster at most */
+		if (c->mgmt && len + 64 > MCLBYTES)
+			continue;
+
+		do {
+			double t0;
+			uint64_t c0;
+
+			for (int i = 0; i < BATCH; i++)
+				m[i] = mkframe(len, c->mgmt, i);
+			t0 = walltime();
+			c0 = rdcycles();
+			for (int i = 0; i < BATCH; i++)
+				m[i] = c->encrypt(&ic, m[i], &tx);
+			ecycles += rdcycles() - c0;
+			esecs += walltime() - t0;
+			eops += BATCH;
+
+			memset(rx.k_rsc, 0, sizeof(rx.k_rsc));
+			rx.k_mgmt_rsc = 0;
+			t0 = walltime();
+			c0 = rdcycles();
+			for (int i = 0; i < BATCH; i++)
+				m[i] = c->decrypt(&ic, m[i], &rx);
+			dcycles += rdcycles() - c0;
+			dsecs += walltime() - t0;
+			dops += BATCH;
+
+			for (int i = 0; i < BATCH; i++) {
+				if (!checkframe(m[i], len, c->mgmt, i)) {
+					fprintf(stderr, "%s: %zu B frame %d did "
+					    "not round-trip\n", c->name, len, i);
+					failures++;
+				}
+				if (m[i] != NULL)
+					mbuf_freem(m[i]);
+			}
+		} while (esecs + dsecs < budget);
+		if (selected(encname.c_str()))
+			record(encname.c_str(), len, eops, esecs, ecycles);
+		if (selected(decname.c_str()))
+			record(decname.c_str(), len, dops, dsecs, dcycles);
+	}
+	c->delete_key(&ic, &tx);
+	c->delete_key(&ic, &rx);
+}
+
+static void
+write_json(const char *path)
+{
+	FILE *fp = fopen(path, "w");
+
+	if (fp == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fprintf(fp, "{\n  \"tool\": \"cryptobench\",\n");
+	fprintf(fp, "  \"cycle_source\": \"%s\",\n", HAVE_TSC ? "tsc" : "ns");
+	fprintf(fp, "  \"aes_accel\": %d,\n", AES_Blk_Accel());
+	fprintf(fp, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const result &r = results[i];
+
+		fprintf(fp, "    { \"name\": \"%s\", \"bytes\": %zu, "
+		    "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.2f, "
+		    "\"cycles_per_byte\": %.3f }%s\n", r.name.c_str(), r.bytes,
+		    r.ops_per_sec, r.mb_per_sec, r.cycles_per_byte,
+		    i + 1 < results.size() ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: cryptobench [-q] [-j file.json] "
+	    "[-t seconds] [name-filter]\n");
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *json = NULL;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "j:qt:")) != -1) {
+		switch (ch) {
+		case 'j':
+			json = optarg;
+			break;
+		case 'q':
+			budget = 0;
+			break;
+		case 't':
+			budget = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind > 1)
+		usage();
+	if (argc - optind == 1)
+		filter = argv[optind];
+
+	shim_random_seed(1);
+	read_random(buf, sizeof(buf));
+	ic.ic_opmode = IEEE80211_M_STA;
+	printf("aes accel: %d, cycles: %s\n", AES_Blk_Accel(),
+	    HAVE_TSC ? "tsc" : "ns");
+
+	bench_primitives();
+	for (const struct cipher &c : ciphers)
+		bench_wrapper(&c);
+
+	if (json != NULL)
+		write_json(json);
+	if (failures) {
+		printf("FAILED (%d frames)\n", failures);
+		return 1;
+	}
+	return 0;
+}
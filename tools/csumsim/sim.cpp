@@ -0,0 +1,802 @@
+/*
+ * csumsim: the TCP/UDP checksum offload paths of iwx, iwm and net80211,
+ * checked on the host against a simulated firmware.
+ *
+ * ieee80211_tx_csum() is extracted from ieee80211_output.c at build
+ * time, iwx_rx_csum() from ItlIwx.cpp, iwm_rx_csum() and iwm_rx_csum_mq()
+ * from mac80211.cpp, and the statements of iwx_tx() and iwm_tx() that
+ * turn the answer of ieee80211_tx_csum() into TX command offload bits,
+ * with the descriptor and capability constants they use (see
+ * tools/Makefile).  The shim's mbufs carry XNU's checksum flags and
+ * mbuf_outbound_finalize().
+ *
+ * On transmit, IPv4 and IPv6 TCP and UDP packets are built as the stack
+ * hands them over, with the pseudo-header sum in the checksum field and
+ * the requests set, encapsulated in QoS and non-QoS data frames and
+ * spread over random mbuf chains.  The firmware model follows the
+ * offload bits: it finds the IP header MH_SIZE + IP_HDR words into the
+ * frame it is given (iwm drivers insert the CCMP IV themselves, iwx
+ * firmware adds it) and computes the TCP or UDP checksum, pseudo-header
+ * included.  The tool checks that every frame goes out with correct
+ * checksums, that eligible packets are offloaded, and that packets are
+ * finished in software and left alone by the firmware when the
+ * capability is off, for IPv4 fragments, when the IPv4 header checksum
+ * is requested too, and when an earlier ieee80211_tx_csum() call already
+ * finished them, as before software encryption or A-MSDU aggregation.
+ *
+ * On receive, the firmware model reports each frame's checksums in the
+ * RX descriptor as the hardware does, and sometimes fails to: no verdict
+ * at all, or a good packet reported bad.  A stack model takes what the
+ * driver marked verified and checks the rest in software.  The tool
+ * checks that corrupt packets are never marked good, that every packet
+ * is accepted or dropped as its contents say, that the verdicts the
+ * firmware gave are passed on, and that AX210 devices, firmware without
+ * the capability, fragments and A-MSDUs on the iwm legacy path get no
+ * flags.
+ * Exits non-zero on failure.
+ */
+#include <random>
+#include <vector>
+
+#include <getopt.h>
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/mbuf.h>
+
+#include <net80211/ieee80211.h>
+#include <net80211/ieee80211_crypto.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+#include "csum.h"
+
+/* As in net/if_llc.h. */
+#define LLC_SNAPFRAMELEN	8
+
+/* The softc, descriptor and TX command fields the extracted code uses. */
+struct ieee80211com;
+
+struct iwx_softc {
+	int			 sc_device_family;
+	uint8_t			 sc_enabled_capa[howmany(IWX_NUM_UCODE_TLV_CAPA, NBBY)];
+};
+
+struct iwx_rx_mpdu_desc {
+	uint16_t		 l3l4_flags;
+};
+
+struct iwm_softc {
+	uint8_t			 sc_enabled_capa[howmany(IWM_NUM_UCODE_TLV_CAPA, NBBY)];
+};
+
+struct iwm_tx_cmd {
+	uint16_t		 offload_assist;
+};
+
+#include "csum.inc"
+
+/* The offload bits iwx_tx() puts in the TX command for m. */
+static uint16_t
+iwx_tx_offload(struct iwx_softc *sc, mbuf_t m, u_int hdrlen)
+{
+	struct ieee80211com *ic = NULL;
+	uint16_t offload_assist = 0;
+
+#include "iwx_tx_csum.inc"
+	return offload_assist;
+}
+
+/* The same for iwm_tx(); k is the key the hardware encrypts with. */
+static uint16_t
+iwm_tx_offload(struct iwm_softc *sc, mbuf_t m, u_int hdrlen,
+    struct ieee80211_key *k)
+{
+	struct ieee80211com *ic = NULL;
+	struct iwm_tx_cmd txcmd = { 0 }, *tx = &txcmd;
+
+#include "iwm_tx_csum.inc"
+	return le16toh(tx->offload_assist);
+}
+
+static void
+put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static uint16_t
+get16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static void
+fill(std::mt19937 &rng, uint8_t *p, size_t len)
+{
+	uint32_t r;
+
+	for (; len >= 4; p += 4, len -= 4) {
+		r = rng();
+		memcpy(p, &r, 4);
+	}
+	for (r = rng(); len > 0; len--, r >>= 8)
+		*p++ = r;
+}
+
+static uint32_t
+sum16(const uint8_t *p, size_t len, uint32_t sum)
+{
+	for (; len >= 2; p += 2, len -= 2)
+		sum += (p[0] << 8) | p[1];
+	if (len > 0)
+		sum += p[0] << 8;
+	return sum;
+}
+
+static uint16_t
+fold(uint32_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return sum;
+}
+
+/* Where the transport header of an IP packet starts, its length and protocol. */
+static void
+l4_span(const uint8_t *ip, size_t *off, size_t *len, int *proto)
+{
+	if ((ip[0] >> 4) == 4) {
+		*off = (ip[0] & 0x0f) << 2;
+		*len = get16(ip + 2) - *off;
+		*proto = ip[9];
+	} else {
+		*off = 40;
+		*len = get16(ip + 4);
+		*proto = ip[6];
+	}
+}
+
+static uint32_t
+pseudo_sum(const uint8_t *ip, size_t l4len, int proto)
+{
+	if ((ip[0] >> 4) == 4)
+		return sum16(ip + 12, 8, 0) + l4len + proto;
+	return sum16(ip + 8, 32, 0) + l4len + proto;
+}
+
+static size_t
+csum_field(int proto)
+{
+	return proto == IPPROTO_TCP ? 16 : 6;	/* th_sum, uh_sum */
+}
+
+/* The TCP or UDP checksum over the packet as it stands: 0 if it verifies. */
+static uint16_t
+l4_cksum(const uint8_t *ip)
+{
+	size_t off, len;
+	int proto;
+
+	l4_span(ip, &off, &len, &proto);
+	return ~fold(sum16(ip + off, len, pseudo_sum(ip, len, proto))) &
+	    0xffff;
+}
+
+static int
+ip_hdr_ok(const uint8_t *ip)
+{
+	return fold(sum16(ip, (ip[0] & 0x0f) << 2, 0)) == 0xffff;
+}
+
+static int
+ip_frag(const uint8_t *ip)
+{
+	return (ip[0] >> 4) == 4 && (get16(ip + 6) & (IP_MF | IP_OFFMASK));
+}
+
+/*
+ * An IPv4 or IPv6 TCP or UDP packet with correct checksums, with IPv4
+ * and TCP options now and then and payloads of 0 to 1400 bytes.
+ */
+static std::vector<uint8_t>
+build_ip(std::mt19937 &rng, int v6, int proto, int frag)
+{
+	size_t iplen, l4hdr, paylen, off, len;
+	std::vector<uint8_t> p;
+	uint8_t *ip, *l4;
+	uint16_t c;
+
+	paylen = rng() % 4 == 0 ? rng() % 65 : rng() % 1401;
+	l4hdr = proto == IPPROTO_UDP ? 8 : rng() % 2 ? 32 : 20;
+	iplen = v6 ? 40 : rng() % 4 == 0 ? 32 : 20;
+	p.resize(iplen + l4hdr + paylen);
+	fill(rng, p.data(), p.size());
+	ip = p.data();
+	l4 = ip + iplen;
+	if (v6) {
+		ip[0] = 0x60;
+		put16(ip + 4, l4hdr + paylen);
+		ip[6] = proto;
+		ip[7] = 64;
+	} else {
+		ip[0] = 0x40 | (iplen >> 2);
+		ip[1] = 0;
+		put16(ip + 2, p.size());
+		put16(ip + 6, frag ? IP_MF : IP_DF);
+		ip[8] = 64;
+		ip[9] = proto;
+		put16(ip + 10, 0);
+		memset(ip + 20, IPOPT_NOP, iplen - 20);
+		put16(ip + 10, ~fold(sum16(ip, iplen, 0)));
+	}
+	if (proto == IPPROTO_TCP) {
+		l4[12] = (l4hdr >> 2) << 4;
+		memset(l4 + 20, TCPOPT_NOP, l4hdr - 20);
+	} else
+		put16(l4 + 4, l4hdr + paylen);
+	l4_span(ip, &off, &len, &proto);
+	put16(l4 + csum_field(proto), 0);
+	c = l4_cksum(ip);
+	if (proto == IPPROTO_UDP && c == 0)
+		c = 0xffff;
+	put16(l4 + csum_field(proto), c);
+	return p;
+}
+
+/*
+ * Turn a packet into what the stack hands the interface when it leaves
+ * the checksums to it: the TCP or UDP field seeded with the pseudo-header
+ * sum and, if reqip, the IPv4 header checksum cleared.
+ */
+static void
+to_stack(uint8_t *ip, int reqip, mbuf_csum_request_flags_t *req,
+    u_int32_t *value)
+{
+	size_t off, len;
+	int proto;
+
+	l4_span(ip, &off, &len, &proto);
+	put16(ip + off + csum_field(proto), fold(pseudo_sum(ip, len, proto)));
+	if ((ip[0] >> 4) == 4) {
+		*req = proto == IPPROTO_TCP ? MBUF_CSUM_REQ_TCP :
+		    MBUF_CSUM_REQ_UDP;
+		if (reqip) {
+			put16(ip + 10, 0);
+			*req |= MBUF_CSUM_REQ_IP;
+		}
+	} else
+		*req = proto == IPPROTO_TCP ? MBUF_CSUM_REQ_TCPIPV6 :
+		    MBUF_CSUM_REQ_UDPIPV6;
+	*value = csum_field(proto);
+}
+
+/* A to-DS data frame carrying body behind an LLC/SNAP header. */
+static std::vector<uint8_t>
+build_frame(std::mt19937 &rng, int qos, int amsdu, uint16_t type,
+    const std::vector<uint8_t> &body, size_t *hdrlen)
+{
+	static const uint8_t snap[6] = { 0xaa, 0xaa, 0x03, 0, 0, 0 };
+	std::vector<uint8_t> f;
+
+	*hdrlen = qos ? sizeof(struct ieee80211_qosframe) :
+	    sizeof(struct ieee80211_frame);
+	f.resize(*hdrlen + LLC_SNAPFRAMELEN + body.size());
+	fill(rng, f.data(), *hdrlen);
+	f[0] = IEEE80211_FC0_VERSION_0 | IEEE80211_FC0_TYPE_DATA |
+	    (qos ? IEEE80211_FC0_SUBTYPE_QOS : 0);
+	f[1] = IEEE80211_FC1_DIR_TODS;
+	if (qos) {
+		f[*hdrlen - 2] = (rng() % IEEE80211_NUM_TID) |
+		    (amsdu ? IEEE80211_QOS_AMSDU : 0);
+		f[*hdrlen - 1] = 0;
+	}
+	memcpy(&f[*hdrlen], snap, sizeof(snap));
+	put16(&f[*hdrlen + 6], type);
+	memcpy(&f[*hdrlen + LLC_SNAPFRAMELEN], body.data(), body.size());
+	return f;
+}
+
+/*
+ * The frame spread over a random mbuf chain, some mbufs with clusters,
+ * the 802.11 header in the first.
+ */
+static mbuf_t
+chain(std::mt19937 &rng, const std::vector<uint8_t> &f, size_t hdrlen)
+{
+	mbuf_t m0 = NULL, m, last = NULL;
+	size_t off = 0, n;
+
+	while (off < f.size()) {
+		m = NULL;
+		if (last == NULL)
+			mbuf_gethdr(MBUF_WAITOK, MBUF_TYPE_DATA, &m);
+		else
+			mbuf_get(MBUF_WAITOK, MBUF_TYPE_DATA, &m);
+		if (rng() % 4 == 0)
+			mbuf_mclget(MBUF_WAITOK, MBUF_TYPE_DATA, &m);
+		n = MIN(f.size() - off, mbuf_maxlen(m));
+		if (last == NULL)
+			n = hdrlen + rng() % (n - hdrlen + 1);
+		else
+			n = 1 + rng() % n;
+		memcpy(mbuf_data(m), &f[off], n);
+		mbuf_setlen(m, n);
+		off += n;
+		if (last == NULL)
+			m0 = m;
+		else
+			mbuf_setnext(last, m);
+		last = m;
+	}
+	mbuf_pkthdr_setlen(m0, f.size());
+	return m0;
+}
+
+static std::vector<uint8_t>
+flatten(mbuf_t m)
+{
+	std::vector<uint8_t> f(mbuf_pkthdr_len(m));
+
+	CHECK(mbuf_copydata(m, 0, f.size(), f.data()) == 0,
+	    "packet length matches the chain");
+	return f;
+}
+
+/*
+ * The firmware's side of TX offload: the TCP or UDP checksum of the
+ * packet whose IP header starts l3 bytes into the frame it was given,
+ * pseudo-header included, over the field as the driver left it.
+ */
+static void
+fw_tx(std::vector<uint8_t> &f, size_t l3)
+{
+	size_t off, len;
+	int proto;
+	uint16_t c;
+
+	if (l3 + sizeof(struct ip) > f.size()) {
+		CHECK(0, "IP header inside the frame");
+		return;
+	}
+	l4_span(&f[l3], &off, &len, &proto);
+	if (l3 + off + len != f.size()) {
+		CHECK(0, "IP header where the offsets say");
+		return;
+	}
+	if (proto != IPPROTO_TCP && proto != IPPROTO_UDP)
+		return;
+	c = l4_cksum(&f[l3]);
+	if (proto == IPPROTO_UDP && c == 0)
+		c = 0xffff;
+	put16(&f[l3 + off + csum_field(proto)], c);
+}
+
+enum tx_case {
+	T_OFFLOAD,	/* eligible */
+	T_NOCAPA,	/* firmware without the capability */
+	T_FRAG,		/* IPv4 fragment */
+	T_REQIP,	/* IPv4 header checksum requested too */
+	T_FINISHED,	/* finished by an earlier call */
+	T_NCASES
+};
+
+static const char *tx_names[T_NCASES] = {
+	"eligible", "no capability", "IPv4 fragment", "IP header too",
+	"finished earlier"
+};
+
+enum tx_drv { X_IWX, X_IWM, X_IWM_CCMP, X_NDRVS };
+
+/* Run n packets through one driver's TX path; returns how many were offloaded. */
+static int
+run_tx(std::mt19937 &rng, enum tx_case c, enum tx_drv d, int n)
+{
+	struct iwx_softc iwx;
+	struct iwm_softc iwm;
+	struct ieee80211_key key;
+	std::vector<uint8_t> ip, air, f;
+	mbuf_csum_request_flags_t req;
+	u_int32_t value;
+	size_t hdrlen, l3;
+	int i, v6, proto, on, mh, ipw, offloaded = 0;
+	uint16_t oa;
+	mbuf_t m;
+
+	memset(&iwx, 0, sizeof(iwx));
+	memset(&iwm, 0, sizeof(iwm));
+	memset(&key, 0, sizeof(key));
+	if (c != T_NOCAPA) {
+		setbit(iwx.sc_enabled_capa, IWX_UCODE_TLV_CAPA_CSUM_SUPPORT);
+		setbit(iwm.sc_enabled_capa, IWM_UCODE_TLV_CAPA_CSUM_SUPPORT);
+	}
+	for (i = 0; i < n; i++) {
+		v6 = (c == T_FRAG || c == T_REQIP) ? 0 : rng() % 2;
+		proto = rng() % 2 ? IPPROTO_TCP : IPPROTO_UDP;
+		ip = build_ip(rng, v6, proto, c == T_FRAG);
+		air = build_frame(rng, rng() % 2, 0,
+		    v6 ? ETHERTYPE_IPV6 : ETHERTYPE_IP, ip, &hdrlen);
+		l3 = hdrlen + LLC_SNAPFRAMELEN;
+		f = air;
+		to_stack(&f[l3], c == T_REQIP, &req, &value);
+		m = chain(rng, f, hdrlen);
+		mbuf_set_csum_requested(m, req, value);
+		if (c == T_FINISHED)
+			ieee80211_tx_csum(NULL, m, hdrlen, 0);
+
+		switch (d) {
+		case X_IWX:
+			oa = iwx_tx_offload(&iwx, m, hdrlen);
+			on = (oa & IWX_TX_CMD_OFFLD_L4_EN) != 0;
+			mh = (oa / IWX_TX_CMD_OFFLD_MH_SIZE(1)) &
+			    IWX_TX_CMD_OFFLD_MH_MASK;
+			ipw = (oa / IWX_TX_CMD_OFFLD_IP_HDR(1)) &
+			    IWX_TX_CMD_OFFLD_IP_HDR_MASK;
+			break;
+		default:
+			oa = iwm_tx_offload(&iwm, m, hdrlen,
+			    d == X_IWM_CCMP ? &key : NULL);
+			on = (oa & IWM_TX_CMD_OFFLD_L4_EN) != 0;
+			mh = (oa / IWM_TX_CMD_OFFLD_MH_SIZE(1)) &
+			    IWM_TX_CMD_OFFLD_MH_MASK;
+			ipw = (oa / IWM_TX_CMD_OFFLD_IP_HDR(1)) &
+			    IWM_TX_CMD_OFFLD_IP_HDR_MASK;
+			break;
+		}
+		f = flatten(m);
+		CHECK(on == (c == T_OFFLOAD), "offloaded when eligible only");
+		if (on) {
+			offloaded++;
+			CHECK(ipw * 2 == LLC_SNAPFRAMELEN,
+			    "IP header offset past LLC/SNAP");
+			/* iwm hands over the CCMP IV, iwx firmware adds it */
+			CHECK(mh * 2 == (int)hdrlen +
+			    (d == X_IWM_CCMP ? IEEE80211_CCMP_HDRLEN : 0),
+			    "MAC header size of the frame handed over");
+		} else {
+			CHECK(oa == 0, "no offload bits when not offloaded");
+			mbuf_get_csum_requested(m, &req, &value);
+			CHECK(req == 0, "requests cleared when finished");
+		}
+		if (d == X_IWM_CCMP) {
+			f.insert(f.begin() + hdrlen, IEEE80211_CCMP_HDRLEN, 0);
+			fill(rng, &f[hdrlen], IEEE80211_CCMP_HDRLEN);
+		}
+		if (on)
+			fw_tx(f, mh * 2 + ipw * 2);
+		if (d == X_IWM_CCMP)
+			f.erase(f.begin() + hdrlen,
+			    f.begin() + hdrlen + IEEE80211_CCMP_HDRLEN);
+		CHECK(f == air, "frame goes out with correct checksums");
+		mbuf_freem(m);
+	}
+	return offloaded;
+}
+
+enum l3_type { L3_NONE, L3_IPV4, L3_IPV4_FRAG, L3_IPV6, L3_ARP };
+
+/* What the receive firmware makes of a frame. */
+struct verdict {
+	enum l3_type		 l3;
+	int			 ipok;	/* IPv4 header checksum */
+	int			 l4ok;	/* TCP/UDP checksum */
+};
+
+enum fw_fail {
+	F_NONE,
+	F_NOVERDICT,	/* nothing reported */
+	F_FALSEBAD	/* a good packet reported bad */
+};
+
+static struct verdict
+fw_rx(const std::vector<uint8_t> &f, size_t l3, enum fw_fail fail)
+{
+	struct verdict v = { L3_NONE, 0, 0 };
+	const uint8_t *ip = &f[l3];
+
+	if (fail == F_NOVERDICT)
+		return v;
+	switch (get16(ip - 2)) {
+	case ETHERTYPE_ARP:
+		v.l3 = L3_ARP;
+		return v;
+	case ETHERTYPE_IP:
+		v.l3 = ip_frag(ip) ? L3_IPV4_FRAG : L3_IPV4;
+		v.ipok = ip_hdr_ok(ip);
+		break;
+	default:
+		v.l3 = L3_IPV6;
+		break;
+	}
+	v.l4ok = v.l3 != L3_IPV4_FRAG && l4_cksum(ip) == 0;
+	if (fail == F_FALSEBAD)
+		v.ipok = v.l4ok = 0;
+	return v;
+}
+
+static uint16_t
+iwx_l3l4(struct verdict v)
+{
+	static const int types[] = { IWX_RX_L3_TYPE_NONE, IWX_RX_L3_TYPE_IPV4,
+	    IWX_RX_L3_TYPE_IPV4_FRAG, IWX_RX_L3_TYPE_IPV6,
+	    IWX_RX_L3_TYPE_ARP };
+
+	return ((types[v.l3] << IWX_RX_L3_PROTO_POS) &
+	    IWX_RX_L3L4_L3_PROTO_MASK) |
+	    (v.ipok ? IWX_RX_L3L4_IP_HDR_CSUM_OK : 0) |
+	    (v.l4ok ? IWX_RX_L3L4_TCP_UDP_CSUM_OK : 0);
+}
+
+static uint16_t
+iwm_l3l4(struct verdict v)
+{
+	static const int types[] = { IWM_RX_L3_TYPE_NONE, IWM_RX_L3_TYPE_IPV4,
+	    IWM_RX_L3_TYPE_IPV4_FRAG, IWM_RX_L3_TYPE_IPV6,
+	    IWM_RX_L3_TYPE_ARP };
+
+	return ((types[v.l3] << IWM_RX_L3_PROTO_POS) &
+	    IWM_RX_L3L4_L3_PROTO_MASK) |
+	    (v.ipok ? IWM_RX_L3L4_IP_HDR_CSUM_OK : 0) |
+	    (v.l4ok ? IWM_RX_L3L4_TCP_UDP_CSUM_OK : 0);
+}
+
+/* The legacy RX status: checked, and good, for whole packets only. */
+static uint32_t
+iwm_status(struct verdict v)
+{
+	uint32_t status = 0;
+
+	if (v.l3 == L3_IPV4 || v.l3 == L3_IPV6) {
+		status |= IWM_RX_MPDU_RES_STATUS_CSUM_DONE;
+		if ((v.l3 == L3_IPV6 || v.ipok) && v.l4ok)
+			status |= IWM_RX_MPDU_RES_STATUS_CSUM_OK;
+	}
+	return status;
+}
+
+/*
+ * The stack's side: checksums the driver marked verified are taken as
+ * they are, the rest are checked in software.  Returns whether the
+ * packet is accepted; *hw is set if the TCP/UDP check was spared.
+ */
+static int
+stack_input(mbuf_t m, size_t l3, int *hw)
+{
+	mbuf_csum_performed_flags_t did;
+	u_int32_t value;
+	std::vector<uint8_t> f = flatten(m);
+	const uint8_t *ip = &f[l3];
+
+	*hw = 0;
+	mbuf_get_csum_performed(m, &did, &value);
+	switch (get16(ip - 2)) {
+	case ETHERTYPE_IP:
+		if (did & MBUF_CSUM_DID_IP) {
+			if (!(did & MBUF_CSUM_IP_GOOD))
+				return 0;
+		} else if (!ip_hdr_ok(ip))
+			return 0;
+		/* reassembly checks the rest */
+		if (ip_frag(ip))
+			return 1;
+		break;
+	case ETHERTYPE_IPV6:
+		break;
+	default:
+		return 1;
+	}
+	if ((did & (MBUF_CSUM_DID_DATA | MBUF_CSUM_PSEUDO_HDR)) ==
+	    (MBUF_CSUM_DID_DATA | MBUF_CSUM_PSEUDO_HDR)) {
+		*hw = 1;
+		return value == 0xffff;
+	}
+	return l4_cksum(ip) == 0;
+}
+
+enum rx_dev {
+	D_IWX, D_AX210, D_IWX_NOCAPA, D_IWM, D_IWM_MQ, D_IWM_NOCAPA,
+	D_NDEVS
+};
+
+static const char *rx_names[D_NDEVS] = {
+	"iwx", "iwx AX210", "iwx no capability", "iwm", "iwm multi-queue",
+	"iwm no capability"
+};
+
+struct rx_result {
+	int			 hw;		/* TCP/UDP verified by hardware */
+	int			 sw;		/* verified in software */
+	int			 dropped;
+};
+
+/*
+ * Receive n frames on one device: IPv4 and IPv6 TCP and UDP packets, now
+ * and then a fragment or an ARP packet, a quarter of them corrupt, a
+ * quarter with a firmware that fails to report.
+ */
+static struct rx_result
+run_rx(std::mt19937 &rng, enum rx_dev d, int n)
+{
+	struct rx_result res = { 0, 0, 0 };
+	struct iwx_softc iwx;
+	struct iwm_softc iwm;
+	struct iwx_rx_mpdu_desc desc;
+	struct verdict v;
+	std::vector<uint8_t> body, f;
+	mbuf_csum_performed_flags_t did;
+	u_int32_t value;
+	size_t hdrlen, l3, off, len;
+	int i, k, v6, proto, frag, qos, amsdu, good, l4ok, hdrok, accept, hw;
+	int reports;
+	enum fw_fail fail;
+	uint16_t type;
+	mbuf_t m;
+
+	memset(&iwx, 0, sizeof(iwx));
+	memset(&iwm, 0, sizeof(iwm));
+	if (d == D_AX210)
+		iwx.sc_device_family = IWX_DEVICE_FAMILY_AX210;
+	if (d != D_IWX_NOCAPA)
+		setbit(iwx.sc_enabled_capa, IWX_UCODE_TLV_CAPA_CSUM_SUPPORT);
+	if (d != D_IWM_NOCAPA)
+		setbit(iwm.sc_enabled_capa, IWM_UCODE_TLV_CAPA_CSUM_SUPPORT);
+
+	for (i = 0; i < n; i++) {
+		k = rng() % 32;
+		v6 = rng() % 2;
+		proto = rng() % 2 ? IPPROTO_TCP : IPPROTO_UDP;
+		frag = k == 1 || k == 2;
+		if (k == 0) {
+			body.resize(28);
+			fill(rng, body.data(), body.size());
+			type = ETHERTYPE_ARP;
+		} else {
+			body = build_ip(rng, v6 && !frag, proto, frag);
+			type = v6 && !frag ? ETHERTYPE_IPV6 : ETHERTYPE_IP;
+			switch (rng() % 8) {
+			case 0:
+			case 1:
+				/* any byte of the transport header or payload */
+				l4_span(body.data(), &off, &len, &proto);
+				body[off + rng() % len] ^= 1 + rng() % 255;
+				break;
+			case 2:
+				/* the IPv4 TTL, outside the pseudo-header */
+				if (type == ETHERTYPE_IP)
+					body[8] ^= 1 + rng() % 255;
+				break;
+			}
+		}
+		qos = rng() % 2;
+		amsdu = qos && rng() % 8 == 0;
+		f = build_frame(rng, qos, amsdu, type, body, &hdrlen);
+		l3 = hdrlen + LLC_SNAPFRAMELEN;
+
+		hdrok = type != ETHERTYPE_IP || ip_hdr_ok(&f[l3]);
+		l4ok = type == ETHERTYPE_ARP || frag || l4_cksum(&f[l3]) == 0;
+		good = hdrok && l4ok;
+
+		k = rng() % 8;
+		fail = k == 0 ? F_NOVERDICT : k == 1 ? F_FALSEBAD : F_NONE;
+		v = fw_rx(f, l3, fail);
+
+		m = NULL;
+		mbuf_gethdr(MBUF_WAITOK, MBUF_TYPE_DATA, &m);
+		mbuf_mclget(MBUF_WAITOK, MBUF_TYPE_DATA, &m);
+		memcpy(mbuf_data(m), f.data(), f.size());
+		mbuf_setlen(m, f.size());
+		mbuf_pkthdr_setlen(m, f.size());
+
+		switch (d) {
+		case D_IWX:
+		case D_AX210:
+		case D_IWX_NOCAPA:
+			desc.l3l4_flags = htole16(iwx_l3l4(v));
+			iwx_rx_csum(&iwx, m, &desc);
+			reports = d == D_IWX;
+			break;
+		case D_IWM_MQ:
+			iwm_rx_csum_mq(&iwm, m, iwm_l3l4(v));
+			reports = 1;
+			break;
+		default:
+			iwm_rx_csum(&iwm, m, iwm_status(v));
+			reports = d == D_IWM && !amsdu;
+			break;
+		}
+
+		mbuf_get_csum_performed(m, &did, &value);
+		accept = stack_input(m, l3, &hw);
+		CHECK(accept == good, "accepted or dropped on the contents");
+		if (!l4ok)
+			CHECK(!(did & MBUF_CSUM_DID_DATA),
+			    "corrupt TCP/UDP never marked good");
+		if (!hdrok)
+			CHECK(!(did & MBUF_CSUM_IP_GOOD),
+			    "corrupt IPv4 header never marked good");
+		if (!reports || fail != F_NONE ||
+		    (v.l3 != L3_IPV4 && v.l3 != L3_IPV6))
+			CHECK(did == 0, "no verdict, no flags");
+		else if (good)
+			CHECK((did & (MBUF_CSUM_DID_DATA |
+			    MBUF_CSUM_PSEUDO_HDR)) == (MBUF_CSUM_DID_DATA |
+			    MBUF_CSUM_PSEUDO_HDR) && value == 0xffff &&
+			    (v.l3 == L3_IPV6 || (did & (MBUF_CSUM_DID_IP |
+			    MBUF_CSUM_IP_GOOD)) == (MBUF_CSUM_DID_IP |
+			    MBUF_CSUM_IP_GOOD)),
+			    "firmware verdicts passed on");
+		if (!accept)
+			res.dropped++;
+		else if (hw)
+			res.hw++;
+		else if (type != ETHERTYPE_ARP && !frag)
+			res.sw++;
+		mbuf_freem(m);
+	}
+	return res;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: csumsim [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	std::mt19937 rng(21);
+	struct rx_result r;
+	int ch, c, d, n = 20000, off[X_NDRVS];
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			n = 2000;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	printf("%-24s %8s %8s %8s\n", "TX offloaded", "iwx", "iwm", "iwm CCMP");
+	for (c = 0; c < T_NCASES; c++) {
+		for (d = 0; d < X_NDRVS; d++)
+			off[d] = run_tx(rng, (enum tx_case)c, (enum tx_drv)d, n);
+		printf("%-24s %8d %8d %8d\n", tx_names[c], off[X_IWX],
+		    off[X_IWM], off[X_IWM_CCMP]);
+	}
+
+	printf("%-24s %8s %8s %8s\n", "RX", "hw", "sw", "dropped");
+	for (d = 0; d < D_NDEVS; d++) {
+		r = run_rx(rng, (enum rx_dev)d, n);
+		printf("%-24s %8d %8d %8d\n", rx_names[d], r.hw, r.sw,
+		    r.dropped);
+		if (d == D_IWX || d == D_IWM || d == D_IWM_MQ)
+			CHECK(r.hw > r.sw, "most packets verified by hardware");
+		else
+			CHECK(r.hw == 0, "nothing verified by hardware");
+		CHECK(r.dropped > 0, "corrupt packets dropped");
+	}
+
+	printf("csumsim: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
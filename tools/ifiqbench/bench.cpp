@@ -0,0 +1,439 @@
+/*
+ * ifiqbench: the RX handoff ring between the drivers and the delivery
+ * task, run on the host with one producer and the real taskq.
+ *
+ * struct ifiqueue is extracted from sys/_if_ether.h, and the producer
+ * (_if_input()), the delivery task (ifiq_deliver()), ifiq_init() and
+ * ifiq_destroy() from sys/_mbuf.cpp, at build time (see tools/Makefile).
+ * The taskq is sys/_task.cpp on the pthread shim.  The main thread plays
+ * the RX notification path holding the command gate: it hands batches of
+ * numbered frames to _if_input().  A model interface takes them from the
+ * delivery task and checks that they arrive in order, each at most once.
+ *
+ * Frames arrive in batches at a fixed rate, or as fast as the producer
+ * can go.  The stack either keeps up or spends time on every frame, so
+ * that the ring fills and the producer drops.  Each load is also run
+ * inline, as if_input() delivered before the ring, to compare how long
+ * the gate is held per frame.  Delivery latency is from the batch being
+ * handed over to the frame reaching the stack.  The tool checks that every frame is either delivered or counted as dropped,
+ * that a batch with drops returns kIOReturnOutputDropped, and that
+ * ifiq_destroy() frees what is still queued.  Exits non-zero on failure.
+ */
+#include <atomic>
+#include <vector>
+
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/param.h>
+#include <sys/_task.h>
+#include <IOKit/IOReturn.h>
+#include <libkern/c++/OSObject.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+typedef uint32_t UInt32;
+
+#ifndef IPL_NET
+#define IPL_NET		6
+#endif
+
+#define OSMemoryBarrier()		__sync_synchronize()
+#define OSCompareAndSwap(o, n, p)	__sync_bool_compare_and_swap((p), (o), (n))
+#define IOSleep(ms)			usleep((ms) * 1000)
+
+/* A frame is only its sequence number; the list links are the mbuf's. */
+struct pkt {
+	uint64_t		 seq;
+	uint64_t		 t;		/* handed to _if_input() */
+	struct pkt		*nextpkt;
+};
+typedef struct pkt *mbuf_t;
+
+static std::atomic<uint64_t> nfreed;
+
+static mbuf_t
+mbuf_nextpkt(mbuf_t m)
+{
+	return m->nextpkt;
+}
+
+static void
+mbuf_freem(mbuf_t m)
+{
+	(void)m;
+	nfreed++;
+}
+
+/* The mbuf list helpers from sys/_mbuf.h. */
+struct mbuf_list {
+	mbuf_t			 ml_head;
+	mbuf_t			 ml_tail;
+	u_int			 ml_len;
+};
+
+#define MBUF_LIST_FOREACH(_ml, _m)					\
+	for ((_m) = (_ml)->ml_head; (_m) != NULL; (_m) = mbuf_nextpkt(_m))
+
+static void
+ml_init(struct mbuf_list *ml)
+{
+	ml->ml_head = ml->ml_tail = NULL;
+	ml->ml_len = 0;
+}
+
+static void
+ml_enqueue(struct mbuf_list *ml, mbuf_t m)
+{
+	m->nextpkt = NULL;
+	if (ml->ml_tail == NULL)
+		ml->ml_head = ml->ml_tail = m;
+	else {
+		ml->ml_tail->nextpkt = m;
+		ml->ml_tail = m;
+	}
+	ml->ml_len++;
+}
+
+static mbuf_t
+ml_dequeue(struct mbuf_list *ml)
+{
+	mbuf_t m;
+
+	m = ml->ml_head;
+	if (m != NULL) {
+		ml->ml_head = m->nextpkt;
+		if (ml->ml_head == NULL)
+			ml->ml_tail = NULL;
+		m->nextpkt = NULL;
+		ml->ml_len--;
+	}
+	return m;
+}
+
+#include "ifiq.h"
+
+/*
+ * The network stack.  inputPacket() checks the order and may spend time
+ * on each frame; when hold is set it waits for the ring to be torn down.
+ */
+struct stack {
+	uint64_t		 spin_ns;
+	int			 hold;
+	std::atomic<int>	 holding;
+	uint64_t		 next;		/* lowest seq still expected */
+	std::atomic<uint64_t>	 delivered;
+	uint64_t		 flushes;
+	int			 disorder;
+	uint64_t		 lat_sum;
+	uint64_t		 lat_max;
+};
+
+static struct stack stack;
+static struct _ifnet *held_ifp;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+class IONetworkInterface {
+public:
+	enum {
+		kInputOptionQueuePacket	= 0x1,
+	};
+};
+
+class IOEthernetInterface : public IONetworkInterface {
+public:
+	void	inputPacket(mbuf_t, UInt32, UInt32);
+	void	flushInputQueue(void);
+};
+
+struct IONetworkStats {
+	UInt32			 inputPackets;
+};
+
+/* The _ifnet fields the extracted code uses, as in sys/_if_ether.h. */
+struct _ifnet {
+	IOEthernetInterface	*iface;
+	IONetworkStats		*netStat;
+	uint32_t		 if_ierrors;
+	struct ifiqueue		 if_rcv;
+};
+
+void
+IOEthernetInterface::inputPacket(mbuf_t m, UInt32 len, UInt32 options)
+{
+	uint64_t t;
+
+	(void)len;
+	if (stack.hold) {
+		stack.holding = 1;
+		while (!held_ifp->if_rcv.ifiq_dying)
+			sched_yield();
+	}
+	if (m->seq < stack.next)
+		stack.disorder++;
+	stack.next = m->seq + 1;
+	t = now_ns();
+	stack.lat_sum += t - m->t;
+	stack.lat_max = MAX(stack.lat_max, t - m->t);
+	if (stack.spin_ns) {
+		t += stack.spin_ns;
+		while (now_ns() < t)
+			;
+	}
+	stack.delivered++;
+}
+
+void
+IOEthernetInterface::flushInputQueue(void)
+{
+	stack.flushes++;
+}
+
+#include "ifiq.inc"
+
+/* Wait, politely, until cond() holds or ten seconds have passed. */
+template <typename F>
+static bool
+wait_for(F cond)
+{
+	uint64_t deadline = now_ns() + 10000000000ULL;
+
+	while (!cond()) {
+		if (now_ns() > deadline)
+			return false;
+		sched_yield();
+	}
+	return true;
+}
+
+struct load {
+	const char		*name;
+	int			 batch;		/* frames per _if_input() */
+	uint64_t		 gap_ns;	/* between frames, 0 to flood */
+	uint64_t		 spin_ns;	/* stack time per frame */
+};
+
+struct result {
+	double			 gate_ns;	/* in _if_input() per frame */
+	double			 mfps;		/* frames delivered per us */
+	double			 per_flush;
+	double			 lat_us;
+	double			 lat_max_us;
+	double			 drop_pct;
+};
+
+static void
+stack_reset(uint64_t spin_ns)
+{
+	stack.spin_ns = spin_ns;
+	stack.hold = 0;
+	stack.holding = 0;
+	stack.next = 0;
+	stack.delivered = 0;
+	stack.flushes = 0;
+	stack.disorder = 0;
+	stack.lat_sum = stack.lat_max = 0;
+	nfreed = 0;
+}
+
+/*
+ * Hand the frames to _if_input() as the load says.  With ring unset the
+ * interface has no delivery task and the frames go up inline.
+ */
+static struct result
+run(std::vector<struct pkt> &pkts, const struct load *l, int ring)
+{
+	static IOEthernetInterface iface;
+	static IONetworkStats stats;
+	static struct _ifnet ifp;
+	struct ifiqueue *ifiq = &ifp.if_rcv;
+	struct mbuf_list ml;
+	struct result res;
+	uint64_t n = pkts.size(), seq, t0, t1, gate = 0, drops;
+	IOReturn rv;
+	int j;
+
+	memset(&ifp, 0, sizeof(ifp));
+	memset(&stats, 0, sizeof(stats));
+	ifp.iface = &iface;
+	ifp.netStat = &stats;
+	if (ring)
+		CHECK(ifiq_init(&ifp) == 0, "ifiq_init");
+	stack_reset(l->spin_ns);
+
+	t0 = now_ns();
+	for (seq = 0; seq < n;) {
+		/*
+		 * Wait for the last frame of the batch to arrive, yielding
+		 * so that the delivery task runs even on one CPU.
+		 */
+		while ((t1 = now_ns()) < t0 + (seq + l->batch) * l->gap_ns)
+			sched_yield();
+		ml_init(&ml);
+		for (j = 0; j < l->batch && seq < n; j++, seq++) {
+			pkts[seq].seq = seq;
+			pkts[seq].t = t1;
+			ml_enqueue(&ml, &pkts[seq]);
+		}
+		drops = ifiq->ifiq_qdrops;
+		rv = _if_input(NULL, &ifp, &ml, NULL, NULL);
+		gate += now_ns() - t1;
+		CHECK(rv == (ifiq->ifiq_qdrops != drops ?
+		    kIOReturnOutputDropped : kIOReturnSuccess),
+		    "drops reported to the caller");
+		CHECK(!ring || ml.ml_len == 0, "the ring takes the list");
+	}
+	CHECK(wait_for([&] {
+		return stack.delivered + ifiq->ifiq_qdrops == n;
+	}), "every frame delivered or dropped");
+	t1 = now_ns();
+	CHECK(wait_for([&] { return ifiq->ifiq_sched == 0; }),
+	    "the delivery task goes idle");
+
+	res.gate_ns = (double)gate / n;
+	res.mfps = (double)stack.delivered / (t1 - t0) * 1000;
+	res.per_flush = stack.flushes ?
+	    (double)stack.delivered / stack.flushes : 0;
+	res.lat_us = stack.delivered ?
+	    (double)stack.lat_sum / stack.delivered / 1000 : 0;
+	res.lat_max_us = stack.lat_max / 1000.0;
+	res.drop_pct = 100.0 * ifiq->ifiq_qdrops / n;
+
+	CHECK(stack.disorder == 0, "frames arrive in order");
+	CHECK(nfreed == ifiq->ifiq_qdrops, "dropped frames are freed");
+	CHECK(ifp.if_ierrors == ifiq->ifiq_qdrops, "drops counted as ierrors");
+	CHECK(stats.inputPackets == stack.delivered, "inputPackets");
+	if (ring) {
+		CHECK(ifiq->ifiq_packets == stack.delivered, "ifiq_packets");
+		CHECK(ifiq->ifiq_batches == stack.flushes, "ifiq_batches");
+		CHECK(ifiq->ifiq_hiwat <= IFIQ_SLOTS,
+		    "high water within the ring");
+		ifiq_destroy(&ifp);
+		CHECK(ifiq->ifiq_tq == NULL, "ifiq_destroy");
+	} else
+		CHECK(stack.flushes == (n + l->batch - 1) / l->batch,
+		    "one flush per inline batch");
+	return res;
+}
+
+/*
+ * Tear the ring down while the stack is stuck on its first frame and the
+ * rest are still queued: the delivery task frees them on its way out and
+ * later batches are dropped.
+ */
+static void
+teardown(void)
+{
+	static IOEthernetInterface iface;
+	static struct _ifnet ifp;
+	std::vector<struct pkt> pkts(IFIQ_SLOTS / 2);
+	struct ifiqueue *ifiq = &ifp.if_rcv;
+	struct mbuf_list ml;
+	size_t i;
+
+	memset(&ifp, 0, sizeof(ifp));
+	ifp.iface = &iface;
+	CHECK(ifiq_init(&ifp) == 0, "ifiq_init");
+	stack_reset(0);
+	stack.hold = 1;
+	held_ifp = &ifp;
+
+	ml_init(&ml);
+	for (i = 0; i < pkts.size(); i++) {
+		pkts[i].seq = i;
+		ml_enqueue(&ml, &pkts[i]);
+	}
+	CHECK(_if_input(NULL, &ifp, &ml, NULL, NULL) == kIOReturnSuccess,
+	    "the batch fits");
+	CHECK(wait_for([&] { return stack.holding != 0; }),
+	    "the delivery task takes the batch");
+	ifiq_destroy(&ifp);
+
+	CHECK(stack.delivered == 1, "only the held frame is delivered");
+	CHECK(nfreed == pkts.size() - 1, "ifiq_destroy frees the rest");
+	CHECK(ifiq->ifiq_cons == ifiq->ifiq_prod, "the ring is empty");
+
+	ml_init(&ml);
+	ml_enqueue(&ml, &pkts[0]);
+	CHECK(_if_input(NULL, &ifp, &ml, NULL, NULL) == kIOReturnSuccess,
+	    "inline after ifiq_destroy");
+	CHECK(stack.delivered == 2, "inline delivery");
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: ifiqbench [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct load loads[] = {
+		{ "1 per 1us",		1,	1000,	0 },
+		{ "8 per 8us",		8,	1000,	0 },
+		{ "32 per 32us",	32,	1000,	0 },
+		{ "32 per 8us",		32,	250,	0 },
+		{ "32 per 32us, slow",	32,	1000,	500 },
+		{ "32 per 8us, slow",	32,	250,	500 },
+		{ "flood, 1",		1,	0,	0 },
+		{ "flood, 64",		64,	0,	0 },
+	};
+	struct result a, b;
+	int quick = 0, ch;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	std::vector<struct pkt> pkts(quick ? 20000 : 500000);
+
+	teardown();
+
+	printf("%-24s %9s %9s %9s %8s %8s %8s %7s\n", "", "inline ns",
+	    "gate ns", "Mframe/s", "f/flush", "lat us", "max us", "drop %");
+	for (i = 0; i < nitems(loads); i++) {
+		const struct load *l = &loads[i];
+
+		a = run(pkts, l, 0);
+		b = run(pkts, l, 1);
+		printf("%-24s %9.1f %9.1f %9.2f %8.1f %8.1f %8.1f %7.2f\n",
+		    l->name, a.gate_ns, b.gate_ns, b.mfps, b.per_flush,
+		    b.lat_us, b.lat_max_us, b.drop_pct);
+		if (l->spin_ns)
+			CHECK(b.gate_ns < a.gate_ns,
+			    "the ring holds the gate for less time");
+	}
+
+	printf("ifiqbench: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
@@ -0,0 +1,398 @@
+/*
+ * nodehash: the MAC address index net80211 keeps in front of ic_tree,
+ * checked against a reference map and timed against the tree walk.
+ *
+ * ieee80211_find_node(), the hash function, the table insert and remove,
+ * the tree comparison and the table sizing from ieee80211_node_attach()
+ * are extracted from ieee80211_node.c at build time (see tools/Makefile).
+ * The model adds and frees nodes the way ieee80211_setup_node() and
+ * ieee80211_free_node() do: into the tree and then the table, out of the
+ * table and then the tree.
+ *
+ * Random adds, frees and lookups run for 1 to 1000 nodes, with the table
+ * sized for each count.  MAC addresses are either random or from a single
+ * OUI with sequential device parts, as a busy scan sees them.  Every lookup
+ * must agree with a reference map, every node must be in the table, and
+ * the table must never be more than half full.
+ *
+ * It reports lookups per second through ieee80211_find_node() for the
+ * tree walk, which is what runs when the table could not be allocated;
+ * for the table with random addresses; for repeated lookups of one
+ * address, which the last-hit cache answers; and for addresses that are
+ * not there.  It also reports the mean and longest probe run.
+ * Exits non-zero on failure.
+ */
+#include <map>
+#include <random>
+#include <vector>
+
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/param.h>
+#include <sys/tree.h>
+#include <IOKit/IOLib.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+/* As in ieee80211.h and ieee80211_var.h. */
+#define IEEE80211_ADDR_LEN	6
+#define IEEE80211_ADDR_EQ(a1,a2)	(memcmp(a1,a2,IEEE80211_ADDR_LEN) == 0)
+
+/* The node and ieee80211com fields the extracted code uses. */
+struct ieee80211_node {
+	RB_ENTRY(ieee80211_node) ni_node;
+	u_int8_t		 ni_macaddr[IEEE80211_ADDR_LEN];
+};
+
+RB_HEAD(ieee80211_tree, ieee80211_node);
+
+struct ieee80211com {
+	struct ieee80211_tree	 ic_tree;
+	int			 ic_nnodes;
+	int			 ic_max_nnodes;
+	struct ieee80211_node	**ic_node_hash;
+	u_int			 ic_node_hashbits;
+	struct ieee80211_node	*ic_node_last;
+};
+
+static void *
+_MallocZero(size_t size)
+{
+	return calloc(1, size);
+}
+
+RB_PROTOTYPE(ieee80211_tree, ieee80211_node, ni_node, ieee80211_node_cmp);
+
+#include "node_hash.inc"
+
+RB_GENERATE(ieee80211_tree, ieee80211_node, ni_node, ieee80211_node_cmp);
+
+typedef std::map<uint64_t, struct ieee80211_node *> refmap;
+
+static uint64_t
+mac_key(const u_int8_t *mac)
+{
+	uint64_t k = 0;
+	int i;
+
+	for (i = 0; i < IEEE80211_ADDR_LEN; i++)
+		k = k << 8 | mac[i];
+	return k;
+}
+
+static void
+mac_make(u_int8_t *mac, std::mt19937_64 &rng, int oui, uint32_t *seq)
+{
+	uint64_t r = rng();
+	int i;
+
+	if (oui) {
+		/* one vendor, device parts handed out in order */
+		mac[0] = 0x00;
+		mac[1] = 0x1b;
+		mac[2] = 0x63;
+		r = (*seq)++;
+		for (i = 5; i >= 3; i--, r >>= 8)
+			mac[i] = r & 0xff;
+		return;
+	}
+	for (i = 0; i < IEEE80211_ADDR_LEN; i++, r >>= 8)
+		mac[i] = r & 0xff;
+	mac[0] &= ~1;		/* unicast */
+}
+
+static void
+ic_init(struct ieee80211com *ic, int max_nnodes, int hashed)
+{
+	memset(ic, 0, sizeof(*ic));
+	RB_INIT(&ic->ic_tree);
+	ic->ic_max_nnodes = max_nnodes;
+	node_hash_attach(ic);
+	if (!hashed) {
+		free(ic->ic_node_hash);
+		ic->ic_node_hash = NULL;
+	}
+}
+
+/* As ieee80211_setup_node() does. */
+static void
+node_add(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+	if (RB_INSERT(ieee80211_tree, &ic->ic_tree, ni) == NULL)
+		ieee80211_node_hash_insert(ic, ni);
+	ic->ic_nnodes++;
+}
+
+/* As ieee80211_free_node() does. */
+static void
+node_free(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+	ieee80211_node_hash_remove(ic, ni);
+	RB_REMOVE(ieee80211_tree, &ic->ic_tree, ni);
+	ic->ic_nnodes--;
+	free(ni);
+}
+
+static void
+ic_destroy(struct ieee80211com *ic)
+{
+	struct ieee80211_node *ni;
+
+	while ((ni = RB_MIN(ieee80211_tree, &ic->ic_tree)) != NULL)
+		node_free(ic, ni);
+	free(ic->ic_node_hash);
+}
+
+/* Probe run lengths, and whether every node is found where it should be. */
+static void
+table_check(struct ieee80211com *ic, double *mean, u_int *longest)
+{
+	struct ieee80211_node *ni;
+	u_int i, home, dist, mask, used = 0;
+	uint64_t total = 0;
+
+	mask = (1U << ic->ic_node_hashbits) - 1;
+	*longest = 0;
+	for (i = 0; i <= mask; i++) {
+		if ((ni = ic->ic_node_hash[i]) == NULL)
+			continue;
+		used++;
+		home = ieee80211_node_hash(ic, ni->ni_macaddr);
+		dist = (i - home) & mask;
+		total += dist + 1;
+		*longest = MAX(*longest, dist + 1);
+		/* no hole between a node and its home slot */
+		while (home != i && ic->ic_node_hash[home] != NULL)
+			home = (home + 1) & mask;
+		CHECK(home == i, "probe run unbroken");
+	}
+	CHECK(used == (u_int)ic->ic_nnodes, "every node in the table");
+	CHECK(2 * used <= mask + 1, "table at most half full");
+	*mean = used ? (double)total / used : 0;
+}
+
+/*
+ * Random adds, frees and lookups around n nodes, compared with a map,
+ * with lookups done with and without the table.
+ */
+static void
+torture(int n, int oui, int nops, std::mt19937_64 &rng)
+{
+	struct ieee80211com ic, tic;
+	struct ieee80211_node *ni, *tni;
+	std::vector<uint64_t> keys;
+	u_int8_t mac[IEEE80211_ADDR_LEN];
+	uint32_t seq = 0;
+	refmap ref;
+	double mean;
+	u_int longest;
+	int op, bad = 0;
+
+	ic_init(&ic, n, 1);
+	ic_init(&tic, n, 0);
+	for (op = 0; op < nops; op++) {
+		int r = rng() % 8;
+
+		if (r < 3 && (int)ref.size() < n) {
+			mac_make(mac, rng, oui, &seq);
+			if (ref.count(mac_key(mac)))
+				continue;
+			ni = (struct ieee80211_node *)calloc(1, sizeof(*ni));
+			tni = (struct ieee80211_node *)calloc(1, sizeof(*tni));
+			memcpy(ni->ni_macaddr, mac, sizeof(mac));
+			memcpy(tni->ni_macaddr, mac, sizeof(mac));
+			node_add(&ic, ni);
+			node_add(&tic, tni);
+			ref[mac_key(mac)] = ni;
+			keys.push_back(mac_key(mac));
+		} else if (r < 5 && !keys.empty()) {
+			size_t k = rng() % keys.size();
+
+			ni = ref[keys[k]];
+			tni = ieee80211_find_node(&tic, ni->ni_macaddr);
+			ref.erase(keys[k]);
+			keys[k] = keys.back();
+			keys.pop_back();
+			node_free(&ic, ni);
+			node_free(&tic, tni);
+		} else {
+			/* a known address, a freed one, or one never seen */
+			if (!keys.empty() && rng() % 4 != 0) {
+				uint64_t k = keys[rng() % keys.size()];
+				int i;
+
+				for (i = IEEE80211_ADDR_LEN - 1; i >= 0; i--, k >>= 8)
+					mac[i] = k & 0xff;
+			} else
+				mac_make(mac, rng, oui, &seq);
+			refmap::iterator it = ref.find(mac_key(mac));
+			ni = ieee80211_find_node(&ic, mac);
+			tni = ieee80211_find_node(&tic, mac);
+			if (it == ref.end())
+				bad += ni != NULL || tni != NULL;
+			else
+				bad += ni != it->second || tni == NULL ||
+				    !IEEE80211_ADDR_EQ(tni->ni_macaddr, mac);
+		}
+	}
+	CHECK(bad == 0, "lookups match the reference");
+	table_check(&ic, &mean, &longest);
+	ic_destroy(&ic);
+	ic_destroy(&tic);
+}
+
+static uint64_t
+wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define NPROBE	4096		/* lookup addresses, cycled through */
+
+/* Lookups per second through ieee80211_find_node(), in millions. */
+static double
+time_lookups(struct ieee80211com *ic, const u_int8_t (*macs)[IEEE80211_ADDR_LEN],
+    int nlookups, int *found)
+{
+	uint64_t t0, t1;
+	int i;
+
+	*found = 0;
+	t0 = wall_ns();
+	for (i = 0; i < nlookups; i++)
+		*found += ieee80211_find_node(ic, macs[i & (NPROBE - 1)]) != NULL;
+	t1 = wall_ns();
+	return nlookups / ((t1 - t0) / 1e9) / 1e6;
+}
+
+struct result {
+	double			 tree;		/* M lookups/s, tree walk */
+	double			 hash;		/* M lookups/s, table */
+	double			 last;		/* M lookups/s, one address */
+	double			 miss;		/* M lookups/s, not there */
+	double			 mean;		/* probe run */
+	u_int			 longest;
+};
+
+static struct result
+bench(int n, int oui, int nlookups, std::mt19937_64 &rng)
+{
+	static u_int8_t hit[NPROBE][IEEE80211_ADDR_LEN];
+	static u_int8_t same[NPROBE][IEEE80211_ADDR_LEN];
+	static u_int8_t miss[NPROBE][IEEE80211_ADDR_LEN];
+	struct ieee80211com ic, tic;
+	struct ieee80211_node *ni;
+	std::vector<struct ieee80211_node *> nodes;
+	struct result res;
+	uint32_t seq = 0;
+	int i, found;
+
+	ic_init(&ic, n, 1);
+	ic_init(&tic, n, 0);
+	while ((int)nodes.size() < n) {
+		ni = (struct ieee80211_node *)calloc(1, sizeof(*ni));
+		mac_make(ni->ni_macaddr, rng, oui, &seq);
+		if (ieee80211_find_node(&ic, ni->ni_macaddr) != NULL) {
+			free(ni);
+			continue;
+		}
+		node_add(&ic, ni);
+		nodes.push_back(ni);
+		ni = (struct ieee80211_node *)calloc(1, sizeof(*ni));
+		memcpy(ni->ni_macaddr, nodes.back()->ni_macaddr,
+		    IEEE80211_ADDR_LEN);
+		node_add(&tic, ni);
+	}
+	for (i = 0; i < NPROBE; i++) {
+		memcpy(hit[i], nodes[rng() % n]->ni_macaddr, IEEE80211_ADDR_LEN);
+		memcpy(same[i], nodes[0]->ni_macaddr, IEEE80211_ADDR_LEN);
+		do
+			mac_make(miss[i], rng, 0, &seq);
+		while (ieee80211_find_node(&ic, miss[i]) != NULL);
+	}
+
+	res.tree = time_lookups(&tic, hit, nlookups, &found);
+	CHECK(found == nlookups, "tree walk finds every node");
+	res.hash = time_lookups(&ic, hit, nlookups, &found);
+	CHECK(found == nlookups, "table finds every node");
+	res.last = time_lookups(&ic, same, nlookups, &found);
+	CHECK(found == nlookups && ic.ic_node_last == nodes[0],
+	    "last hit cached");
+	res.miss = time_lookups(&ic, miss, nlookups, &found);
+	CHECK(found == 0, "unknown addresses not found");
+	table_check(&ic, &res.mean, &res.longest);
+
+	ic_destroy(&ic);
+	ic_destroy(&tic);
+	return res;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: nodehash [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int counts[] = { 1, 10, 100, 200, 500, 1000 };
+	std::mt19937_64 rng(1);
+	struct ieee80211com ic;
+	struct result r;
+	int quick = 0, ch, nops, nlookups, oui;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	nops = quick ? 20000 : 200000;
+	nlookups = quick ? 200000 : 10000000;
+
+	/* the size ieee80211_node_attach() picks for the kext */
+	ic_init(&ic, IEEE80211_CACHE_SIZE, 1);
+	printf("%d nodes: %u slots\n\n", IEEE80211_CACHE_SIZE,
+	    1U << ic.ic_node_hashbits);
+	ic_destroy(&ic);
+
+	printf("%-24s %9s %9s %9s %9s %7s %7s\n", "", "tree M/s", "hash M/s",
+	    "last M/s", "miss M/s", "probes", "longest");
+	for (oui = 0; oui < 2; oui++) {
+		for (i = 0; i < nitems(counts); i++) {
+			char label[32];
+
+			torture(counts[i], oui, nops, rng);
+			r = bench(counts[i], oui, nlookups, rng);
+			snprintf(label, sizeof(label), "%d nodes%s", counts[i],
+			    oui ? ", one OUI" : "");
+			printf("%-24s %9.1f %9.1f %9.1f %9.1f %7.2f %7u\n",
+			    label, r.tree, r.hash, r.last, r.miss, r.mean,
+			    r.longest);
+		}
+	}
+
+	printf("nodehash: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
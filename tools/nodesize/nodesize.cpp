@@ -0,0 +1,147 @@
+/*
+ * nodesize: what a cached BSS costs, before and after the per-node verb[]
+ * scan result buffer was removed and the node timeouts made lazy.
+ *
+ * struct ieee80211_node, with the structures it embeds, is extracted from
+ * ieee80211_node.h at build time as struct node_layout.  The layout before
+ * is the same structure with the 0x1024 byte verb[] buffer put back at its
+ * end, where it was (see tools/Makefile).  Before, ieee80211_setup_node()
+ * also created six CTimeout objects per node: the EAPOL and SA Query
+ * timeouts and one ADDBA request timer per access category.  The tool
+ * runs the extracted ieee80211_node_set_timeouts() on a node and checks
+ * that it creates none now, that it leaves every timer pointer NULL and
+ * that it writes nothing but the timers and the ADDBA request intervals.
+ *
+ * There is no hashed scan table: BSS selection and both scan exporters
+ * walk ic_tree, so each cached BSS still holds a whole node, and the
+ * saving per node is what the table reports.
+ * Exits non-zero on failure.
+ */
+#include <stddef.h>
+
+#include <sys/tree.h>
+#include <IOKit/IOLocks.h>
+#include <sys/CTimeout.hpp>
+#include <net80211/ieee80211_var.h>
+
+#include "node_layout.h"
+
+/* The kext's OSObject carries a retain count next to its vtable. */
+#define KEXT_OSOBJECT_SIZE	16
+#define TIMEOUT_SIZE	(sizeof(CTimeout) - sizeof(OSObject) + KEXT_OSOBJECT_SIZE)
+#define OLD_TIMEOUTS	6
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+static int timeouts_created;
+
+#define timeout_set(to, fn, arg)	(timeouts_created++)
+
+/* The kext builds the AP side, which owns the EAPOL and SA Query timers. */
+#undef IEEE80211_STA_ONLY
+#include "node_timeouts.inc"
+
+/* Is byte off of the node one that ieee80211_node_set_timeouts() owns? */
+static int
+timer_byte(size_t off)
+{
+	static const struct {
+		size_t	 off;
+		size_t	 len;
+	} fields[] = {
+		{ offsetof(struct node_layout, ni_eapol_to),
+		    sizeof(((struct node_layout *)0)->ni_eapol_to) },
+		{ offsetof(struct node_layout, ni_sa_query_to),
+		    sizeof(((struct node_layout *)0)->ni_sa_query_to) },
+		{ offsetof(struct node_layout, ni_addba_req_to),
+		    sizeof(((struct node_layout *)0)->ni_addba_req_to) },
+		{ offsetof(struct node_layout, ni_addba_req_intval),
+		    sizeof(((struct node_layout *)0)->ni_addba_req_intval) },
+	};
+	size_t i;
+
+	for (i = 0; i < nitems(fields); i++)
+		if (off >= fields[i].off && off < fields[i].off + fields[i].len)
+			return 1;
+	return 0;
+}
+
+static void
+check_set_timeouts(void)
+{
+	static struct node_layout ni, orig;
+	const uint8_t *a = (const uint8_t *)&ni, *b = (const uint8_t *)&orig;
+	size_t off, stray = 0;
+	int i;
+
+	memset(&ni, 0xa5, sizeof(ni));
+	orig = ni;
+	timeouts_created = 0;
+	ieee80211_node_set_timeouts(&ni);
+
+	CHECK(timeouts_created == 0, "no timeout created per node");
+	CHECK(ni.ni_eapol_to == NULL && ni.ni_sa_query_to == NULL,
+	    "EAPOL and SA Query timeouts left unset");
+	for (i = 0; i < IEEE80211_NUM_TID; i++) {
+		CHECK(ni.ni_addba_req_to[i] == NULL,
+		    "ADDBA request timers left unset");
+		CHECK(ni.ni_addba_req_intval[i] == 1,
+		    "ADDBA request intervals reset");
+	}
+	for (off = 0; off < sizeof(ni); off++)
+		if (!timer_byte(off) && a[off] != b[off])
+			stray++;
+	CHECK(stray == 0, "only the timer fields written");
+	if (stray)
+		printf("ieee80211_node_set_timeouts() wrote %zu other bytes\n",
+		    stray);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int counts[] = { 100, 500, 1000 };
+	size_t before, after, node_before, node_after;
+	size_t i;
+
+	if (argc != 1) {
+		fprintf(stderr, "usage: nodesize\n");
+		exit(2);
+	}
+
+	check_set_timeouts();
+
+	node_before = sizeof(struct node_layout_old);
+	node_after = sizeof(struct node_layout);
+	before = node_before + OLD_TIMEOUTS * TIMEOUT_SIZE;
+	after = node_after + timeouts_created * TIMEOUT_SIZE;
+
+	printf("%-24s %10s %10s %10s\n", "", "before", "after", "saved");
+	printf("%-24s %10zu %10zu %10zu\n", "node bytes", node_before,
+	    node_after, node_before - node_after);
+	printf("%-24s %10d %10d %10d\n", "timeouts per node", OLD_TIMEOUTS,
+	    timeouts_created, OLD_TIMEOUTS - timeouts_created);
+	printf("%-24s %10zu %10zu %10zu\n", "bytes per node", before, after,
+	    before - after);
+	for (i = 0; i < nitems(counts); i++) {
+		char label[32];
+
+		snprintf(label, sizeof(label), "KB for %d BSS", counts[i]);
+		printf("%-24s %10.1f %10.1f %10.1f\n", label,
+		    counts[i] * before / 1024.0, counts[i] * after / 1024.0,
+		    counts[i] * (before - after) / 1024.0);
+	}
+
+	CHECK(node_before - node_after >= 0x1024, "verb[] no longer carried");
+
+	printf("nodesize: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * pbkdf2kat: known-answer and equivalence tests for pbkdf2_sha1(), the
+ * WPA passphrase to PSK derivation, built on the host from sha1-pbkdf2.c.
+ *
+ * The IEEE Std 802.11-2016 J.4.2 (802.11i H.4) vectors and the RFC 6070
+ * PBKDF2-HMAC-SHA1 vectors are checked first.  Then random passphrases,
+ * SSIDs, iteration counts and output lengths are derived both with
+ * pbkdf2_sha1() and with PBKDF2 written out plainly on top of hmac_sha1(),
+ * which is how sha1-pbkdf2.c computed it before the iteration loop was
+ * unrolled onto precomputed pad states.  Passphrases longer than the SHA-1
+ * block take the hashed key path.
+ *
+ * The same test is linked twice: pbkdf2kat against the host build of
+ * crypto/, where the loop may run on SHA-NI, and pbkdf2kat-kext against
+ * sha1-pbkdf2.c built without CRYPTO_SIMD, which is the loop the kext
+ * runs.  Exits non-zero on any failure.
+ */
+#include <random>
+
+#include <sys/param.h>
+
+#include <crypto/sha1.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+static size_t
+unhex(const char *s, uint8_t *out)
+{
+	size_t n = 0;
+	unsigned int v;
+
+	for (; s[0] != '\0' && s[1] != '\0'; s += 2) {
+		sscanf(s, "%2x", &v);
+		out[n++] = v;
+	}
+	return n;
+}
+
+/* PBKDF2 as defined, one HMAC per U, on the exported hmac_sha1(). */
+static void
+pbkdf2_ref(const char *passphrase, const u8 *ssid, size_t ssid_len,
+    int iterations, u8 *buf, size_t buflen)
+{
+	u8 salt[64], u[SHA1_MAC_LEN], next[SHA1_MAC_LEN], t[SHA1_MAC_LEN];
+	size_t plen, klen = strlen(passphrase);
+	u_int32_t count;
+	int i, j;
+
+	for (count = 1; buflen > 0; count++) {
+		memcpy(salt, ssid, ssid_len);
+		salt[ssid_len] = count >> 24;
+		salt[ssid_len + 1] = count >> 16;
+		salt[ssid_len + 2] = count >> 8;
+		salt[ssid_len + 3] = count;
+		hmac_sha1((const u8 *)passphrase, klen, salt, ssid_len + 4, u);
+		memcpy(t, u, sizeof(t));
+		for (i = 1; i < iterations; i++) {
+			hmac_sha1((const u8 *)passphrase, klen, u, sizeof(u),
+			    next);
+			memcpy(u, next, sizeof(u));
+			for (j = 0; j < SHA1_MAC_LEN; j++)
+				t[j] ^= u[j];
+		}
+		plen = MIN(buflen, (size_t)SHA1_MAC_LEN);
+		memcpy(buf, t, plen);
+		buf += plen;
+		buflen -= plen;
+	}
+}
+
+static void
+known_answers(void)
+{
+	static const struct {
+		const char	*passphrase;
+		const char	*ssid;
+		int		 iterations;
+		const char	*key;
+	} vec[] = {
+		/* IEEE Std 802.11-2016 J.4.2 */
+		{ "password", "IEEE", 4096,
+		  "f42c6fc52df0ebef9ebb4b90b38a5f90"
+		  "2e83fe1b135a70e23aed762e9710a12e" },
+		{ "ThisIsAPassword", "ThisIsASSID", 4096,
+		  "0dc0d6eb90555ed6419756b9a15ec3e3"
+		  "209b63df707dd508d14581f8982721af" },
+		{ "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+		  "ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ", 4096,
+		  "becb93866bb8c3832cb777c2f559807c"
+		  "8c59afcb6eae734885001300a981cc62" },
+		/* RFC 6070 */
+		{ "password", "salt", 1,
+		  "0c60c80f961f0e71f3a9b524af6012062fe037a6" },
+		{ "password", "salt", 2,
+		  "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957" },
+		{ "password", "salt", 4096,
+		  "4b007901b765489abead49d926f721d065a429c1" },
+		{ "passwordPASSWORDpassword",
+		  "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+		  "3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038" },
+	};
+	u8 want[64], got[64], ref[64];
+	size_t i, n;
+
+	for (i = 0; i < nitems(vec); i++) {
+		n = unhex(vec[i].key, want);
+		pbkdf2_sha1(vec[i].passphrase, (const u8 *)vec[i].ssid,
+		    strlen(vec[i].ssid), vec[i].iterations, got, n);
+		pbkdf2_ref(vec[i].passphrase, (const u8 *)vec[i].ssid,
+		    strlen(vec[i].ssid), vec[i].iterations, ref, n);
+		CHECK(memcmp(got, want, n) == 0, vec[i].passphrase);
+		CHECK(memcmp(ref, want, n) == 0, "reference PBKDF2");
+	}
+}
+
+static void
+equivalence(int ncases)
+{
+	static const int iters[] = { 1, 2, 3, 17, 4096 };
+	std::mt19937 rng(1);
+	char passphrase[101];
+	u8 ssid[32], got[64], ref[64];
+	size_t plen, slen, buflen, j;
+	int i, iterations, bad = 0, over = 0;
+
+	for (i = 0; i < ncases; i++) {
+		plen = 1 + rng() % 100;
+		for (j = 0; j < plen; j++)
+			passphrase[j] = ' ' + rng() % 95;
+		passphrase[plen] = '\0';
+		slen = rng() % (sizeof(ssid) + 1);
+		for (j = 0; j < slen; j++)
+			ssid[j] = rng();
+		iterations = iters[rng() % nitems(iters)];
+		buflen = 1 + rng() % sizeof(got);
+
+		memset(got, 0xa5, sizeof(got));
+		pbkdf2_sha1(passphrase, ssid, slen, iterations, got, buflen);
+		pbkdf2_ref(passphrase, ssid, slen, iterations, ref, buflen);
+		bad += memcmp(got, ref, buflen) != 0;
+		over += buflen < sizeof(got) && got[buflen] != 0xa5;
+	}
+	CHECK(bad == 0, "pbkdf2_sha1() matches the reference");
+	CHECK(over == 0, "nothing written past buflen");
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *name;
+
+	(void)argc;
+	if ((name = strrchr(argv[0], '/')) != NULL)
+		name++;
+	else
+		name = argv[0];
+
+	known_answers();
+	equivalence(200);
+
+	printf("%s: %s (%d failures)\n", name, failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
@@ -0,0 +1,466 @@
+/*
+ * pmksabench: the net80211 PMKSA cache, built on the host from
+ * ieee80211_crypto.c, checked for recycling, expiry and opportunistic key
+ * caching, and timed.
+ *
+ * ieee80211_pmksa_add(), ieee80211_pmksa_find(), ieee80211_pmksa_find_ess(),
+ * ieee80211_pmksa_okc(), the helpers they share and the PMKID derivation
+ * are extracted at build time (see tools/Makefile) and run on the real
+ * HMAC code.  The model supplies the ieee80211com and node fields they
+ * use, ieee80211_find_node() over a set of candidate APs, and a simulated
+ * clock behind nsecuptime().  Frees are counted and must find the entry
+ * already wiped.
+ *
+ * The tool checks that:
+ * - the cache never holds more than IEEE80211_PMKSA_MAX entries, recycles
+ *   the least recently used one, and counts lookups and updates as use;
+ * - an entry is found until its lifetime runs out and dropped once a
+ *   lookup walks over it after that, and an infinite one never expires;
+ * - opportunistic key caching copies the most recently used PMK of the
+ *   AP's ESS and AKM, with the PMKID derived for the new AP and the expiry
+ *   of the original, even when adding the copy recycles the original.
+ *
+ * It then reports lookups per second through ieee80211_pmksa_find() for
+ * hits and misses, through the LRU list walk the cache used before it was
+ * hashed, and through ieee80211_pmksa_find_ess().
+ * Exits non-zero on failure.
+ */
+#include <vector>
+
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/mbuf.h>
+#include <sys/_clock.h>
+#include <IOKit/IOLib.h>
+
+#include <crypto/sha1.h>
+#include <crypto/sha2.h>
+#include <crypto/hmac.h>
+#include <net80211/ieee80211.h>
+#include <net80211/ieee80211_crypto.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+/* As in ieee80211_var.h. */
+#define IEEE80211_ADDR_EQ(a1,a2)	(memcmp(a1,a2,IEEE80211_ADDR_LEN) == 0)
+#define IEEE80211_ADDR_COPY(dst,src)	memcpy(dst,src,IEEE80211_ADDR_LEN)
+
+/* The ieee80211com and node fields the extracted code uses. */
+struct ieee80211_node {
+	u_int8_t		 ni_macaddr[IEEE80211_ADDR_LEN];
+	u_int8_t		 ni_esslen;
+	u_int8_t		 ni_essid[IEEE80211_NWID_LEN];
+	u_int			 ni_rsnakms;
+};
+
+struct ieee80211com {
+	TAILQ_HEAD(, ieee80211_pmk) ic_pmksa;
+	LIST_HEAD(, ieee80211_pmk) ic_pmksa_hash[IEEE80211_PMKSA_HASHSZ];
+	int			 ic_npmksa;
+	u_int8_t		 ic_myaddr[IEEE80211_ADDR_LEN];
+	struct ieee80211_node	*ic_bss;
+};
+
+static uint64_t now_ns;
+static std::vector<struct ieee80211_node *> aps;	/* for find_node */
+static int live, unwiped;
+
+static struct ieee80211_node *
+ieee80211_find_node(struct ieee80211com *ic, const u_int8_t *macaddr)
+{
+	size_t i;
+
+	for (i = 0; i < aps.size(); i++)
+		if (IEEE80211_ADDR_EQ(aps[i]->ni_macaddr, macaddr))
+			return aps[i];
+	return NULL;
+}
+
+static void *
+_MallocZero(size_t size)
+{
+	live++;
+	return calloc(1, size);
+}
+
+static void
+model_free(void *p, size_t size)
+{
+	const u_int8_t *b = (const u_int8_t *)p;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (b[i] != 0) {
+			unwiped++;
+			break;
+		}
+	live--;
+	free(p);
+}
+#define IOFree(p, size)	model_free((p), (size))
+
+#include "pmksa.inc"
+
+static void
+ic_init(struct ieee80211com *ic)
+{
+	int i;
+
+	memset(ic, 0, sizeof(*ic));
+	TAILQ_INIT(&ic->ic_pmksa);
+	for (i = 0; i < IEEE80211_PMKSA_HASHSZ; i++)
+		LIST_INIT(&ic->ic_pmksa_hash[i]);
+	memcpy(ic->ic_myaddr, "\x02\x00\x00\x00\x00\x01", IEEE80211_ADDR_LEN);
+}
+
+/* As ieee80211_crypto_detach() does. */
+static void
+ic_purge(struct ieee80211com *ic)
+{
+	struct ieee80211_pmk *pmk;
+
+	while ((pmk = TAILQ_FIRST(&ic->ic_pmksa)) != NULL)
+		ieee80211_pmksa_free(ic, pmk);
+}
+
+/* An AP of the given ESS; the device part of the BSSID is n. */
+static struct ieee80211_node *
+ap_new(uint32_t n, const char *essid, u_int akm)
+{
+	struct ieee80211_node *ni;
+
+	ni = (struct ieee80211_node *)calloc(1, sizeof(*ni));
+	memcpy(ni->ni_macaddr, "\x00\x1b\x63", 3);
+	ni->ni_macaddr[3] = n >> 16;
+	ni->ni_macaddr[4] = n >> 8;
+	ni->ni_macaddr[5] = n;
+	ni->ni_esslen = strlen(essid);
+	memcpy(ni->ni_essid, essid, ni->ni_esslen);
+	ni->ni_rsnakms = akm;
+	aps.push_back(ni);
+	return ni;
+}
+
+static void
+aps_free(void)
+{
+	size_t i;
+
+	for (i = 0; i < aps.size(); i++)
+		free(aps[i]);
+	aps.clear();
+}
+
+static struct ieee80211_pmk *
+add(struct ieee80211com *ic, struct ieee80211_node *ni, u_int8_t keybyte,
+    u_int32_t lifetime)
+{
+	u_int8_t key[IEEE80211_PMK_LEN];
+
+	memset(key, keybyte, sizeof(key));
+	return ieee80211_pmksa_add(ic, (enum ieee80211_akm)ni->ni_rsnakms,
+	    ni->ni_macaddr, key, lifetime);
+}
+
+static int
+cached(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+	return ieee80211_pmksa_find(ic, ni, NULL) != NULL;
+}
+
+static void
+check_lru(void)
+{
+	struct ieee80211com ic;
+	struct ieee80211_node *ni[IEEE80211_PMKSA_MAX + 8];
+	struct ieee80211_pmk *pmk;
+	int i, n = IEEE80211_PMKSA_MAX + 8, missing;
+
+	ic_init(&ic);
+	for (i = 0; i < n; i++)
+		ni[i] = ap_new(i, "lru", IEEE80211_AKM_8021X);
+
+	for (i = 0; i < IEEE80211_PMKSA_MAX; i++)
+		CHECK(add(&ic, ni[i], i, 0) != NULL, "add");
+	CHECK(ic.ic_npmksa == IEEE80211_PMKSA_MAX, "cache filled");
+
+	/* a lookup and an update both count as use */
+	CHECK(cached(&ic, ni[0]), "oldest entry found");
+	pmk = add(&ic, ni[1], 0xee, 0);
+	CHECK(pmk != NULL && pmk->pmk_key[0] == 0xee, "entry updated");
+	CHECK(ic.ic_npmksa == IEEE80211_PMKSA_MAX, "update does not grow");
+
+	/* the next adds recycle 2, 3, ... and not 0 or 1 */
+	for (i = IEEE80211_PMKSA_MAX; i < n; i++)
+		CHECK(add(&ic, ni[i], i, 0) != NULL, "add beyond the limit");
+	CHECK(ic.ic_npmksa == IEEE80211_PMKSA_MAX, "cache bounded");
+	CHECK(live == IEEE80211_PMKSA_MAX, "recycled entries freed");
+	CHECK(cached(&ic, ni[0]) && cached(&ic, ni[1]),
+	    "recently used entries kept");
+	missing = 0;
+	for (i = 2; i < 2 + n - IEEE80211_PMKSA_MAX; i++)
+		missing += !cached(&ic, ni[i]);
+	CHECK(missing == n - IEEE80211_PMKSA_MAX,
+	    "least recently used entries recycled");
+	for (i = 2 + n - IEEE80211_PMKSA_MAX; i < n; i++)
+		CHECK(cached(&ic, ni[i]), "other entries kept");
+
+	/* the same peer under another AKM is another entry */
+	ni[0]->ni_rsnakms = IEEE80211_AKM_SHA256_8021X;
+	CHECK(!cached(&ic, ni[0]), "AKM is part of the key");
+	ni[0]->ni_rsnakms = IEEE80211_AKM_8021X;
+
+	ic_purge(&ic);
+	CHECK(live == 0 && ic.ic_npmksa == 0, "cache purged");
+	aps_free();
+}
+
+static void
+check_expiry(void)
+{
+	struct ieee80211com ic;
+	struct ieee80211_node *a, *b, *c;
+
+	ic_init(&ic);
+	a = ap_new(1, "expiry", IEEE80211_AKM_8021X);
+	b = ap_new(2, "expiry", IEEE80211_AKM_8021X);
+	c = ap_new(3, "expiry", IEEE80211_AKM_8021X);
+
+	now_ns = 1000000000ULL;
+	add(&ic, a, 1, 10);
+	add(&ic, b, 2, IEEE80211_PMK_INFINITE);
+	add(&ic, c, 3, 20);
+
+	now_ns += 10000000000ULL - 1;
+	CHECK(cached(&ic, a), "found until the lifetime runs out");
+	now_ns += 1;
+	CHECK(!cached(&ic, a), "not found once it has");
+	CHECK(ic.ic_npmksa == 2 && live == 2, "expired entry freed");
+
+	/* find_ess drops what it walks over */
+	now_ns += 10000000000ULL;
+	CHECK(ieee80211_pmksa_find_ess(&ic, a) != NULL, "ESS entry found");
+	CHECK(ic.ic_npmksa == 1 && !cached(&ic, c), "ESS walk expires");
+
+	now_ns += 1000000ULL * 1000000000ULL;
+	CHECK(cached(&ic, b), "infinite lifetime never expires");
+
+	ic_purge(&ic);
+	aps_free();
+}
+
+static void
+check_okc(void)
+{
+	struct ieee80211com ic;
+	struct ieee80211_node *a1, *a2, *b, *other, *sha, *noess;
+	struct ieee80211_node *fill[IEEE80211_PMKSA_MAX];
+	struct ieee80211_pmk *pmk;
+	u_int8_t pmkid[IEEE80211_PMKID_LEN];
+	uint64_t expire;
+	int i;
+
+	ic_init(&ic);
+	now_ns = 1000000000ULL;
+	a1 = ap_new(1, "corp", IEEE80211_AKM_8021X);
+	a2 = ap_new(2, "corp", IEEE80211_AKM_8021X);
+	b = ap_new(3, "corp", IEEE80211_AKM_8021X);
+	other = ap_new(4, "guest", IEEE80211_AKM_8021X);
+	sha = ap_new(5, "corp", IEEE80211_AKM_SHA256_8021X);
+	noess = ap_new(6, "", IEEE80211_AKM_8021X);
+
+	/* the PMK is remembered with the ESS of the AP it was made with */
+	ic.ic_bss = a1;
+	add(&ic, a1, 0xa1, 3600);
+	now_ns += 1000000000ULL;
+	ic.ic_bss = a2;
+	pmk = add(&ic, a2, 0xa2, 3600);
+	expire = pmk->pmk_expire;
+	CHECK(pmk->pmk_esslen == 4 && memcmp(pmk->pmk_essid, "corp", 4) == 0,
+	    "ESS remembered");
+	ic.ic_bss = NULL;
+
+	CHECK(!cached(&ic, b), "nothing cached for the new AP");
+	pmk = ieee80211_pmksa_okc(&ic, b);
+	CHECK(pmk != NULL, "PMK of the ESS reused");
+	if (pmk != NULL) {
+		CHECK(IEEE80211_ADDR_EQ(pmk->pmk_macaddr, b->ni_macaddr),
+		    "copy cached for the new AP");
+		CHECK(pmk->pmk_key[0] == 0xa2, "most recently used PMK taken");
+		ieee80211_derive_pmkid(IEEE80211_AKM_8021X, pmk->pmk_key,
+		    b->ni_macaddr, ic.ic_myaddr, pmkid);
+		CHECK(memcmp(pmk->pmk_pmkid, pmkid, sizeof(pmkid)) == 0,
+		    "PMKID derived for the new AP");
+		CHECK(pmk->pmk_expire == expire, "expiry of the original kept");
+		CHECK(cached(&ic, b), "later lookups find the copy");
+	}
+	CHECK(ieee80211_pmksa_okc(&ic, other) == NULL, "other ESS not used");
+	CHECK(ieee80211_pmksa_okc(&ic, sha) == NULL, "other AKM not used");
+	CHECK(ieee80211_pmksa_okc(&ic, noess) == NULL, "hidden ESS not used");
+
+	/* with the cache full and the only ESS entry the oldest */
+	ic_purge(&ic);
+	ic.ic_bss = a1;
+	add(&ic, a1, 0x5a, 0);
+	ic.ic_bss = NULL;
+	for (i = 0; i < IEEE80211_PMKSA_MAX - 1; i++) {
+		fill[i] = ap_new(100 + i, "fill", IEEE80211_AKM_8021X);
+		add(&ic, fill[i], 0, 0);
+	}
+	pmk = ieee80211_pmksa_okc(&ic, b);
+	CHECK(pmk != NULL && pmk->pmk_key[0] == 0x5a &&
+	    pmk->pmk_key[IEEE80211_PMK_LEN - 1] == 0x5a,
+	    "copy survives recycling the original");
+	CHECK(!cached(&ic, a1) && ic.ic_npmksa == IEEE80211_PMKSA_MAX,
+	    "original recycled");
+
+	ic_purge(&ic);
+	aps_free();
+}
+
+static uint64_t
+wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ieee80211_pmksa_find() before the cache was hashed. */
+static struct ieee80211_pmk *
+pmksa_find_list(struct ieee80211com *ic, struct ieee80211_node *ni,
+    const u_int8_t *pmkid)
+{
+	struct ieee80211_pmk *pmk;
+
+	TAILQ_FOREACH(pmk, &ic->ic_pmksa, pmk_next) {
+		if (pmk->pmk_akm == ni->ni_rsnakms &&
+		    IEEE80211_ADDR_EQ(pmk->pmk_macaddr, ni->ni_macaddr) &&
+		    (pmkid == NULL ||
+		    memcmp(pmk->pmk_pmkid, pmkid, IEEE80211_PMKID_LEN) == 0))
+			break;
+	}
+	return pmk;
+}
+
+struct result {
+	double			 hit;		/* M lookups/s */
+	double			 miss;
+	double			 list;
+	double			 ess;
+};
+
+static struct result
+bench(int n, int nlookups)
+{
+	struct ieee80211com ic;
+	struct ieee80211_node *ni[IEEE80211_PMKSA_MAX], *out, *probe;
+	struct result res;
+	uint64_t t0;
+	int i, found;
+
+	ic_init(&ic);
+	for (i = 0; i < n; i++) {
+		ni[i] = ap_new(i, "bench", IEEE80211_AKM_8021X);
+		add(&ic, ni[i], i, 0);
+	}
+	out = ap_new(0xffffff, "elsewhere", IEEE80211_AKM_8021X);
+
+	found = 0;
+	t0 = wall_ns();
+	for (i = 0; i < nlookups; i++) {
+		probe = ni[(i * 7) % n];
+		found += ieee80211_pmksa_find(&ic, probe, NULL) != NULL;
+	}
+	res.hit = nlookups / ((wall_ns() - t0) / 1e9) / 1e6;
+	CHECK(found == nlookups, "every entry found");
+
+	found = 0;
+	t0 = wall_ns();
+	for (i = 0; i < nlookups; i++)
+		found += ieee80211_pmksa_find(&ic, out, NULL) != NULL;
+	res.miss = nlookups / ((wall_ns() - t0) / 1e9) / 1e6;
+	CHECK(found == 0, "unknown AP not found");
+
+	found = 0;
+	t0 = wall_ns();
+	for (i = 0; i < nlookups; i++) {
+		probe = ni[(i * 7) % n];
+		found += pmksa_find_list(&ic, probe, NULL) != NULL;
+	}
+	res.list = nlookups / ((wall_ns() - t0) / 1e9) / 1e6;
+	CHECK(found == nlookups, "list walk finds every entry");
+
+	found = 0;
+	t0 = wall_ns();
+	for (i = 0; i < nlookups; i++)
+		found += ieee80211_pmksa_find_ess(&ic, ni[0]) != NULL;
+	res.ess = nlookups / ((wall_ns() - t0) / 1e9) / 1e6;
+	CHECK(found == nlookups, "ESS lookup finds an entry");
+
+	ic_purge(&ic);
+	aps_free();
+	return res;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: pmksabench [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int counts[] = { 1, 8, 32, IEEE80211_PMKSA_MAX };
+	struct result r;
+	int quick = 0, ch, nlookups;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	shim_sim_uptime = &now_ns;
+	check_lru();
+	check_expiry();
+	check_okc();
+	CHECK(live == 0, "no entry leaked");
+	CHECK(unwiped == 0, "entries wiped before they are freed");
+
+	nlookups = quick ? 100000 : 5000000;
+	printf("%-24s %9s %9s %9s %9s\n", "", "hit M/s", "miss M/s",
+	    "list M/s", "ess M/s");
+	for (i = 0; i < nitems(counts); i++) {
+		char label[32];
+
+		r = bench(counts[i], nlookups);
+		snprintf(label, sizeof(label), "%d entries", counts[i]);
+		printf("%-24s %9.1f %9.1f %9.1f %9.1f\n", label, r.hit, r.miss,
+		    r.list, r.ess);
+	}
+
+	printf("pmksabench: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
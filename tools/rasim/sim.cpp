@@ -0,0 +1,755 @@
+/*
+ * rasim: a rate control simulator for the net80211 rate control modules,
+ * built on the host from the kext's sources.
+ *
+ * ieee80211_ra.c (RA), ieee80211_mrr.c and ieee80211_amrr.c run
+ * unmodified and are fed the way iwm(4) feeds them:
+ * - single-frame Tx responses, with the failure count walked down the
+ *   LQ retry table (iwm_ht_single_rate_control());
+ * - A-MPDU block acks reporting the ACKed subframes
+ *   (iwm_ampdu_rate_control());
+ * - one failed attempt for each subframe retried as a single frame
+ *   (iwm_ampdu_tx_done());
+ * - the 500 ms calibration timer for AMRR on legacy rates.
+ *
+ * The channel gives each rate a logistic PER curve over SNR, with 5 dB
+ * more needed for two streams and 1 dB for SGI.  Scenarios are static,
+ * stepped, or AR(1) log-normal fading around a mean.  Goodput is
+ * reported against an oracle that always picks the best fixed rate for
+ * the instantaneous SNR.  Convergence is the time from an SNR step until
+ * the first rate in the retry table stays within 90% of the oracle for
+ * 100 ms.  CPU cost is measured by replaying one run's calls into the
+ * module in a tight loop.
+ *
+ * MiRA (ieee80211_mira.c) is still built into the kext but no driver
+ * calls it any more, so it is not simulated.
+ */
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+
+#include <sys/param.h>
+
+#include <net80211/ieee80211_var.h>
+#include <net80211/ieee80211_ra.h>
+#include <net80211/ieee80211_amrr.h>
+#include <net80211/ieee80211_mrr.h>
+
+/* Rate ids: 0-15 HT MCS with long GI, +16 with SGI, 32-39 legacy OFDM. */
+#define RID_SGI		16
+#define RID_LEG		32
+#define NRID		40
+#define LQ_LEN		16	/* IWM_MAX_TX_RETRY_TABLE entries */
+
+#define FRAME_BITS	12000.0	/* 1500 B MPDUs */
+#define OVERHEAD_US	150.0	/* per PPDU: preamble, SIFS, (B)ACK */
+#define AMPDU_N		16
+
+/* SNR (dB) at 50% PER for each legacy rate and for MCS 0-7. */
+static const double leg_thr[8] = { 4, 5, 6.5, 8.5, 11.5, 15, 19, 20.5 };
+static const double ht_thr[8] = { 4, 7, 9.5, 12.5, 16, 20, 21.5, 23 };
+#define MIMO_PENALTY	5.0
+#define SGI_PENALTY	1.0
+#define PER_SLOPE	1.2
+
+static double
+rid_mbps(int rid)
+{
+	const struct ieee80211_ht_rateset *rs;
+	int mcs;
+
+	if (rid >= RID_LEG)
+		return (ieee80211_std_rateset_11a.rs_rates[rid - RID_LEG] &
+		    IEEE80211_RATE_VAL) / 2.0;
+	mcs = rid & 15;
+	rs = &ieee80211_std_ratesets_11n[(mcs / 8) * 2 + (rid >= RID_SGI)];
+	return rs->rates[mcs % 8] / 2.0;
+}
+
+static double
+rid_per(int rid, double snr)
+{
+	double thr;
+	int mcs;
+
+	if (rid >= RID_LEG)
+		thr = leg_thr[rid - RID_LEG];
+	else {
+		mcs = rid & 15;
+		thr = ht_thr[mcs % 8] + (mcs >= 8 ? MIMO_PENALTY : 0) +
+		    (rid >= RID_SGI ? SGI_PENALTY : 0);
+	}
+	return 1.0 / (1.0 + exp(PER_SLOPE * (snr - thr)));
+}
+
+static double
+airtime_us(int rid, int nframes)
+{
+	return OVERHEAD_US + nframes * FRAME_BITS / rid_mbps(rid);
+}
+
+/* Expected goodput (Mbit/s) of a fixed rate. */
+static double
+rid_goodput(int rid, double snr, int ampdu)
+{
+	int n = ampdu ? AMPDU_N : 1;
+
+	return (1 - rid_per(rid, snr)) * n * FRAME_BITS / airtime_us(rid, n);
+}
+
+static double
+oracle(double snr, int ampdu, int legacy)
+{
+	double best = 0;
+	int r;
+
+	for (r = legacy ? RID_LEG : 0; r < (legacy ? NRID : RID_LEG); r++)
+		best = fmax(best, rid_goodput(r, snr, ampdu));
+	return best;
+}
+
+/* xorshift64*, seeded per run */
+static uint64_t rng;
+
+static double
+urand(void)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return ((rng * 2685821657736338717ULL) >> 11) *
+	    (1.0 / 9007199254740992.0);
+}
+
+static double
+nrand(void)
+{
+	double u1 = urand() + 1e-300, u2 = urand();
+
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+struct scenario {
+	const char			*name;
+	double				 duration;	/* s */
+	std::vector<double>		 steps;		/* mean changes */
+	std::function<double(double)>	 mean;		/* dB at time t */
+	double				 fade_std;	/* dB */
+	double				 fade_tc;	/* s */
+};
+
+struct channel {
+	const struct scenario	*sc;
+	double			 fade;
+	double			 last;
+
+	double
+	snr(double t)
+	{
+		double a;
+
+		if (sc->fade_std > 0 && t > last) {
+			a = exp(-(t - last) / sc->fade_tc);
+			fade = a * fade + sqrt(1 - a * a) * sc->fade_std *
+			    nrand();
+			last = t;
+		}
+		return sc->mean(t) + fade;
+	}
+};
+
+/* The clock the modules see through nsecuptime(). */
+static uint64_t sim_uptime;
+
+static double
+walltime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* A call into the module, recorded so that it can be replayed. */
+struct op {
+	uint8_t		kind;
+#define OP_STATS	0
+#define OP_CHOOSE	1
+#define OP_TXDONE	2
+	int16_t		mcs;
+	uint16_t	total;
+	uint16_t	fail;
+	uint64_t	now;
+};
+
+static struct ieee80211com sim_ic;
+
+/* An HT20 2x2 peer with SGI, as the drivers set one up on association. */
+static void
+ht_node(struct ieee80211_node *ni)
+{
+	memset(ni, 0, sizeof(*ni));
+	ni->ni_ic = &sim_ic;
+	ni->ni_flags = IEEE80211_NODE_HT | IEEE80211_NODE_HTCAP;
+	ni->ni_htcaps = IEEE80211_HTCAP_SGI20;
+	ni->ni_chw = IEEE80211_CHAN_WIDTH_20;
+	ni->ni_rxmcs[0] = ni->ni_rxmcs[1] = 0xff;
+}
+
+/*
+ * A rate control module as a driver glues it in.  lq() returns the LQ
+ * retry table the driver would program, one attempt per entry.
+ */
+struct policy {
+	std::vector<struct op>	*rec = nullptr;
+
+	/* every policy is a new association, at a clock that starts over */
+	policy() { sim_uptime = 0; }
+	virtual ~policy() {}
+	virtual int legacy() { return 0; }
+	virtual void lq(int *tab) = 0;
+	virtual void tx_single(int initial, int ackfailcnt, int txfail) = 0;
+	virtual void tx_ampdu(int rid, int nacked) = 0;
+	/* a subframe sent at rid is being retried as a single frame */
+	virtual void tx_ampdu_fail(int rid) { (void)rid; }
+	virtual void tick(double t) { (void)t; }
+	/* replay recorded calls on a fresh node; ns per choose */
+	virtual double replay(const std::vector<struct op> &ops,
+	    int reps) = 0;
+
+	void
+	record(int kind, int mcs, int total, int fail)
+	{
+		if (rec != nullptr)
+			rec->push_back({ (uint8_t)kind, (int16_t)mcs,
+			    (uint16_t)total, (uint16_t)fail, sim_uptime });
+	}
+};
+
+struct ra_policy : policy {
+	struct ieee80211_node		ni;
+	struct ieee80211_ra_node	rn;
+
+	ra_policy()
+	{
+		ht_node(&ni);
+		ieee80211_ra_node_init(&sim_ic, &rn, &ni);
+	}
+
+	/* iwm_setrates(): walk down the current rateset */
+	void
+	lq(int *tab)
+	{
+		const struct ieee80211_ra_rate *rs =
+		    ieee80211_ra_get_rateset(&rn, &sim_ic, &ni, ni.ni_txmcs);
+		int j = 0, sgi = rs->sgi ? RID_SGI : 0, m;
+
+		for (m = ni.ni_txmcs; m >= rs->min_mcs && j < LQ_LEN; m--)
+			tab[j++] = m + sgi;
+		while (j < LQ_LEN)
+			tab[j++] = RID_LEG;
+	}
+
+	void
+	add(int mcs, unsigned int total, unsigned int fail)
+	{
+		ieee80211_ra_add_stats_ht(&rn, &sim_ic, &ni, mcs, total, fail);
+		record(OP_STATS, mcs, total, fail);
+	}
+
+	void
+	choose(void)
+	{
+		ieee80211_ra_choose(&rn, &sim_ic, &ni);
+		record(OP_CHOOSE, 0, 0, 0);
+	}
+
+	/* iwm_ht_single_rate_control() */
+	void
+	tx_single(int initial, int ackfailcnt, int txfail)
+	{
+		const struct ieee80211_ra_rate *rs;
+		int mcs = initial & 15, i;
+		unsigned int retries = 0;
+
+		if (mcs != ni.ni_txmcs)
+			return;
+		rs = ieee80211_ra_get_rateset(&rn, &sim_ic, &ni, mcs);
+		for (i = 0; i < ackfailcnt; i++) {
+			if (mcs > rs->min_mcs) {
+				add(mcs, 1, 1);
+				mcs--;
+			} else
+				retries++;
+		}
+		if (txfail && ackfailcnt == 0)
+			add(mcs, 1, 1);
+		else
+			add(mcs, retries + 1, retries);
+		choose();
+	}
+
+	/* iwm_ampdu_tx_done() */
+	void
+	tx_ampdu_fail(int rid)
+	{
+		add(rid & 15, 1, 1);
+	}
+
+	/* iwm_ampdu_rate_control() */
+	void
+	tx_ampdu(int rid, int nacked)
+	{
+		int i;
+
+		for (i = 0; i < nacked; i++)
+			add(rid & 15, 1, 0);
+		choose();
+	}
+
+	double
+	replay(const std::vector<struct op> &ops, int reps)
+	{
+		uint64_t n = 0;
+		double t0 = walltime_ns();
+		int r;
+
+		for (r = 0; r < reps; r++) {
+			ht_node(&ni);
+			ieee80211_ra_node_init(&sim_ic, &rn, &ni);
+			for (const struct op &op : ops) {
+				if (op.kind == OP_STATS)
+					ieee80211_ra_add_stats_ht(&rn, &sim_ic,
+					    &ni, op.mcs, op.total, op.fail);
+				else {
+					ieee80211_ra_choose(&rn, &sim_ic, &ni);
+					n++;
+				}
+			}
+		}
+		return (walltime_ns() - t0) / n;
+	}
+};
+
+/* MRR, opted into with -mrr; the LQ table is the retry chain. */
+struct mrr_policy : policy {
+	struct ieee80211_node		ni;
+	struct ieee80211_mrr_node	mn;
+
+	mrr_policy()
+	{
+		ht_node(&ni);
+		ieee80211_mrr_node_init(&sim_ic, &mn, &ni);
+		ieee80211_mrr_choose(&mn, &sim_ic, &ni);
+	}
+
+	static int
+	rid(const struct ieee80211_mrr_node *mn, int rate)
+	{
+		return ieee80211_mrr_mcs(mn, rate) +
+		    (ieee80211_mrr_group(mn, rate)->sgi ? RID_SGI : 0);
+	}
+
+	/* iwm_mrr_fill_lq(): each stage repeated for its tries */
+	void
+	lq(int *tab)
+	{
+		int i, k, j = 0;
+
+		for (i = 0; i < mn.nchain; i++)
+			for (k = 0; k < mn.chain[i].tries && j < LQ_LEN; k++)
+				tab[j++] = rid(&mn, mn.chain[i].rate);
+		while (j < LQ_LEN)
+			tab[j++] = RID_LEG;
+	}
+
+	void
+	choose(void)
+	{
+		ieee80211_mrr_choose(&mn, &sim_ic, &ni);
+		record(OP_CHOOSE, 0, 0, 0);
+	}
+
+	/* iwm_mrr_tx_done() */
+	void
+	tx_single(int initial, int ackfailcnt, int txfail)
+	{
+		ieee80211_mrr_tx_done(&mn, &sim_ic, &ni, initial & 15, 0,
+		    initial >= RID_SGI, ackfailcnt, txfail);
+		record(OP_TXDONE, initial, ackfailcnt, txfail);
+		choose();
+	}
+
+	/* iwm_rx_tx_cmd_single(): a failed A-MPDU subframe */
+	void
+	tx_ampdu_fail(int rid)
+	{
+		ieee80211_mrr_add_stats(&mn, &sim_ic, &ni, rid & 15, 1, 1);
+		record(OP_STATS, rid & 15, 1, 1);
+	}
+
+	/* iwm_ampdu_rate_control(): at the rate of ni_txmcs */
+	void
+	tx_ampdu(int rid, int nacked)
+	{
+		if ((rid & 15) != ni.ni_txmcs)
+			abort();
+		ieee80211_mrr_add_stats(&mn, &sim_ic, &ni, rid & 15,
+		    nacked, 0);
+		record(OP_STATS, rid & 15, nacked, 0);
+		choose();
+	}
+
+	double
+	replay(const std::vector<struct op> &ops, int reps)
+	{
+		uint64_t n = 0;
+		double t0 = walltime_ns();
+		int r;
+
+		for (r = 0; r < reps; r++) {
+			ht_node(&ni);
+			ieee80211_mrr_node_init(&sim_ic, &mn, &ni);
+			for (const struct op &op : ops) {
+				sim_uptime = op.now;
+				if (op.kind == OP_STATS)
+					ieee80211_mrr_add_stats(&mn, &sim_ic,
+					    &ni, op.mcs, op.total, op.fail);
+				else if (op.kind == OP_TXDONE)
+					ieee80211_mrr_tx_done(&mn, &sim_ic,
+					    &ni, op.mcs & 15, 0,
+					    op.mcs >= RID_SGI, op.total,
+					    op.fail);
+				else {
+					ieee80211_mrr_choose(&mn, &sim_ic,
+					    &ni);
+					n++;
+				}
+			}
+		}
+		return (walltime_ns() - t0) / n;
+	}
+};
+
+struct amrr_policy : policy {
+	struct ieee80211_node		ni;
+	struct ieee80211_amrr		amrr;
+	struct ieee80211_amrr_node	amn;
+	double				next_tick = 0.5;
+
+	amrr_policy()
+	{
+		memset(&ni, 0, sizeof(ni));
+		ni.ni_rates = ieee80211_std_rateset_11a;
+		amrr.amrr_min_success_threshold =
+		    IEEE80211_AMRR_MIN_SUCCESS_THRESHOLD;
+		amrr.amrr_max_success_threshold =
+		    IEEE80211_AMRR_MAX_SUCCESS_THRESHOLD;
+		ieee80211_amrr_node_init(&amrr, &amn);
+	}
+
+	int legacy() { return 1; }
+
+	void
+	lq(int *tab)
+	{
+		int j = 0, r;
+
+		for (r = ni.ni_txrate; r >= 0 && j < LQ_LEN; r--)
+			tab[j++] = RID_LEG + r;
+		while (j < LQ_LEN)
+			tab[j++] = RID_LEG;
+	}
+
+	/* the legacy branch of iwm_rx_tx_cmd_single() */
+	void
+	tx_single(int initial, int ackfailcnt, int txfail)
+	{
+		if (initial - RID_LEG != ni.ni_txrate)
+			return;
+		amn.amn_txcnt++;
+		if (txfail)
+			amn.amn_retrycnt++;
+		if (ackfailcnt > 0)
+			amn.amn_retrycnt++;
+	}
+
+	void tx_ampdu(int rid, int nacked) { (void)rid; (void)nacked; }
+
+	/* iwm_calib_timeout() */
+	void
+	tick(double t)
+	{
+		if (t < next_tick)
+			return;
+		next_tick = t + 0.5;
+		record(OP_CHOOSE, 0, amn.amn_txcnt, amn.amn_retrycnt);
+		ieee80211_amrr_choose(&amrr, &ni, &amn);
+	}
+
+	double
+	replay(const std::vector<struct op> &ops, int reps)
+	{
+		uint64_t n = 0;
+		double t0 = walltime_ns();
+		int r;
+
+		for (r = 0; r < reps; r++) {
+			ni.ni_txrate = 0;
+			ieee80211_amrr_node_init(&amrr, &amn);
+			for (const struct op &op : ops) {
+				amn.amn_txcnt = op.total;
+				amn.amn_retrycnt = op.fail;
+				ieee80211_amrr_choose(&amrr, &ni, &amn);
+				n++;
+			}
+		}
+		return (walltime_ns() - t0) / n;
+	}
+};
+
+struct result {
+	double		goodput;	/* Mbit/s */
+	double		oracle;		/* Mbit/s */
+	double		conv_ms;	/* mean over converged steps */
+	int		conv_n;
+	int		conv_miss;
+	uint64_t	frames;
+	uint64_t	lost;
+};
+
+static struct result
+run(struct policy *p, const struct scenario &sc, int ampdu, uint64_t seed)
+{
+	struct channel ch = { &sc, 0, 0 };
+	struct result r;
+	std::vector<double> conv;
+	double t = 0, bits = 0, orc = 0, orc_t = 0, snr, o;
+	double step_t = sc.steps.empty() ? -1 : sc.steps[0];
+	double conv_start = 0, good_since = -1;
+	int legacy = p->legacy(), tab[LQ_LEN], converging = 1;
+	int pending, agg_rid, i, ok;
+	size_t step = 0;
+
+	memset(&r, 0, sizeof(r));
+	rng = seed;
+	while (t < sc.duration) {
+		snr = ch.snr(t);
+		sim_uptime = (uint64_t)(t * 1e9);
+
+		/* integrate the oracle at 1 ms resolution */
+		while (orc_t < t) {
+			orc += oracle(ch.snr(orc_t), ampdu, legacy) * 1e-3;
+			orc_t += 1e-3;
+		}
+
+		/* convergence after each step of the mean SNR */
+		if (step_t >= 0 && t >= step_t) {
+			if (converging)
+				r.conv_miss++;
+			converging = 1;
+			conv_start = step_t;
+			good_since = -1;
+			step++;
+			step_t = step < sc.steps.size() ? sc.steps[step] : -1;
+		}
+		p->tick(t);
+		p->lq(tab);
+		if (converging) {
+			o = oracle(sc.mean(t), ampdu, legacy);
+			if (rid_goodput(tab[0], sc.mean(t), ampdu) >= 0.9 * o) {
+				if (good_since < 0)
+					good_since = t;
+				else if (t - good_since >= 0.1) {
+					conv.push_back(good_since - conv_start);
+					converging = 0;
+				}
+			} else
+				good_since = -1;
+		}
+
+		pending = 1;
+		agg_rid = -1;
+		if (ampdu && tab[0] < RID_LEG) {
+			agg_rid = tab[0];
+			for (i = ok = 0; i < AMPDU_N; i++)
+				ok += urand() >= rid_per(tab[0], snr);
+			t += airtime_us(tab[0], AMPDU_N) * 1e-6;
+			bits += ok * FRAME_BITS;
+			r.frames += ok;
+			p->tx_ampdu(tab[0], ok);
+			/* failed subframes are retried as single frames */
+			pending = AMPDU_N - ok;
+			if (pending)
+				p->lq(tab);
+		}
+		for (; pending > 0; pending--) {
+			if (agg_rid >= 0)
+				p->tx_ampdu_fail(agg_rid);
+			for (i = ok = 0; i < LQ_LEN; i++) {
+				t += airtime_us(tab[i], 1) * 1e-6;
+				if (urand() >= rid_per(tab[i], ch.snr(t))) {
+					ok = 1;
+					break;
+				}
+			}
+			if (ok) {
+				bits += FRAME_BITS;
+				r.frames++;
+				p->tx_single(tab[0], i, 0);
+			} else {
+				r.lost++;
+				p->tx_single(tab[0], LQ_LEN, 1);
+			}
+			p->lq(tab);
+		}
+	}
+	if (converging && !sc.steps.empty())
+		r.conv_miss++;
+
+	r.goodput = bits / t / 1e6;
+	r.oracle = orc / orc_t;
+	r.conv_n = conv.size();
+	for (double c : conv)
+		r.conv_ms += c * 1e3;
+	if (!conv.empty())
+		r.conv_ms /= conv.size();
+	return r;
+}
+
+static std::vector<struct scenario>
+scenarios(void)
+{
+	std::vector<struct scenario> v;
+	struct scenario s;
+	int i;
+
+	v.push_back({ "static-35dB", 20, {},
+	    [](double) { return 35.0; }, 0, 1 });
+	v.push_back({ "static-26dB", 20, {},
+	    [](double) { return 26.0; }, 0, 1 });
+	v.push_back({ "static-18dB", 20, {},
+	    [](double) { return 18.0; }, 0, 1 });
+	s = { "step-35/14", 40, {},
+	    [](double t) { return ((int)(t / 5)) % 2 ? 14.0 : 35.0; }, 0, 1 };
+	for (i = 0; i < 8; i++)
+		s.steps.push_back(i * 5.0);
+	v.push_back(s);
+	v.push_back({ "fade-slow", 30, {},
+	    [](double) { return 24.0; }, 5, 0.2 });
+	v.push_back({ "fade-fast", 30, {},
+	    [](double) { return 24.0; }, 6, 0.01 });
+	return v;
+}
+
+typedef std::function<struct policy *(void)> factory;
+
+static const struct {
+	const char	*name;
+	factory		 make;
+} policies[] = {
+	{ "ra",		[] { return (struct policy *)new ra_policy(); } },
+	{ "mrr",	[] { return (struct policy *)new mrr_policy(); } },
+	{ "amrr",	[] { return (struct policy *)new amrr_policy(); } },
+};
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: rasim [-q] [-s seeds] [policy]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *only = NULL;
+	int seeds = 5, quick = 0, ch, ampdu, s, reps;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "qs:")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			seeds = 1;
+			break;
+		case 's':
+			seeds = atoi(optarg);
+			if (seeds < 1)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind < argc)
+		only = argv[optind];
+
+	sim_ic.ic_curmode = IEEE80211_MODE_11N;
+	sim_ic.ic_userflags = IEEE80211_F_MRR;	/* as -mrr sets it */
+	sim_ic.ic_sup_mcs[0] = sim_ic.ic_sup_mcs[1] = 0xff;
+	shim_sim_uptime = &sim_uptime;
+
+	printf("%-6s %-12s %-6s %9s %9s %7s %14s %8s %8s\n", "policy",
+	    "scenario", "mode", "goodput", "oracle", "ratio", "converge",
+	    "lost", "ns/call");
+	for (i = 0; i < nitems(policies); i++) {
+		if (only != NULL && strcmp(only, policies[i].name) != 0)
+			continue;
+		for (const struct scenario &sc : scenarios()) {
+			for (ampdu = 0; ampdu < 2; ampdu++) {
+				std::unique_ptr<struct policy> probe(
+				    policies[i].make());
+				std::vector<struct op> ops;
+				double gp = 0, orc = 0, cms = 0, ns = 0;
+				uint64_t lost = 0, frames = 0;
+				int cn = 0, cmiss = 0;
+				char conv[32] = "-";
+
+				if (ampdu && probe->legacy())
+					continue;
+				for (s = 0; s < seeds; s++) {
+					std::unique_ptr<struct policy> p(
+					    policies[i].make());
+					struct result r;
+
+					if (s == 0)
+						p->rec = &ops;
+					r = run(p.get(), sc, ampdu,
+					    0x9e3779b97f4a7c15ULL * (s + 1));
+					gp += r.goodput;
+					orc += r.oracle;
+					cms += r.conv_ms * r.conv_n;
+					cn += r.conv_n;
+					cmiss += r.conv_miss;
+					lost += r.lost;
+					frames += r.frames;
+				}
+				/* CPU cost from the first seed's calls */
+				if (!quick && !ops.empty()) {
+					std::unique_ptr<struct policy> q(
+					    policies[i].make());
+
+					reps = 2000000 / ops.size() + 1;
+					ns = q->replay(ops, reps);
+				}
+				if (!sc.steps.empty())
+					snprintf(conv, sizeof(conv),
+					    "%.0fms %d/%d", cn ? cms / cn : 0,
+					    cn, cn + cmiss);
+				printf("%-6s %-12s %-6s %9.2f %9.2f %6.1f%% "
+				    "%14s %7.3f%% %8.1f\n", policies[i].name,
+				    sc.name, ampdu ? "ampdu" : "single",
+				    gp / seeds, orc / seeds, 100 * gp / orc,
+				    conv, 100.0 * lost / (lost + frames), ns);
+			}
+		}
+	}
+	shim_sim_uptime = NULL;
+	return 0;
+}
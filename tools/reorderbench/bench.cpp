@@ -0,0 +1,445 @@
+/*
+ * reorderbench: the RX block ack reorder engine, built on the host from
+ * net80211 and fed streams with loss and reordering.
+ *
+ * ieee80211_input_ba(), the functions it uses to release frames, skip
+ * gaps and move the window, the gap timeout and the buffer allocation
+ * are extracted from ieee80211_input.c and ieee80211_node.c at build time,
+ * with struct ieee80211_rx_ba from ieee80211_node.h (see tools/Makefile).
+ * The model supplies the node, the frames and a simulated clock on which
+ * the gap timeout fires.
+ *
+ * Each pattern sends one TID's MPDUs 10 us of simulated time apart, with
+ * 64, 256 and 1024 frame windows.  Frames may be shuffled within bursts
+ * of half a window, lost, or lost and retried half a window later.  The
+ * tool checks that frames reach the stack in sequence order and at most
+ * once, that the lost frame counter covers every frame not delivered,
+ * and, where no frame can fall behind the window, that every frame which
+ * arrived is delivered.  Exits non-zero if a check fails.
+ *
+ * It reports host frames/s through ieee80211_input_ba() and the slowest
+ * single call.  Release latency is simulated time from a frame's arrival
+ * to its delivery while the stream runs, and must stay within two
+ * windows' worth of frames.  Once the stream stops nothing moves the
+ * window but the gap timeout, which skips one gap per expiry; the time
+ * the buffer then takes to drain is reported separately.
+ */
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/param.h>
+#include <sys/endian.h>
+#include <IOKit/IOLib.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+#define FRAME_NS	10000		/* between MPDUs, simulated */
+
+/* A frame is its 802.11 header and its place in the stream. */
+struct ieee80211_frame {
+	u_int8_t		 i_fc[2];
+	u_int8_t		 i_dur[2];
+	u_int8_t		 i_addr1[6];
+	u_int8_t		 i_addr2[6];
+	u_int8_t		 i_addr3[6];
+	u_int8_t		 i_seq[2];
+} __packed;
+
+struct pkt {
+	struct ieee80211_frame	 wh;
+	uint64_t		 idx;
+	uint64_t		 t;		/* arrival, simulated ns */
+};
+typedef struct pkt *mbuf_t;
+
+#define mtod(m, t)	((t)&(m)->wh)
+
+struct mbuf_list {
+	mbuf_t			 ml_head;
+	mbuf_t			 ml_tail;
+	u_int			 ml_len;
+};
+
+#define MBUF_LIST_INITIALIZER()	{ NULL, NULL, 0 }
+
+/* As in ieee80211_node.h. */
+struct ieee80211_rxinfo {
+	u_int32_t		 rxi_flags;
+	u_int32_t		 rxi_tstamp;
+	int			 rxi_rssi;
+};
+
+/* The gap timeout, on the simulated clock. */
+struct CTimeout {
+	void			(*fn)(void *);
+	void			*arg;
+	uint64_t		 deadline;	/* 0 when idle */
+};
+
+static uint64_t now_ns;
+
+static void
+timeout_set(CTimeout **to, void (*fn)(void *), void *arg)
+{
+	*to = (CTimeout *)calloc(1, sizeof(CTimeout));
+	(*to)->fn = fn;
+	(*to)->arg = arg;
+}
+
+static int
+timeout_add_msec(CTimeout **to, int msecs)
+{
+	(*to)->deadline = now_ns + msecs * 1000000ULL;
+	return 1;
+}
+
+static int
+timeout_pending(CTimeout **to)
+{
+	return (*to)->deadline != 0;
+}
+
+static int
+timeout_del(CTimeout **to)
+{
+	int pending = timeout_pending(to);
+
+	(*to)->deadline = 0;
+	return pending;
+}
+
+#include "ba_reorder.h"
+
+/* The counters and fields the extracted code uses. */
+struct ieee80211_stats {
+	u_int32_t		 is_ht_rx_frame_below_ba_winstart;
+	u_int32_t		 is_ht_rx_frame_above_ba_winend;
+	u_int32_t		 is_ht_rx_ba_window_slide;
+	u_int32_t		 is_ht_rx_ba_window_jump;
+	u_int32_t		 is_ht_rx_ba_no_buf;
+	u_int32_t		 is_ht_rx_ba_frame_lost;
+	u_int32_t		 is_ht_rx_ba_window_gap_timeout;
+};
+
+struct IONetworkStats {
+	u_int32_t		 inputErrors;
+};
+
+struct _ifnet {
+	IONetworkStats		*netStat;
+};
+
+struct ieee80211com {
+	struct _ifnet		 ic_if;
+	struct ieee80211_stats	 ic_stats;
+};
+
+struct ieee80211_node {
+	struct ieee80211com	*ni_ic;
+	struct ieee80211_rx_ba	 ni_rx_ba[IEEE80211_NUM_TID];
+};
+
+/* What reached the stack. */
+static uint64_t delivered, discarded, next_idx, tail;
+static int disorder, draining;
+static std::vector<uint64_t> latency;
+
+static uint64_t
+nsecuptime(void)
+{
+	return now_ns;
+}
+
+static int
+splnet(void)
+{
+	return 0;
+}
+
+static void
+splx(int s)
+{
+	(void)s;
+}
+
+static void *
+_MallocZero(size_t size)
+{
+	return calloc(1, size);
+}
+
+static void
+mbuf_freem(mbuf_t m)
+{
+	if (m != NULL)
+		discarded++;
+}
+
+static void
+ieee80211_inputm(struct _ifnet *ifp, mbuf_t m, struct ieee80211_node *ni,
+    struct ieee80211_rxinfo *rxi, struct mbuf_list *ml)
+{
+	(void)ifp;
+	(void)ni;
+	(void)rxi;
+	(void)ml;
+	if (m->idx < next_idx)
+		disorder++;
+	next_idx = m->idx + 1;
+	if (draining)
+		tail++;
+	else
+		latency.push_back(now_ns - m->t);
+	delivered++;
+}
+
+static int
+if_input(struct _ifnet *ifp, struct mbuf_list *ml)
+{
+	(void)ifp;
+	(void)ml;
+	return 0;
+}
+
+void	ieee80211_input_ba_seq(struct ieee80211com *, struct ieee80211_node *,
+	    uint8_t, uint16_t, struct mbuf_list *);
+void	ieee80211_input_ba_flush(struct ieee80211com *,
+	    struct ieee80211_node *, struct ieee80211_rx_ba *,
+	    struct mbuf_list *);
+int	ieee80211_input_ba_gap_skip(struct ieee80211_rx_ba *);
+void	ieee80211_ba_move_window(struct ieee80211com *,
+	    struct ieee80211_node *, u_int8_t, u_int16_t, struct mbuf_list *);
+
+#include "ba_reorder.inc"
+
+static uint64_t
+wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct pattern {
+	const char		*name;
+	int			 loss;		/* per mille */
+	int			 shuffle;	/* in bursts of half a window */
+	int			 retry;		/* lost frames come half a window later */
+	int			 exact;		/* nothing can miss the window */
+};
+
+/* The order frames arrive in, as stream indices. */
+static std::vector<uint64_t>
+make_stream(const struct pattern *p, uint64_t n, int winsize,
+    std::mt19937_64 &rng, uint64_t *nlost)
+{
+	std::vector<uint64_t> order, out;
+	std::vector<std::pair<uint64_t, uint64_t>> retries;	/* due, idx */
+	uint64_t i, burst = winsize / 2;
+	size_t r = 0;
+
+	for (i = 0; i < n; i++)
+		order.push_back(i);
+	if (p->shuffle) {
+		for (i = 0; i < n; i += burst)
+			std::shuffle(order.begin() + i,
+			    order.begin() + std::min(i + burst, n), rng);
+	}
+	*nlost = 0;
+	for (i = 0; i < n; i++) {
+		while (r < retries.size() && retries[r].first <= i)
+			out.push_back(retries[r++].second);
+		/* the last frame always arrives, so that every gap closes */
+		if (order[i] != n - 1 && (int)(rng() % 1000) < p->loss) {
+			if (p->retry)
+				retries.push_back({ i + burst, order[i] });
+			else
+				(*nlost)++;
+			continue;
+		}
+		out.push_back(order[i]);
+	}
+	for (; r < retries.size(); r++)
+		out.push_back(retries[r].second);
+	return out;
+}
+
+struct result {
+	double			 mfps;		/* host, through input_ba */
+	double			 worst_us;	/* host, slowest call */
+	double			 p99_us;	/* simulated release latency */
+	double			 max_us;
+	uint64_t		 tail;		/* frames left at the end */
+	double			 drain_ms;	/* until they are released */
+};
+
+static void
+fire_due(CTimeout *to)
+{
+	if (to->deadline != 0 && to->deadline <= now_ns) {
+		to->deadline = 0;
+		to->fn(to->arg);
+	}
+}
+
+static struct result
+run(const struct pattern *p, int winsize, uint64_t n)
+{
+	static struct ieee80211com ic;
+	static struct ieee80211_node ni;
+	static IONetworkStats stats;
+	std::mt19937_64 rng(winsize * 1000 + p->loss);
+	std::vector<struct pkt> pkts(n);
+	std::vector<uint64_t> stream;
+	struct ieee80211_rx_ba *ba = &ni.ni_rx_ba[0];
+	struct ieee80211_rxinfo rxi;
+	struct mbuf_list ml = MBUF_LIST_INITIALIZER();
+	struct result res;
+	uint64_t nlost, t0, t, end, busy = 0, worst = 0;
+	struct pkt *m;
+
+	memset(&ic, 0, sizeof(ic));
+	memset(&ni, 0, sizeof(ni));
+	memset(&stats, 0, sizeof(stats));
+	ic.ic_if.netStat = &stats;
+	ni.ni_ic = &ic;
+	delivered = discarded = next_idx = tail = 0;
+	disorder = draining = 0;
+	latency.clear();
+	latency.reserve(n);
+	now_ns = 1000000000ULL;
+
+	/* as ieee80211_recv_addba_req() sets the agreement up */
+	ba->ba_ni = &ni;
+	timeout_set(&ba->ba_gap_to, ieee80211_input_ba_gap_timeout, ba);
+	ba->ba_winsize = winsize;
+	ba->ba_winstart = 0;
+	ba->ba_winend = winsize - 1;
+	CHECK(ieee80211_rx_ba_buf_alloc(ba) == 0, "buffer allocated");
+	CHECK(ba->ba_bufsz >= winsize && (ba->ba_bufsz & (ba->ba_bufsz - 1)) == 0,
+	    "buffer a power of two covering the window");
+
+	stream = make_stream(p, n, winsize, rng, &nlost);
+	for (uint64_t idx : stream) {
+		now_ns += FRAME_NS;
+		fire_due(ba->ba_gap_to);
+		m = &pkts[idx];
+		m->idx = idx;
+		m->t = now_ns;
+		*(u_int16_t *)m->wh.i_seq =
+		    htole16((idx & 0xfff) << IEEE80211_SEQ_SEQ_SHIFT);
+		memset(&rxi, 0, sizeof(rxi));
+		t0 = wall_ns();
+		ieee80211_input_ba(&ic, m, &ni, 0, &rxi, &ml);
+		t = wall_ns() - t0;
+		busy += t;
+		worst = MAX(worst, t);
+	}
+	/* let the gap timeout release whatever is left */
+	draining = 1;
+	end = now_ns;
+	while (ba->ba_gap_to->deadline != 0) {
+		now_ns = ba->ba_gap_to->deadline;
+		fire_due(ba->ba_gap_to);
+	}
+
+	CHECK(disorder == 0, "delivered in sequence order");
+	CHECK(delivered + discarded == stream.size(),
+	    "every frame delivered or discarded");
+	CHECK(delivered + ic.ic_stats.is_ht_rx_ba_frame_lost == n,
+	    "every frame not delivered counted as lost");
+	CHECK(ba->ba_gapwait == 0, "nothing left in the buffer");
+	if (p->exact) {
+		CHECK(delivered == n - nlost, "every frame that arrived delivered");
+		CHECK(ic.ic_stats.is_ht_rx_ba_frame_lost == nlost,
+		    "lost counter");
+	}
+	ieee80211_rx_ba_buf_free(ba);
+	CHECK(ba->ba_buf == NULL && ba->ba_bitmap == NULL, "buffer freed");
+	free(ba->ba_gap_to);
+
+	std::sort(latency.begin(), latency.end());
+	CHECK(latency.empty() ||
+	    latency.back() <= 2ULL * winsize * FRAME_NS,
+	    "release latency within two windows");
+	res.mfps = busy ? (double)stream.size() / busy * 1000 : 0;
+	res.worst_us = worst / 1000.0;
+	res.p99_us = latency.empty() ? 0 :
+	    latency[latency.size() * 99 / 100] / 1000.0;
+	res.max_us = latency.empty() ? 0 : latency.back() / 1000.0;
+	res.tail = tail;
+	res.drain_ms = (now_ns - end) / 1000000.0;
+	return res;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: reorderbench [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct pattern patterns[] = {
+		{ "in order",		0,	0,	0,	1 },
+		{ "shuffled",		0,	1,	0,	1 },
+		{ "1% loss",		10,	0,	0,	1 },
+		{ "10% loss",		100,	0,	0,	1 },
+		{ "10% loss, retried",	100,	0,	1,	1 },
+		{ "shuffled, 10% loss",	100,	1,	0,	0 },
+	};
+	static const int winsizes[] = {
+		IEEE80211_BA_MAX_WINSZ,
+		IEEE80211_HE_BA_MAX_WINSZ,
+		IEEE80211_EHT_BA_MAX_WINSZ,
+	};
+	struct result res;
+	int quick = 0, ch;
+	size_t i, j;
+	uint64_t n;
+	char label[64];
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	n = quick ? 20000 : 1000000;
+	printf("%-24s %9s %9s %9s %9s %6s %9s\n", "", "Mframe/s",
+	    "worst us", "p99 us", "max us", "tail", "drain ms");
+	for (i = 0; i < nitems(winsizes); i++) {
+		for (j = 0; j < nitems(patterns); j++) {
+			res = run(&patterns[j], winsizes[i], n);
+			snprintf(label, sizeof(label), "%s, %d", patterns[j].name,
+			    winsizes[i]);
+			printf("%-24s %9.2f %9.1f %9.1f %9.1f %6ju %9.0f\n",
+			    label, res.mfps, res.worst_us, res.p99_us,
+			    res.max_us, (uintmax_t)res.tail, res.drain_ms);
+		}
+	}
+
+	printf("reorderbench: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
@@ -0,0 +1,17 @@
+# Print "#define NAME value" for each NAME in the space separated list
+# names, whether the source defines it as a macro or an enum member.
+BEGIN {
+	split(names, n)
+	for (i in n)
+		want[n[i]] = 1
+}
+$1 == "#define" && ($2 in want) {
+	print
+	next
+}
+($1 in want) && $2 == "=" {
+	v = $0
+	sub(/^[^=]*= */, "", v)
+	sub(/,.*$/, "", v)
+	print "#define " $1 "\t" v
+}
@@ -0,0 +1,309 @@
+/*
+ * rxpoll: a host model of the iwx RX ring, interrupt mask and workloop,
+ * driving the driver's own budgeted RX polling code.
+ *
+ * iwx_rx_intr(), iwx_rx_poll(), iwx_rx_poll_timeout() and the helpers
+ * they call are extracted from ItlIwx.cpp at build time, as are the
+ * register and ring constants (see tools/Makefile).  The model supplies
+ * the softc fields they touch, a firmware that closes ring entries in
+ * bursts, and a workloop that runs one event per 10 usec step: either
+ * the RX interrupt, if it is pending and unmasked, or the poll timeout.
+ *
+ * Each traffic phase runs with the legacy interrupt mask and with MSI-X,
+ * with moderation on and off, and with moderation on while every third
+ * timeout_add_usec() fails, as it does once the timeout wheel is gone;
+ * the driver must then drain the ring itself.  The tool checks that every entry the
+ * firmware closed was processed, that no round went over the budget,
+ * that RX is never left masked without a pending round, that closed
+ * entries always have an interrupt or a round coming, and that the
+ * coalescing timer follows the entry rate.  Exits non-zero on failure.
+ */
+#include <sys/param.h>
+
+#include <net80211/ieee80211_var.h>
+
+#include "iwx_rx_consts.h"
+
+#define DPRINTFN(n, x)
+
+struct mbuf_list {
+	int			 n;
+};
+#define MBUF_LIST_INITIALIZER()	{ 0 }
+
+struct CTimeout;
+
+struct iwx_rx_data {
+	int			 unused;
+};
+
+/* The softc fields the extracted code uses, named as in if_iwxvar.h. */
+struct iwx_softc {
+	struct {
+		void			*stat;
+		struct iwx_rx_data	 data[IWX_RX_MQ_RING_COUNT];
+		int			 cur;
+	}			 rxq;
+	struct {
+		struct {
+			int		 unused;
+		}		 ic_if;
+		u_int32_t	 ic_userflags;
+	}			 sc_ic;
+	int			 sc_msix;
+	int			 sc_device_family;
+	int			 sc_intmask;
+	uint32_t		 sc_fh_mask;
+	CTimeout		*sc_rx_poll_to;
+	int			 sc_rx_polling;
+	uint8_t			 sc_int_timeout;
+	uint64_t		 sc_rx_mod_start;
+	uint32_t		 sc_rx_mod_frames;
+	uint64_t		 sc_rx_rounds;
+	uint64_t		 sc_rx_exhausted;
+	uint64_t		 sc_rx_frames;
+	uint64_t		 sc_rx_round_hist[IWX_RX_POLL_HIST];
+};
+
+/* Model state: simulated time, device registers and counters. */
+static uint64_t now_ns;
+static uint32_t reg_int_mask;
+static uint32_t reg_fh_mask_ad;
+static uint8_t reg_coalescing;
+static int timer_armed;
+static int arm_fail;	/* every arm_fail'th timeout_add_usec() fails */
+static int arms;
+static int irq_pending;
+static struct iwx_rb_status rb_status;
+static uint64_t closed, processed;
+static int round_entries, max_round;
+static int fw_racing;	/* entries to close at the next RX mask write */
+
+static int
+rx_irq_enabled(struct iwx_softc *sc)
+{
+	if (sc->sc_msix)
+		return (reg_fh_mask_ad & IWX_MSIX_FH_INT_CAUSES_Q0) == 0;
+	return (reg_int_mask & IWX_CSR_INT_BIT_FH_RX) != 0;
+}
+
+/*
+ * Close up to n more entries; the firmware stops one short of cur.
+ * Entries closed while RX is masked raise no interrupt later.
+ */
+static void
+fw_close(struct iwx_softc *sc, int n)
+{
+	uint16_t next;
+
+	for (; n > 0; n--) {
+		next = (rb_status.closed_rb_num + 1) % IWX_RX_MQ_RING_COUNT;
+		if ((next + 1) % IWX_RX_MQ_RING_COUNT == sc->rxq.cur)
+			break;
+		rb_status.closed_rb_num = next;
+		closed++;
+		if (rx_irq_enabled(sc))
+			irq_pending = 1;
+	}
+}
+
+/* The extracted code reads the simulated clock, not the host's. */
+static uint64_t
+model_uptime(void)
+{
+	return now_ns;
+}
+#define nsecuptime()	model_uptime()
+
+static void
+IWX_WRITE(struct iwx_softc *sc, uint32_t reg, uint32_t val)
+{
+	/* The firmware keeps closing entries while the driver unmasks. */
+	if (reg == IWX_CSR_INT_MASK || reg == IWX_CSR_MSIX_FH_INT_MASK_AD) {
+		fw_close(sc, fw_racing);
+		fw_racing = 0;
+	}
+	if (reg == IWX_CSR_INT_MASK)
+		reg_int_mask = val;
+	else if (reg == IWX_CSR_MSIX_FH_INT_MASK_AD)
+		reg_fh_mask_ad = val;
+}
+
+static void
+IWX_WRITE_1(struct iwx_softc *sc, uint32_t reg, uint8_t val)
+{
+	(void)sc;
+	if (reg == IWX_CSR_INT_COALESCING)
+		reg_coalescing = val;
+}
+
+static int
+timeout_add_usec(CTimeout **to, int usec)
+{
+	(void)to; (void)usec;
+	if (arm_fail != 0 && ++arms % arm_fail == 0)
+		return 0;
+	timer_armed = 1;
+	return 1;
+}
+
+static void
+iwx_rx_pkt(struct iwx_softc *sc, struct iwx_rx_data *data,
+    struct mbuf_list *ml)
+{
+	(void)sc; (void)data; (void)ml;
+	processed++;
+	round_entries++;
+}
+
+static void
+if_input(void *ifp, struct mbuf_list *ml)
+{
+	(void)ifp; (void)ml;
+}
+
+/* The driver is not built with -Wsign-compare. */
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#include "iwx_rx_poll.inc"
+#pragma GCC diagnostic warning "-Wsign-compare"
+
+/* One workloop event, as iwx_intr() and the timeout would run it. */
+static void
+workloop_step(struct iwx_softc *sc)
+{
+	round_entries = 0;
+	if (irq_pending && rx_irq_enabled(sc)) {
+		irq_pending = 0;
+		if (!sc->sc_msix)
+			IWX_WRITE(sc, IWX_CSR_INT_MASK, 0);
+		iwx_rx_intr(sc);
+		if (!sc->sc_msix)
+			iwx_restore_interrupts(sc);
+	} else if (timer_armed) {
+		timer_armed = 0;
+		iwx_rx_poll_timeout(sc);
+	}
+	if (round_entries > max_round)
+		max_round = round_entries;
+}
+
+/* Entry rates (per 10 usec step) and the timer each should select. */
+static const struct {
+	const char	*name;
+	int		 period;	/* one entry every period steps ... */
+	int		 burst;		/* ... or up to burst every step */
+	uint8_t		 timeout;
+} phases[] = {
+	{ "quiet",	200,	0,	0x02 },		/*    500/s */
+	{ "light",	33,	0,	0x08 },		/*  ~3000/s */
+	{ "medium",	8,	0,	0x10 },		/* 12500/s */
+	{ "flood",	0,	4,	IWX_HOST_INT_TIMEOUT_DEF },
+};
+
+#define PHASE_STEPS	200000		/* 2 s of simulated time */
+
+static int
+run(int msix, int nointrmod, int armfail)
+{
+	struct iwx_softc sc;
+	int failures = 0;
+	size_t p;
+	int step, n;
+
+	memset(&sc, 0, sizeof(sc));
+	memset(&rb_status, 0, sizeof(rb_status));
+	sc.rxq.stat = &rb_status;
+	sc.sc_msix = msix;
+	sc.sc_intmask = IWX_CSR_INT_BIT_FH_RX | IWX_CSR_INT_BIT_SW_RX |
+	    IWX_CSR_INT_BIT_RX_PERIODIC;
+	sc.sc_fh_mask = IWX_MSIX_FH_INT_CAUSES_Q0 | IWX_MSIX_FH_INT_CAUSES_Q1;
+	sc.sc_int_timeout = IWX_HOST_INT_TIMEOUT_DEF;
+	sc.sc_ic.ic_userflags = nointrmod ? IEEE80211_F_NOINTRMOD : 0;
+	reg_coalescing = IWX_HOST_INT_TIMEOUT_DEF;
+	reg_int_mask = 0;
+	reg_fh_mask_ad = 0;
+	/* nothing left over from the last run may close entries on unmask */
+	timer_armed = irq_pending = fw_racing = 0;
+	iwx_rx_poll_mask(&sc, 0);
+	arm_fail = armfail;
+	arms = 0;
+	closed = processed = 0;
+	max_round = 0;
+	srand(1);
+
+	for (p = 0; p < nitems(phases); p++) {
+		for (step = 0; step < PHASE_STEPS; step++) {
+			now_ns += 10000;
+			if (phases[p].burst)
+				n = rand() % (phases[p].burst + 1);
+			else
+				n = rand() % phases[p].period == 0;
+			/* a 400 entry burst every half second */
+			if (step % 50000 == 0)
+				n += 400;
+			/* some entries land just as the driver unmasks */
+			n += fw_racing;
+			fw_racing = n > 0 ? rand() % 2 : 0;
+			fw_close(&sc, n - fw_racing);
+			workloop_step(&sc);
+			if (!sc.sc_rx_polling && !rx_irq_enabled(&sc)) {
+				printf("FAIL %s: RX masked with no round "
+				    "pending\n", phases[p].name);
+				return 1;
+			}
+			if (!sc.sc_rx_polling && !irq_pending &&
+			    sc.rxq.cur != iwx_rx_closed(&sc)) {
+				printf("FAIL %s: closed entries with no "
+				    "interrupt or round pending\n",
+				    phases[p].name);
+				return 1;
+			}
+		}
+		if (!nointrmod && reg_coalescing != phases[p].timeout) {
+			printf("FAIL %s: coalescing 0x%02x, expected 0x%02x\n",
+			    phases[p].name, reg_coalescing, phases[p].timeout);
+			failures++;
+		}
+	}
+	/* let the last rounds finish */
+	for (step = 0; step < 1000 && (timer_armed || irq_pending); step++)
+		workloop_step(&sc);
+
+	printf("%-6s %-10s closed=%llu processed=%llu rounds=%llu "
+	    "exhausted=%llu max_round=%d\n", msix ? "msix" : "legacy",
+	    nointrmod ? "nointrmod" : armfail ? "arm-fails" : "moderated",
+	    (unsigned long long)closed,
+	    (unsigned long long)processed,
+	    (unsigned long long)sc.sc_rx_rounds,
+	    (unsigned long long)sc.sc_rx_exhausted, max_round);
+	if (processed != closed || sc.rxq.cur != rb_status.closed_rb_num) {
+		printf("FAIL entries lost\n");
+		failures++;
+	}
+	/* a drain after a failed arm is one unbudgeted round */
+	if (!nointrmod && !armfail && max_round > IWX_RX_POLL_BUDGET) {
+		printf("FAIL round over budget\n");
+		failures++;
+	}
+	if (sc.sc_rx_polling || timer_armed) {
+		printf("FAIL still polling after the ring drained\n");
+		failures++;
+	}
+	return failures;
+}
+
+int
+main(void)
+{
+	int failures = 0;
+
+	failures += run(0, 0, 0);
+	failures += run(1, 0, 0);
+	failures += run(0, 1, 0);
+	failures += run(1, 1, 0);
+	failures += run(0, 0, 3);
+	failures += run(1, 0, 3);
+	printf("rxpoll: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
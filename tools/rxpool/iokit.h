@@ -0,0 +1,137 @@
+/*
+ * The IOKit pieces the buffer pool in compat.cpp uses, for the tools that
+ * build it from the extracted rxpool.inc: a one-CPU lock, the atomics,
+ * and wired memory with page-sized physical segments.  Misuse is reported
+ * through the including tool's CHECK().
+ */
+#ifndef _TOOLS_RXPOOL_IOKIT_H_
+#define _TOOLS_RXPOOL_IOKIT_H_
+
+#include <IOKit/IOReturn.h>
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE	4096
+#endif
+
+typedef uint64_t	IOPhysicalAddress;
+typedef uint64_t	IOByteCount;
+typedef int32_t		SInt32;
+typedef uint32_t	UInt32;
+
+struct IOPhysicalSegment {
+	IOPhysicalAddress	 location;
+	UInt32			 length;
+};
+
+/* One CPU, so the lock only has to notice misuse. */
+struct IOSimpleLock {
+	int			 held;
+};
+
+static IOSimpleLock *
+IOSimpleLockAlloc(void)
+{
+	return (IOSimpleLock *)calloc(1, sizeof(IOSimpleLock));
+}
+
+static void
+IOSimpleLockFree(IOSimpleLock *l)
+{
+	CHECK(!l->held, "lock freed while held");
+	free(l);
+}
+
+static void
+IOSimpleLockLock(IOSimpleLock *l)
+{
+	CHECK(!l->held, "lock taken twice");
+	l->held = 1;
+}
+
+static void
+IOSimpleLockUnlock(IOSimpleLock *l)
+{
+	CHECK(l->held, "lock released while free");
+	l->held = 0;
+}
+
+static SInt32
+OSIncrementAtomic(volatile SInt32 *p)
+{
+	return (*p)++;
+}
+
+static SInt32
+OSDecrementAtomic(volatile SInt32 *p)
+{
+	return (*p)--;
+}
+
+#define kernel_task		NULL
+#define kIODirectionInOut	3
+#define kIOMemoryMapperNone	0
+
+/*
+ * Wired memory at a made-up physical address below 4 GB.  Pages are
+ * physically contiguous only within themselves, so a segment never runs
+ * past the end of its page.
+ */
+#define PHYS_BASE		0x40000000ULL
+
+static int live_mem;
+
+class IOBufferMemoryDescriptor {
+public:
+	uint8_t			*bytes;
+	size_t			 len;
+	IOPhysicalAddress	 phys;
+	int			 prepared;
+
+	static IOBufferMemoryDescriptor *
+	inTaskWithPhysicalMask(void *task, int dir, size_t cap, uint64_t mask)
+	{
+		static IOPhysicalAddress next = PHYS_BASE;
+		IOBufferMemoryDescriptor *md;
+
+		(void)task;
+		(void)dir;
+		md = new IOBufferMemoryDescriptor;
+		md->len = roundup(cap, PAGE_SIZE);
+		md->bytes = (uint8_t *)aligned_alloc(PAGE_SIZE, md->len);
+		md->phys = next;
+		md->prepared = 0;
+		next += md->len;
+		if (md->bytes == NULL || ((md->phys + md->len - 1) & ~mask &
+		    ~(uint64_t)(PAGE_SIZE - 1)) != 0) {
+			free(md->bytes);
+			delete md;
+			return NULL;
+		}
+		live_mem++;
+		return md;
+	}
+
+	IOReturn prepare() { prepared = 1; return kIOReturnSuccess; }
+	void complete() { CHECK(prepared, "complete without prepare"); }
+	void *getBytesNoCopy() { return bytes; }
+
+	IOPhysicalAddress
+	getPhysicalSegment(IOByteCount off, IOByteCount *seglen, int opts)
+	{
+		(void)opts;
+		if (!prepared || off >= len)
+			return 0;
+		*seglen = PAGE_SIZE - off % PAGE_SIZE;
+		return phys + off;
+	}
+
+	void
+	release()
+	{
+		free(bytes);
+		live_mem--;
+		delete this;
+	}
+};
+
+#endif /* _TOOLS_RXPOOL_IOKIT_H_ */
@@ -0,0 +1,308 @@
+/*
+ * rxpool: a host model of an RX ring refilled from the recycling buffer
+ * pool, measuring what a refill costs with the pool and without it.
+ *
+ * rxpool_create(), rxpool_get(), rxpool_slice() and the rest of the pool
+ * are extracted from compat.cpp at build time (see tools/Makefile).  The
+ * model supplies a wired memory descriptor with page-sized physical
+ * segments, and a ring refilled the way iwx_rx_addbuf() does it: from the
+ * pool, else allocatePacket() plus a physical segment lookup.  The
+ * device writes every frame through the physical address it was given,
+ * and the stack holds a number of frames, as reorder queues do, before
+ * checking and freeing them.
+ *
+ * The tool checks that every frame reads back what the device wrote, so
+ * a buffer is never lent twice or given a stale address, that every lent
+ * buffer comes back, and that the pool outlives its ring until the last
+ * one has.  It also checks that slices of one buffer return it only when
+ * the last of them is freed.  Exits non-zero on failure.
+ */
+#include <deque>
+
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/kpi_mbuf.h>
+#include <IOKit/IOLib.h>
+
+#include "iwx_rx_consts.h"
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+#include "iokit.h"
+#include "rxpool.inc"
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* What the allocatePacket() fallback costs besides the allocation. */
+static uint64_t seg_lookups;
+
+/* The descriptor the pool's slab lives in, to play the device's DMA. */
+static IOBufferMemoryDescriptor *pool_mem;
+
+static uint8_t *
+dma_addr(IOPhysicalAddress pa)
+{
+	if (pool_mem != NULL && pa >= pool_mem->phys &&
+	    pa < pool_mem->phys + pool_mem->len)
+		return pool_mem->bytes + (pa - pool_mem->phys);
+	/* fallback buffers are mapped 1:1 in this model */
+	return (uint8_t *)(uintptr_t)pa;
+}
+
+struct slot {
+	mbuf_t			 m;
+	IOPhysicalSegment	 seg;
+};
+
+struct ring {
+	struct rxpool		*pool;
+	struct slot		 slot[IWX_RX_MQ_RING_COUNT];
+	uint64_t		 starved;
+};
+
+/* As iwx_rx_addbuf(): the pool first, then allocatePacket(). */
+static int
+rx_addbuf(struct ring *ring, int idx)
+{
+	struct slot *s = &ring->slot[idx];
+	mbuf_t m;
+
+	m = rxpool_get(ring->pool, &s->seg, NULL);
+	if (m == NULL) {
+		if (mbuf_getcluster(MBUF_DONTWAIT, MBUF_TYPE_DATA,
+		    IWX_RBUF_SIZE, &m) != 0) {
+			if (ring->pool != NULL)
+				ring->pool->rp_stats.starved++;
+			ring->starved++;
+			return ENOMEM;
+		}
+		mbuf_setlen(m, IWX_RBUF_SIZE);
+		mbuf_pkthdr_setlen(m, IWX_RBUF_SIZE);
+		s->seg.location = (uintptr_t)mbuf_data(m);
+		s->seg.length = IWX_RBUF_SIZE;
+		seg_lookups++;
+	}
+	CHECK(s->seg.length >= IWX_RBUF_SIZE &&
+	    dma_addr(s->seg.location) == mbuf_data(m), "DMA address");
+	s->m = m;
+	return 0;
+}
+
+/* A frame as the stack sees it: the id the device stamped on it. */
+static void
+stack_free(mbuf_t m, uint64_t id)
+{
+	uint64_t got;
+
+	memcpy(&got, mbuf_data(m), sizeof(got));
+	CHECK(got == id, "frame intact until the stack frees it");
+	mbuf_freem(m);
+}
+
+struct held {
+	mbuf_t			 m;
+	uint64_t		 id;
+};
+
+struct result {
+	double			 ns;
+	double			 mbufs, clusters, lookups;
+	uint64_t		 hit, miss;
+};
+
+/*
+ * Receive n frames through a ring whose stack keeps the last hold frames.
+ * With use_pool the ring gets a pool sized as the drivers size it.
+ */
+static struct result
+run(uint64_t n, int hold, int use_pool, int teardown_check)
+{
+	static struct ring ring;
+	std::deque<struct held> stack;
+	struct result res = {};
+	uint64_t id, t0;
+	int idx;
+
+	memset(&ring, 0, sizeof(ring));
+	if (use_pool) {
+		ring.pool = rxpool_create(IWX_RBUF_SIZE,
+		    IWX_RX_MQ_RING_COUNT + IWX_RX_MQ_RING_COUNT / 2);
+		CHECK(ring.pool != NULL, "rxpool_create");
+		if (ring.pool == NULL)
+			return res;
+		pool_mem = ring.pool->rp_mem;
+	}
+	for (idx = 0; idx < IWX_RX_MQ_RING_COUNT; idx++)
+		CHECK(rx_addbuf(&ring, idx) == 0, "initial fill");
+
+	shim_mbuf_allocs = shim_cluster_allocs = seg_lookups = 0;
+	if (ring.pool != NULL)
+		ring.pool->rp_stats.hit = ring.pool->rp_stats.miss = 0;
+	t0 = now_ns();
+	for (id = 1, idx = 0; id <= n; id++) {
+		struct slot *s = &ring.slot[idx];
+
+		/* the device fills the buffer through its DMA address */
+		memcpy(dma_addr(s->seg.location), &id, sizeof(id));
+		stack.push_back({ s->m, id });
+		s->m = NULL;
+		if (rx_addbuf(&ring, idx) != 0)
+			break;
+		while ((int)stack.size() > hold) {
+			stack_free(stack.front().m, stack.front().id);
+			stack.pop_front();
+		}
+		idx = (idx + 1) % IWX_RX_MQ_RING_COUNT;
+	}
+	res.ns = (double)(now_ns() - t0) / n;
+	res.mbufs = (double)shim_mbuf_allocs / n;
+	res.clusters = (double)shim_cluster_allocs / n;
+	res.lookups = (double)seg_lookups / n;
+	if (ring.pool != NULL) {
+		res.hit = ring.pool->rp_stats.hit;
+		res.miss = ring.pool->rp_stats.miss;
+		CHECK(res.hit + res.miss == n, "every refill counted");
+	}
+	CHECK(ring.starved == 0, "no starvation");
+
+	/* free the ring while the stack still holds frames */
+	for (idx = 0; idx < IWX_RX_MQ_RING_COUNT; idx++)
+		if (ring.slot[idx].m != NULL)
+			mbuf_freem(ring.slot[idx].m);
+	rxpool_destroy(ring.pool);
+	if (teardown_check && use_pool && !stack.empty())
+		CHECK(live_mem == 1, "pool outlives its ring");
+	while (!stack.empty()) {
+		stack_free(stack.front().m, stack.front().id);
+		stack.pop_front();
+	}
+	CHECK(live_mem == 0, "pool freed after the last buffer");
+	pool_mem = NULL;
+	return res;
+}
+
+/* Slices of one buffer give it back only when the last one is freed. */
+static void
+check_slices(void)
+{
+	IOPhysicalSegment seg;
+	struct rxpool_buf *buf;
+	struct rxpool *pool;
+	mbuf_t m, s[3];
+	int i, nfree;
+
+	pool = rxpool_create(IWX_RBUF_SIZE, 2);
+	CHECK(pool != NULL, "rxpool_create");
+	if (pool == NULL)
+		return;
+	CHECK(rxpool_create(IWX_RBUF_SIZE * 2, 2) == NULL,
+	    "buffers larger than a page refused");
+	m = rxpool_get(pool, &seg, &buf);
+	CHECK(m != NULL && buf != NULL, "rxpool_get");
+	for (i = 0; i < 3; i++) {
+		s[i] = rxpool_slice(buf, i * 1000, 900);
+		CHECK(s[i] != NULL && mbuf_len(s[i]) == 900 &&
+		    (uint8_t *)mbuf_data(s[i]) ==
+		    (uint8_t *)mbuf_data(m) + i * 1000, "rxpool_slice");
+		CHECK(mbuf_trailingspace(s[i]) == 0,
+		    "a slice cannot grow into its neighbour");
+	}
+	CHECK(rxpool_slice(buf, IWX_RBUF_SIZE - 10, 11) == NULL,
+	    "slice past the buffer refused");
+	mbuf_freem(m);
+	for (i = 0; i < 3; i++) {
+		nfree = 0;
+		SLIST_FOREACH(buf, &pool->rp_free, rb_next)
+			nfree++;
+		CHECK(nfree == 1, "buffer held while a slice is");
+		mbuf_freem(s[i]);
+	}
+	nfree = 0;
+	SLIST_FOREACH(buf, &pool->rp_free, rb_next)
+		nfree++;
+	CHECK(nfree == 2 && pool->rp_refs == 1, "buffer back after slices");
+	rxpool_destroy(pool);
+	CHECK(live_mem == 0, "pool freed");
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: rxpool [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int holds[] = { 0, 64, 256, 512, 1024 };
+	struct result p, a;
+	int quick = 0, ch;
+	uint64_t n;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	check_slices();
+
+	n = quick ? 20000 : 2000000;
+	run(n / 10, 0, 0, 0);	/* warm the allocator up */
+	printf("%-24s %8s %7s %7s %7s %7s %8s\n", "", "frames", "hit %",
+	    "mbuf/f", "clus/f", "seg/f", "ns/f");
+	for (i = 0; i < nitems(holds); i++) {
+		char label[32];
+
+		a = run(n, holds[i], 0, 0);
+		p = run(n, holds[i], 1, 1);
+		snprintf(label, sizeof(label), "hold %d allocate", holds[i]);
+		printf("%-24s %8llu %7s %7.2f %7.2f %7.2f %8.1f\n", label,
+		    (unsigned long long)n, "-", a.mbufs, a.clusters,
+		    a.lookups, a.ns);
+		snprintf(label, sizeof(label), "hold %d pool", holds[i]);
+		printf("%-24s %8llu %7.1f %7.2f %7.2f %7.2f %8.1f\n", label,
+		    (unsigned long long)n, 100.0 * p.hit / n, p.mbufs,
+		    p.clusters, p.lookups, p.ns);
+		CHECK(a.clusters == 1 && a.lookups == 1,
+		    "one allocation and lookup per frame without the pool");
+		/*
+		 * The pool covers the ring, the frame being refilled for
+		 * and half a ring more, less that one frame.
+		 */
+		if (holds[i] < IWX_RX_MQ_RING_COUNT / 2)
+			CHECK(p.miss == 0 && p.clusters == 0 && p.lookups == 0,
+			    "no allocation while the pool covers the backlog");
+		else
+			CHECK(p.miss > 0, "misses once the backlog outgrows it");
+	}
+
+	printf("rxpool: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
@@ -0,0 +1,750 @@
+/*
+ * scanbench: the itlwm scan result ioctls, replayed over a simulated
+ * 500-BSS scan, checked and timed.
+ *
+ * sSCAN_RESULT(), which returns one BSS per call, and the bulk
+ * sSCAN_RESULTSGated() are extracted from ItlNetworkUserClient.cpp at
+ * build time (see tools/Makefile), with ieee80211_find_node_geq(), the
+ * tree comparison and airport_up_time().  The model supplies the user
+ * client, driver and node fields they use.  The scan is replayed into
+ * ic_tree in beacon arrival order the way ieee80211_setup_node() adds
+ * nodes.  Each node carries an IE body of the size a beacon's would
+ * have: mostly 120 to 500 bytes, a few with large vendor IEs.
+ *
+ * The tool checks that:
+ * - one BSS per call returns every node once in tree order, then
+ *   kIONoScanResult, and starts over after that;
+ * - a bulk pass returns every node once in BSSID order, each record
+ *   matching its node, 4-byte aligned and inside buf, and that a call
+ *   only stops early when the next record does not fit;
+ * - a set moves the cursor to the first BSSID not below the one given,
+ *   and all zeroes rewind it;
+ * - with nodes freed and added between calls, the cursor's own node
+ *   included, every node present throughout a pass is returned once,
+ *   none twice, and the generation changes;
+ * - a node whose IEs would not fit an empty buffer does not stall the
+ *   walk.
+ *
+ * It then reports calls and bytes copied out per pass, the time spent in
+ * the handlers, and an estimate for a whole pass.  The estimate adds a
+ * user/kernel crossing per call, measured on this host as a read() of
+ * the ioctl structure's size from /dev/zero; an IOKit call through
+ * mach_msg costs more than that.
+ * Exits non-zero on failure.
+ */
+#include <random>
+#include <set>
+
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/param.h>
+#include <sys/tree.h>
+#include <net/ethernet.h>
+#include <IOKit/IOLib.h>
+#include <IOKit/IOReturn.h>
+
+#include <ClientKit/Common.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+/* As in ieee80211.h and ieee80211_var.h. */
+#define IEEE80211_ADDR_LEN	6
+#define IEEE80211_NWID_LEN	32
+#define IEEE80211_CHAN_MAX	255
+
+/* The node and ieee80211com fields the extracted code uses. */
+struct ieee80211_channel {
+	u_int16_t		 ic_freq;
+};
+
+struct ieee80211_node {
+	RB_ENTRY(ieee80211_node) ni_node;
+	u_int8_t		 ni_rssi;
+	u_int8_t		 ni_macaddr[IEEE80211_ADDR_LEN];
+	u_int8_t		 ni_bssid[IEEE80211_ADDR_LEN];
+	u_int16_t		 ni_capinfo;
+	u_int8_t		 ni_esslen;
+	u_int8_t		 ni_essid[IEEE80211_NWID_LEN];
+	struct ieee80211_channel *ni_chan;
+	u_int64_t		 ni_age_ts;
+	u_int			 ni_supported_rsnprotos;
+	u_int			 ni_rsnprotos;
+	u_int			 ni_supported_rsnakms;
+	u_int			 ni_rsnakms;
+	u_int			 ni_rsnciphers;
+	int			 ni_rsngroupcipher;
+	int			 ni_rsngroupmgmtcipher;
+	int			 ni_rsncipher;
+	u_int8_t		*ni_rsnie_tlv;
+	uint32_t		 ni_rsnie_tlv_len;
+};
+
+RB_HEAD(ieee80211_tree, ieee80211_node);
+
+struct ieee80211com {
+	struct ieee80211_channel ic_channels[IEEE80211_CHAN_MAX + 1];
+	struct ieee80211_tree	 ic_tree;
+	int			 ic_nnodes;
+	u_int32_t		 ic_node_gen;
+};
+
+static int
+ieee80211_chan2ieee(struct ieee80211com *ic, const struct ieee80211_channel *c)
+{
+	return c - ic->ic_channels;
+}
+
+/* The user client and what it reaches through its driver. */
+typedef struct OSObject OSObject;
+
+struct ItlHalService {
+	struct ieee80211com	*ic;
+
+	struct ieee80211com *get80211Controller() { return ic; }
+};
+
+struct ItlDriver {
+	ItlHalService		*fHalService;
+};
+
+struct ItlDriverInfo {
+	int16_t getBSSNoise() { return -96; }
+};
+
+struct ItlNetworkUserClient {
+	ItlDriver		*fDriver;
+	ItlDriverInfo		*fDriverInfo;
+	bool			 fScanResultWrapping;
+	struct ieee80211_node	*fNextNodeToSend;
+	uint8_t			 fScanCursor[ETHER_ADDR_LEN];
+};
+
+#define OSDynamicCast(type, inst)	((type *)(inst))
+
+RB_PROTOTYPE(ieee80211_tree, ieee80211_node, ni_node, ieee80211_node_cmp);
+
+#include "scan_results.inc"
+
+RB_GENERATE(ieee80211_tree, ieee80211_node, ni_node, ieee80211_node_cmp);
+
+/* A record header plus this much IE data fills buf on its own. */
+#define IE_MAX	(SCAN_RESULTS_BUF_LEN - sizeof(struct ioctl_scan_record))
+
+struct scan {
+	struct ieee80211com	 ic;
+	ItlHalService		 hal;
+	ItlDriver		 drv;
+	ItlDriverInfo		 info;
+	ItlNetworkUserClient	 uc;
+	std::mt19937_64		 rng;
+	uint32_t		 seq;
+};
+
+static uint64_t
+mac_key(const u_int8_t *mac)
+{
+	uint64_t k = 0;
+	int i;
+
+	for (i = 0; i < IEEE80211_ADDR_LEN; i++)
+		k = k << 8 | mac[i];
+	return k;
+}
+
+static void
+mac_from_key(u_int8_t *mac, uint64_t k)
+{
+	int i;
+
+	for (i = IEEE80211_ADDR_LEN - 1; i >= 0; i--, k >>= 8)
+		mac[i] = k & 0xff;
+}
+
+static struct ieee80211_node *
+node_find(struct scan *s, const u_int8_t *mac)
+{
+	struct ieee80211_node key;
+
+	memcpy(key.ni_macaddr, mac, IEEE80211_ADDR_LEN);
+	return RB_FIND(ieee80211_tree, &s->ic.ic_tree, &key);
+}
+
+static struct ieee80211_node *
+node_random(struct scan *s)
+{
+	struct ieee80211_node *ni;
+	int i = s->rng() % s->ic.ic_nnodes;
+
+	RB_FOREACH(ni, ieee80211_tree, &s->ic.ic_tree)
+		if (i-- == 0)
+			break;
+	return ni;
+}
+
+/* IE bytes a node's data can be told by. */
+static u_int8_t
+ie_byte(const struct ieee80211_node *ni, uint32_t i)
+{
+	return (ni->ni_macaddr[5] + ni->ni_macaddr[4] * 7 + i) & 0xff;
+}
+
+/* Beacon IE body sizes: mostly 120-500 bytes, 2% with big vendor IEs. */
+static uint32_t
+ie_size(std::mt19937_64 &rng)
+{
+	if (rng() % 50 == 0)
+		return 900 + rng() % 600;
+	return 120 + rng() % 381;
+}
+
+/*
+ * A BSS as the scan sees it.  APs announce up to four SSIDs from
+ * consecutive BSSIDs, so addresses come in runs.
+ */
+static struct ieee80211_node *
+node_make(struct scan *s, uint32_t ie_len)
+{
+	struct ieee80211_node *ni;
+	uint64_t r = s->rng();
+	uint32_t i;
+	int chan;
+
+	ni = (struct ieee80211_node *)calloc(1, sizeof(*ni));
+	ni->ni_macaddr[0] = (r & 0xfc) | 0x02;
+	ni->ni_macaddr[1] = 0x1b;
+	ni->ni_macaddr[2] = (r >> 8) & 0xff;
+	ni->ni_macaddr[3] = (s->seq >> 10) & 0xff;
+	ni->ni_macaddr[4] = (s->seq >> 2) & 0xff;
+	ni->ni_macaddr[5] = ((s->seq & 3) << 4) | ((r >> 16) & 0xf);
+	s->seq++;
+	memcpy(ni->ni_bssid, ni->ni_macaddr, IEEE80211_ADDR_LEN);
+	ni->ni_esslen = (r >> 24) % 20 == 0 ? 0 : 1 + (r >> 32) % IEEE80211_NWID_LEN;
+	for (i = 0; i < ni->ni_esslen; i++)
+		ni->ni_essid[i] = 'a' + (i + ni->ni_macaddr[5]) % 26;
+	if ((r >> 40) % 5 < 2)
+		chan = 1 + (r >> 44) % 13;
+	else
+		chan = 36 + 4 * ((r >> 44) % 33);
+	ni->ni_chan = &s->ic.ic_channels[chan];
+	ni->ni_rssi = (r >> 50) % 70;
+	ni->ni_capinfo = 0x0401 | ((r >> 58) & 1) << 4;
+	ni->ni_age_ts = airport_up_time() - (r >> 52) % 4000;
+	ni->ni_rsnie_tlv_len = ie_len;
+	ni->ni_rsnie_tlv = (u_int8_t *)malloc(ie_len);
+	for (i = 0; i < ie_len; i++)
+		ni->ni_rsnie_tlv[i] = ie_byte(ni, i);
+	return ni;
+}
+
+/* As ieee80211_setup_node() does. */
+static void
+node_add(struct scan *s, struct ieee80211_node *ni)
+{
+	if (RB_INSERT(ieee80211_tree, &s->ic.ic_tree, ni) != NULL) {
+		free(ni->ni_rsnie_tlv);
+		free(ni);
+		return;
+	}
+	s->ic.ic_nnodes++;
+	s->ic.ic_node_gen++;
+}
+
+/* As ieee80211_free_node() does. */
+static void
+node_free(struct scan *s, struct ieee80211_node *ni)
+{
+	RB_REMOVE(ieee80211_tree, &s->ic.ic_tree, ni);
+	s->ic.ic_nnodes--;
+	s->ic.ic_node_gen++;
+	free(ni->ni_rsnie_tlv);
+	free(ni);
+}
+
+static void
+scan_init(struct scan *s, uint64_t seed)
+{
+	int i;
+
+	memset(&s->ic, 0, sizeof(s->ic));
+	for (i = 0; i <= IEEE80211_CHAN_MAX; i++)
+		s->ic.ic_channels[i].ic_freq = i < 15 ? 2407 + 5 * i : 5000 + 5 * i;
+	RB_INIT(&s->ic.ic_tree);
+	s->hal.ic = &s->ic;
+	s->drv.fHalService = &s->hal;
+	memset(&s->uc, 0, sizeof(s->uc));
+	s->uc.fDriver = &s->drv;
+	s->uc.fDriverInfo = &s->info;
+	s->rng.seed(seed);
+	s->seq = 0;
+}
+
+/* Replay a scan of n BSSes into ic_tree in the order beacons arrive. */
+static void
+scan_replay(struct scan *s, int n)
+{
+	while (s->ic.ic_nnodes < n)
+		node_add(s, node_make(s, ie_size(s->rng)));
+}
+
+static void
+scan_destroy(struct scan *s)
+{
+	struct ieee80211_node *ni;
+
+	while ((ni = RB_MIN(ieee80211_tree, &s->ic.ic_tree)) != NULL)
+		node_free(s, ni);
+}
+
+static IOReturn
+bulk_get(struct scan *s, struct ioctl_scan_results *sr)
+{
+	return sSCAN_RESULTSGated(NULL, &s->uc, sr, NULL, NULL);
+}
+
+static IOReturn
+bulk_set(struct scan *s, const u_int8_t *cursor)
+{
+	struct ioctl_scan_results sr;
+
+	memset(&sr, 0, sizeof(sr));
+	if (cursor != NULL)
+		memcpy(sr.cursor, cursor, ETHER_ADDR_LEN);
+	return sSCAN_RESULTSGated(NULL, &s->uc, &sr, (void *)1, NULL);
+}
+
+static int
+rec_matches(struct scan *s, const struct ioctl_scan_record *rec,
+    const struct ieee80211_node *ni)
+{
+	uint32_t ie_len = MIN(ni->ni_rsnie_tlv_len, IE_MAX);
+	uint32_t i;
+
+	if (rec->ie_len != ie_len ||
+	    memcmp(rec->bssid, ni->ni_bssid, ETHER_ADDR_LEN) != 0 ||
+	    rec->ssid_len != ni->ni_esslen ||
+	    memcmp(rec->ssid, ni->ni_essid, ni->ni_esslen) != 0 ||
+	    rec->channel != (uint32_t)(ni->ni_chan - s->ic.ic_channels) ||
+	    rec->rssi != ni->ni_rssi - 100 || rec->noise != -96 ||
+	    rec->capinfo != ni->ni_capinfo)
+		return 0;
+	/* the clock moves on between the replay and the call */
+	if (rec->age + 1000 < airport_up_time() - ni->ni_age_ts ||
+	    rec->age > airport_up_time() - ni->ni_age_ts)
+		return 0;
+	for (i = 0; i < ie_len; i++)
+		if (rec->ie[i] != ie_byte(ni, i))
+			return 0;
+	return 1;
+}
+
+/*
+ * Walk the records of one bulk call, checking their layout and that each
+ * is the next node in the tree.  *next is the node the call should start
+ * at and is left at the one after the last record.
+ */
+static void
+check_records(struct scan *s, const struct ioctl_scan_results *sr,
+    struct ieee80211_node **next)
+{
+	const struct ioctl_scan_record *rec;
+	uint32_t off = 0, n = 0;
+
+	while (off < sr->len && n < sr->count) {
+		rec = (const struct ioctl_scan_record *)&sr->buf[off];
+		CHECK(off % 4 == 0 && rec->len % 4 == 0, "records are 4-byte aligned");
+		CHECK(rec->len == roundup(sizeof(*rec) + rec->ie_len, 4),
+		    "record length covers its IEs");
+		CHECK(off + rec->len <= sr->len, "record inside the used part of buf");
+		if (rec->len == 0 || off + rec->len > sr->len)
+			return;
+		CHECK(*next != NULL && rec_matches(s, rec, *next),
+		    "record matches the next node");
+		if (*next != NULL)
+			*next = RB_NEXT(ieee80211_tree, &s->ic.ic_tree, *next);
+		off += rec->len;
+		n++;
+	}
+	CHECK(off == sr->len && n == sr->count, "len and count cover the records");
+	CHECK(sr->len <= sizeof(sr->buf), "records inside buf");
+}
+
+static uint32_t
+reclen(const struct ieee80211_node *ni)
+{
+	return roundup(sizeof(struct ioctl_scan_record) +
+	    MIN(ni->ni_rsnie_tlv_len, IE_MAX), 4);
+}
+
+static void
+check_single(int n)
+{
+	struct scan s;
+	struct ioctl_network_info info;
+	struct ieee80211_node *ni;
+	int pass, i;
+
+	scan_init(&s, n);
+	scan_replay(&s, n);
+	for (pass = 0; pass < 2; pass++) {
+		ni = RB_MIN(ieee80211_tree, &s.ic.ic_tree);
+		for (i = 0; i < n; i++) {
+			CHECK(sSCAN_RESULT((OSObject *)&s.uc, &info, false) ==
+			    kIOReturnSuccess, "one BSS per call");
+			CHECK(memcmp(info.bssid, ni->ni_bssid, ETHER_ADDR_LEN) == 0 &&
+			    info.channel == (uint32_t)(ni->ni_chan - s.ic.ic_channels) &&
+			    info.rssi == ni->ni_rssi - 100,
+			    "one BSS per call in tree order");
+			ni = RB_NEXT(ieee80211_tree, &s.ic.ic_tree, ni);
+		}
+		CHECK(sSCAN_RESULT((OSObject *)&s.uc, &info, false) ==
+		    kIONoScanResult, "end of the results");
+	}
+	scan_destroy(&s);
+	scan_init(&s, 0);
+	CHECK(sSCAN_RESULT((OSObject *)&s.uc, &info, false) == kIONoScanResult,
+	    "no results from an empty tree");
+}
+
+static void
+check_bulk(int n)
+{
+	static struct ioctl_scan_results sr;
+	struct scan s;
+	struct ieee80211_node *ni, *prev;
+	u_int8_t below[ETHER_ADDR_LEN];
+	uint32_t calls, seen;
+	int pass, more, i;
+
+	scan_init(&s, n + 1);
+	scan_replay(&s, n);
+	for (pass = 0; pass < 2; pass++) {
+		ni = RB_MIN(ieee80211_tree, &s.ic.ic_tree);
+		calls = seen = 0;
+		do {
+			memset(&sr, 0xa5, sizeof(sr));
+			CHECK(bulk_get(&s, &sr) == kIOReturnSuccess, "bulk get");
+			CHECK(sr.version == IOCTL_VERSION, "version");
+			CHECK(sr.generation == s.ic.ic_node_gen, "generation");
+			CHECK(sr.count > 0, "every call makes progress");
+			check_records(&s, &sr, &ni);
+			seen += sr.count;
+			calls++;
+			more = sr.more;
+			CHECK(more == (ni != NULL), "more while nodes remain");
+			if (ni != NULL) {
+				CHECK(memcmp(sr.cursor, ni->ni_macaddr,
+				    ETHER_ADDR_LEN) == 0, "cursor is the next BSSID");
+				CHECK(sr.len + reclen(ni) > SCAN_RESULTS_BUF_LEN,
+				    "a call stops only when the next record does not fit");
+			} else {
+				static const u_int8_t zero[ETHER_ADDR_LEN] = {};
+
+				CHECK(memcmp(sr.cursor, zero, ETHER_ADDR_LEN) == 0,
+				    "cursor rewinds after the last record");
+			}
+		} while (more && calls <= (uint32_t)n);
+		CHECK(seen == (uint32_t)n, "a pass returns every node");
+	}
+
+	/* Set: to the first BSSID not below the one given, zeroes rewind. */
+	ni = RB_MIN(ieee80211_tree, &s.ic.ic_tree);
+	for (i = 0; i < n / 2; i++)
+		ni = RB_NEXT(ieee80211_tree, &s.ic.ic_tree, ni);
+	mac_from_key(below, mac_key(ni->ni_macaddr) - 1);
+	prev = RB_PREV(ieee80211_tree, &s.ic.ic_tree, ni);
+	if (prev != NULL && mac_key(prev->ni_macaddr) < mac_key(below)) {
+		bulk_set(&s, below);
+		bulk_get(&s, &sr);
+		CHECK(sr.count > 0 && memcmp(((struct ioctl_scan_record *)
+		    sr.buf)->bssid, ni->ni_macaddr, ETHER_ADDR_LEN) == 0,
+		    "set moves the cursor to the next BSSID");
+	}
+	bulk_set(&s, ni->ni_macaddr);
+	bulk_get(&s, &sr);
+	CHECK(sr.count > 0 && memcmp(((struct ioctl_scan_record *)
+	    sr.buf)->bssid, ni->ni_macaddr, ETHER_ADDR_LEN) == 0,
+	    "set moves the cursor to that BSSID");
+	bulk_set(&s, NULL);
+	bulk_get(&s, &sr);
+	CHECK(sr.count > 0 && memcmp(((struct ioctl_scan_record *)sr.buf)->bssid,
+	    RB_MIN(ieee80211_tree, &s.ic.ic_tree)->ni_macaddr,
+	    ETHER_ADDR_LEN) == 0, "a zero set rewinds");
+	bulk_set(&s, NULL);
+	scan_destroy(&s);
+
+	scan_init(&s, 0);
+	CHECK(bulk_get(&s, &sr) == kIONoScanResult, "no results from an empty tree");
+}
+
+/*
+ * Nodes freed and added between calls.  The walk resumes by address, so
+ * every node present for the whole pass comes back once.
+ */
+static void
+check_churn(int n, int seeds)
+{
+	static struct ioctl_scan_results sr;
+	struct scan s;
+	struct ieee80211_node *ni;
+	std::set<uint64_t> stable, gone, seen;
+	uint64_t k, last;
+	uint32_t gen, calls;
+	int seed, i, dup, changed;
+
+	for (seed = 0; seed < seeds; seed++) {
+		scan_init(&s, 1000 + seed);
+		scan_replay(&s, n);
+		stable.clear();
+		gone.clear();
+		seen.clear();
+		RB_FOREACH(ni, ieee80211_tree, &s.ic.ic_tree)
+			stable.insert(mac_key(ni->ni_macaddr));
+		bulk_set(&s, NULL);
+		dup = changed = 0;
+		calls = 0;
+		last = 0;
+		gen = s.ic.ic_node_gen;
+		do {
+			CHECK(bulk_get(&s, &sr) == kIOReturnSuccess, "bulk get");
+			for (uint32_t off = 0; off < sr.len; ) {
+				struct ioctl_scan_record *rec =
+				    (struct ioctl_scan_record *)&sr.buf[off];
+
+				k = mac_key(rec->bssid);
+				dup += !seen.insert(k).second;
+				CHECK(gone.count(k) == 0, "no freed node after its free");
+				CHECK(k >= last, "records in BSSID order");
+				last = k;
+				off += rec->len;
+			}
+			changed |= sr.generation != gen;
+			gen = sr.generation;
+			calls++;
+
+			/* the cursor's node, and a few others */
+			if (sr.more && s.rng() % 2 &&
+			    (ni = node_find(&s, sr.cursor)) != NULL) {
+				k = mac_key(ni->ni_macaddr);
+				stable.erase(k);
+				gone.insert(k);
+				node_free(&s, ni);
+			}
+			for (i = 0; i < 3; i++) {
+				int r = s.rng() % 4;
+
+				if (r == 0) {
+					node_add(&s, node_make(&s, ie_size(s.rng)));
+				} else if (r == 1 && s.ic.ic_nnodes > 0) {
+					ni = node_random(&s);
+					k = mac_key(ni->ni_macaddr);
+					stable.erase(k);
+					gone.insert(k);
+					node_free(&s, ni);
+				}
+			}
+		} while (sr.more && calls <= (uint32_t)n * 2);
+		CHECK(!sr.more, "a churned pass ends");
+		CHECK(dup == 0, "no node twice in a pass");
+		CHECK(changed, "generation changes with the tree");
+		for (k = 0; !stable.empty(); stable.erase(stable.begin()))
+			k += seen.count(*stable.begin()) == 0;
+		CHECK(k == 0, "every node present throughout is returned");
+		scan_destroy(&s);
+	}
+}
+
+/* IEs that would not fit an empty buffer are cut, not a stall. */
+static void
+check_oversize(void)
+{
+	static struct ioctl_scan_results sr;
+	struct scan s;
+	struct ieee80211_node *big;
+	uint32_t seen = 0, calls = 0;
+
+	scan_init(&s, 7);
+	scan_replay(&s, 20);
+	big = node_make(&s, SCAN_RESULTS_BUF_LEN + 1000);
+	node_add(&s, big);
+	bulk_set(&s, NULL);
+	do {
+		CHECK(bulk_get(&s, &sr) == kIOReturnSuccess, "bulk get");
+		CHECK(sr.count > 0, "oversized IEs do not stall the walk");
+		seen += sr.count;
+	} while (sr.more && sr.count > 0 && ++calls < 100);
+	CHECK(seen == 21, "oversized IEs: every node returned");
+	bulk_set(&s, big->ni_macaddr);
+	bulk_get(&s, &sr);
+	CHECK(sr.count == 1 && sr.len == SCAN_RESULTS_BUF_LEN &&
+	    rec_matches(&s, (struct ioctl_scan_record *)sr.buf, big),
+	    "oversized IEs are cut to fill buf");
+	scan_destroy(&s);
+}
+
+static uint64_t
+wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Stands in for the copyout of the structure to the caller. */
+static void
+copyout(const void *src, void *dst, size_t len)
+{
+	memcpy(dst, src, len);
+	__asm__ __volatile__("" : : "r"(dst) : "memory");
+}
+
+struct result {
+	double	 calls;		/* per pass */
+	double	 kbytes;	/* copied out per pass */
+	double	 handler_us;	/* handler and copyout per pass */
+};
+
+static struct result
+bench_single(int n, int passes)
+{
+	static struct ioctl_network_info info, user;
+	struct result res = {};
+	struct scan s;
+	uint64_t t0, calls = 0;
+	int pass;
+
+	scan_init(&s, 42);
+	scan_replay(&s, n);
+	t0 = wall_ns();
+	for (pass = 0; pass < passes; pass++) {
+		do {
+			calls++;
+			copyout(&info, &user, sizeof(info));
+		} while (sSCAN_RESULT((OSObject *)&s.uc, &info, false) ==
+		    kIOReturnSuccess);
+	}
+	res.handler_us = (wall_ns() - t0) / 1e3 / passes;
+	res.calls = (double)calls / passes;
+	res.kbytes = res.calls * sizeof(info) / 1024.0;
+	CHECK(calls == (uint64_t)passes * (n + 1), "one BSS per call: n + 1 calls");
+	scan_destroy(&s);
+	return res;
+}
+
+static struct result
+bench_bulk(int n, int passes)
+{
+	static struct ioctl_scan_results sr, user;
+	struct result res = {};
+	struct scan s;
+	uint64_t t0, calls = 0, seen = 0;
+	int pass;
+
+	scan_init(&s, 42);
+	scan_replay(&s, n);
+	t0 = wall_ns();
+	for (pass = 0; pass < passes; pass++) {
+		do {
+			bulk_get(&s, &sr);
+			copyout(&sr, &user, sizeof(sr));
+			seen += sr.count;
+			calls++;
+		} while (sr.more);
+	}
+	res.handler_us = (wall_ns() - t0) / 1e3 / passes;
+	res.calls = (double)calls / passes;
+	res.kbytes = res.calls * sizeof(sr) / 1024.0;
+	CHECK(seen == (uint64_t)passes * n, "bulk: every node each pass");
+	scan_destroy(&s);
+	return res;
+}
+
+/* One user/kernel crossing that copies len bytes out, in microseconds. */
+static double
+crossing_us(size_t len, int iters)
+{
+	static char buf[8192];
+	uint64_t t0;
+	int fd, i;
+
+	fd = open("/dev/zero", O_RDONLY);
+	if (fd < 0)
+		return 0;
+	t0 = wall_ns();
+	for (i = 0; i < iters; i++)
+		if (read(fd, buf, len) != (ssize_t)len)
+			break;
+	close(fd);
+	return (wall_ns() - t0) / 1e3 / iters;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: scanbench [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int counts[] = { 100, 300, 500 };
+	struct result one, bulk;
+	double x_one, x_bulk;
+	int quick = 0, ch, passes;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	check_single(500);
+	check_bulk(500);
+	check_bulk(1);
+	check_churn(500, quick ? 3 : 50);
+	check_oversize();
+
+	passes = quick ? 20 : 2000;
+	x_one = crossing_us(sizeof(struct ioctl_network_info), passes * 100);
+	x_bulk = crossing_us(sizeof(struct ioctl_scan_results), passes * 100);
+	printf("%-24s %.2f us (%zu bytes), %.2f us (%zu bytes)\n",
+	    "read() per call", x_one, sizeof(struct ioctl_network_info),
+	    x_bulk, sizeof(struct ioctl_scan_results));
+	printf("%-24s %9s %9s %9s %9s\n", "", "calls", "KB out",
+	    "handler us", "pass us");
+	for (i = 0; i < nitems(counts); i++) {
+		char label[32];
+
+		one = bench_single(counts[i], passes);
+		bulk = bench_bulk(counts[i], passes);
+		snprintf(label, sizeof(label), "%d BSS one per call", counts[i]);
+		printf("%-24s %9.0f %9.1f %9.1f %9.1f\n", label, one.calls,
+		    one.kbytes, one.handler_us, one.handler_us + one.calls * x_one);
+		snprintf(label, sizeof(label), "%d BSS bulk", counts[i]);
+		printf("%-24s %9.0f %9.1f %9.1f %9.1f\n", label, bulk.calls,
+		    bulk.kbytes, bulk.handler_us,
+		    bulk.handler_us + bulk.calls * x_bulk);
+	}
+
+	printf("scanbench: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
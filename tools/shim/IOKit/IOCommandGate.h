@@ -0,0 +1,7 @@
+/* Host build shim for <IOKit/IOCommandGate.h>; nothing is used from it. */
+#ifndef _SHIM_IOKIT_IOCOMMANDGATE_H_
+#define _SHIM_IOKIT_IOCOMMANDGATE_H_
+
+#include <IOKit/IOLocks.h>
+
+#endif /* _SHIM_IOKIT_IOCOMMANDGATE_H_ */
@@ -0,0 +1,88 @@
+/*
+ * Host build shim for <IOKit/IOLib.h>.  Allocation, logging and the
+ * uptime clock map onto libc, though a simulator may supply the clock;
+ * read_random() is a seeded xorshift so that runs of the tools are
+ * reproducible.
+ */
+#ifndef _SHIM_IOKIT_IOLIB_H_
+#define _SHIM_IOKIT_IOLIB_H_
+
+#include <sys/types.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/time.h>
+
+typedef size_t vm_size_t;
+
+static inline void *
+IOMalloc(vm_size_t size)
+{
+	return malloc(size);
+}
+
+static inline void
+IOFree(void *p, vm_size_t size)
+{
+	(void)size;
+	free(p);
+}
+
+#define IOLog(...)	fprintf(stderr, __VA_ARGS__)
+#define XYLog(...)	do { } while (0)
+
+[[noreturn]] static inline void
+panic(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	abort();
+}
+
+/*
+ * Absolute time is kept in nanoseconds.  Simulators point
+ * shim_sim_uptime at their own clock; otherwise the host's is used.
+ */
+extern const uint64_t *shim_sim_uptime;
+
+static inline void
+clock_get_uptime(uint64_t *t)
+{
+	struct timespec ts;
+
+	if (shim_sim_uptime != NULL) {
+		*t = *shim_sim_uptime;
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*t = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void
+absolutetime_to_nanoseconds(uint64_t t, uint64_t *ns)
+{
+	*ns = t;
+}
+
+static inline void
+microuptime(struct timeval *tv)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+}
+#define getmicrouptime(tv)	microuptime(tv)
+
+void	shim_random_seed(uint64_t);
+void	read_random(void *, u_int);
+
+#endif /* _SHIM_IOKIT_IOLIB_H_ */
@@ -0,0 +1,30 @@
+/*
+ * Host build shim for <IOKit/IOLocks.h>: plain and recursive locks, and
+ * IORecursiveLockSleep()/IORecursiveLockWakeup(), on pthreads.
+ *
+ * A wakeup wakes every sleeper on the lock, whatever event it waits for,
+ * so sleepers see spurious wakeups.  The kernel allows those too and
+ * every caller re-checks its condition.
+ */
+#ifndef _SHIM_IOKIT_IOLOCKS_H_
+#define _SHIM_IOKIT_IOLOCKS_H_
+
+#include <kern/thread.h>
+#include <stdint.h>
+
+typedef struct _IOLock IOLock;
+typedef struct _IORecursiveLock IORecursiveLock;
+
+IOLock	*IOLockAlloc(void);
+void	IOLockFree(IOLock *);
+void	IOLockLock(IOLock *);
+void	IOLockUnlock(IOLock *);
+
+IORecursiveLock	*IORecursiveLockAlloc(void);
+void	IORecursiveLockFree(IORecursiveLock *);
+void	IORecursiveLockLock(IORecursiveLock *);
+void	IORecursiveLockUnlock(IORecursiveLock *);
+int	IORecursiveLockSleep(IORecursiveLock *, void *, uint32_t);
+void	IORecursiveLockWakeup(IORecursiveLock *, void *, bool);
+
+#endif /* _SHIM_IOKIT_IOLOCKS_H_ */
@@ -0,0 +1,14 @@
+/* Host build shim for <IOKit/IOReturn.h>. */
+#ifndef _SHIM_IOKIT_IORETURN_H_
+#define _SHIM_IOKIT_IORETURN_H_
+
+typedef int	IOReturn;
+
+#define kIOReturnSuccess	0
+#define kIOReturnError		0x2bc
+#define kIOReturnNoMemory	0x2bd
+#define kIOReturnNoResources	0x2be
+#define kIOReturnBadArgument	0x2c2
+#define kIOReturnOutputDropped	0x2d7
+
+#endif /* _SHIM_IOKIT_IORETURN_H_ */
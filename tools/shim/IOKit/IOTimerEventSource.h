@@ -0,0 +1,60 @@
+/*
+ * Host build shim for <IOKit/IOTimerEventSource.h>.  The timer only
+ * records when it is due, on the uptime clock; a tool fires it by
+ * calling shim_fire() once it has moved the clock there.
+ */
+#ifndef _SHIM_IOKIT_IOTIMEREVENTSOURCE_H_
+#define _SHIM_IOKIT_IOTIMEREVENTSOURCE_H_
+
+#include <IOKit/IOLib.h>
+#include <IOKit/IOWorkLoop.h>
+
+typedef uint32_t	UInt32;
+
+class IOTimerEventSource : public IOEventSource {
+public:
+	typedef void (*Action)(OSObject *, IOTimerEventSource *);
+
+	OSObject	*shim_owner = NULL;
+	Action		 shim_action = NULL;
+	bool		 shim_armed = false;
+	uint64_t	 shim_deadline = 0;	/* uptime, ns */
+	uint64_t	 shim_programs = 0;	/* setTimeout calls */
+
+	static IOTimerEventSource *
+	timerEventSource(OSObject *owner, Action action)
+	{
+		IOTimerEventSource *es = new IOTimerEventSource;
+
+		es->shim_owner = owner;
+		es->shim_action = action;
+		return es;
+	}
+
+	IOReturn
+	setTimeoutUS(UInt32 us)
+	{
+		uint64_t now;
+
+		clock_get_uptime(&now);
+		shim_deadline = now + (uint64_t)us * 1000;
+		shim_armed = true;
+		shim_programs++;
+		return kIOReturnSuccess;
+	}
+
+	void
+	cancelTimeout()
+	{
+		shim_armed = false;
+	}
+
+	void
+	shim_fire()
+	{
+		shim_armed = false;
+		shim_action(shim_owner, this);
+	}
+};
+
+#endif /* _SHIM_IOKIT_IOTIMEREVENTSOURCE_H_ */
@@ -0,0 +1,46 @@
+/*
+ * Host build shim for <IOKit/IOWorkLoop.h>.  Nothing runs on it; it
+ * only records its event sources so that a tool can drive them.
+ */
+#ifndef _SHIM_IOKIT_IOWORKLOOP_H_
+#define _SHIM_IOKIT_IOWORKLOOP_H_
+
+#include <IOKit/IOReturn.h>
+#include <libkern/c++/OSObject.h>
+
+class IOEventSource : public OSObject {
+public:
+	void enable() {}
+	void disable() {}
+};
+
+class IOWorkLoop : public OSObject {
+public:
+	enum { SHIM_MAX_SOURCES = 8 };
+
+	IOEventSource	*shim_sources[SHIM_MAX_SOURCES] = {};
+	int		 shim_nsources = 0;
+
+	IOReturn
+	addEventSource(IOEventSource *es)
+	{
+		if (shim_nsources == SHIM_MAX_SOURCES)
+			return kIOReturnNoResources;
+		shim_sources[shim_nsources++] = es;
+		return kIOReturnSuccess;
+	}
+
+	IOReturn
+	removeEventSource(IOEventSource *es)
+	{
+		for (int i = 0; i < shim_nsources; i++) {
+			if (shim_sources[i] == es) {
+				shim_sources[i] = shim_sources[--shim_nsources];
+				return kIOReturnSuccess;
+			}
+		}
+		return kIOReturnError;
+	}
+};
+
+#endif /* _SHIM_IOKIT_IOWORKLOOP_H_ */
@@ -0,0 +1,7 @@
+/* Host build shim for <kern/clock.h>; the clock lives in IOLib.h. */
+#ifndef _SHIM_KERN_CLOCK_H_
+#define _SHIM_KERN_CLOCK_H_
+
+#include <IOKit/IOLib.h>
+
+#endif /* _SHIM_KERN_CLOCK_H_ */
@@ -0,0 +1,43 @@
+/*
+ * Host build shim for the Mach thread calls the itl80211 sources use,
+ * mapped onto pthreads.
+ */
+#ifndef _SHIM_KERN_THREAD_H_
+#define _SHIM_KERN_THREAD_H_
+
+#include <pthread.h>
+
+typedef pthread_t	thread_t;
+typedef void		(*thread_continue_t)(void *, int);
+typedef int		kern_return_t;
+
+#define KERN_SUCCESS		0
+#define KERN_FAILURE		5
+
+#define THREAD_UNINT		0
+#define THREAD_INTERRUPTIBLE	1
+#define THREAD_AWAKENED		0
+#define THREAD_TIMED_OUT	1
+
+kern_return_t	kernel_thread_start(thread_continue_t, void *, thread_t *);
+
+static inline thread_t
+current_thread(void)
+{
+	return pthread_self();
+}
+
+static inline void
+thread_deallocate(thread_t thread)
+{
+	(void)thread;
+}
+
+[[noreturn]] static inline void
+thread_terminate(thread_t thread)
+{
+	(void)thread;
+	pthread_exit(NULL);
+}
+
+#endif /* _SHIM_KERN_THREAD_H_ */
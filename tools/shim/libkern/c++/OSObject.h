@@ -0,0 +1,16 @@
+/*
+ * Host build shim for <libkern/c++/OSObject.h>: reference counting
+ * reduced to a single owner, which is all the tools need.
+ */
+#ifndef _SHIM_LIBKERN_OSOBJECT_H_
+#define _SHIM_LIBKERN_OSOBJECT_H_
+
+#define OSDeclareDefaultStructors(className)
+
+class OSObject {
+public:
+	virtual ~OSObject() {}
+	virtual void release() { delete this; }
+};
+
+#endif /* _SHIM_LIBKERN_OSOBJECT_H_ */
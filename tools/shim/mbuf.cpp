@@ -0,0 +1,673 @@
+/*
+ * Host build shim: the mbuf KPI model declared in <sys/kpi_mbuf.h>.
+ */
+#include <sys/param.h>
+#include <sys/kpi_mbuf.h>
+#include <sys/socket.h>
+
+uint64_t shim_mbuf_allocs;
+uint64_t shim_cluster_allocs;
+uint64_t shim_pullup_bytes;
+
+#define MIN_(a, b)	((a) < (b) ? (a) : (b))
+
+static mbuf_t
+shim_mbuf_alloc(mbuf_type_t type, int pkthdr)
+{
+	mbuf_t m;
+
+	m = (mbuf_t)calloc(1, sizeof(*m));
+	if (m == NULL)
+		return NULL;
+	m->type = type;
+	if (pkthdr) {
+		m->flags = MBUF_PKTHDR;
+		/* the packet header eats into the inline data area */
+		m->data = m->dat + (SHIM_MLEN - SHIM_MHLEN);
+	} else
+		m->data = m->dat;
+	shim_mbuf_allocs++;
+	return m;
+}
+
+static int
+shim_mbuf_attach_cluster(mbuf_t m, size_t size)
+{
+	struct shim_mbuf_ext *ext;
+
+	ext = (struct shim_mbuf_ext *)malloc(sizeof(*ext));
+	if (ext == NULL)
+		return ENOMEM;
+	ext->buf = (uint8_t *)malloc(size);
+	if (ext->buf == NULL) {
+		free(ext);
+		return ENOMEM;
+	}
+	ext->size = size;
+	ext->refs = 1;
+	ext->extfree = NULL;
+	m->ext = ext;
+	m->flags |= MBUF_EXT;
+	m->data = ext->buf;
+	shim_cluster_allocs++;
+	return 0;
+}
+
+errno_t
+mbuf_get(mbuf_how_t how, mbuf_type_t type, mbuf_t *mp)
+{
+	(void)how;
+	*mp = shim_mbuf_alloc(type, 0);
+	return *mp == NULL ? ENOMEM : 0;
+}
+
+errno_t
+mbuf_gethdr(mbuf_how_t how, mbuf_type_t type, mbuf_t *mp)
+{
+	(void)how;
+	*mp = shim_mbuf_alloc(type, 1);
+	return *mp == NULL ? ENOMEM : 0;
+}
+
+errno_t
+mbuf_mclget(mbuf_how_t how, mbuf_type_t type, mbuf_t *mp)
+{
+	int created = 0;
+
+	if (*mp == NULL) {
+		if (mbuf_get(how, type, mp) != 0)
+			return ENOMEM;
+		created = 1;
+	}
+	if (shim_mbuf_attach_cluster(*mp, SHIM_MCLBYTES) != 0) {
+		if (created) {
+			mbuf_free(*mp);
+			*mp = NULL;
+		}
+		return ENOMEM;
+	}
+	return 0;
+}
+
+errno_t
+mbuf_getcluster(mbuf_how_t how, mbuf_type_t type, size_t size, mbuf_t *mp)
+{
+	int created = 0;
+
+	if (size != SHIM_MCLBYTES && size != SHIM_MBIGCLBYTES &&
+	    size != SHIM_M16KCLBYTES)
+		return EINVAL;
+	if (*mp == NULL) {
+		if (mbuf_gethdr(how, type, mp) != 0)
+			return ENOMEM;
+		created = 1;
+	}
+	if (shim_mbuf_attach_cluster(*mp, size) != 0) {
+		if (created) {
+			mbuf_free(*mp);
+			*mp = NULL;
+		}
+		return ENOMEM;
+	}
+	return 0;
+}
+
+errno_t
+mbuf_attachcluster(mbuf_how_t how, mbuf_type_t type, mbuf_t *mp,
+    caddr_t extbuf, void (*extfree)(caddr_t, u_int, caddr_t), size_t extsize,
+    caddr_t extarg)
+{
+	struct shim_mbuf_ext *ext;
+	int created = 0;
+
+	if (extbuf == NULL || extfree == NULL || extsize == 0)
+		return EINVAL;
+	if (*mp == NULL) {
+		if (mbuf_gethdr(how, type, mp) != 0)
+			return ENOMEM;
+		created = 1;
+	}
+	ext = (struct shim_mbuf_ext *)malloc(sizeof(*ext));
+	if (ext == NULL) {
+		if (created) {
+			mbuf_free(*mp);
+			*mp = NULL;
+		}
+		return ENOMEM;
+	}
+	ext->buf = (uint8_t *)extbuf;
+	ext->size = extsize;
+	ext->refs = 1;
+	ext->extfree = extfree;
+	ext->extarg = extarg;
+	(*mp)->ext = ext;
+	(*mp)->flags |= MBUF_EXT;
+	(*mp)->data = ext->buf;
+	return 0;
+}
+
+mbuf_t
+mbuf_free(mbuf_t m)
+{
+	mbuf_t n = m->next;
+
+	if ((m->flags & MBUF_EXT) && --m->ext->refs == 0) {
+		if (m->ext->extfree != NULL)
+			m->ext->extfree((caddr_t)m->ext->buf,
+			    (u_int)m->ext->size, m->ext->extarg);
+		else
+			free(m->ext->buf);
+		free(m->ext);
+	}
+	free(m);
+	return n;
+}
+
+void
+mbuf_freem(mbuf_t m)
+{
+	while (m != NULL)
+		m = mbuf_free(m);
+}
+
+int
+mbuf_mclhasreference(mbuf_t m)
+{
+	return (m->flags & MBUF_EXT) && m->ext->refs > 1;
+}
+
+size_t
+mbuf_leadingspace(const mbuf_t m)
+{
+	if (mbuf_mclhasreference(m))
+		return 0;
+	return m->data - (uint8_t *)mbuf_datastart(m);
+}
+
+size_t
+mbuf_trailingspace(const mbuf_t m)
+{
+	if (mbuf_mclhasreference(m))
+		return 0;
+	return (uint8_t *)mbuf_datastart(m) + mbuf_maxlen(m) -
+	    (m->data + m->len);
+}
+
+errno_t
+mbuf_setdata(mbuf_t m, void *data, size_t len)
+{
+	uint8_t *start = (uint8_t *)mbuf_datastart(m);
+
+	if ((uint8_t *)data < start ||
+	    (uint8_t *)data + len > start + mbuf_maxlen(m))
+		return EINVAL;
+	m->data = (uint8_t *)data;
+	m->len = len;
+	return 0;
+}
+
+errno_t
+mbuf_copy_pkthdr(mbuf_t to, const mbuf_t from)
+{
+	if (!(from->flags & MBUF_PKTHDR))
+		return EINVAL;
+	to->flags |= from->flags & ~MBUF_EXT;
+	to->pktlen = from->pktlen;
+	to->rcvif = from->rcvif;
+	to->csum_flags = from->csum_flags;
+	to->csum_data = from->csum_data;
+	/* like m_copy_pkthdr(), an inline buffer now starts after the header */
+	if (!(to->flags & MBUF_EXT))
+		to->data = (uint8_t *)mbuf_datastart(to);
+	return 0;
+}
+
+errno_t
+mbuf_copydata(const mbuf_t m0, size_t off, size_t len, void *out)
+{
+	uint8_t *o = (uint8_t *)out;
+	mbuf_t m = m0;
+	size_t n;
+
+	while (m != NULL && off >= m->len) {
+		off -= m->len;
+		m = m->next;
+	}
+	while (len > 0) {
+		if (m == NULL)
+			return EINVAL;
+		n = MIN_(m->len - off, len);
+		memcpy(o, m->data + off, n);
+		o += n;
+		len -= n;
+		off = 0;
+		m = m->next;
+	}
+	return 0;
+}
+
+errno_t
+mbuf_copyback(mbuf_t m0, size_t off, size_t len, const void *data,
+    mbuf_how_t how)
+{
+	const uint8_t *d = (const uint8_t *)data;
+	mbuf_t m = m0;
+	size_t n;
+
+	(void)how;
+	while (m != NULL && off >= m->len) {
+		off -= m->len;
+		m = m->next;
+	}
+	while (len > 0) {
+		if (m == NULL)
+			return EINVAL;
+		n = MIN_(m->len - off, len);
+		memcpy(m->data + off, d, n);
+		d += n;
+		len -= n;
+		off = 0;
+		m = m->next;
+	}
+	return 0;
+}
+
+/* Deep copy of the whole chain into fresh storage, as XNU's m_dup(). */
+errno_t
+mbuf_dup(const mbuf_t src, mbuf_how_t how, mbuf_t *mp)
+{
+	mbuf_t m, last = NULL, s;
+
+	*mp = NULL;
+	for (s = src; s != NULL; s = s->next) {
+		if (s == src && (s->flags & MBUF_PKTHDR))
+			mbuf_gethdr(how, s->type, &m);
+		else
+			mbuf_get(how, s->type, &m);
+		if (m == NULL)
+			goto fail;
+		if (s->len > SHIM_MHLEN &&
+		    shim_mbuf_attach_cluster(m, s->len > SHIM_MCLBYTES ?
+		    SHIM_M16KCLBYTES : SHIM_MCLBYTES) != 0) {
+			mbuf_free(m);
+			goto fail;
+		}
+		if (s == src)
+			mbuf_copy_pkthdr(m, s);
+		memcpy(m->data, s->data, s->len);
+		m->len = s->len;
+		if (last == NULL)
+			*mp = m;
+		else
+			last->next = m;
+		last = m;
+	}
+	return 0;
+fail:
+	mbuf_freem(*mp);
+	*mp = NULL;
+	return ENOMEM;
+}
+
+/* Copy of a range that shares clusters with the source, like m_copym(). */
+errno_t
+mbuf_copym(const mbuf_t src, size_t off, size_t len, mbuf_how_t how,
+    mbuf_t *mp)
+{
+	mbuf_t m, last = NULL, s = src;
+	size_t n;
+
+	*mp = NULL;
+	while (s != NULL && off >= s->len) {
+		off -= s->len;
+		s = s->next;
+	}
+	while (len > 0 && s != NULL) {
+		if (last == NULL && (src->flags & MBUF_PKTHDR))
+			mbuf_gethdr(how, s->type, &m);
+		else
+			mbuf_get(how, s->type, &m);
+		if (m == NULL) {
+			mbuf_freem(*mp);
+			*mp = NULL;
+			return ENOMEM;
+		}
+		n = MIN_(s->len - off, len);
+		if (s->flags & MBUF_EXT) {
+			m->ext = s->ext;
+			m->ext->refs++;
+			m->flags |= MBUF_EXT;
+			m->data = s->data + off;
+		} else
+			memcpy(m->data, s->data + off, n);
+		m->len = n;
+		if (last == NULL) {
+			*mp = m;
+			if (src->flags & MBUF_PKTHDR) {
+				mbuf_copy_pkthdr(m, src);
+				if (len != MBUF_COPYALL)
+					m->pktlen = len;
+			}
+		} else
+			last->next = m;
+		last = m;
+		if (len != MBUF_COPYALL)
+			len -= n;
+		off = 0;
+		s = s->next;
+	}
+	return 0;
+}
+
+errno_t
+mbuf_prepend(mbuf_t *mp, size_t len, mbuf_how_t how)
+{
+	mbuf_t m = *mp, n;
+
+	if (mbuf_leadingspace(m) >= len) {
+		m->data -= len;
+		m->len += len;
+		if (m->flags & MBUF_PKTHDR)
+			m->pktlen += len;
+		return 0;
+	}
+	if (len > SHIM_MHLEN)
+		return EINVAL;
+	if (mbuf_gethdr(how, m->type, &n) != 0) {
+		mbuf_freem(m);
+		*mp = NULL;
+		return ENOMEM;
+	}
+	if (m->flags & MBUF_PKTHDR) {
+		mbuf_copy_pkthdr(n, m);
+		m->flags &= ~MBUF_PKTHDR;
+	}
+	/* leave the new data at the end of the buffer, like M_ALIGN */
+	n->data = n->dat + SHIM_MLEN - len;
+	n->len = len;
+	n->next = m;
+	n->pktlen += len;
+	*mp = n;
+	return 0;
+}
+
+errno_t
+mbuf_pullup(mbuf_t *mp, size_t len)
+{
+	mbuf_t m = *mp, n;
+	size_t space, cnt;
+
+	/*
+	 * As XNU's m_pullup(): only a plain mbuf with more mbufs behind it
+	 * is pulled up into, even when it already holds len bytes.  The
+	 * head of a cluster mbuf always moves into a new one.
+	 */
+	if (!(m->flags & MBUF_EXT) && m->next != NULL &&
+	    (uint8_t *)mbuf_datastart(m) + mbuf_maxlen(m) >= m->data + len) {
+		if (m->len >= len)
+			return 0;
+		n = m;
+		m = m->next;
+		len -= n->len;
+	} else {
+		if (len > SHIM_MHLEN) {
+			mbuf_freem(m);
+			*mp = NULL;
+			return EINVAL;
+		}
+		if (mbuf_gethdr(MBUF_DONTWAIT, m->type, &n) != 0) {
+			mbuf_freem(m);
+			*mp = NULL;
+			return ENOMEM;
+		}
+		if (m->flags & MBUF_PKTHDR) {
+			mbuf_copy_pkthdr(n, m);
+			m->flags &= ~MBUF_PKTHDR;
+		}
+	}
+	space = (uint8_t *)mbuf_datastart(n) + mbuf_maxlen(n) -
+	    (n->data + n->len);
+	while (len > 0 && m != NULL) {
+		cnt = MIN_(MIN_(space, len), m->len);
+		memcpy(n->data + n->len, m->data, cnt);
+		shim_pullup_bytes += cnt;
+		len -= cnt;
+		space -= cnt;
+		n->len += cnt;
+		m->data += cnt;
+		m->len -= cnt;
+		if (m->len == 0)
+			m = mbuf_free(m);
+	}
+	if (len > 0) {
+		mbuf_freem(n);
+		mbuf_freem(m);
+		*mp = NULL;
+		return EINVAL;
+	}
+	n->next = m;
+	*mp = n;
+	return 0;
+}
+
+errno_t
+mbuf_split(mbuf_t m0, size_t len, mbuf_how_t how, mbuf_t *mp)
+{
+	mbuf_t m = m0, n;
+	size_t remain;
+
+	while (m != NULL && len > m->len) {
+		len -= m->len;
+		m = m->next;
+	}
+	if (m == NULL)
+		return EINVAL;
+	remain = m->len - len;
+	if (mbuf_gethdr(how, m->type, &n) != 0)
+		return ENOMEM;
+	if (m->flags & MBUF_EXT) {
+		n->ext = m->ext;
+		n->ext->refs++;
+		n->flags |= MBUF_EXT;
+		n->data = m->data + len;
+	} else if (remain > 0)
+		memcpy(n->data, m->data + len, remain);
+	n->len = remain;
+	n->next = m->next;
+	m->len = len;
+	m->next = NULL;
+	for (remain = 0, m = n; m != NULL; m = m->next)
+		remain += m->len;
+	n->pktlen = remain;
+	if (m0->flags & MBUF_PKTHDR)
+		m0->pktlen -= remain;
+	*mp = n;
+	return 0;
+}
+
+/* Trim len bytes from the head (len > 0) or the tail (len < 0). */
+void
+mbuf_adj(mbuf_t mp, int req_len)
+{
+	size_t len, total;
+	mbuf_t m;
+
+	if (mp == NULL)
+		return;
+	if (req_len >= 0) {
+		len = req_len;
+		for (m = mp; m != NULL && len > 0; m = m->next) {
+			if (m->len <= len) {
+				len -= m->len;
+				m->len = 0;
+			} else {
+				m->data += len;
+				m->len -= len;
+				len = 0;
+			}
+		}
+		if (mp->flags & MBUF_PKTHDR)
+			mp->pktlen -= req_len - len;
+		return;
+	}
+	len = -req_len;
+	for (total = 0, m = mp; m != NULL; m = m->next)
+		total += m->len;
+	if (len > total)
+		len = total;
+	total -= len;
+	if (mp->flags & MBUF_PKTHDR)
+		mp->pktlen = total;
+	for (m = mp; m != NULL; m = m->next) {
+		if (m->len >= total) {
+			m->len = total;
+			for (m = m->next; m != NULL; m = m->next)
+				m->len = 0;
+			break;
+		}
+		total -= m->len;
+	}
+}
+
+errno_t
+mbuf_set_csum_requested(mbuf_t m, mbuf_csum_request_flags_t req,
+    u_int32_t value)
+{
+	if (!(m->flags & MBUF_PKTHDR))
+		return EINVAL;
+	m->csum_flags = (m->csum_flags & ~SHIM_CSUM_REQ_MASK) |
+	    (req & SHIM_CSUM_REQ_MASK);
+	m->csum_data = value;
+	return 0;
+}
+
+errno_t
+mbuf_get_csum_requested(mbuf_t m, mbuf_csum_request_flags_t *req,
+    u_int32_t *value)
+{
+	if (!(m->flags & MBUF_PKTHDR))
+		return EINVAL;
+	*req = m->csum_flags & SHIM_CSUM_REQ_MASK;
+	if (value != NULL)
+		*value = m->csum_data;
+	return 0;
+}
+
+errno_t
+mbuf_clear_csum_requested(mbuf_t m)
+{
+	if (!(m->flags & MBUF_PKTHDR))
+		return EINVAL;
+	m->csum_flags &= ~SHIM_CSUM_REQ_MASK;
+	m->csum_data = 0;
+	return 0;
+}
+
+errno_t
+mbuf_set_csum_performed(mbuf_t m, mbuf_csum_performed_flags_t did,
+    u_int32_t value)
+{
+	if (!(m->flags & MBUF_PKTHDR))
+		return EINVAL;
+	m->csum_flags = (m->csum_flags & ~SHIM_CSUM_DID_MASK) |
+	    (did & SHIM_CSUM_DID_MASK);
+	m->csum_data = value;
+	return 0;
+}
+
+errno_t
+mbuf_get_csum_performed(mbuf_t m, mbuf_csum_performed_flags_t *did,
+    u_int32_t *value)
+{
+	if (!(m->flags & MBUF_PKTHDR))
+		return EINVAL;
+	*did = m->csum_flags & SHIM_CSUM_DID_MASK;
+	if (value != NULL)
+		*value = m->csum_data;
+	return 0;
+}
+
+errno_t
+mbuf_clear_csum_performed(mbuf_t m)
+{
+	if (!(m->flags & MBUF_PKTHDR))
+		return EINVAL;
+	m->csum_flags &= ~SHIM_CSUM_DID_MASK;
+	m->csum_data = 0;
+	return 0;
+}
+
+/* Ones' complement sum of len bytes at off, carried into sum. */
+static uint32_t
+shim_cksum_add(const mbuf_t m, size_t off, size_t len, uint32_t sum)
+{
+	uint8_t b[2];
+
+	for (; len >= 2; off += 2, len -= 2) {
+		mbuf_copydata(m, off, 2, b);
+		sum += (b[0] << 8) | b[1];
+	}
+	if (len > 0) {
+		mbuf_copydata(m, off, 1, b);
+		sum += b[0] << 8;
+	}
+	return sum;
+}
+
+static uint16_t
+shim_cksum_fold(uint32_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum & 0xffff;
+}
+
+/*
+ * Compute the checksums still requested on an outbound packet whose
+ * network header starts at off, as XNU's in_finalize_cksum() and
+ * in6_finalize_cksum(): the TCP/UDP field holds the pseudo-header sum
+ * and csum_data its offset in the transport header.  The requests are
+ * cleared.
+ */
+void
+mbuf_outbound_finalize(mbuf_t m, u_int32_t family, size_t off)
+{
+	uint32_t req = m->csum_flags & SHIM_CSUM_REQ_MASK;
+	uint8_t h[8], c[2];
+	size_t hlen, l4len;
+	uint16_t sum;
+
+	if (!(m->flags & MBUF_PKTHDR) || req == 0)
+		return;
+	if (family == PF_INET) {
+		if (mbuf_copydata(m, off, 4, h) != 0)
+			goto out;
+		hlen = (h[0] & 0x0f) << 2;
+		l4len = ((h[2] << 8) | h[3]) - hlen;
+		if (req & MBUF_CSUM_REQ_IP) {
+			c[0] = c[1] = 0;
+			mbuf_copyback(m, off + 10, 2, c, MBUF_DONTWAIT);
+			sum = shim_cksum_fold(shim_cksum_add(m, off, hlen, 0));
+			c[0] = sum >> 8;
+			c[1] = sum;
+			mbuf_copyback(m, off + 10, 2, c, MBUF_DONTWAIT);
+		}
+	} else {
+		if (mbuf_copydata(m, off, 8, h) != 0)
+			goto out;
+		hlen = 40;
+		l4len = (h[4] << 8) | h[5];
+	}
+	if (req & (MBUF_CSUM_REQ_TCP | MBUF_CSUM_REQ_UDP |
+	    MBUF_CSUM_REQ_TCPIPV6 | MBUF_CSUM_REQ_UDPIPV6)) {
+		sum = shim_cksum_fold(shim_cksum_add(m, off + hlen, l4len, 0));
+		if (sum == 0 && (req & (MBUF_CSUM_REQ_UDP | MBUF_CSUM_REQ_UDPIPV6)))
+			sum = 0xffff;
+		c[0] = sum >> 8;
+		c[1] = sum;
+		mbuf_copyback(m, off + hlen + m->csum_data, 2, c, MBUF_DONTWAIT);
+	}
+out:
+	m->csum_flags &= ~SHIM_CSUM_REQ_MASK;
+	m->csum_data = 0;
+}
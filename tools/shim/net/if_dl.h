@@ -0,0 +1 @@
+/* Host build shim for <net/if_dl.h>; nothing in itl80211 needs it. */
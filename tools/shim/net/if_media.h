@@ -0,0 +1 @@
+/* Host build shim for <net/if_media.h>; nothing in itl80211 needs it. */
@@ -0,0 +1,23 @@
+/*
+ * Host build shim: the net80211 functions the ciphers and rate control
+ * modules call outside their own files.  ieee80211_get_hdrlen() and
+ * ieee80211_cipher_keylen() are extracted from ieee80211_input.c and
+ * ieee80211_crypto.c at build time, and the standard rate tables from
+ * ieee80211.c (see tools/Makefile).
+ */
+#include <sys/param.h>
+#include <sys/mbuf.h>
+
+#include <net80211/ieee80211_var.h>
+
+#include "ieee80211_funcs.inc"
+#include "ieee80211_ratesets.inc"
+
+/* Only reached on a TKIP MIC failure; the tools have no 802.1X state. */
+int
+ieee80211_send_eapol_key_req(struct ieee80211com *ic,
+    struct ieee80211_node *ni, u_int16_t info, u_int64_t tsc)
+{
+	(void)ic; (void)ni; (void)info; (void)tsc;
+	return 0;
+}
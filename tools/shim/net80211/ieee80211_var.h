@@ -0,0 +1,208 @@
+/*
+ * Host build shim for <net80211/ieee80211_var.h>.
+ *
+ * The real header pulls in the whole kernel environment (timeouts,
+ * taskqs, IOKit queues).  The tools only build the stateless parts of
+ * net80211 -- the software ciphers and the rate control modules -- so
+ * this provides the real frame and crypto definitions plus just the
+ * ieee80211com and ieee80211_node fields those files touch.  Values
+ * copied from ieee80211_var.h, ieee80211_node.h and ieee80211_proto.h
+ * must be kept in sync with them; the rateset definitions and tables are
+ * extracted from the real sources at build time (see tools/Makefile).
+ */
+#ifndef _SHIM_NET80211_IEEE80211_VAR_H_
+#define _SHIM_NET80211_IEEE80211_VAR_H_
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/mbuf.h>
+#include <sys/_clock.h>
+#include <sys/_arc4random.h>
+
+#include <net/if.h>
+
+#include <net80211/ieee80211.h>
+#include <net80211/ieee80211_crypto.h>
+#include <net80211/ieee80211_ioctl.h>
+
+#ifndef IEEE80211_STA_ONLY
+#error "the tools build net80211 with IEEE80211_STA_ONLY"
+#endif
+
+#undef max
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#undef min
+#define min(a, b)	((a) < (b) ? (a) : (b))
+
+/* The kext's KASSERT compiles away; some callers rely on that. */
+#define _KASSERT(exp)	do { } while (0)
+
+static inline void *
+_MallocZero(vm_size_t size)
+{
+	void *ret = IOMalloc(size);
+
+	if (ret != NULL)
+		bzero(ret, size);
+	return ret;
+}
+
+static inline u_int32_t
+ether_crc32_le_update(u_int32_t crc, const u_int8_t *buf, size_t len)
+{
+	static const u_int32_t crctab[] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+		0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+		0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+	};
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		crc ^= buf[i];
+		crc = (crc >> 4) ^ crctab[crc & 0xf];
+		crc = (crc >> 4) ^ crctab[crc & 0xf];
+	}
+	return (crc);
+}
+
+static inline int splnet(void) { return 0; }
+static inline void splx(int s) { (void)s; }
+
+static inline const char *
+ether_sprintf(const u_int8_t *addr)
+{
+	static char buf[18];
+
+	snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+	    addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+	return buf;
+}
+
+/* ieee80211_var.h */
+enum ieee80211_phymode {
+	IEEE80211_MODE_AUTO	= 0,
+	IEEE80211_MODE_11A	= 1,
+	IEEE80211_MODE_11B	= 2,
+	IEEE80211_MODE_11G	= 3,
+	IEEE80211_MODE_11N	= 4,
+	IEEE80211_MODE_11AC	= 5,
+	IEEE80211_MODE_11AX	= 6,
+};
+
+enum ieee80211_opmode {
+	IEEE80211_M_STA		= 1,
+	IEEE80211_M_MONITOR	= 8
+};
+
+#define	IEEE80211_ADDR_EQ(a1,a2)	(memcmp(a1,a2,IEEE80211_ADDR_LEN) == 0)
+#define	IEEE80211_ADDR_COPY(dst,src)	memcpy(dst,src,IEEE80211_ADDR_LEN)
+
+#define IEEE80211_F_COUNTERM	0x00800000
+
+/* ieee80211_proto.h */
+enum ieee80211_state {
+	IEEE80211_S_INIT	= 0,
+	IEEE80211_S_SCAN	= 1,
+	IEEE80211_S_AUTH	= 2,
+	IEEE80211_S_ASSOC	= 3,
+	IEEE80211_S_RUN		= 4
+};
+
+#define IEEE80211_SEND_MGMT(_ic, _ni, _type, _arg) \
+	((*(_ic)->ic_send_mgmt)(_ic, _ni, _type, _arg, 0))
+#define ieee80211_new_state(_ic, _nstate, _arg) \
+	(((_ic)->ic_newstate)((_ic), (_nstate), (_arg)))
+
+u_int	ieee80211_get_hdrlen(const struct ieee80211_frame *);
+int	ieee80211_send_eapol_key_req(struct ieee80211com *,
+	    struct ieee80211_node *, u_int16_t, u_int64_t);
+
+/* ieee80211_node.h */
+#include "ieee80211_node_rates.h"
+
+#define IEEE80211_NODE_HT	0x0400
+#define IEEE80211_NODE_VHT	0x10000
+#define IEEE80211_NODE_HTCAP	0x20000
+#define IEEE80211_NODE_VHTCAP	0x40000
+#define IEEE80211_NODE_HE	0x200000
+
+struct _ifnet {
+	int			 if_flags;
+};
+
+struct ieee80211com {
+	struct {
+		struct _ifnet	 ac_if;
+	}			 ic_ac;
+	struct ieee80211_stats	 ic_stats;
+	u_int32_t		 ic_flags;
+	u_int32_t		 ic_userflags;
+	enum ieee80211_opmode	 ic_opmode;
+	enum ieee80211_phymode	 ic_curmode;
+	struct ieee80211_node	*ic_bss;
+	u_int8_t		 ic_sup_mcs[howmany(80, NBBY)];
+	u_int8_t		 ic_tx_mcs_set;
+	int			 ic_tkip_micfail;
+	u_int64_t		 ic_tkip_micfail_last_tsc;
+	int			(*ic_send_mgmt)(struct ieee80211com *,
+				    struct ieee80211_node *, int, int, int);
+	int			(*ic_newstate)(struct ieee80211com *,
+				    enum ieee80211_state, int);
+};
+
+struct ieee80211_node {
+	struct ieee80211com	*ni_ic;
+	u_int8_t		 ni_macaddr[IEEE80211_ADDR_LEN];
+	u_int32_t		 ni_flags;
+	struct ieee80211_rateset ni_rates;
+	int			 ni_txrate;
+	u_int16_t		 ni_htcaps;
+	u_int8_t		 ni_rxmcs[howmany(80, NBBY)];
+	int			 ni_txmcs;
+	u_int32_t		 ni_vhtcaps;
+	enum ieee80211_chan_width ni_chw;
+};
+
+static inline int
+ieee80211_node_supports_ht(struct ieee80211_node *ni)
+{
+	return ((ni->ni_flags & IEEE80211_NODE_HTCAP) &&
+	    ni->ni_rxmcs[0] & 0xff);
+}
+
+static inline int
+ieee80211_node_supports_vht(struct ieee80211_node *ni)
+{
+	return ((ni->ni_flags & IEEE80211_NODE_VHTCAP));
+}
+
+static inline int
+ieee80211_node_supports_ht_sgi20(struct ieee80211_node *ni)
+{
+	return ieee80211_node_supports_ht(ni) &&
+	    (ni->ni_htcaps & IEEE80211_HTCAP_SGI20);
+}
+
+static inline int
+ieee80211_node_supports_ht_sgi40(struct ieee80211_node *ni)
+{
+	return ieee80211_node_supports_ht(ni) &&
+	    (ni->ni_htcaps & IEEE80211_HTCAP_SGI40);
+}
+
+static inline int
+ieee80211_node_supports_vht_sgi80(struct ieee80211_node *ni)
+{
+	return ieee80211_node_supports_vht(ni) &&
+	    (ni->ni_vhtcaps & IEEE80211_VHTCAP_SHORT_GI_80);
+}
+
+static inline int
+ieee80211_node_supports_vht_sgi160(struct ieee80211_node *ni)
+{
+	return ieee80211_node_supports_vht(ni) &&
+	    (ni->ni_vhtcaps & IEEE80211_VHTCAP_SHORT_GI_160);
+}
+
+#endif /* _SHIM_NET80211_IEEE80211_VAR_H_ */
@@ -0,0 +1,32 @@
+/*
+ * Host build shim: out-of-line pieces of the kernel environment.
+ */
+#include <sys/param.h>
+#include <IOKit/IOLib.h>
+
+const uint64_t *shim_sim_uptime;
+
+static uint64_t shim_rng = 0x9e3779b97f4a7c15ULL;
+
+void
+shim_random_seed(uint64_t seed)
+{
+	shim_rng = seed ? seed : 0x9e3779b97f4a7c15ULL;
+}
+
+/* xorshift64*, deterministic so that tool runs can be compared. */
+void
+read_random(void *buf, u_int len)
+{
+	uint8_t *p = (uint8_t *)buf;
+	uint64_t r;
+
+	while (len > 0) {
+		shim_rng ^= shim_rng >> 12;
+		shim_rng ^= shim_rng << 25;
+		shim_rng ^= shim_rng >> 27;
+		r = shim_rng * 2685821657736338717ULL;
+		for (int i = 0; i < 8 && len > 0; i++, len--)
+			*p++ = r >> (i * 8);
+	}
+}
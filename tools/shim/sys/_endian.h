@@ -0,0 +1,2 @@
+/* Host build shim for <sys/_endian.h>, used by crypto/sha2.c. */
+#include <sys/endian.h>
@@ -0,0 +1,40 @@
+/*
+ * Host build shim for <sys/endian.h>: the OpenBSD byte order names on
+ * top of the host's <endian.h>.
+ */
+#ifndef _SHIM_SYS_ENDIAN_H_
+#define _SHIM_SYS_ENDIAN_H_
+
+#ifdef __APPLE__
+#include <libkern/OSByteOrder.h>
+#define htobe16(x)	OSSwapHostToBigInt16(x)
+#define htobe32(x)	OSSwapHostToBigInt32(x)
+#define htobe64(x)	OSSwapHostToBigInt64(x)
+#define htole16(x)	OSSwapHostToLittleInt16(x)
+#define htole32(x)	OSSwapHostToLittleInt32(x)
+#define htole64(x)	OSSwapHostToLittleInt64(x)
+#define be16toh(x)	OSSwapBigToHostInt16(x)
+#define be32toh(x)	OSSwapBigToHostInt32(x)
+#define be64toh(x)	OSSwapBigToHostInt64(x)
+#define le16toh(x)	OSSwapLittleToHostInt16(x)
+#define le32toh(x)	OSSwapLittleToHostInt32(x)
+#define le64toh(x)	OSSwapLittleToHostInt64(x)
+#else
+#include <endian.h>
+#define _OSSwapInt16(x)	__builtin_bswap16(x)
+#define _OSSwapInt32(x)	__builtin_bswap32(x)
+#define _OSSwapInt64(x)	__builtin_bswap64(x)
+#endif
+
+#define swap16(x)	__builtin_bswap16(x)
+#define swap32(x)	__builtin_bswap32(x)
+#define swap64(x)	__builtin_bswap64(x)
+
+#define betoh16(x)	be16toh(x)
+#define betoh32(x)	be32toh(x)
+#define betoh64(x)	be64toh(x)
+#define letoh16(x)	le16toh(x)
+#define letoh32(x)	le32toh(x)
+#define letoh64(x)	le64toh(x)
+
+#endif /* _SHIM_SYS_ENDIAN_H_ */
@@ -0,0 +1,2 @@
+/* Host build shim for <sys/kernel.h>. */
+#include <sys/_clock.h>
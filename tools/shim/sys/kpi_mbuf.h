@@ -0,0 +1,170 @@
+/*
+ * Host build shim for <sys/kpi_mbuf.h>: a small model of the XNU mbuf KPI.
+ *
+ * Mbufs carry MLEN bytes inline (MHLEN with a packet header) and may
+ * attach a reference counted cluster.  Shared clusters report no leading
+ * or trailing space and mbuf_mclhasreference() != 0, like XNU, so code
+ * that must not write into shared storage is exercised the same way.
+ * Allocations are counted so tools can report mbufs per packet.
+ * Clusters attached with mbuf_attachcluster() are the caller's and go
+ * back through its free function.
+ */
+#ifndef _SHIM_SYS_KPI_MBUF_H_
+#define _SHIM_SYS_KPI_MBUF_H_
+
+#include <sys/types.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHIM_MSIZE		256
+#define SHIM_MLEN		224
+#define SHIM_MHLEN		168
+#define SHIM_MINCLSIZE		(SHIM_MHLEN + SHIM_MLEN)
+#define SHIM_MCLBYTES		2048
+#define SHIM_MBIGCLBYTES	4096
+#define SHIM_M16KCLBYTES	16384
+
+#ifndef MCLBYTES
+#define MCLBYTES		SHIM_MCLBYTES
+#endif
+
+typedef int errno_t;
+typedef void *ifnet_t;
+
+typedef enum {
+	MBUF_TYPE_FREE = 0,
+	MBUF_TYPE_DATA = 1,
+	MBUF_TYPE_HEADER = 2
+} mbuf_type_t;
+
+typedef enum {
+	MBUF_WAITOK = 0,
+	MBUF_DONTWAIT = 1
+} mbuf_how_t;
+
+typedef uint32_t mbuf_flags_t;
+#define MBUF_EXT	0x0001
+#define MBUF_PKTHDR	0x0002
+#define MBUF_EOR	0x0004
+#define MBUF_BCAST	0x0010
+#define MBUF_MCAST	0x0020
+
+#define MBUF_COPYALL	1000000000
+
+/* Checksum requests and results share one flags word, as in XNU. */
+typedef uint32_t mbuf_csum_request_flags_t;
+typedef uint32_t mbuf_csum_performed_flags_t;
+#define MBUF_CSUM_REQ_IP	0x0001
+#define MBUF_CSUM_REQ_TCP	0x0002
+#define MBUF_CSUM_REQ_UDP	0x0004
+#define MBUF_CSUM_REQ_TCPIPV6	0x0020
+#define MBUF_CSUM_REQ_UDPIPV6	0x0040
+#define MBUF_CSUM_DID_IP	0x0100
+#define MBUF_CSUM_IP_GOOD	0x0200
+#define MBUF_CSUM_DID_DATA	0x0400
+#define MBUF_CSUM_PSEUDO_HDR	0x0800
+#define SHIM_CSUM_REQ_MASK	(MBUF_CSUM_REQ_IP | MBUF_CSUM_REQ_TCP | \
+	MBUF_CSUM_REQ_UDP | MBUF_CSUM_REQ_TCPIPV6 | MBUF_CSUM_REQ_UDPIPV6)
+#define SHIM_CSUM_DID_MASK	(MBUF_CSUM_DID_IP | MBUF_CSUM_IP_GOOD | \
+	MBUF_CSUM_DID_DATA | MBUF_CSUM_PSEUDO_HDR)
+
+struct shim_mbuf_ext {
+	uint8_t			*buf;
+	size_t			 size;
+	int			 refs;
+	void			(*extfree)(caddr_t, u_int, caddr_t);
+	caddr_t			 extarg;
+};
+
+struct shim_mbuf {
+	struct shim_mbuf	*next;
+	struct shim_mbuf	*nextpkt;
+	uint8_t			*data;
+	size_t			 len;
+	mbuf_flags_t		 flags;
+	mbuf_type_t		 type;
+	size_t			 pktlen;
+	ifnet_t			 rcvif;
+	uint32_t		 csum_flags;
+	uint32_t		 csum_data;
+	struct shim_mbuf_ext	*ext;
+	uint8_t			 dat[SHIM_MLEN];
+};
+typedef struct shim_mbuf *mbuf_t;
+
+/* Allocation and copy counters, reset by the tools between measurements. */
+extern uint64_t shim_mbuf_allocs;
+extern uint64_t shim_cluster_allocs;
+extern uint64_t shim_pullup_bytes;
+
+errno_t	mbuf_get(mbuf_how_t, mbuf_type_t, mbuf_t *);
+errno_t	mbuf_gethdr(mbuf_how_t, mbuf_type_t, mbuf_t *);
+errno_t	mbuf_mclget(mbuf_how_t, mbuf_type_t, mbuf_t *);
+errno_t	mbuf_getcluster(mbuf_how_t, mbuf_type_t, size_t, mbuf_t *);
+errno_t	mbuf_attachcluster(mbuf_how_t, mbuf_type_t, mbuf_t *, caddr_t,
+	    void (*)(caddr_t, u_int, caddr_t), size_t, caddr_t);
+mbuf_t	mbuf_free(mbuf_t);
+void	mbuf_freem(mbuf_t);
+errno_t	mbuf_dup(const mbuf_t, mbuf_how_t, mbuf_t *);
+errno_t	mbuf_copym(const mbuf_t, size_t, size_t, mbuf_how_t, mbuf_t *);
+errno_t	mbuf_prepend(mbuf_t *, size_t, mbuf_how_t);
+errno_t	mbuf_pullup(mbuf_t *, size_t);
+errno_t	mbuf_split(mbuf_t, size_t, mbuf_how_t, mbuf_t *);
+void	mbuf_adj(mbuf_t, int);
+errno_t	mbuf_copydata(const mbuf_t, size_t, size_t, void *);
+errno_t	mbuf_copyback(mbuf_t, size_t, size_t, const void *, mbuf_how_t);
+errno_t	mbuf_copy_pkthdr(mbuf_t, const mbuf_t);
+errno_t	mbuf_setdata(mbuf_t, void *, size_t);
+size_t	mbuf_leadingspace(const mbuf_t);
+size_t	mbuf_trailingspace(const mbuf_t);
+int	mbuf_mclhasreference(mbuf_t);
+errno_t	mbuf_set_csum_requested(mbuf_t, mbuf_csum_request_flags_t, u_int32_t);
+errno_t	mbuf_get_csum_requested(mbuf_t, mbuf_csum_request_flags_t *,
+	    u_int32_t *);
+errno_t	mbuf_clear_csum_requested(mbuf_t);
+errno_t	mbuf_set_csum_performed(mbuf_t, mbuf_csum_performed_flags_t,
+	    u_int32_t);
+errno_t	mbuf_get_csum_performed(mbuf_t, mbuf_csum_performed_flags_t *,
+	    u_int32_t *);
+errno_t	mbuf_clear_csum_performed(mbuf_t);
+void	mbuf_outbound_finalize(mbuf_t, u_int32_t, size_t);
+
+static inline void *mbuf_data(mbuf_t m) { return m->data; }
+static inline void *mbuf_datastart(mbuf_t m)
+{
+	if (m->flags & MBUF_EXT)
+		return m->ext->buf;
+	return (m->flags & MBUF_PKTHDR) ? m->dat + (SHIM_MLEN - SHIM_MHLEN) :
+	    m->dat;
+}
+static inline size_t mbuf_len(const mbuf_t m) { return m->len; }
+static inline void mbuf_setlen(mbuf_t m, size_t len) { m->len = len; }
+static inline size_t mbuf_maxlen(const mbuf_t m)
+{
+	if (m->flags & MBUF_EXT)
+		return m->ext->size;
+	return (m->flags & MBUF_PKTHDR) ? SHIM_MHLEN : SHIM_MLEN;
+}
+static inline mbuf_t mbuf_next(const mbuf_t m) { return m->next; }
+static inline errno_t mbuf_setnext(mbuf_t m, mbuf_t n)
+{ m->next = n; return 0; }
+static inline mbuf_t mbuf_nextpkt(const mbuf_t m) { return m->nextpkt; }
+static inline void mbuf_setnextpkt(mbuf_t m, mbuf_t n) { m->nextpkt = n; }
+static inline mbuf_type_t mbuf_type(const mbuf_t m) { return m->type; }
+static inline mbuf_flags_t mbuf_flags(const mbuf_t m) { return m->flags; }
+static inline errno_t mbuf_setflags(mbuf_t m, mbuf_flags_t f)
+{ m->flags = (m->flags & MBUF_EXT) | (f & ~MBUF_EXT); return 0; }
+static inline size_t mbuf_pkthdr_len(const mbuf_t m) { return m->pktlen; }
+static inline void mbuf_pkthdr_setlen(mbuf_t m, size_t len)
+{ m->pktlen = len; }
+static inline void mbuf_pkthdr_adjustlen(mbuf_t m, int amount)
+{ m->pktlen += amount; }
+static inline ifnet_t mbuf_pkthdr_rcvif(const mbuf_t m) { return m->rcvif; }
+static inline errno_t mbuf_pkthdr_setrcvif(mbuf_t m, ifnet_t ifp)
+{ m->rcvif = ifp; return 0; }
+static inline size_t mbuf_get_mlen(void) { return SHIM_MLEN; }
+static inline size_t mbuf_get_mhlen(void) { return SHIM_MHLEN; }
+static inline size_t mbuf_get_minclsize(void) { return SHIM_MINCLSIZE; }
+
+#endif /* _SHIM_SYS_KPI_MBUF_H_ */
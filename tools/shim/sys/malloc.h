@@ -0,0 +1,2 @@
+/* Host build shim for <sys/malloc.h>. */
+#include <IOKit/IOLib.h>
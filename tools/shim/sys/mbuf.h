@@ -0,0 +1,19 @@
+/*
+ * Host build shim for <sys/mbuf.h>: the mbuf KPI model plus the OpenBSD
+ * helpers from sys/_mbuf.h that net80211 uses.
+ */
+#ifndef _SHIM_SYS_MBUF_H_
+#define _SHIM_SYS_MBUF_H_
+
+#include <sys/kpi_mbuf.h>
+
+#define mtod(m, t)	((t)mbuf_data(m))
+
+static inline int
+m_dup_pkthdr(mbuf_t to, mbuf_t from, int wait)
+{
+	(void)wait;
+	return mbuf_copy_pkthdr(to, from);
+}
+
+#endif /* _SHIM_SYS_MBUF_H_ */
@@ -0,0 +1,8 @@
+/* Host build shim for <sys/param.h>. */
+#ifndef _SHIM_SYS_PARAM_H_
+#define _SHIM_SYS_PARAM_H_
+
+#include_next <sys/param.h>
+#include <sys/systm.h>
+
+#endif /* _SHIM_SYS_PARAM_H_ */
@@ -0,0 +1,7 @@
+/* Host build shim for <sys/proc.h>; nothing is used from it. */
+#ifndef _SHIM_SYS_PROC_H_
+#define _SHIM_SYS_PROC_H_
+
+#include <kern/thread.h>
+
+#endif /* _SHIM_SYS_PROC_H_ */
@@ -0,0 +1,24 @@
+/*
+ * Host build shim for <sys/queue.h>: glibc's copy lacks the _SAFE
+ * iterators the BSD and XNU ones have.
+ */
+#ifndef _SHIM_SYS_QUEUE_H_
+#define _SHIM_SYS_QUEUE_H_
+
+#include_next <sys/queue.h>
+
+#ifndef LIST_FOREACH_SAFE
+#define LIST_FOREACH_SAFE(var, head, field, tvar)			\
+	for ((var) = LIST_FIRST((head));				\
+	    (var) && ((tvar) = LIST_NEXT((var), field), 1);		\
+	    (var) = (tvar))
+#endif
+
+#ifndef TAILQ_FOREACH_SAFE
+#define TAILQ_FOREACH_SAFE(var, head, field, tvar)			\
+	for ((var) = TAILQ_FIRST((head));				\
+	    (var) && ((tvar) = TAILQ_NEXT((var), field), 1);		\
+	    (var) = (tvar))
+#endif
+
+#endif /* _SHIM_SYS_QUEUE_H_ */
@@ -0,0 +1 @@
+/* Host build shim for <sys/sysctl.h>; nothing in itl80211 needs it. */
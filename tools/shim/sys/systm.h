@@ -0,0 +1,60 @@
+/*
+ * Host build shim for <sys/systm.h>: the handful of kernel helpers the
+ * itl80211 sources use, mapped onto libc.
+ */
+#ifndef _SHIM_SYS_SYSTM_H_
+#define _SHIM_SYS_SYSTM_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <IOKit/IOLib.h>
+
+#ifndef nitems
+#define nitems(_a)	(sizeof((_a)) / sizeof((_a)[0]))
+#endif
+
+#ifndef __packed
+#define __packed	__attribute__((__packed__))
+#endif
+#ifndef __aligned
+#define __aligned(x)	__attribute__((__aligned__(x)))
+#endif
+
+/*
+ * libc may declare its own arc4random family; <sys/_arc4random.h> defines
+ * static inline versions on top of read_random(), so keep them apart.
+ */
+#define arc4random		shim_arc4random
+#define arc4random_buf		shim_arc4random_buf
+#define arc4random_uniform	shim_arc4random_uniform
+
+#ifndef DIV_ROUND_UP
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#endif
+
+static inline unsigned int
+hweight8(unsigned int w)
+{
+	return __builtin_popcount(w & 0xff);
+}
+
+#define KASSERT(exp, msg)	do { if (!(exp)) panic msg; } while (0)
+
+static inline void
+shim_explicit_bzero(void *p, size_t n)
+{
+	volatile unsigned char *b = (volatile unsigned char *)p;
+
+	while (n-- > 0)
+		*b++ = 0;
+}
+#define explicit_bzero(p, n)	shim_explicit_bzero((p), (n))
+
+extern int timingsafe_bcmp(const void *, const void *, size_t);
+
+#endif /* _SHIM_SYS_SYSTM_H_ */
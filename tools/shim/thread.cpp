@@ -0,0 +1,132 @@
+/*
+ * Host build shim: Mach threads and IOKit locks on pthreads.
+ */
+#include <IOKit/IOLib.h>
+#include <IOKit/IOLocks.h>
+
+struct _IOLock {
+	pthread_mutex_t	mtx;
+};
+
+struct _IORecursiveLock {
+	pthread_mutex_t	mtx;
+	pthread_cond_t	cv;
+};
+
+struct thread_start {
+	thread_continue_t	fn;
+	void			*arg;
+};
+
+static void *
+thread_trampoline(void *xts)
+{
+	struct thread_start ts = *(struct thread_start *)xts;
+
+	free(xts);
+	ts.fn(ts.arg, 0);
+	return NULL;
+}
+
+kern_return_t
+kernel_thread_start(thread_continue_t fn, void *arg, thread_t *thread)
+{
+	struct thread_start *ts;
+
+	ts = (struct thread_start *)malloc(sizeof(*ts));
+	if (ts == NULL)
+		return KERN_FAILURE;
+	ts->fn = fn;
+	ts->arg = arg;
+	if (pthread_create(thread, NULL, thread_trampoline, ts) != 0) {
+		free(ts);
+		return KERN_FAILURE;
+	}
+	pthread_detach(*thread);
+	return KERN_SUCCESS;
+}
+
+IOLock *
+IOLockAlloc(void)
+{
+	IOLock *lock;
+
+	lock = (IOLock *)malloc(sizeof(*lock));
+	if (lock != NULL)
+		pthread_mutex_init(&lock->mtx, NULL);
+	return lock;
+}
+
+void
+IOLockFree(IOLock *lock)
+{
+	pthread_mutex_destroy(&lock->mtx);
+	free(lock);
+}
+
+void
+IOLockLock(IOLock *lock)
+{
+	pthread_mutex_lock(&lock->mtx);
+}
+
+void
+IOLockUnlock(IOLock *lock)
+{
+	pthread_mutex_unlock(&lock->mtx);
+}
+
+IORecursiveLock *
+IORecursiveLockAlloc(void)
+{
+	IORecursiveLock *lock;
+	pthread_mutexattr_t attr;
+
+	lock = (IORecursiveLock *)malloc(sizeof(*lock));
+	if (lock == NULL)
+		return NULL;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lock->mtx, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_cond_init(&lock->cv, NULL);
+	return lock;
+}
+
+void
+IORecursiveLockFree(IORecursiveLock *lock)
+{
+	pthread_cond_destroy(&lock->cv);
+	pthread_mutex_destroy(&lock->mtx);
+	free(lock);
+}
+
+void
+IORecursiveLockLock(IORecursiveLock *lock)
+{
+	pthread_mutex_lock(&lock->mtx);
+}
+
+void
+IORecursiveLockUnlock(IORecursiveLock *lock)
+{
+	pthread_mutex_unlock(&lock->mtx);
+}
+
+/* The caller must hold the lock exactly once, as in the kernel. */
+int
+IORecursiveLockSleep(IORecursiveLock *lock, void *event, uint32_t type)
+{
+	(void)event;
+	(void)type;
+	pthread_cond_wait(&lock->cv, &lock->mtx);
+	return THREAD_AWAKENED;
+}
+
+void
+IORecursiveLockWakeup(IORecursiveLock *lock, void *event, bool one)
+{
+	(void)event;
+	(void)one;
+	pthread_cond_broadcast(&lock->cv);
+}
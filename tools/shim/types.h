@@ -0,0 +1,12 @@
+/* Host build shim for the Linux-style "types.h" used by crypto/sha1.h. */
+#ifndef _SHIM_TYPES_H_
+#define _SHIM_TYPES_H_
+
+#include <sys/systm.h>
+
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+
+#endif /* _SHIM_TYPES_H_ */
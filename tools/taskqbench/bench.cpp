@@ -0,0 +1,285 @@
+/*
+ * taskqbench: enqueue-to-run latency and dispatch rate of the itl80211
+ * taskq, built on the host from sys/_task.cpp against a pthread shim.
+ *
+ * Before timing anything it checks that queued tasks run by priority
+ * class and then in FIFO order, that task_add() of a queued task and
+ * task_del() behave, and that a task re-adding itself from its own
+ * function is never lost.  Exits non-zero if a check fails.
+ */
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+
+#include <sys/param.h>
+#include <sys/_task.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Spin, politely, until cond() holds or a second has passed. */
+template <typename F>
+static bool
+wait_for(F cond)
+{
+	uint64_t deadline = now_ns() + 1000000000ULL;
+
+	while (!cond()) {
+		if (now_ns() > deadline)
+			return false;
+		sched_yield();
+	}
+	return true;
+}
+
+/* Tasks that log their ids in the order they run. */
+static int run_order[16];
+static std::atomic<int> nrun;
+
+struct logged {
+	struct task		 t;
+	int			 id;
+};
+
+static void
+logged_fn(void *arg)
+{
+	struct logged *l = (struct logged *)arg;
+	int i = nrun;
+
+	if (i < (int)nitems(run_order))
+		run_order[i] = l->id;
+	nrun = i + 1;
+}
+
+static std::atomic<int> blocker_started, blocker_release;
+
+static void
+blocker_fn(void *arg)
+{
+	(void)arg;
+	blocker_started = 1;
+	while (!blocker_release)
+		sched_yield();
+}
+
+static void
+check_order(struct taskq *tq)
+{
+	/* queued in this order; ids give the expected run order */
+	static const struct {
+		int		prio;
+		int		id;
+	} add[] = {
+		{ TASK_PRIO_LOW,	5 },
+		{ TASK_PRIO_NORMAL,	3 },
+		{ TASK_PRIO_HIGH,	0 },
+		{ TASK_PRIO_NORMAL,	4 },
+		{ TASK_PRIO_HIGH,	1 },
+		{ TASK_PRIO_HIGH,	2 },
+		{ TASK_PRIO_LOW,	6 },
+	};
+	struct logged l[nitems(add)], gone;
+	struct task blocker;
+	size_t i;
+
+	task_set(&blocker, blocker_fn, NULL, "blocker");
+	blocker_started = blocker_release = 0;
+	nrun = 0;
+	task_add(tq, &blocker);
+	CHECK(wait_for([] { return blocker_started != 0; }), "blocker ran");
+
+	/* the worker is busy, so all of these stay queued */
+	for (i = 0; i < nitems(add); i++) {
+		task_set(&l[i].t, logged_fn, &l[i], "logged");
+		task_set_prio(&l[i].t, add[i].prio);
+		l[i].id = add[i].id;
+		CHECK(task_add(tq, &l[i].t) == 1, "task_add");
+	}
+	CHECK(task_add(tq, &l[0].t) == 0, "task_add of a queued task");
+	task_set(&gone.t, logged_fn, &gone, "gone");
+	gone.id = -1;
+	task_add(tq, &gone.t);
+	CHECK(task_pending(&gone.t), "task_pending");
+	CHECK(task_del(tq, &gone.t) == 1 && !task_pending(&gone.t),
+	    "task_del of a queued task");
+	CHECK(task_del(tq, &gone.t) == 0, "task_del of an idle task");
+
+	blocker_release = 1;
+	CHECK(wait_for([] { return nrun == (int)nitems(add); }),
+	    "every task ran");
+	CHECK(nrun == (int)nitems(add), "no task ran twice");
+	for (i = 0; i < nitems(add); i++)
+		CHECK(run_order[i] == (int)i, "priority and FIFO order");
+}
+
+/* A task that re-adds itself until it has run a given number of times. */
+struct chain {
+	struct task		 t;
+	struct taskq		*tq;
+	uint64_t		 left;
+	std::atomic<uint64_t>	 runs;
+};
+
+static void
+chain_fn(void *arg)
+{
+	struct chain *c = (struct chain *)arg;
+
+	if (--c->left > 0)
+		task_add(c->tq, &c->t);
+	c->runs++;	/* last touch: the waiter may free c */
+}
+
+static double
+run_chain(struct taskq *tq, uint64_t n)
+{
+	struct chain c;
+	uint64_t t0;
+
+	task_set(&c.t, chain_fn, &c, "chain");
+	c.tq = tq;
+	c.left = n;
+	c.runs = 0;
+	t0 = now_ns();
+	task_add(tq, &c.t);
+	while (c.runs < n)
+		sched_yield();
+	return n / ((now_ns() - t0) * 1e-9);
+}
+
+/* A task that stamps the time it started running. */
+struct stamp {
+	struct task		 t;
+	std::atomic<uint64_t>	 ran;
+};
+
+static void
+stamp_fn(void *arg)
+{
+	struct stamp *s = (struct stamp *)arg;
+
+	s->ran = now_ns();
+}
+
+static void
+run_latency(struct taskq *tq, int n, int prio)
+{
+	std::vector<double> lat;
+	struct stamp s;
+	uint64_t t0;
+	int i;
+
+	task_set(&s.t, stamp_fn, &s, "stamp");
+	task_set_prio(&s.t, prio);
+	for (i = 0; i < n; i++) {
+		s.ran = 0;
+		t0 = now_ns();
+		task_add(tq, &s.t);
+		while (s.ran == 0)
+			sched_yield();
+		lat.push_back((s.ran - t0) * 1e-3);
+	}
+	std::sort(lat.begin(), lat.end());
+	printf("%-24s %8d tasks  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+	    prio == TASK_PRIO_HIGH ? "latency-high" : "latency-normal", n,
+	    lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+}
+
+/* Producer-driven load: 64 tasks, each re-added as soon as it has run. */
+static std::atomic<uint64_t> produced_runs;
+
+static void
+produced_fn(void *arg)
+{
+	(void)arg;
+	produced_runs++;
+}
+
+static void
+run_producer(struct taskq *tq, double seconds)
+{
+	static struct task t[64];
+	uint64_t t0, end, added = 0;
+	size_t i;
+
+	for (i = 0; i < nitems(t); i++)
+		task_set(&t[i], produced_fn, NULL, "producer");
+	produced_runs = 0;
+	t0 = now_ns();
+	end = t0 + (uint64_t)(seconds * 1e9);
+	while (now_ns() < end) {
+		for (i = 0; i < nitems(t); i++)
+			added += task_add(tq, &t[i]);
+	}
+	CHECK(wait_for([&] { return produced_runs == added; }),
+	    "every produced task ran");
+	printf("%-24s %8llu tasks  %10.0f tasks/s\n", "producer-64",
+	    (unsigned long long)added, added / ((now_ns() - t0) * 1e-9));
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: taskqbench [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct taskq *tq;
+	int quick = 0, ch;
+	uint64_t n;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	tq = taskq_create("bench", 1, 0, 0);
+	if (tq == NULL) {
+		printf("FAIL taskq_create\n");
+		return 1;
+	}
+
+	check_order(tq);
+	n = quick ? 10000 : 1000000;
+	run_chain(tq, n);
+	printf("%-24s %8llu tasks  %10.0f tasks/s\n", "self-readd",
+	    (unsigned long long)n, run_chain(tq, n));
+	run_latency(tq, quick ? 1000 : 20000, TASK_PRIO_NORMAL);
+	run_latency(tq, quick ? 1000 : 20000, TASK_PRIO_HIGH);
+	run_producer(tq, quick ? 0.05 : 1.0);
+
+	taskq_destroy(tq);
+	printf("taskqbench: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
@@ -0,0 +1,635 @@
+/*
+ * txamsdu: a host model of the iwx TX path that counts what each packet
+ * costs on the ring, with and without A-MSDU aggregation on transmit.
+ *
+ * The start loop of _iwx_start_task() is extracted from ItlIwx.cpp at
+ * build time, and ieee80211_encap() and the A-MSDU builder,
+ * ieee80211_amsdu_start(), ieee80211_amsdu_append(),
+ * ieee80211_amsdu_take() and the functions they call, from
+ * ieee80211_output.c (see tools/Makefile).  The model supplies the send
+ * queue the loop drains, one station-mode peer with block ack agreements
+ * on every TID, and an iwx_tx_submit() that lays each MPDU out on the
+ * ring as iwx_tx() would: one TFD and TX command, two TBs for the command
+ * and 802.11 header and one per payload segment, coalesced when there are
+ * more than the TFD holds.  Packets carry no checksum requests, so
+ * ieee80211_tx_csum() has nothing to do and the model's returns at once.
+ *
+ * Each pass queues a burst of packets and runs the loop once, as the
+ * start task runs once per wakeup.  The tool checks that:
+ *
+ *   - every packet leaves in order, in an MPDU or as an A-MSDU subframe
+ *     with its addresses, length, LLC/SNAP header and payload intact;
+ *   - A-MSDU subframes are padded to 4 bytes, at most 8 share an MPDU,
+ *     the body fits the peer's limit and only the head mbuf carries a
+ *     packet header;
+ *   - sequence numbers stay consecutive per TID, so the peer's reorder
+ *     window sees no holes;
+ *   - every node reference the loop takes is given back;
+ *   - bursts of one, frames on alternating TIDs and aggregation off all
+ *     cost one MPDU per packet.
+ *
+ * It reports MPDUs (TFDs, TX commands and PHY headers) and TBs per
+ * packet for TCP ACKs, VoIP, a mixed load and bulk transfers, with
+ * aggregation off and on towards an HT and a VHT peer.
+ * Exits non-zero on failure.
+ */
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <getopt.h>
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/mbuf.h>
+#include <sys/_clock.h>
+#include <IOKit/IOLib.h>
+
+#include <net80211/ieee80211.h>
+#include <net80211/ieee80211_crypto.h>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+/* The kext builds the IBSS and hostap cases; so does sys/endian.h INET6. */
+#undef IEEE80211_STA_ONLY
+#define INET6
+
+#include "txencap.h"
+#include "txamsdu.h"
+
+/* As in net/if_llc.h and netinet/if_ether.h. */
+#define LLC_UI		0x03
+#define LLC_SNAP_LSAP	0xaa
+#define LLC_SNAPFRAMELEN	8
+
+struct llc {
+	u_int8_t		 llc_dsap;
+	u_int8_t		 llc_ssap;
+	u_int8_t		 llc_control;
+	struct {
+		u_int8_t	 org_code[3];
+		u_int16_t	 ether_type;
+	} __packed		 llc_snap;
+} __packed;
+
+#define ETHERTYPE_PAE	0x888e
+
+#define IEEE80211_ADDR_EQ(a1,a2)	(memcmp(a1,a2,IEEE80211_ADDR_LEN) == 0)
+#define IEEE80211_ADDR_COPY(dst,src)	memcpy(dst,src,IEEE80211_ADDR_LEN)
+
+#define DPRINTF(x)
+#define min(a, b)	((a) < (b) ? (a) : (b))
+
+/* The raw 802.11 branch of ieee80211_encap() is dead code. */
+typedef uintptr_t	mbuf_tag_id_t;
+#define DLT_IEEE802_11		105
+#define DLT_IEEE802_11_RADIO	127
+
+/* The send queue, interface and ieee80211com fields the code uses. */
+struct snd_queue {
+	std::deque<mbuf_t>	 q;
+
+	mbuf_t
+	lockDequeue(void)
+	{
+		mbuf_t m;
+
+		if (q.empty())
+			return NULL;
+		m = q.front();
+		q.pop_front();
+		return m;
+	}
+};
+
+struct net_stats {
+	u_int64_t		 outputPackets;
+	u_int64_t		 outputErrors;
+};
+
+struct _ifnet {
+	char			 if_xname[16];
+	struct snd_queue	*if_snd;
+	struct net_stats	*netStat;
+};
+
+struct mbuf_queue {
+	int			 mq_len;	/* management frames: none */
+};
+
+static mbuf_t
+mq_dequeue(struct mbuf_queue *mq)
+{
+	(void)mq;
+	return NULL;
+}
+
+struct ieee80211_tx_ba {
+	int			 ba_timeout_val;
+	u_int64_t		 ba_lastact;
+	int			 ba_state;
+	u_int16_t		 ba_params;
+};
+
+struct ieee80211_node {
+	u_int8_t		 ni_bssid[IEEE80211_ADDR_LEN];
+	u_int			 ni_rsnprotos;
+	enum ieee80211_cipher	 ni_rsncipher;
+	int			 ni_port_valid;
+	struct ieee80211_tx_ba	 ni_tx_ba[IEEE80211_NUM_TID];
+	u_int16_t		 ni_txseq;
+	u_int16_t		 ni_qos_txseqs[IEEE80211_NUM_TID];
+	struct ieee80211_txhdr	*ni_txhdr;
+	int			 ni_inact;
+	int			 ni_state;
+	u_int32_t		 ni_flags;
+	u_int16_t		 ni_htcaps;
+	u_int32_t		 ni_vhtcaps;
+	int			 ni_refcnt;
+};
+
+struct ieee80211com {
+	struct _ifnet		 ic_if;		/* first: encap casts ifp */
+	struct {
+		u_int32_t	 is_tx_nombuf;
+		u_int32_t	 is_tx_nonode;
+		u_int32_t	 is_tx_noauth;
+	}			 ic_stats;
+	u_int32_t		 ic_flags;
+	u_int32_t		 ic_xflags;
+	u_int32_t		 ic_caps;
+	enum ieee80211_opmode	 ic_opmode;
+	int			 ic_state;
+	struct ieee80211_node	*ic_bss;
+	u_int16_t		 ic_tid_noack;
+	u_int16_t		 ic_tx_amsdu_maxlen;
+	struct mbuf_queue	 ic_mgtq;
+	int			(*ic_ampdu_tx_start)(struct ieee80211com *,
+				    struct ieee80211_node *, u_int8_t);
+};
+
+struct iwx_softc {
+	struct ieee80211com	 sc_ic;
+};
+
+u_int	ieee80211_get_hdrlen(const struct ieee80211_frame *);
+
+static struct ieee80211_node *tx_node;	/* what the lookup finds */
+
+static struct ieee80211_node *
+ieee80211_find_txnode(struct ieee80211com *ic, const u_int8_t *macaddr)
+{
+	(void)ic;
+	(void)macaddr;
+	tx_node->ni_refcnt++;
+	return tx_node;
+}
+
+static struct ieee80211_node *
+ieee80211_ref_node(struct ieee80211_node *ni)
+{
+	ni->ni_refcnt++;
+	return ni;
+}
+
+static void
+ieee80211_release_node(struct ieee80211com *ic, struct ieee80211_node *ni)
+{
+	(void)ic;
+	ni->ni_refcnt--;
+}
+
+static void
+ieee80211_node_trigger_addba_req(struct ieee80211_node *ni, int tid)
+{
+	(void)ni;
+	(void)tid;
+}
+
+static int
+ieee80211_pwrsave(struct ieee80211com *ic, mbuf_t m, struct ieee80211_node *ni)
+{
+	(void)ic;
+	(void)m;
+	(void)ni;
+	return 0;
+}
+
+static void *
+_MallocZero(size_t size)
+{
+	return calloc(1, size);
+}
+
+/* The pairwise key is CCMP, as iwx installs it in hardware. */
+static struct ieee80211_key ccmp_key;
+
+struct ieee80211_key *
+ieee80211_get_txkey(struct ieee80211com *ic, const struct ieee80211_frame *wh,
+    struct ieee80211_node *ni)
+{
+	(void)ic;
+	(void)wh;
+	(void)ni;
+	return &ccmp_key;
+}
+
+int
+ieee80211_tx_csum(struct ieee80211com *ic, mbuf_t m, u_int hdrlen,
+    int offload)
+{
+	(void)ic;
+	(void)m;
+	(void)hdrlen;
+	(void)offload;
+	return 0;
+}
+
+#include "txencap.inc"
+#include "txamsdu.inc"
+
+/* Ethernet frames queued and not yet seen on the ring, oldest first. */
+static std::deque<std::vector<u_int8_t> > inflight;
+
+static struct {
+	u_int64_t	 mpdus;
+	u_int64_t	 tbs;
+	u_int64_t	 coalesced;
+	u_int64_t	 msdus;
+	int		 bad;
+	int		 badseq;
+	int		 badhdr;
+	int		 toolong;
+	int		 maxsub;
+	int		 seqvalid[IEEE80211_NUM_TID];
+	u_int16_t	 nextseq[IEEE80211_NUM_TID];
+} ring;
+
+static int body_max;	/* the A-MSDU body limit the peer allows */
+
+/* Match one delivered MSDU against the oldest packet in flight. */
+static void
+msdu_check(const u_int8_t *da, const u_int8_t *sa, const u_int8_t *body,
+    size_t len)
+{
+	if (inflight.empty()) {
+		ring.bad++;
+		return;
+	}
+	const std::vector<u_int8_t> &p = inflight.front();
+	ring.msdus++;
+	if (memcmp(da, &p[0], ETHER_ADDR_LEN) != 0 ||
+	    memcmp(sa, &p[ETHER_ADDR_LEN], ETHER_ADDR_LEN) != 0 ||
+	    len != p.size() - ETHER_HDR_LEN + LLC_SNAPFRAMELEN ||
+	    body[0] != LLC_SNAP_LSAP || body[1] != LLC_SNAP_LSAP ||
+	    body[2] != LLC_UI || body[3] != 0 || body[4] != 0 ||
+	    body[5] != 0 ||
+	    memcmp(body + 6, &p[12], p.size() - 12) != 0)
+		ring.bad++;
+	inflight.pop_front();
+}
+
+/*
+ * What iwx_tx() does with a frame, as far as the ring is concerned: the
+ * 802.11 header goes into the TX command and every mbuf of the rest is a
+ * DMA segment.  The frame is then checked and freed, and the node
+ * reference given back as on TX completion.
+ */
+static int
+iwx_tx_submit(struct iwx_softc *sc, mbuf_t m, struct ieee80211_node *ni)
+{
+	std::vector<u_int8_t> f;
+	struct ieee80211_qosframe *wh;
+	size_t hdrlen, off, len, skip, pktlen = 0;
+	u_int16_t qos, seq;
+	int nsegs = 0, pkthdrs = 0, nsub = 0, tid;
+	mbuf_t n;
+
+	f.resize(mbuf_pkthdr_len(m));
+	mbuf_copydata(m, 0, f.size(), f.data());
+	wh = (struct ieee80211_qosframe *)f.data();
+	hdrlen = ieee80211_get_hdrlen((struct ieee80211_frame *)wh);
+
+	for (n = m, skip = hdrlen; n != NULL; n = mbuf_next(n)) {
+		pktlen += mbuf_len(n);
+		pkthdrs += (mbuf_flags(n) & MBUF_PKTHDR) != 0;
+		if (mbuf_len(n) <= skip) {
+			skip -= mbuf_len(n);
+			continue;
+		}
+		skip = 0;
+		nsegs++;
+	}
+	if (nsegs > IWX_TFH_NUM_TBS - 2) {
+		ring.coalesced++;
+		nsegs = 1;
+	}
+	ring.mpdus++;
+	ring.tbs += 2 + nsegs;
+	ring.badhdr += pkthdrs != 1 || pktlen != f.size();
+
+	tid = letoh16(*(u_int16_t *)wh->i_qos) & IEEE80211_QOS_TID;
+	seq = letoh16(*(u_int16_t *)wh->i_seq) >> IEEE80211_SEQ_SEQ_SHIFT;
+	if (ring.seqvalid[tid])
+		ring.badseq += seq != ring.nextseq[tid];
+	ring.seqvalid[tid] = 1;
+	ring.nextseq[tid] = (seq + 1) & 0xfff;
+
+	qos = letoh16(*(u_int16_t *)wh->i_qos);
+	if (!(qos & IEEE80211_QOS_AMSDU)) {
+		msdu_check(wh->i_addr3, wh->i_addr2, f.data() + hdrlen,
+		    f.size() - hdrlen);
+	} else {
+		ring.toolong += f.size() - hdrlen > (size_t)body_max;
+		ring.bad += !IEEE80211_ADDR_EQ(wh->i_addr3, wh->i_addr1);
+		for (off = hdrlen; off < f.size(); nsub++) {
+			if (off + ETHER_HDR_LEN > f.size()) {
+				ring.bad++;
+				break;
+			}
+			len = (f[off + 12] << 8) | f[off + 13];
+			if (off + ETHER_HDR_LEN + len > f.size()) {
+				ring.bad++;
+				break;
+			}
+			msdu_check(&f[off], &f[off + ETHER_ADDR_LEN],
+			    &f[off + ETHER_HDR_LEN], len);
+			off += ETHER_HDR_LEN + len;
+			if (off < f.size()) {
+				ring.bad += (off - hdrlen) & 3 &&
+				    f[off] != 0;
+				off = hdrlen + roundup(off - hdrlen, 4);
+			}
+		}
+		ring.maxsub += nsub > IEEE80211_AMSDU_TX_MAXSUB || nsub < 2;
+	}
+
+	mbuf_freem(m);
+	ieee80211_release_node(&sc->sc_ic, ni);
+	return 0;
+}
+
+/* One pass of the start task's loop over the send queue. */
+static void
+iwx_start_loop(struct iwx_softc *sc)
+{
+	struct ieee80211com *ic = &sc->sc_ic;
+	struct _ifnet *ifp = &ic->ic_if;
+	struct ieee80211_node *ni, *ni0;
+	struct ieee80211_amsdu am;
+	struct ether_header *eh;
+	mbuf_t m, m0;
+	int stop;
+
+#include "iwx_tx_amsdu.inc"
+}
+
+static const u_int8_t myaddr[IEEE80211_ADDR_LEN] =
+    { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const u_int8_t bssid[IEEE80211_ADDR_LEN] =
+    { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+static const u_int8_t peer[IEEE80211_ADDR_LEN] =
+    { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 };
+
+/* An IPv4 packet as the stack hands it to the interface. */
+static std::vector<u_int8_t>
+packet(size_t len, u_int8_t tos, u_int8_t proto, std::mt19937 &rng)
+{
+	std::vector<u_int8_t> p(len);
+	u_int32_t v;
+	size_t i;
+
+	for (i = 0; i < len; i += sizeof(v)) {
+		v = rng();
+		memcpy(&p[i], &v, MIN(sizeof(v), len - i));
+	}
+	memcpy(&p[0], peer, ETHER_ADDR_LEN);
+	memcpy(&p[ETHER_ADDR_LEN], myaddr, ETHER_ADDR_LEN);
+	p[12] = ETHERTYPE_IP >> 8;
+	p[13] = ETHERTYPE_IP & 0xff;
+	p[14] = 0x45;
+	p[15] = tos;
+	p[23] = proto;
+	return p;
+}
+
+/*
+ * Put a packet where XNU leaves it: 2 bytes after max_linkhdr's Ethernet
+ * header, in a packet header mbuf when it fits and a cluster otherwise.
+ */
+static mbuf_t
+packet_mbuf(const std::vector<u_int8_t> &p)
+{
+	mbuf_t m = NULL;
+	u_int8_t *d;
+
+	if (p.size() + 2 <= mbuf_get_mhlen()) {
+		if (mbuf_gethdr(MBUF_DONTWAIT, MBUF_TYPE_DATA, &m) != 0)
+			return NULL;
+	} else if (mbuf_getcluster(MBUF_DONTWAIT, MBUF_TYPE_DATA, MCLBYTES,
+	    &m) != 0)
+		return NULL;
+	d = (u_int8_t *)mbuf_datastart(m) + 2;
+	memcpy(d, p.data(), p.size());
+	mbuf_setdata(m, d, p.size());
+	mbuf_pkthdr_setlen(m, p.size());
+	return m;
+}
+
+enum peer_kind { PEER_HT, PEER_VHT };
+
+enum load {
+	L_ACK,		/* TCP ACKs */
+	L_VOIP,		/* 200 B UDP */
+	L_MIXED,	/* 7:4:1 of 66, 576 and 1514 B */
+	L_BULK,		/* 1514 B */
+	L_TIDS,		/* 200 B, alternating TIDs */
+};
+
+static const char *load_names[] = {
+	"TCP ACKs", "VoIP 200 B", "mixed", "1514 B bulk", "2 TIDs 200 B"
+};
+
+struct result {
+	double		 mpdus;		/* per packet */
+	double		 tbs;		/* per packet */
+};
+
+static struct result
+run(enum load load, int burst, int amsdu, enum peer_kind kind, int npkts)
+{
+	static const size_t mix[] = { 66, 66, 66, 66, 66, 66, 66,
+	    576, 576, 576, 576, 1514 };
+	static struct iwx_softc sc;
+	static struct ieee80211_node ni;
+	struct snd_queue snd;
+	struct net_stats stats;
+	std::mt19937 rng(load * 100 + burst);
+	std::vector<u_int8_t> p;
+	struct result res;
+	struct ieee80211com *ic = &sc.sc_ic;
+	int i, sent = 0, tid, lost = 0;
+	size_t len;
+	u_int8_t tos;
+	mbuf_t m;
+
+	memset(&sc, 0, sizeof(sc));
+	memset(&ring, 0, sizeof(ring));
+	memset(&stats, 0, sizeof(stats));
+	snprintf(ic->ic_if.if_xname, sizeof(ic->ic_if.if_xname), "itlwm0");
+	ic->ic_if.if_snd = &snd;
+	ic->ic_if.netStat = &stats;
+	ic->ic_opmode = IEEE80211_M_STA;
+	ic->ic_state = IEEE80211_S_RUN;
+	ic->ic_flags = IEEE80211_F_QOS | IEEE80211_F_RSNON;
+	ic->ic_caps = IEEE80211_C_TX_AMPDU;
+	/* as iwx sets it */
+	ic->ic_tx_amsdu_maxlen = amsdu ? IEEE80211_MAX_MPDU_LEN_VHT_7991 : 0;
+	ccmp_key.k_cipher = IEEE80211_CIPHER_CCMP;
+
+	memset(&ni, 0, sizeof(ni));
+	memcpy(ni.ni_bssid, bssid, IEEE80211_ADDR_LEN);
+	ni.ni_rsnprotos = IEEE80211_PROTO_RSN;
+	ni.ni_rsncipher = IEEE80211_CIPHER_CCMP;
+	ni.ni_port_valid = 1;
+	ni.ni_state = IEEE80211_STA_ASSOC;
+	ni.ni_flags = IEEE80211_NODE_QOS | IEEE80211_NODE_TXPROT |
+	    IEEE80211_NODE_HT;
+	if (kind == PEER_VHT) {
+		ni.ni_flags |= IEEE80211_NODE_VHT;
+		ni.ni_vhtcaps = IEEE80211_VHTCAP_MAX_MPDU_LENGTH_7991;
+		body_max = IEEE80211_MAX_MPDU_LEN_VHT_7991;
+	} else
+		body_max = IEEE80211_MAX_MPDU_LEN_HT_3839;
+	body_max -= sizeof(struct ieee80211_qosframe) +
+	    IEEE80211_CCMP_HDRLEN + IEEE80211_CCMP_MICLEN + IEEE80211_CRC_LEN;
+	for (tid = 0; tid < IEEE80211_NUM_TID; tid++) {
+		ni.ni_tx_ba[tid].ba_state = IEEE80211_BA_AGREED;
+		ni.ni_tx_ba[tid].ba_params = IEEE80211_ADDBA_AMSDU;
+	}
+	ic->ic_bss = tx_node = &ni;
+	ni.ni_refcnt = 1;	/* ic_bss */
+	inflight.clear();
+
+	while (sent < npkts) {
+		for (i = 0; i < burst && sent < npkts; i++, sent++) {
+			tos = 0;
+			switch (load) {
+			case L_ACK:
+				len = 66;
+				break;
+			case L_VOIP:
+				len = 200;
+				break;
+			case L_MIXED:
+				len = mix[rng() % nitems(mix)];
+				break;
+			case L_BULK:
+				len = 1514;
+				break;
+			default:
+				len = 200;
+				/* best effort and video: TIDs 0 and 2 */
+				tos = sent & 1 ? IPTOS_PREC_PRIORITY : 0;
+				break;
+			}
+			p = packet(len, tos, load == L_ACK || load == L_MIXED ?
+			    IPPROTO_TCP : IPPROTO_UDP, rng);
+			if ((m = packet_mbuf(p)) == NULL) {
+				lost++;
+				continue;
+			}
+			inflight.push_back(p);
+			snd.q.push_back(m);
+		}
+		iwx_start_loop(&sc);
+	}
+	CHECK(lost == 0, "mbufs for every packet");
+	CHECK(snd.q.empty() && inflight.empty(), "every packet sent");
+	CHECK(stats.outputErrors == 0 && ic->ic_stats.is_tx_nombuf == 0,
+	    "no packet dropped");
+	CHECK(ring.msdus == (u_int64_t)npkts, "every packet on the ring");
+	CHECK(ring.bad == 0, "subframes intact and in order");
+	CHECK(ring.badhdr == 0, "packet header on the head mbuf only");
+	CHECK(ring.badseq == 0, "sequence numbers without holes");
+	CHECK(ring.toolong == 0, "A-MSDUs within the peer's limit");
+	CHECK(ring.maxsub == 0, "2 to 8 subframes per A-MSDU");
+	CHECK(ring.coalesced == 0, "segments fit one TFD");
+	CHECK(ni.ni_refcnt == 1, "node references given back");
+	if (ni.ni_txhdr != NULL)
+		IOFree(ni.ni_txhdr,
+		    (IEEE80211_NUM_TID + 1) * sizeof(struct ieee80211_txhdr));
+
+	res.mpdus = (double)ring.mpdus / npkts;
+	res.tbs = (double)ring.tbs / npkts;
+	return res;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: txamsdu [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int bursts[] = { 1, 4, 16, 64 };
+	struct result off, ht, vht;
+	char label[32];
+	int ch, npkts = 20000;
+	size_t b;
+	int l;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			npkts = 2000;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	printf("%-24s %8s %8s %8s %8s %8s %8s\n", "per packet", "off MPDU",
+	    "TB", "HT MPDU", "TB", "VHT MPDU", "TB");
+	for (l = L_ACK; l <= L_TIDS; l++)
+		for (b = 0; b < nitems(bursts); b++) {
+			off = run((enum load)l, bursts[b], 0, PEER_VHT, npkts);
+			ht = run((enum load)l, bursts[b], 1, PEER_HT, npkts);
+			vht = run((enum load)l, bursts[b], 1, PEER_VHT, npkts);
+			snprintf(label, sizeof(label), "%s, burst %d",
+			    load_names[l], bursts[b]);
+			printf("%-24s %8.3f %8.2f %8.3f %8.2f %8.3f %8.2f\n",
+			    label, off.mpdus, off.tbs, ht.mpdus, ht.tbs,
+			    vht.mpdus, vht.tbs);
+			CHECK(off.mpdus == 1, "one MPDU per packet when off");
+			if (bursts[b] == 1 || l == L_TIDS)
+				CHECK(ht.mpdus == 1 && vht.mpdus == 1,
+				    "nothing to aggregate");
+			if (bursts[b] >= 16 && (l == L_ACK || l == L_VOIP))
+				CHECK(vht.mpdus == 1.0 / IEEE80211_AMSDU_TX_MAXSUB,
+				    "small packets packed 8 to an MPDU");
+			CHECK(vht.mpdus <= ht.mpdus && ht.mpdus <= off.mpdus,
+			    "a larger limit packs no fewer");
+		}
+
+	printf("txamsdu: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
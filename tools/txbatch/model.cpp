@@ -0,0 +1,281 @@
+/*
+ * txbatch: a host model of the iwx TX rings that drives the driver's own
+ * doorbell batching code and counts the MMIO writes it makes.
+ *
+ * iwx_tx_publish(), iwx_tx_kick(), iwx_tx_kick_all(), iwx_tx_kick_late()
+ * and the ring stop/wake helpers are extracted from ItlIwx.cpp at build
+ * time, as are the constants they use (see tools/Makefile).  The model
+ * plays _iwx_start_task(): it opens a batch, fills one descriptor per
+ * frame on its queue's ring, checks the latency bound after each frame
+ * the way iwx_start_frame() does, and flushes the batch when the send
+ * queue runs dry.  Frames for a stopped ring stay queued, as they do on
+ * the driver's parking lists.  The firmware completes everything that was
+ * published before the next start, waking rings below their low mark.
+ *
+ * Each load runs with batching off, which is the old one write per frame,
+ * and on.  The tool checks that a start never ends with a frame behind a
+ * deferred doorbell, that every write pointer matches the ring, that no
+ * doorbell covers more than IWX_TX_BATCH_MAX frames, and that no frame
+ * waits longer than IWX_TX_BATCH_USEC plus one frame for its doorbell.
+ * Exits non-zero on failure.
+ */
+#include <deque>
+
+#include <getopt.h>
+
+#include <sys/param.h>
+
+#include "iwx_tx_consts.h"
+
+#define NQUEUES		4
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+/* The ring and softc fields the extracted code uses, as in if_iwxvar.h. */
+struct iwx_tx_ring {
+	unsigned int		 ring_count;
+	unsigned int		 hi_mark;
+	unsigned int		 low_mark;
+	int			 qid;
+	int			 queued;
+	int			 cur;
+	int			 tail;
+	int			 db_pending;
+	int			 stopped;
+	uint64_t		 stall_start;
+	uint64_t		 stall_ns;
+	uint32_t		 stalls;
+};
+
+struct iwx_softc {
+	struct iwx_tx_ring	 txq[NQUEUES];
+	int			 sc_tx_batch;
+	uint32_t		 sc_tx_dbmsk;
+	uint64_t		 sc_tx_batch_start;
+	uint64_t		 sc_tx_doorbells;
+	uint64_t		 sc_tx_db_frames;
+};
+
+/* Model state: simulated time, what the device has been told, counters. */
+static uint64_t now_ns;
+static int fw_wptr[NQUEUES];		/* last write pointer per queue */
+static int fw_done[NQUEUES];		/* completed up to here */
+static uint64_t pub_ns[NQUEUES][IWX_DEFAULT_QUEUE_SIZE];
+static uint64_t mmio_writes, max_delay, max_per_db;
+
+static uint64_t
+model_uptime(void)
+{
+	return now_ns;
+}
+#define nsecuptime()	model_uptime()
+
+static uint32_t
+getTxQueueSize(void)
+{
+	return IWX_DEFAULT_QUEUE_SIZE;
+}
+
+/* The device learns of frames up to the write pointer. */
+static void
+IWX_WRITE(struct iwx_softc *sc, uint32_t reg, uint32_t val)
+{
+	int qid = val >> 16, idx = val & 0xffff, n;
+
+	mmio_writes++;
+	CHECK(reg == IWX_HBUS_TARG_WRPTR, "only doorbells are written");
+	CHECK(qid < NQUEUES && idx == sc->txq[qid].cur,
+	    "write pointer matches the ring");
+	n = (idx - fw_wptr[qid] + IWX_DEFAULT_QUEUE_SIZE) %
+	    IWX_DEFAULT_QUEUE_SIZE;
+	CHECK(n > 0, "a doorbell publishes something");
+	max_per_db = MAX(max_per_db, (uint64_t)n);
+	for (; fw_wptr[qid] != idx;
+	    fw_wptr[qid] = (fw_wptr[qid] + 1) % IWX_DEFAULT_QUEUE_SIZE)
+		max_delay = MAX(max_delay, now_ns - pub_ns[qid][fw_wptr[qid]]);
+}
+
+#include "iwx_tx_batch.inc"
+
+struct load {
+	const char		*name;
+	int			 burst;		/* frames queued per start */
+	int			 nq;		/* queues they are spread over */
+	uint64_t		 frame_ns;	/* host time to send one frame */
+};
+
+/* The firmware finishes what it was told about, as TX done would. */
+static void
+fw_complete(struct iwx_softc *sc)
+{
+	struct iwx_tx_ring *ring;
+	int qid, n;
+
+	for (qid = 0; qid < NQUEUES; qid++) {
+		ring = &sc->txq[qid];
+		n = (fw_wptr[qid] - fw_done[qid] + IWX_DEFAULT_QUEUE_SIZE) %
+		    IWX_DEFAULT_QUEUE_SIZE;
+		ring->queued -= n;
+		fw_done[qid] = fw_wptr[qid];
+		if (ring->queued < (int)ring->low_mark)
+			iwx_tx_ring_wake(sc, ring);
+	}
+}
+
+/* One _iwx_start_task() run over the backlog. */
+static void
+start(struct iwx_softc *sc, std::deque<int> &backlog, uint64_t frame_ns)
+{
+	std::deque<int> parked;
+	struct iwx_tx_ring *ring;
+	int qid;
+
+	sc->sc_tx_batch = 1;
+	sc->sc_tx_batch_start = now_ns;
+	while (!backlog.empty()) {
+		qid = backlog.front();
+		backlog.pop_front();
+		ring = &sc->txq[qid];
+		if (ring->stopped) {
+			parked.push_back(qid);
+			continue;
+		}
+		now_ns += frame_ns;
+		pub_ns[qid][ring->cur] = now_ns;
+		iwx_tx_publish(sc, ring);
+		iwx_tx_kick_late(sc);
+	}
+	iwx_tx_kick_all(sc);
+	sc->sc_tx_batch = 0;
+	backlog.swap(parked);
+
+	CHECK(sc->sc_tx_dbmsk == 0, "no doorbell left deferred");
+	for (qid = 0; qid < NQUEUES; qid++)
+		CHECK(sc->txq[qid].db_pending == 0 &&
+		    fw_wptr[qid] == sc->txq[qid].cur,
+		    "every published frame rung");
+}
+
+struct result {
+	double			 writes;	/* MMIO writes per frame */
+	double			 per_db;	/* frames per doorbell */
+	uint64_t		 max_per_db;
+	uint64_t		 max_delay;
+};
+
+static struct result
+run(const struct load *l, int nstarts, int batch)
+{
+	static struct iwx_softc sc;
+	std::deque<int> backlog;
+	struct result res;
+	uint64_t frames;
+	int i, j;
+
+	memset(&sc, 0, sizeof(sc));
+	for (i = 0; i < NQUEUES; i++) {
+		iwx_tx_ring_init(&sc, &sc.txq[i], IWX_DEFAULT_QUEUE_SIZE);
+		sc.txq[i].qid = i;
+		fw_wptr[i] = fw_done[i] = 0;
+	}
+	now_ns = 1000000000ULL;
+	mmio_writes = max_delay = max_per_db = 0;
+
+	for (i = 0; i < nstarts; i++) {
+		for (j = 0; j < l->burst; j++)
+			backlog.push_back(j % l->nq);
+		fw_complete(&sc);
+		if (batch)
+			start(&sc, backlog, l->frame_ns);
+		else {
+			/* the old path: a doorbell for every frame */
+			sc.sc_tx_batch_start = now_ns;
+			while (!backlog.empty() &&
+			    !sc.txq[backlog.front()].stopped) {
+				struct iwx_tx_ring *ring =
+				    &sc.txq[backlog.front()];
+
+				backlog.pop_front();
+				now_ns += l->frame_ns;
+				pub_ns[ring->qid][ring->cur] = now_ns;
+				iwx_tx_publish(&sc, ring);
+			}
+		}
+		/* time until the next start, long enough to drain */
+		now_ns += 1000000;
+	}
+	frames = sc.sc_tx_db_frames;
+	res.writes = frames ? (double)mmio_writes / frames : 0;
+	res.per_db = sc.sc_tx_doorbells ?
+	    (double)sc.sc_tx_db_frames / sc.sc_tx_doorbells : 0;
+	res.max_per_db = max_per_db;
+	res.max_delay = max_delay;
+	CHECK(mmio_writes == sc.sc_tx_doorbells, "doorbells counted");
+	return res;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: txbatch [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct load loads[] = {
+		{ "1 frame",		1,	1,	2000 },
+		{ "4 frames",		4,	1,	2000 },
+		{ "16 frames",		16,	1,	2000 },
+		{ "32 frames",		32,	1,	2000 },
+		{ "64 frames",		64,	1,	2000 },
+		{ "32 frames, 4 ACs",	32,	4,	2000 },
+		{ "64 frames, 4 ACs",	64,	4,	2000 },
+		{ "32 frames, slow",	32,	1,	20000 },
+	};
+	struct result a, b;
+	int quick = 0, ch, nstarts;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	nstarts = quick ? 200 : 20000;
+	printf("%-24s %10s %10s %9s %12s\n", "", "writes/f", "batched",
+	    "frames/db", "max wait us");
+	for (i = 0; i < nitems(loads); i++) {
+		const struct load *l = &loads[i];
+
+		a = run(l, nstarts, 0);
+		b = run(l, nstarts, 1);
+		printf("%-24s %10.3f %10.3f %9.2f %12.1f\n", l->name,
+		    a.writes, b.writes, b.per_db, b.max_delay / 1000.0);
+		CHECK(a.writes == 1.0, "one write per frame unbatched");
+		CHECK(b.writes <= a.writes, "batching never adds writes");
+		CHECK(b.max_per_db <= IWX_TX_BATCH_MAX,
+		    "batch bounded by IWX_TX_BATCH_MAX");
+		CHECK(b.max_delay <= IWX_TX_BATCH_USEC * 1000ULL + l->frame_ns,
+		    "wait bounded by IWX_TX_BATCH_USEC");
+	}
+
+	printf("txbatch: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * wheelbench: the CTimeout timing wheel under load, built on the host
+ * from net80211/CTimeout.cpp against a simulated clock and event source.
+ *
+ * It arms 100k timeouts spread from microseconds to hours, cancels and
+ * re-arms some of them, lets some re-arm themselves from their callback,
+ * then runs the clock forward by firing the event source wherever the
+ * wheel programmed it.  It checks that every timeout fires exactly as
+ * often as it was armed, never early, and that cancelled ones never
+ * fire.  Exits non-zero if a check fails.
+ *
+ * Arm, cancel and pending costs are wall time on the host.  Lateness is
+ * simulated time from expiry to callback: with an exact event source it
+ * must be zero, with a jittery one it must stay within the jitter.
+ */
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/CTimeout.hpp>
+
+static int failures;
+
+#define CHECK(cond, what) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s (line %d)\n", (what), __LINE__);	\
+		failures++;						\
+	}								\
+} while (0)
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t sim_ns;
+
+static uint64_t
+sim_us(void)
+{
+	return sim_ns / 1000;
+}
+
+struct tmr {
+	CTimeout	*to;
+	uint64_t	 due;		/* us; 0 when not armed */
+	int		 armed;		/* times armed */
+	int		 fired;		/* times fired */
+	int		 rearm;		/* times to re-arm from the callback */
+};
+
+static std::mt19937_64 rng;
+static std::vector<double> lateness;
+static int early;
+
+/* The most the simulated workloop takes to run a due event source, us. */
+static uint64_t jitter;
+
+/*
+ * Move the clock to end, running the event source whenever it comes due
+ * on the way, as the workloop would.
+ */
+static void
+run_until(IOTimerEventSource *es, uint64_t end)
+{
+	while (es->shim_armed && es->shim_deadline <= end) {
+		if (es->shim_deadline > sim_ns)
+			sim_ns = es->shim_deadline;
+		if (jitter)
+			sim_ns += (rng() % (jitter + 1)) * 1000;
+		es->shim_fire();
+	}
+	if (end > sim_ns)
+		sim_ns = end;
+}
+
+/*
+ * Mostly short timeouts, as the drivers use, with a tail reaching every
+ * level of the wheel.
+ */
+static uint64_t
+pick_delay(void)
+{
+	uint64_t r = rng();
+
+	switch (r % 16) {
+	case 0:
+		return 1 + (r >> 8) % 64;			/* level 0 */
+	case 1:
+		return (r >> 8) % (3600ULL * 1000000);		/* an hour */
+	case 2:
+		return (r >> 8) % (30ULL * 1000000);		/* 30 s */
+	default:
+		return 1 + (r >> 8) % 200000;			/* 200 ms */
+	}
+}
+
+static void
+arm(struct tmr *t, uint64_t delay)
+{
+	CTimeout::timeout_add_usec(&t->to, delay);
+	t->due = sim_us() + delay;
+	t->armed++;
+}
+
+static void
+tmr_fn(void *arg)
+{
+	struct tmr *t = (struct tmr *)arg;
+
+	if (t->due == 0 || sim_us() < t->due)
+		early++;
+	else
+		lateness.push_back(sim_us() - t->due);
+	t->due = 0;
+	t->fired++;
+	if (t->rearm > 0) {
+		t->rearm--;
+		arm(t, 1 + rng() % 5000);
+	}
+}
+
+static void
+percentiles(const char *name, std::vector<double> &v)
+{
+	size_t n = v.size();
+
+	std::sort(v.begin(), v.end());
+	printf("%-24s %8zu fires  p50 %6.0f us  p99 %6.0f us  max %6.0f us\n",
+	    name, n, n ? v[n / 2] : 0, n ? v[n * 99 / 100] : 0,
+	    n ? v[n - 1] : 0);
+}
+
+/* One pass over n timeouts. */
+static void
+run(int n, const char *name)
+{
+	std::vector<struct tmr> t(n);
+	IOWorkLoop wl;
+	IOTimerEventSource *es;
+	uint64_t t0, late = 0, programs;
+	size_t nfired;
+	int i, pending, npending, ncancel = 0;
+	char label[64];
+
+	sim_ns = 1000000000ULL;
+	lateness.clear();
+	early = 0;
+	CHECK(CTimeout::wheelInit(&wl), "wheelInit");
+	es = (IOTimerEventSource *)wl.shim_sources[0];
+
+	for (i = 0; i < n; i++) {
+		CTimeout::timeout_set(&t[i].to, tmr_fn, &t[i]);
+		t[i].rearm = i % 64 == 0 ? 3 : 0;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+		arm(&t[i], pick_delay());
+	if (jitter == 0)
+		printf("%-24s %8d ops    %6.1f ns/op\n", "arm", n,
+		    (double)(now_ns() - t0) / n);
+
+	/* some fire, and the wheel lags the clock until the next event */
+	run_until(es, sim_ns + 5000000);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i += 4) {
+		pending = t[i].due != 0;
+		CHECK(CTimeout::timeout_del(&t[i].to) == pending,
+		    "timeout_del");
+		if (pending) {
+			t[i].due = 0;
+			t[i].armed--;
+		}
+		t[i].rearm = 0;
+		ncancel++;
+	}
+	if (jitter == 0)
+		printf("%-24s %8d ops    %6.1f ns/op\n", "cancel", ncancel,
+		    (double)(now_ns() - t0) / ncancel);
+	CHECK(CTimeout::timeout_del(&t[0].to) == 0, "timeout_del of idle");
+
+	/* re-arming a pending timeout moves it */
+	for (i = 1; i < n; i += 8) {
+		if (t[i].due != 0)
+			t[i].armed--;
+		arm(&t[i], pick_delay());
+	}
+
+	t0 = now_ns();
+	pending = npending = 0;
+	for (i = 0; i < n; i++) {
+		pending += CTimeout::timeout_pending(&t[i].to);
+		npending += t[i].due != 0;
+	}
+	if (jitter == 0)
+		printf("%-24s %8d ops    %6.1f ns/op\n", "pending", n,
+		    (double)(now_ns() - t0) / n);
+	CHECK(pending == npending, "timeout_pending");
+
+	nfired = lateness.size();
+	programs = es->shim_programs;
+	t0 = now_ns();
+	run_until(es, UINT64_MAX);
+	t0 = now_ns() - t0;
+	nfired = lateness.size() - nfired;
+
+	for (i = 0; i < n; i++) {
+		CHECK(t[i].fired == t[i].armed, "fired once per arm");
+		CHECK(!CTimeout::timeout_pending(&t[i].to), "idle at the end");
+		CTimeout::timeout_free(NULL, &t[i].to, NULL, NULL, NULL);
+	}
+	CHECK(early == 0, "never early");
+	for (double l : lateness)
+		late = std::max(late, (uint64_t)l);
+	CHECK(late <= jitter, "lateness within the event source jitter");
+
+	snprintf(label, sizeof(label), "fire (%s)", name);
+	printf("%-24s %8zu fires  %6.1f ns/fire  %5.2f programs/fire\n",
+	    label, nfired, nfired ? (double)t0 / nfired : 0.0,
+	    nfired ? (double)(es->shim_programs - programs) / nfired : 0.0);
+	snprintf(label, sizeof(label), "lateness (%s)", name);
+	percentiles(label, lateness);
+
+	CTimeout::wheelRelease();
+	CHECK(wl.shim_nsources == 0, "wheelRelease");
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: wheelbench [-q]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	int quick = 0, ch, n;
+
+	while ((ch = getopt(argc, argv, "q")) != -1) {
+		switch (ch) {
+		case 'q':
+			quick = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	shim_sim_uptime = &sim_ns;
+	n = quick ? 10000 : 100000;
+	run(n, "exact");
+	jitter = 100;
+	run(n, "100us jitter");
+
+	printf("wheelbench: %s (%d failures)\n", failures ? "FAILED" : "ok",
+	    failures);
+	return failures != 0;
+}